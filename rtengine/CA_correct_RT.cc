@@ -26,6 +26,7 @@
 #include "rtengine.h"
 #include "rawimagesource.h"
 #include "rt_math.h"
+#include "cafitcache.h"
 
 using namespace std;
 using namespace rtengine;
@@ -164,6 +165,23 @@ void RawImageSource::CA_correct_RT(double cared, double cablue) {
 	//order of 2d polynomial fit (polyord), and numpar=polyord^2
 	int polyord=4, numpar=16;
 
+	// the fit of a previous image shot with the same lens and settings can replace the diagnostic pass,
+	// which then only interpolates G
+	std::string fitKey;
+	bool fitCached = false;
+	if (autoCA && settings->reuseCAFit) {
+		fitKey = CAFitCache::key (idata, width, height);
+		CAFit fit;
+		if (!fitKey.empty() && caFitCache.get (fitKey, fit)) {
+			polyord = fit.polyord;
+			numpar = polyord*polyord;
+			memcpy (fitparams, fit.params, sizeof fitparams);
+			fitCached = true;
+			if (settings->verbose)
+				printf ("CA correction: reusing the fit of %s\n", fitKey.c_str());
+		}
+	}
+
 #pragma omp parallel shared(Gtmp,width,height,blockave,blocksqave,blockdenom,blockvar,blockwt,blockshifts,fitparams,polyord,numpar)
 {
 	int progresscounter = 0;
@@ -396,6 +414,9 @@ void RawImageSource::CA_correct_RT(double cared, double cablue) {
 						Gtmp[row*width + col] = rgb[1][indx];
 				}
 
+			if (fitCached)
+				continue;
+
 			//%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
 
 			for (rr=4; rr < rr1-4; rr++)
@@ -598,7 +619,12 @@ void RawImageSource::CA_correct_RT(double cared, double cablue) {
 #pragma omp barrier
 
 #pragma omp single
-{
+if (fitCached) {
+	if(plistener) {
+		progress = 0.5;
+		plistener->setProgress(progress);
+	}
+} else {
 	for (j=0; j<2; j++)
 		for (c=0; c<3; c+=2) {
 			if (blockdenom[j][c]) {
@@ -709,6 +735,12 @@ void RawImageSource::CA_correct_RT(double cared, double cablue) {
 						processpasstwo = false;
 					}
 				}
+		if(processpasstwo && !fitKey.empty()) {
+			CAFit fit;
+			fit.polyord = polyord;
+			memcpy (fit.params, fitparams, sizeof fitparams);
+			caFitCache.put (fitKey, fit);
+		}
 
 }
 	//fitparams[polyord*i+j] gives the coefficients of (vblock^i hblock^j) in a polynomial fit for i,j<=4
@@ -27,6 +27,8 @@
 #include "../rtgui/threadutils.h"
 #include "rtengine.h"
 #include "improcfun.h"
+#include "tileplan.h"
+#include "medianfilter.h"
 #include "LUT.h"
 #include "array2D.h"
 #include "iccmatrices.h"
@@ -182,7 +184,7 @@ float media(float *elements, int N)
 
 void ImProcFunctions::Median_Denoise( float **src, float **dst, const int width, const int height, const mediantype medianType, const int iterations, const int numThreads, float **buffer)
 {
-	int border=1, numElements, middleElement;
+	int border=1;
 	switch(medianType) {
 		case MED_3X3SOFT:
 		case MED_3X3STRONG:
@@ -196,13 +198,9 @@ void ImProcFunctions::Median_Denoise( float **src, float **dst, const int width,
 			break;
 		case MED_7X7:
 			border = 3;
-			numElements = 49;
-			middleElement = 24;
 			break;
 		default: // includes MED_9X9
 			border = 4;
-			numElements = 81;
-			middleElement = 40;
 	}
 
 	float **allocBuffer = NULL;
@@ -228,6 +226,12 @@ void ImProcFunctions::Median_Denoise( float **src, float **dst, const int width,
 		medianIn = medBuffer[BufferIndex];
 		medianOut = medBuffer[BufferIndex^1];
 
+		if(medianType != MED_3X3SOFT && medianType != MED_5X5SOFT) { // square windows
+			medianFilter (medianIn, medianOut, width, height, border, true, numThreads);
+			BufferIndex ^= 1; // swap buffers
+			continue;
+		}
+
 		if(iteration == 1) { // upper border
 			for (int i=0; i<border; i++)
 				for (int j=0;j<width;j++)
@@ -248,16 +252,6 @@ void ImProcFunctions::Median_Denoise( float **src, float **dst, const int width,
 				}
 				for(;j<width;j++)
 					medianOut[i][j] = medianIn[i][j];
-			} else if(medianType == MED_3X3STRONG) {
-				float pp[9],temp;
-				int j;
-				for (j=0;j<border;j++)
-					medianOut[i][j] = medianIn[i][j];
-				for (;j<width-border; j++) {
-					med3(medianIn[i][j] ,medianIn[i-1][j], medianIn[i+1][j] ,medianIn[i][j+1],medianIn[i][j-1], medianIn[i-1][j-1],medianIn[i-1][j+1],medianIn[i+1][j-1],medianIn[i+1][j+1],medianOut[i][j]);
-				}
-				for(;j<width;j++)
-					medianOut[i][j] = medianIn[i][j];
 			} else if(medianType == MED_5X5SOFT) {
 				float pp[13];
 				int j;
@@ -271,37 +265,6 @@ void ImProcFunctions::Median_Denoise( float **src, float **dst, const int width,
 				}
 				for(;j<width;j++)
 					medianOut[i][j] = medianIn[i][j];
-			} else if(medianType == MED_5X5STRONG) {
-				float pp[25],temp;
-				int j;
-				for (j=0;j<border;j++)
-					medianOut[i][j] = medianIn[i][j];
-				for (; j<width-border; j++) {
-					med5(medianIn[i][j],medianIn[i-1][j],medianIn[i+1][j],medianIn[i][j+1],medianIn[i][j-1],medianIn[i-1][j-1],medianIn[i-1][j+1], medianIn[i+1][j-1],medianIn[i+1][j+1],
-					medianIn[i-2][j],medianIn[i+2][j],medianIn[i][j+2],medianIn[i][j-2],medianIn[i-2][j-2],medianIn[i-2][j+2],medianIn[i+2][j-2],medianIn[i+2][j+2],	
-					medianIn[i-2][j+1],medianIn[i+2][j+1],medianIn[i-1][j+2],medianIn[i-1][j-2],medianIn[i-2][j-1],medianIn[i+2][j-1],medianIn[i+1][j+2],medianIn[i+1][j-2],	
-					medianOut[i][j]);
-				}
-				for(;j<width;j++)
-					medianOut[i][j] = medianIn[i][j];
-			} else {// includes MED_7X7 and MED_9X9
-				float pp[81];
-				int j;
-				for (j=0;j<border;j++)
-					medianOut[i][j] = medianIn[i][j];
-				for (; j<width-border; j++) {
-					int kk=0;
-					for (int ii=-border;ii<=border;ii++) {
-						for (int jj=-border;jj<=border;jj++) {
-							kk++;
-							pp[kk]=medianIn[i+ii][j+jj];
-						}
-					}
-					fq_sort2(pp,numElements);
-					medianOut[i][j]=pp[middleElement];
-				}
-				for(;j<width;j++)
-					medianOut[i][j] = medianIn[i][j];
 			}
 		}
 		if(iteration == 1) { // lower border
@@ -371,7 +334,7 @@ void ImProcFunctions::Tile_calc (int tilesize, int overlap, int kall, int imwidt
 int denoiseNestedLevels = 1;
 enum nrquality {QUALITY_STANDARD, QUALITY_HIGH};
 
-SSEFUNCTION void ImProcFunctions::RGB_denoise(int kall, Imagefloat * src, Imagefloat * dst,Imagefloat * calclum, float * ch_M, float *max_r, float *max_b, bool isRAW, const procparams::DirPyrDenoiseParams & dnparams, const double expcomp, const NoiseCurve & noiseLCurve, const NoiseCurve & noiseCCurve, float &chaut, float &redaut, float &blueaut, float &maxredaut, float &maxblueaut, float &nresi, float &highresi)
+SSEFUNCTION void ImProcFunctions::RGB_denoise(int kall, Imagefloat * src, Imagefloat * dst,Imagefloat * calclum, float * ch_M, float *max_r, float *max_b, bool isRAW, const procparams::DirPyrDenoiseParams & dnparams, const double expcomp, const NoiseCurve & noiseLCurve, const NoiseCurve & noiseCCurve, float &chaut, float &redaut, float &blueaut, float &maxredaut, float &maxblueaut, float &nresi, float &highresi, const volatile bool* cancelFlag)
 {
 //#ifdef _DEBUG
 	MyTime t1e,t2e;
@@ -563,16 +526,8 @@ SSEFUNCTION void ImProcFunctions::RGB_denoise(int kall, Imagefloat * src, Imagef
 				}
 			}
 		}
-int tilesize;
-int overlap;
-if(settings->leveldnti ==0) {
-	tilesize = 1024;
-	overlap = 128;
-}
-if(settings->leveldnti ==1) {
-	tilesize = 768;
-	overlap = 96;
-}
+// tile size chosen in the preferences, the actual one may be smaller to fit the memory budget
+int tilesize = settings->leveldnti == 1 ? 768 : 1024;
 	int numTries = 0;
 	if(ponder)
 		printf("Tiled denoise processing caused by Automatic Multizone mode\n");
@@ -582,9 +537,15 @@ do {
 	numTries++;
 	if(numTries == 2)
 		printf("1st denoise pass failed due to insufficient memory, starting 2nd (tiled) pass now...\n");
-	int numtiles_W, numtiles_H, tilewidth, tileheight, tileWskip, tileHskip;
-	
-	Tile_calc (tilesize, overlap, (options.rgbDenoiseThreadLimit == 0 && !ponder) ? (numTries == 1 ? 0 : 2) : 2, imwidth, imheight, numtiles_W, numtiles_H, tilewidth, tileheight, tileWskip, tileHskip);
+	// about 96 bytes per pixel of a tile: the input tile, labdn, the noise variances and the decompositions of L, a and b.
+	// The automatic multizone mode keeps the tile size of the preferences: its zones (ch_M, max_r, max_b) are measured
+	// by processImage on that layout.
+	TilePlan plan = planTiles ("RGB_denoise", imwidth, imheight, 96, ponder ? tilesize : 512, tilesize, 0.125f,
+	                           options.rgbDenoiseThreadLimit == 0 && !ponder && numTries == 1, options.rgbDenoiseThreadLimit, memoryBudget);
+	int numtiles_W = plan.numtiles_W, numtiles_H = plan.numtiles_H;
+	int tilewidth = plan.tilewidth, tileheight = plan.tileheight;
+	int tileWskip = plan.tileWskip, tileHskip = plan.tileHskip;
+	int overlap = plan.overlap;
 	memoryAllocationFailed = false;
 	const int numtiles = numtiles_W * numtiles_H;
 
@@ -642,21 +603,11 @@ do {
 #ifndef _OPENMP
 	int numthreads = 1;
 #else
-	// Calculate number of tiles. If less than omp_get_max_threads(), then limit num_threads to number of tiles
-	int numthreads = MIN(numtiles,omp_get_max_threads());
-	if(options.rgbDenoiseThreadLimit > 0)
-		numthreads = MIN(numthreads,options.rgbDenoiseThreadLimit);
-	denoiseNestedLevels = omp_get_max_threads() / numthreads;
+	int numthreads = plan.numthreads;
+	denoiseNestedLevels = plan.nestedLevels;
 	bool oldNested = omp_get_nested();
-	if(denoiseNestedLevels < 2)
-		denoiseNestedLevels = 1;
-	else
+	if(denoiseNestedLevels > 1)
 		omp_set_nested(true);
-	if(options.rgbDenoiseThreadLimit > 0)
-		while(denoiseNestedLevels*numthreads > options.rgbDenoiseThreadLimit)
-			denoiseNestedLevels--;
-	if(settings->verbose)
-		printf("RGB_denoise uses %d main thread(s) and up to %d nested thread(s) for each main thread\n",numthreads,denoiseNestedLevels);
 #endif
 	float *LbloxArray[denoiseNestedLevels*numthreads];
 	float *fLbloxArray[denoiseNestedLevels*numthreads];
@@ -706,6 +657,8 @@ do {
 
 	for (int tiletop=0; tiletop<imheight; tiletop+=tileHskip) {
 		for (int tileleft=0; tileleft<imwidth ; tileleft+=tileWskip) {
+			if (cancelFlag && *cancelFlag)
+				continue;   // the result is obsolete, skip the remaining tiles
 			//printf("titop=%d tileft=%d\n",tiletop/tileHskip, tileleft/tileWskip);
 			pos = (tiletop/tileHskip)*numtiles_W + tileleft/tileWskip ;
 			int tileright = MIN(imwidth,tileleft+tilewidth);
@@ -2856,8 +2809,6 @@ SSEFUNCTION void ImProcFunctions::RGB_denoise_info(Imagefloat * src, Imagefloat
 					}
 				}
 			}
-			int datalen = labdn->W * labdn->H;
-
 			//now perform basic wavelet denoise
 			//last two arguments of wavelet decomposition are max number of wavelet decomposition levels;
 			//and whether to subsample the image after wavelet filtering.  Subsampling is coded as
@@ -2882,13 +2833,13 @@ SSEFUNCTION void ImProcFunctions::RGB_denoise_info(Imagefloat * src, Imagefloat
 #pragma omp section
 #endif
 {
-			adecomp = new wavelet_decomposition (labdn->data+datalen, labdn->W, labdn->H, levwav, 1 );
+			adecomp = new wavelet_decomposition (labdn->a[0], labdn->W, labdn->H, levwav, 1 );
 }
 #ifdef _OPENMP
 #pragma omp section
 #endif
 {
-			bdecomp = new wavelet_decomposition (labdn->data+2*datalen, labdn->W, labdn->H, levwav, 1 );
+			bdecomp = new wavelet_decomposition (labdn->b[0], labdn->W, labdn->H, levwav, 1 );
 }
 }
 			bool autoch = dnparams.autochroma;
@@ -186,6 +186,10 @@ public:
 		clip = flags;
 	}
 
+	int getClip() const {
+		return clip;
+	}
+
 	/** @brief Get the number of element in the LUT (i.e. dimension of the array)
 	 *  For a LUT(500), it will return 500
 	 *  @return number of element in the array
@@ -232,68 +236,28 @@ public:
 	}
 
 #if defined( __SSE2__ ) && defined( __x86_64__ )
+	// use with float indices, same as operator[](float) for 4 indices at once
 	__m128 operator[](__m128 indexv ) const {
-		printf("don't use this operator. It's not ready for production");
-		return _mm_setzero_ps();
-
-		// convert floats to ints
-		__m128i	idxv =  _mm_cvttps_epi32( indexv );
-		__m128 tempv, resultv, p1v, p2v;
-		vmask maxmask = vmaskf_gt(indexv, maxsv);
-		idxv = _mm_castps_si128(vself(maxmask, maxsv, _mm_castsi128_ps(idxv)));
-		vmask minmask = vmaskf_lt(indexv, _mm_setzero_ps());
-		idxv = _mm_castps_si128(vself(minmask, _mm_setzero_ps(), _mm_castsi128_ps(idxv)));
-		// access the LUT 4 times and shuffle the values into p1v and p2v
-
-		int idx;
-
-		// get 4th value
-		idx = _mm_cvtsi128_si32 (_mm_shuffle_epi32(idxv,_MM_SHUFFLE(3,3,3,3)));
-		tempv = LVFU(data[idx]);
-		p1v = _mm_shuffle_ps(tempv, tempv, _MM_SHUFFLE(0,0,0,0));
-		p2v = _mm_shuffle_ps(tempv, tempv, _MM_SHUFFLE(1,1,1,1));
-		// now p1v is 3 3 3 3
-		//     p2v is 3 3 3 3
-
-		// get 3rd value
-		idx = _mm_cvtsi128_si32 (_mm_shuffle_epi32(idxv,_MM_SHUFFLE(2,2,2,2)));
-		tempv = LVFU(data[idx]);
-		p1v = _mm_move_ss( p1v, tempv);
-		tempv = _mm_shuffle_ps(tempv, tempv, _MM_SHUFFLE(1,1,1,1));
-		p2v = _mm_move_ss( p2v, tempv);
-		// now p1v is 3 3 3 2
-		//     p2v is 3 3 3 2
-
-		// get 2nd value
-		idx = _mm_cvtsi128_si32 (_mm_shuffle_epi32(idxv,_MM_SHUFFLE(1,1,1,1)));
-		tempv = LVFU(data[idx]);
-		p1v = _mm_shuffle_ps( p1v, p1v, _MM_SHUFFLE(1,0,1,0));
-		p2v = _mm_shuffle_ps( p2v, p2v, _MM_SHUFFLE(1,0,1,0));
-		// now p1v is 3 2 3 2
-		// now p2v is 3 2 3 2
-		p1v = _mm_move_ss( p1v, tempv );
-		// now p1v is 3 2 3 1
-		tempv = _mm_shuffle_ps(tempv, tempv, _MM_SHUFFLE(1,1,1,1));
-		p2v = _mm_move_ss( p2v, tempv);
-		// now p1v is 3 2 3 1
-
-		// get 1st value
-		idx = _mm_cvtsi128_si32 (_mm_shuffle_epi32(idxv,_MM_SHUFFLE(0,0,0,0)));
-		tempv = LVFU(data[idx]);
-		p1v = _mm_shuffle_ps( p1v, p1v, _MM_SHUFFLE(3,2,0,0));
-		// now p1v is 3 2 1 1
-		p2v = _mm_shuffle_ps( p2v, p2v, _MM_SHUFFLE(3,2,0,0));
-		// now p2v is 3 2 1 1
-		p1v = _mm_move_ss( p1v, tempv );
-		// now p1v is 3 2 1 0
-		tempv = _mm_shuffle_ps(tempv, tempv, _MM_SHUFFLE(1,1,1,1));
-		p2v = _mm_move_ss( p2v, tempv);
-		// now p2v is 3 2 1 0
-
-		__m128 diffv = indexv - _mm_cvtepi32_ps ( idxv );
-		diffv = vself(vorm(maxmask,minmask), _mm_setzero_ps(), diffv);
-		resultv = p1v + p2v * diffv;
-		return resultv	;
+		// the integer parts, clamped to [0, maxs] so that the 2 values read around each index are in the table
+		__m128i idxv = _mm_cvttps_epi32( _mm_min_ps( _mm_max_ps( indexv, _mm_setzero_ps() ), maxsv ) );
+		__m128 diffv = indexv - _mm_cvtepi32_ps( idxv );
+
+		// read the values at idx and idx+1 of 2 lanes at once, then split them into p1v and p2v
+		int idx0 = _mm_cvtsi128_si32 (idxv);
+		int idx1 = _mm_cvtsi128_si32 (_mm_shuffle_epi32(idxv,_MM_SHUFFLE(1,1,1,1)));
+		int idx2 = _mm_cvtsi128_si32 (_mm_shuffle_epi32(idxv,_MM_SHUFFLE(2,2,2,2)));
+		int idx3 = _mm_cvtsi128_si32 (_mm_shuffle_epi32(idxv,_MM_SHUFFLE(3,3,3,3)));
+		__m128 p01v = _mm_loadh_pi( _mm_loadl_pi( _mm_setzero_ps(), (__m64*)&data[idx0] ), (__m64*)&data[idx1] );
+		__m128 p23v = _mm_loadh_pi( _mm_loadl_pi( _mm_setzero_ps(), (__m64*)&data[idx2] ), (__m64*)&data[idx3] );
+		__m128 p1v = _mm_shuffle_ps( p01v, p23v, _MM_SHUFFLE(2,0,2,0) );
+		__m128 p2v = _mm_shuffle_ps( p01v, p23v, _MM_SHUFFLE(3,1,3,1) );
+		__m128 resultv = p1v + (p2v - p1v) * diffv;
+
+		if (clip & LUT_CLIP_BELOW)
+			resultv = vself( vmaskf_lt(indexv, _mm_setzero_ps()), _mm_set1_ps(data[0]), resultv );
+		if (clip & LUT_CLIP_ABOVE)
+			resultv = vself( vmaskf_gt(indexv, maxsv), _mm_set1_ps(data[size - 1]), resultv );
+		return resultv;
 	}
 
 	__m128 operator[](__m128i idxv ) const
@@ -172,4 +172,72 @@ public:
         buffer->inUse=false;
     }
 };
+
+// Buffers kept from one call to the next, for the operations needing a large temporary buffer each time they run
+template <class T> class AlignedBufferPool {
+private:
+    MyMutex mtx;
+    std::vector<AlignedBuffer<T>*> buffers;
+    size_t maxIdle;
+    size_t alignment;
+    size_t maxIdleSize;
+
+public:
+    /** @param maxIdleP number of buffers kept allocated while they aren't used
+     * @param alignmentP alignment of the buffers, in bytes
+     * @param maxIdleSizeP largest buffer kept allocated while it isn't used, in elements, 0 = no limit
+     */
+    AlignedBufferPool(size_t maxIdleP=1, size_t alignmentP=16, size_t maxIdleSizeP=0) : maxIdle(maxIdleP), alignment(alignmentP), maxIdleSize(maxIdleSizeP) {}
+
+    ~AlignedBufferPool() {
+        for (size_t i=0;i<buffers.size();i++) delete buffers[i];
+    }
+
+    /** @brief Leases a buffer of at least size elements
+     * @return the buffer, its data being NULL if the allocation failed; it has to be given back to release in any case
+     */
+    AlignedBuffer<T>* acquire(size_t size) {
+        MyMutex::MyLock lock(mtx);
+
+        // the smallest idle buffer large enough, else the largest one, which gets reallocated
+        AlignedBuffer<T>* buffer=NULL;
+        for (size_t i=0;i<buffers.size();i++) {
+            AlignedBuffer<T>* candidate=buffers[i];
+            if (candidate->inUse)
+                continue;
+            if (!buffer)
+                buffer=candidate;
+            else if (buffer->getSize()<size ? candidate->getSize()>buffer->getSize() : (candidate->getSize()>=size && candidate->getSize()<buffer->getSize()))
+                buffer=candidate;
+        }
+
+        if (!buffer) {
+            buffer=new AlignedBuffer<T>(0, alignment);
+            buffers.push_back(buffer);
+        }
+        if (buffer->getSize()<size)
+            buffer->resize(size);
+        buffer->inUse=true;
+        return buffer;
+    }
+
+    void release(AlignedBuffer<T>* buffer) {
+        MyMutex::MyLock lock(mtx);
+
+        buffer->inUse=false;
+
+        size_t idle=0;
+        for (size_t i=0;i<buffers.size();i++)
+            if (!buffers[i]->inUse)
+                idle++;
+        if (idle>maxIdle || (maxIdleSize && buffer->getSize()>maxIdleSize)) {
+            for (size_t i=0;i<buffers.size();i++)
+                if (buffers[i]==buffer) {
+                    buffers.erase(buffers.begin()+i);
+                    break;
+                }
+            delete buffer;
+        }
+    }
+};
 #endif
@@ -65,6 +65,7 @@
 
 #include <cstring>
 #include <cstdio>
+#include "planaralloc.h"
 
 template<typename T>
 class array2D {
@@ -80,13 +81,13 @@ private:
 			ptr = NULL;
 		}
 		if ((data) && (((h * w) > (x * y)) || ((h * w) < ((x * y) / 4)))) {
-			delete[] data;
+			rtengine::freePlanes(data);
 			data = NULL;
 		}
 		if (ptr == NULL)
 			ptr = new T*[h];
 		if (data == NULL)
-			data = new T[h * w];
+			data = (T*) rtengine::allocPlanes((size_t)h * w * sizeof(T));
 
 		x = w;
 		y = h;
@@ -107,7 +108,7 @@ public:
 	array2D(int w, int h, unsigned int flgs = 0) {
 		flags = flgs;
 		lock = flags & ARRAY2D_LOCK_DATA;
-		data = new T[h * w];
+		data = (T*) rtengine::allocPlanes((size_t)h * w * sizeof(T));
 		owner = 1;
 		x = w;
 		y = h;
@@ -127,7 +128,7 @@ public:
 		// TODO: improve this code with ar_realloc()
 		owner = (flags & ARRAY2D_BYREFERENCE) ? 0 : 1;
 		if (owner)
-			data = new T[h * w];
+			data = (T*) rtengine::allocPlanes((size_t)h * w * sizeof(T));
 		else
 			data = NULL;
 		x = w;
@@ -150,7 +151,7 @@ public:
 			printf(" deleting array2D size %dx%d \n", x, y);
 
 		if ((owner) && (data))
-			delete[] data;
+			rtengine::freePlanes(data);
 		if (ptr)
 			delete[] ptr;
 	}
@@ -0,0 +1,64 @@
+/*
+ *  This file is part of RawTherapee.
+ *
+ *  RawTherapee is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  RawTherapee is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with RawTherapee.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "cafitcache.h"
+#include "rtengine.h"
+#include <cstdio>
+
+namespace rtengine {
+
+CAFitCache caFitCache;
+
+std::string CAFitCache::key (const ImageMetaData* idata, int width, int height) {
+
+    if (!idata)
+        return "";
+
+    const std::string lens = idata->getLens();
+    const double focalLen = idata->getFocalLen();
+    const double fnumber = idata->getFNumber();
+    if (lens.empty() || !lens.compare (0, 7, "Unknown") || focalLen <= 0.0 || fnumber <= 0.0)
+        return "";
+
+    char settings[64];
+    sprintf (settings, "|%.1f|%.1f|%dx%d", focalLen, fnumber, width, height);
+    return idata->getMake() + "|" + idata->getModel() + "|" + lens + settings;
+}
+
+bool CAFitCache::get (const std::string& key, CAFit& fit) {
+
+    MyMutex::MyLock lock (mutex);
+
+    Fits::iterator it = fits.find (key);
+    if (it == fits.end())
+        return false;
+    fit = it->second;
+    return true;
+}
+
+void CAFitCache::put (const std::string& key, const CAFit& fit) {
+
+    MyMutex::MyLock lock (mutex);
+    fits[key] = fit;
+}
+
+void CAFitCache::clear () {
+
+    MyMutex::MyLock lock (mutex);
+    fits.clear();
+}
+
+}
@@ -0,0 +1,62 @@
+/*
+ *  This file is part of RawTherapee.
+ *
+ *  RawTherapee is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  RawTherapee is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with RawTherapee.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef _CAFITCACHE_H_
+#define _CAFITCACHE_H_
+
+#include <map>
+#include <string>
+#include "../rtgui/threadutils.h"
+
+namespace rtengine {
+
+class ImageMetaData;
+
+/** @brief Polynomial fit of the chromatic aberration shifts computed by the diagnostic pass of CA_correct_RT */
+struct CAFit {
+    int polyord;                ///< order of the polynomial in each direction, the fit having polyord^2 parameters
+    double params[3][2][16];    ///< coefficients for red (0) and blue (2), vertical (0) and horizontal (1) shifts
+};
+
+/** @brief Cache of the automatic CA fits, keyed by camera, lens, focal length, aperture and image size
+  *
+  * The fit mostly depends on the lens and its settings, so the images of a series can reuse the fit of the first one
+  * instead of running their own diagnostic pass. */
+class CAFitCache {
+
+    typedef std::map<std::string, CAFit> Fits;
+
+    Fits fits;
+    MyMutex mutex;
+
+  public:
+    /** @brief Key of the fits of an image
+      * @return the key, or an empty string if the lens or its settings are unknown */
+    static std::string key (const ImageMetaData* idata, int width, int height);
+
+    /** @brief Copies the fit stored under key into fit
+      * @return true if the fit was in the cache */
+    bool get (const std::string& key, CAFit& fit);
+
+    void put (const std::string& key, const CAFit& fit);
+
+    void clear ();
+};
+
+extern CAFitCache caFitCache;
+
+}
+#endif
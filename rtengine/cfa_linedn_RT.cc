@@ -23,10 +23,12 @@
 ////////////////////////////////////////////////////////////////
 
 #include <cmath>
+#include <cstring>
 
 #include "rtengine.h"
 #include "rawimagesource.h"
 #include "rt_math.h"
+#include "opthelper.h"
 
 #define TS 224		// Tile size of 224 instead of 512 speeds up processing
 
@@ -37,9 +39,23 @@
 using namespace std;
 using namespace rtengine;
 
+template<class T> static void ddct8x8s(int isgn, T a[8][8]);
+
+#ifdef __SSE2__
+// the same pixel of the 4 RGGB subarrays, 2 in the row of p and 2 in the next one of the tile
+static INLINE vfloat loadRGGB(const float* p) {
+	return _mm_loadh_pi(_mm_loadl_pi(ZEROV, (const __m64*)p), (const __m64*)(p+TS));
+}
+
+static INLINE void storeRGGB(float* p, vfloat v) {
+	_mm_storel_pi((__m64*)p, v);
+	_mm_storeh_pi((__m64*)(p+TS), v);
+}
+#endif
+
 // %%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
 
-void RawImageSource::CLASS cfa_linedn(float noise)
+SSEFUNCTION void RawImageSource::CLASS cfa_linedn(float noise)
 {
 	// local variables
 	int height=H, width=W;
@@ -63,7 +79,9 @@ void RawImageSource::CLASS cfa_linedn(float noise)
 	float noisevar=SQR(3*noise*65535); // _noise_ (as a fraction of saturation) is input to the algorithm
 	float noisevarm4 = 4.0f * noisevar;
 	volatile double progress = 0.0;
-	float* RawDataTmp = (float*)malloc( width*height*sizeof(float));
+	// the tiles are written in place one band of tiles after the other; the band read keeps the original rows it shares
+	// with the band above, which the tiles of that band have already overwritten
+	float* bandData = (float*)malloc(TS*width*sizeof(float));
 #pragma omp parallel
 	{	
 	
@@ -74,18 +92,33 @@ void RawImageSource::CLASS cfa_linedn(float noise)
 	float *cfadiff =(float*)(buffer+(2*TS*TS*sizeof(float))+ 2 * 64);
 	float *cfadn =(float*)(buffer+(3*TS*TS*sizeof(float))+ 3 * 64);
 
-
+#ifdef __SSE2__
+	vfloat dctblock[8][8];	// the 4 RGGB subarrays of a block, one per lane
+	vfloat noisefactor[8][2];
+	vfloat gaussv[5];
+	for (int i=0; i<5; i++)
+		gaussv[i] = F2V(gauss[i]);
+	const vfloat epsv = F2V(eps);
+	const vfloat noisevarm4v = F2V(noisevarm4);
+	const vfloat halfv = F2V(0.5f);
+#else
 	float linehvar[4], linevvar[4], noisefactor[4][8][2], coeffsq;
 	float dctblock[4][8][8];
+#endif
 
+	// Main algorithm: Tile loop
+	for (int top=0; top < height-16; top += TS-32) {
+		// load the band, the rows shared with the previous one from its copy
+		const int bandrows = min(TS, height-top);
+		const int kept = top > 0 ? min(32, bandrows) : 0;
+#pragma omp for
+		for (int rr=0; rr<kept; rr++)
+			memcpy(bandData+rr*width, bandData+(rr+TS-32)*width, width*sizeof(float));
 #pragma omp for
-	for(int i=0;i<height;i++)
-		for(int j=0;j<width;j++)
-			RawDataTmp[i*width+j] = rawData[i][j];
+		for (int rr=kept; rr<bandrows; rr++)
+			memcpy(bandData+rr*width, rawData[top+rr], width*sizeof(float));
 
-	// Main algorithm: Tile loop
-#pragma omp for schedule(dynamic) collapse(2)
-	for (int top=0; top < height-16; top += TS-32)
+#pragma omp for schedule(dynamic)
 		for (int left=0; left < width-16; left += TS-32) {
 	
 			int bottom = min(top+TS,height);
@@ -94,10 +127,8 @@ void RawImageSource::CLASS cfa_linedn(float noise)
 			int numcols = right - left;
 			int indx1;
 			// load CFA data; data should be in linear gamma space, before white balance multipliers are applied
-			for (int rr=top; rr < top+numrows; rr++)
-				for (int cc=left, indx=(rr-top)*TS; cc < left+numcols; cc++, indx++) {
-					cfain[indx] = rawData[rr][cc];
-				}
+			for (int rr=0; rr < numrows; rr++)
+				memcpy(cfain+rr*TS, bandData+rr*width+left, numcols*sizeof(float));
 			//pad the block to a multiple of 16 on both sides
 			
 			if (numcols < TS) {
@@ -122,13 +153,34 @@ void RawImageSource::CLASS cfa_linedn(float noise)
 			
 			//gaussian blur of CFA data
 			for (int rr=8; rr < numrows-8; rr++){
-				for (int indx=rr*TS; indx < rr*TS+numcols; indx++) {
+				int indx=rr*TS;
+#ifdef __SSE2__
+				for (; indx < rr*TS+numcols-3; indx+=4) {
+					vfloat blurv = gaussv[0]*LVFU(cfain[indx]);
+					for (int i=1; i<5; i++) {
+						blurv += gaussv[i]*(LVFU(cfain[indx-(2*i)*TS])+LVFU(cfain[indx+(2*i)*TS]));
+					}
+					_mm_storeu_ps(&cfablur[indx], blurv);
+				}
+#endif
+				for (; indx < rr*TS+numcols; indx++) {
 					cfablur[indx]=gauss[0]*cfain[indx];
 					for (int i=1; i<5; i++) {
 						cfablur[indx] += gauss[i]*(cfain[indx-(2*i)*TS]+cfain[indx+(2*i)*TS]);
 					}
 				}
-				for (int indx=rr*TS+8; indx < rr*TS+numcols-8; indx++) {
+				indx=rr*TS+8;
+#ifdef __SSE2__
+				for (; indx < rr*TS+numcols-8-3; indx+=4) {
+					vfloat dnv = gaussv[0]*LVFU(cfablur[indx]);
+					for (int i=1; i<5; i++) {
+						dnv += gaussv[i]*(LVFU(cfablur[indx-2*i])+LVFU(cfablur[indx+2*i]));
+					}
+					_mm_storeu_ps(&cfadn[indx], dnv);
+					_mm_storeu_ps(&cfadiff[indx], LVFU(cfain[indx])-dnv); // hipass cfa data
+				}
+#endif
+				for (; indx < rr*TS+numcols-8; indx++) {
 					cfadn[indx] = gauss[0]*cfablur[indx];
 					for (int i=1; i<5; i++) {
 						cfadn[indx] += gauss[i]*(cfablur[indx-2*i]+cfablur[indx+2*i]);
@@ -140,6 +192,48 @@ void RawImageSource::CLASS cfa_linedn(float noise)
 			//begin block DCT
 			for (int rr=8; rr < numrows-22; rr+=8) // (rr,cc) shift by 8 to overlap blocks
 				for (int cc=8; cc < numcols-22; cc+=8) {
+#ifdef __SSE2__
+					// the 4 RGGB subarrays go through the transforms and the filter together, lanes 2*ey+ex
+					for (int i=0; i<8; i++) 
+						for (int j=0; j<8; j++) {
+							dctblock[i][j] = loadRGGB(&cfadiff[(rr+2*i)*TS+cc+2*j]);
+						}
+					
+					ddct8x8s(-1, dctblock); //forward DCT
+
+					vfloat linehvarv = ZEROV, linevvarv = ZEROV;
+					for (int i=4; i<8; i++) {
+						linehvarv += SQRV(dctblock[0][i]);
+						linevvarv += SQRV(dctblock[i][0]);
+					}
+					//Wiener filter for line denoising; roll off low frequencies
+					for (int i=1; i<8; i++) {
+						vfloat coeffsqv = SQRV(dctblock[i][0]);//vertical
+						noisefactor[i][0] = coeffsqv/(coeffsqv+F2V(rolloff[i]*noisevar)+epsv);
+						coeffsqv = SQRV(dctblock[0][i]);//horizontal
+						noisefactor[i][1] = coeffsqv/(coeffsqv+F2V(rolloff[i]*noisevar)+epsv);
+					}
+					//horizontal lines, subarrays 0 with 1 and 2 with 3
+					const vmask hormask = vmaskf_gt(noisevarm4v, linehvarv+_mm_shuffle_ps(linehvarv, linehvarv, _MM_SHUFFLE(2,3,0,1)));
+					for (int i=1; i<8; i++) {
+						vfloat factorv = halfv*(noisefactor[i][1]+_mm_shuffle_ps(noisefactor[i][1], noisefactor[i][1], _MM_SHUFFLE(2,3,0,1)));
+						dctblock[0][i] = vself(hormask, dctblock[0][i]*factorv, dctblock[0][i]);
+					}
+					//vertical lines, subarrays 0 with 2 and 1 with 3
+					const vmask vertmask = vmaskf_gt(noisevarm4v, linevvarv+_mm_shuffle_ps(linevvarv, linevvarv, _MM_SHUFFLE(1,0,3,2)));
+					for (int i=1; i<8; i++) {
+						vfloat factorv = halfv*(noisefactor[i][0]+_mm_shuffle_ps(noisefactor[i][0], noisefactor[i][0], _MM_SHUFFLE(1,0,3,2)));
+						dctblock[i][0] = vself(vertmask, dctblock[i][0]*factorv, dctblock[i][0]);
+					}
+
+					ddct8x8s(1, dctblock); //inverse DCT
+					//multiply by window fn and add to output (cfadn)
+					for (int i=0; i<8; i++) 
+						for (int j=0; j<8; j++) {
+							float* dn = &cfadn[(rr+2*i)*TS+cc+2*j];
+							storeRGGB(dn, loadRGGB(dn)+F2V(window[i]*window[j])*dctblock[i][j]);
+						}
+#else
 					for (int ey=0; ey<2; ey++) // (ex,ey) specify RGGB subarray
 						for (int ex=0; ex<2; ex++) {
 							//grab an 8x8 block of a given RGGB channel
@@ -203,15 +297,16 @@ void RawImageSource::CLASS cfa_linedn(float noise)
 									cfadn[(rr+2*i+ey)*TS+cc+2*j+ex] += window[i]*window[j]*dctblock[2*ey+ex][i][j];
 								}
 						}	
+#endif
 				}
 		
 			// %%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
-			// copy smoothed results to temporary buffer
+			// write smoothed results in place, the tests on the original data read in the band
 			for (int rr=16; rr < numrows-16; rr++) {
 				int row = rr + top; 
 				for (int col=16+left, indx=rr*TS+16; indx < rr*TS+numcols-16; indx++, col++) {
-					if (rawData[row][col]<clip_pt && cfadn[indx]<clip_pt) 
-					   RawDataTmp[row*width+col] = CLIP((int)(cfadn[indx]+ 0.5f));
+					if (bandData[rr*width+col]<clip_pt && cfadn[indx]<clip_pt) 
+					   rawData[row][col] = CLIP((int)(cfadn[indx]+ 0.5f));
 				}
 			}
 			if(plistener) {
@@ -224,18 +319,13 @@ void RawImageSource::CLASS cfa_linedn(float noise)
 			}
 			
 		}
+	}
 	// clean up
 	free(buffer);
 
-// copy temporary buffer back to image matrix
-#pragma omp for
-	for(int i=0;i<height;i++)
-		for(int j=0;j<width;j++)
-			rawData[i][j] = RawDataTmp[i*width+j];
-
 	} // end of parallel processing
 
-	free(RawDataTmp);
+	free(bandData);
 }
 #undef TS
 
@@ -257,7 +347,7 @@ void RawImageSource::CLASS cfa_linedn(float noise)
  functions
  ddct8x8s  : 8x8 DCT
  function prototypes
- void ddct8x8s(int isgn, float **a);
+ template<class T> void ddct8x8s(int isgn, T a[8][8]);
  */
 
 
@@ -302,11 +392,22 @@ void RawImageSource::CLASS cfa_linedn(float noise)
 #define W8_4R   0.70710678118654752440
 
 
-void RawImageSource::ddct8x8s(int isgn, float a[8][8])
+template<class T> static inline T dctConst(float c);
+template<> inline float dctConst<float>(float c) { return c; }
+#ifdef __SSE2__
+template<> inline vfloat dctConst<vfloat>(float c) { return F2V(c); }
+#endif
+
+// T is float for one block, vfloat for 4 blocks transformed together
+template<class T> static void ddct8x8s(int isgn, T a[8][8])
 {
     int j;
-    float x0r, x0i, x1r, x1i, x2r, x2i, x3r, x3i;
-    float xr, xi;
+    T x0r, x0i, x1r, x1i, x2r, x2i, x3r, x3i;
+    T xr, xi;
+    const T c8_1r = dctConst<T>(C8_1R), c8_1i = dctConst<T>(C8_1I);
+    const T c8_2r = dctConst<T>(C8_2R), c8_2i = dctConst<T>(C8_2I);
+    const T c8_3r = dctConst<T>(C8_3R), c8_3i = dctConst<T>(C8_3I);
+    const T c8_4r = dctConst<T>(C8_4R), w8_4r = dctConst<T>(W8_4R);
     
     if (isgn < 0) {
         for (j = 0; j <= 7; j++) {
@@ -320,22 +421,22 @@ void RawImageSource::ddct8x8s(int isgn, float a[8][8])
             x3i = a[6][j] - a[1][j];
             xr = x0r + x2r;
             xi = x0i + x2i;
-            a[0][j] = C8_4R * (xr + xi);
-            a[4][j] = C8_4R * (xr - xi);
+            a[0][j] = c8_4r * (xr + xi);
+            a[4][j] = c8_4r * (xr - xi);
             xr = x0r - x2r;
             xi = x0i - x2i;
-            a[2][j] = C8_2R * xr - C8_2I * xi;
-            a[6][j] = C8_2R * xi + C8_2I * xr;
-            xr = W8_4R * (x1i - x3i);
-            x1i = W8_4R * (x1i + x3i);
+            a[2][j] = c8_2r * xr - c8_2i * xi;
+            a[6][j] = c8_2r * xi + c8_2i * xr;
+            xr = w8_4r * (x1i - x3i);
+            x1i = w8_4r * (x1i + x3i);
             x3i = x1i - x3r;
             x1i += x3r;
             x3r = x1r - xr;
             x1r += xr;
-            a[1][j] = C8_1R * x1r - C8_1I * x1i;
-            a[7][j] = C8_1R * x1i + C8_1I * x1r;
-            a[3][j] = C8_3R * x3r - C8_3I * x3i;
-            a[5][j] = C8_3R * x3i + C8_3I * x3r;
+            a[1][j] = c8_1r * x1r - c8_1i * x1i;
+            a[7][j] = c8_1r * x1i + c8_1i * x1r;
+            a[3][j] = c8_3r * x3r - c8_3i * x3i;
+            a[5][j] = c8_3r * x3i + c8_3i * x3r;
         }
         for (j = 0; j <= 7; j++) {
             x0r = a[j][0] + a[j][7];
@@ -348,39 +449,39 @@ void RawImageSource::ddct8x8s(int isgn, float a[8][8])
             x3i = a[j][6] - a[j][1];
             xr = x0r + x2r;
             xi = x0i + x2i;
-            a[j][0] = C8_4R * (xr + xi);
-            a[j][4] = C8_4R * (xr - xi);
+            a[j][0] = c8_4r * (xr + xi);
+            a[j][4] = c8_4r * (xr - xi);
             xr = x0r - x2r;
             xi = x0i - x2i;
-            a[j][2] = C8_2R * xr - C8_2I * xi;
-            a[j][6] = C8_2R * xi + C8_2I * xr;
-            xr = W8_4R * (x1i - x3i);
-            x1i = W8_4R * (x1i + x3i);
+            a[j][2] = c8_2r * xr - c8_2i * xi;
+            a[j][6] = c8_2r * xi + c8_2i * xr;
+            xr = w8_4r * (x1i - x3i);
+            x1i = w8_4r * (x1i + x3i);
             x3i = x1i - x3r;
             x1i += x3r;
             x3r = x1r - xr;
             x1r += xr;
-            a[j][1] = C8_1R * x1r - C8_1I * x1i;
-            a[j][7] = C8_1R * x1i + C8_1I * x1r;
-            a[j][3] = C8_3R * x3r - C8_3I * x3i;
-            a[j][5] = C8_3R * x3i + C8_3I * x3r;
+            a[j][1] = c8_1r * x1r - c8_1i * x1i;
+            a[j][7] = c8_1r * x1i + c8_1i * x1r;
+            a[j][3] = c8_3r * x3r - c8_3i * x3i;
+            a[j][5] = c8_3r * x3i + c8_3i * x3r;
         }
     } else {
         for (j = 0; j <= 7; j++) {
-            x1r = C8_1R * a[1][j] + C8_1I * a[7][j];
-            x1i = C8_1R * a[7][j] - C8_1I * a[1][j];
-            x3r = C8_3R * a[3][j] + C8_3I * a[5][j];
-            x3i = C8_3R * a[5][j] - C8_3I * a[3][j];
+            x1r = c8_1r * a[1][j] + c8_1i * a[7][j];
+            x1i = c8_1r * a[7][j] - c8_1i * a[1][j];
+            x3r = c8_3r * a[3][j] + c8_3i * a[5][j];
+            x3i = c8_3r * a[5][j] - c8_3i * a[3][j];
             xr = x1r - x3r;
             xi = x1i + x3i;
             x1r += x3r;
             x3i -= x1i;
-            x1i = W8_4R * (xr + xi);
-            x3r = W8_4R * (xr - xi);
-            xr = C8_2R * a[2][j] + C8_2I * a[6][j];
-            xi = C8_2R * a[6][j] - C8_2I * a[2][j];
-            x0r = C8_4R * (a[0][j] + a[4][j]);
-            x0i = C8_4R * (a[0][j] - a[4][j]);
+            x1i = w8_4r * (xr + xi);
+            x3r = w8_4r * (xr - xi);
+            xr = c8_2r * a[2][j] + c8_2i * a[6][j];
+            xi = c8_2r * a[6][j] - c8_2i * a[2][j];
+            x0r = c8_4r * (a[0][j] + a[4][j]);
+            x0i = c8_4r * (a[0][j] - a[4][j]);
             x2r = x0r - xr;
             x2i = x0i - xi;
             x0r += xr;
@@ -395,20 +496,20 @@ void RawImageSource::ddct8x8s(int isgn, float a[8][8])
             a[1][j] = x2i + x3r;
         }
         for (j = 0; j <= 7; j++) {
-            x1r = C8_1R * a[j][1] + C8_1I * a[j][7];
-            x1i = C8_1R * a[j][7] - C8_1I * a[j][1];
-            x3r = C8_3R * a[j][3] + C8_3I * a[j][5];
-            x3i = C8_3R * a[j][5] - C8_3I * a[j][3];
+            x1r = c8_1r * a[j][1] + c8_1i * a[j][7];
+            x1i = c8_1r * a[j][7] - c8_1i * a[j][1];
+            x3r = c8_3r * a[j][3] + c8_3i * a[j][5];
+            x3i = c8_3r * a[j][5] - c8_3i * a[j][3];
             xr = x1r - x3r;
             xi = x1i + x3i;
             x1r += x3r;
             x3i -= x1i;
-            x1i = W8_4R * (xr + xi);
-            x3r = W8_4R * (xr - xi);
-            xr = C8_2R * a[j][2] + C8_2I * a[j][6];
-            xi = C8_2R * a[j][6] - C8_2I * a[j][2];
-            x0r = C8_4R * (a[j][0] + a[j][4]);
-            x0i = C8_4R * (a[j][0] - a[j][4]);
+            x1i = w8_4r * (xr + xi);
+            x3r = w8_4r * (xr - xi);
+            xr = c8_2r * a[j][2] + c8_2i * a[j][6];
+            xi = c8_2r * a[j][6] - c8_2i * a[j][2];
+            x0r = c8_4r * (a[j][0] + a[j][4]);
+            x0i = c8_4r * (a[j][0] - a[j][4]);
             x2r = x0r - xr;
             x2i = x0i - xi;
             x0r += xr;
@@ -3,12 +3,19 @@
 #include "stdimagesource.h"
 #include "safegtk.h"
 #include "../rtgui/options.h"
+#include "opthelper.h"
+#include "sleef.c"
+#ifdef __SSE2__
+#include "sleefsseavx.c"
+#endif
 
 rtengine::CLUTStore clutStore;
 
 using namespace rtengine;
 
 const float MAXVAL8 = 255.;
+// larger Hald CLUTs are resampled to this cube side, tetrahedral interpolation doesn't need more nodes
+const int MAXGRIDSIZE = 64;
 
 CLUTStore::CLUTStore()
 {
@@ -106,6 +113,7 @@ void rtengine::splitClutFilename( Glib::ustring filename, Glib::ustring &name, G
 
 HaldCLUT::HaldCLUT()
 :   m_clutImage( 0 ),
+    m_gridSize( 0 ),
     m_level (0),
     m_profile( "sRGB" )
 {
@@ -126,6 +134,7 @@ void HaldCLUT::load( Glib::ustring filename )
 	splitClutFilename( filename, name, ext, m_profile );
 	if ( m_clutImage ) {
 		m_filename = filename;
+		compile();
 	}
 }
 
@@ -217,15 +226,78 @@ Imagefloat* HaldCLUT::generateIdentImage( int level )
 
 bool HaldCLUT::isValid() const
 {
-    return m_clutImage != 0;
+    return m_gridSize >= 2;
 }
 
 void HaldCLUT::getRGB( float rr, float gg, float bb, float &outR, float &outG, float &outB ) const
 {
-    rr /= MAXVALF;
-    gg /= MAXVALF;
-    bb /= MAXVALF;
-    correct( *m_clutImage, m_level, rr, gg, bb, outR, outG, outB );
+    getRGB( &rr, &gg, &bb, &outR, &outG, &outB, 1 );
+}
+
+// tetrahedral interpolation: the unit cube around the pixel is split in 6 tetrahedra along its main diagonal,
+// the one holding the pixel is selected by sorting the fractional parts and only its 4 nodes are blended
+SSEFUNCTION void HaldCLUT::getRGB( const float *rr, const float *gg, const float *bb, float *outR, float *outG, float *outB, int n ) const
+{
+    const float scale = float(m_gridSize - 1) / MAXVALF;
+    const int maxNode = m_gridSize - 2;
+    const int stepR = 4;
+    const int stepG = 4 * m_gridSize;
+    const int stepB = 4 * m_gridSize * m_gridSize;
+    const float *grid = m_grid.data;
+
+    for ( int k = 0; k < n; ++k ) {
+        float fr = rr[k] * scale;
+        float fg = gg[k] * scale;
+        float fb = bb[k] * scale;
+        int red = LIM( int(fr), 0, maxNode );
+        int green = LIM( int(fg), 0, maxNode );
+        int blue = LIM( int(fb), 0, maxNode );
+        fr -= red;
+        fg -= green;
+        fb -= blue;
+
+        // w1 >= w2 >= w3 are the sorted fractions, offset1 and offset2 the nodes reached after one and two steps along the cube edges
+        int offset1, offset2;
+        float w1, w2, w3;
+        if ( fr > fg ) {
+            if ( fg > fb ) {
+                offset1 = stepR; offset2 = stepR + stepG; w1 = fr; w2 = fg; w3 = fb;
+            } else if ( fr > fb ) {
+                offset1 = stepR; offset2 = stepR + stepB; w1 = fr; w2 = fb; w3 = fg;
+            } else {
+                offset1 = stepB; offset2 = stepR + stepB; w1 = fb; w2 = fr; w3 = fg;
+            }
+        } else {
+            if ( fb > fg ) {
+                offset1 = stepB; offset2 = stepG + stepB; w1 = fb; w2 = fg; w3 = fr;
+            } else if ( fb > fr ) {
+                offset1 = stepG; offset2 = stepG + stepB; w1 = fg; w2 = fb; w3 = fr;
+            } else {
+                offset1 = stepG; offset2 = stepR + stepG; w1 = fg; w2 = fr; w3 = fb;
+            }
+        }
+
+        const float *node = grid + red * stepR + green * stepG + blue * stepB;
+        const float *last = node + stepR + stepG + stepB;
+#ifdef __SSE2__
+        ALIGNED16 float result[4];
+        vfloat resv = vmulf( LVF( node[0] ), vcast_vf_f( 1.f - w1 ) );
+        resv = vaddf( resv, vmulf( LVF( node[offset1] ), vcast_vf_f( w1 - w2 ) ) );
+        resv = vaddf( resv, vmulf( LVF( node[offset2] ), vcast_vf_f( w2 - w3 ) ) );
+        resv = vaddf( resv, vmulf( LVF( last[0] ), vcast_vf_f( w3 ) ) );
+        STVF( result[0], resv );
+        outR[k] = result[0];
+        outG[k] = result[1];
+        outB[k] = result[2];
+#else
+        const float w0 = 1.f - w1;
+        w1 -= w2;
+        w2 -= w3;
+        outR[k] = node[0] * w0 + node[offset1] * w1 + node[offset2] * w2 + last[0] * w3;
+        outG[k] = node[1] * w0 + node[offset1 + 1] * w1 + node[offset2 + 1] * w2 + last[1] * w3;
+        outB[k] = node[2] * w0 + node[offset1 + 2] * w1 + node[offset2 + 2] * w2 + last[2] * w3;
+#endif
+    }
 }
 
 inline float valF( unsigned char val )
@@ -392,3 +464,40 @@ void HaldCLUT::correct( Imagefloat &clutImage, int level, float rr, float gg, fl
     outG = outG * (1 - b) + tmp[1] * b;
     outB = outB * (1 - b) + tmp[2] * b;
 }
+
+void HaldCLUT::compile()
+{
+    const int level = m_level * m_level;
+    if ( level < 2 ) {
+        return;
+    }
+    m_gridSize = min( level, MAXGRIDSIZE );
+    m_grid.resize( 4 * m_gridSize * m_gridSize * m_gridSize );
+    const int imageSideSize = m_clutImage->getW();
+    const float step = 1.f / float(m_gridSize - 1);
+
+#ifdef _OPENMP
+    #pragma omp parallel for
+#endif
+    for ( int b = 0; b < m_gridSize; ++b ) {
+        for ( int g = 0; g < m_gridSize; ++g ) {
+            float *node = m_grid.data + 4 * ( g + b * m_gridSize ) * m_gridSize;
+            for ( int r = 0; r < m_gridSize; ++r, node += 4 ) {
+                if ( m_gridSize == level ) {
+                    // same nodes as the Hald image, just copy them
+                    int x, y;
+                    pos2xy( r + g * level + b * level * level, imageSideSize, x, y );
+                    node[0] = m_clutImage->r( x, y );
+                    node[1] = m_clutImage->g( x, y );
+                    node[2] = m_clutImage->b( x, y );
+                } else {
+                    correct( *m_clutImage, m_level, r * step, g * step, b * step, node[0], node[1], node[2] );
+                }
+                node[3] = 0.f;
+            }
+        }
+    }
+
+    m_clutImage->free();
+    m_clutImage = 0;
+}
@@ -4,6 +4,7 @@
 #include <gtkmm.h>
 #include "../rtgui/threadutils.h"
 #include "imagefloat.h"
+#include "alignedbuffer.h"
 #include <vector>
 #include <map>
 
@@ -14,6 +15,8 @@ class CLUT
 {
 public:
     virtual void getRGB( float r, float g, float b, float &outR, float &outG, float &outB ) const = 0;
+    // same as above for n pixels at once, inputs and outputs in [0;65535]
+    virtual void getRGB( const float *r, const float *g, const float *b, float *outR, float *outG, float *outB, int n ) const = 0;
     virtual Glib::ustring profile() const  = 0;
 protected:
     virtual ~CLUT() {};
@@ -28,6 +31,7 @@ public:
     bool isValid() const;
 
     void getRGB( float r, float g, float b, float &outR, float &outG, float &outB ) const;
+    void getRGB( const float *r, const float *g, const float *b, float *outR, float *outG, float *outB, int n ) const;
     Glib::ustring profile() const;
 
     typedef std::vector<unsigned char> RawClut; // using 8 bit for reduce memory usage
@@ -39,8 +43,13 @@ public:
 private:
     
     void loadClut( Imagefloat *img, RawClut &outClut );
+    // builds m_grid from m_clutImage, then frees the image
+    void compile();
     
     Imagefloat *m_clutImage;
+    // the cube as m_gridSize^3 nodes of 4 floats (r, g, b, unused), red varying fastest
+    AlignedBuffer<float> m_grid;
+    int m_gridSize;
     int m_level;
     Glib::ustring m_filename;
     Glib::ustring m_profile;
@@ -2207,6 +2207,159 @@ void ColorTemp::jch2xyz_ciecam02float( float &x, float &y, float &z, float J, fl
     ColorTemp::cat02_to_xyzfloat( x, y, z, r, g, b, gamu );
 }
 
+#ifdef __SSE2__
+void ColorTemp::xyz_to_cat02float( vfloat &r, vfloat &g, vfloat &b, vfloat x, vfloat y, vfloat z )
+{
+	//gamut correction M.H.Brill S.Susstrunk
+	r = vsubf( vaddf( vmulf( F2V( 1.007245f ), x ), vmulf( F2V( 0.011136f ), y ) ), vmulf( F2V( 0.018381f ), z ) );//Changjun Li
+	g = vaddf( vaddf( vmulf( F2V( -0.318061f ), x ), vmulf( F2V( 1.314589f ), y ) ), vmulf( F2V( 0.003471f ), z ) );
+	b = z;
+}
+
+void ColorTemp::cat02_to_hpefloat( vfloat &rh, vfloat &gh, vfloat &bh, vfloat r, vfloat g, vfloat b )
+{
+	//Changjun Li
+	rh = vsubf( vaddf( vmulf( F2V( 0.550930835f ), r ), vmulf( F2V( 0.519435987f ), g ) ), vmulf( F2V( 0.070356303f ), b ) );
+	gh = vaddf( vaddf( vmulf( F2V( 0.055954056f ), r ), vmulf( F2V( 0.89973132f ), g ) ), vmulf( F2V( 0.044315524f ), b ) );
+	bh = b;
+}
+
+void ColorTemp::cat02_to_xyzfloat( vfloat &x, vfloat &y, vfloat &z, vfloat r, vfloat g, vfloat b )
+{
+	//gamut correction M.H.Brill S.Susstrunk
+	x = vaddf( vsubf( vmulf( F2V( 0.99015849f ), r ), vmulf( F2V( 0.00838772f ), g ) ), vmulf( F2V( 0.018229217f ), b ) );//Changjun Li
+	y = vaddf( vaddf( vmulf( F2V( 0.239565979f ), r ), vmulf( F2V( 0.758664642f ), g ) ), vmulf( F2V( 0.001770137f ), b ) );
+	z = b;
+}
+
+void ColorTemp::hpe_to_xyzfloat( vfloat &x, vfloat &y, vfloat &z, vfloat r, vfloat g, vfloat b )
+{
+	x = vaddf( vsubf( vmulf( F2V( 1.910197f ), r ), vmulf( F2V( 1.112124f ), g ) ), vmulf( F2V( 0.201908f ), b ) );
+	y = vsubf( vaddf( vmulf( F2V( 0.370950f ), r ), vmulf( F2V( 0.629054f ), g ) ), vmulf( F2V( 0.000008f ), b ) );
+	z = b;
+}
+
+void ColorTemp::Aab_to_rgbfloat( vfloat &r, vfloat &g, vfloat &b, vfloat A, vfloat aa, vfloat bb, vfloat nbb )
+{
+	vfloat c1 = vmulf( F2V( 0.32787f ), vaddf( vdivf( A, nbb ), F2V( 0.305f ) ) );
+
+	/*       c1              c2               c3       */
+	r = vaddf( c1, vaddf( vmulf( F2V( 0.32145f ), aa ), vmulf( F2V( 0.20527f ), bb ) ) );
+	/*       c1              c4               c5       */
+	g = vsubf( c1, vaddf( vmulf( F2V( 0.63507f ), aa ), vmulf( F2V( 0.18603f ), bb ) ) );
+	/*       c1              c6               c7       */
+	b = vsubf( c1, vaddf( vmulf( F2V( 0.15681f ), aa ), vmulf( F2V( 4.49038f ), bb ) ) );
+}
+
+void ColorTemp::calculate_abfloat( vfloat &aa, vfloat &bb, vfloat h, vfloat e, vfloat t, vfloat nbb, vfloat a )
+{
+	vfloat2 sincosval = xsincosf( vmulf( h, F2V( float(M_PI) / 180.0f ) ) );
+	vfloat sinh = sincosval.x;
+	vfloat cosh = sincosval.y;
+	vfloat x = vaddf( vdivf( a, nbb ), F2V( 0.305f ) );
+	const float p3 = 1.05f;
+	vfloat num = vmulf( vmulf( F2V( 0.32787f ), x ), F2V( 2.0f + p3 ) );
+	vfloat c1 = F2V( -0.31362f - (p3 * 0.15681f) );
+	vfloat c2 = F2V( 0.01924f - (p3 * 4.49038f) );
+	vfloat eOverT = vdivf( e, t );
+	// both branches of the scalar version are computed, the one with the larger divisor is kept
+	vmask sinmask = vmaskf_ge( vabsf( sinh ), vabsf( cosh ) );
+	vfloat bbs = vdivf( num, vsubf( vsubf( vdivf( eOverT, sinh ), vmulf( c1, vdivf( cosh, sinh ) ) ), c2 ) );
+	vfloat aas = vdivf( vmulf( bbs, cosh ), sinh );
+	vfloat aac = vdivf( num, vsubf( vsubf( vdivf( eOverT, cosh ), c1 ), vmulf( c2, vdivf( sinh, cosh ) ) ) );
+	vfloat bbc = vdivf( vmulf( aac, sinh ), cosh );
+	aa = vself( sinmask, aas, aac );
+	bb = vself( sinmask, bbs, bbc );
+}
+
+void ColorTemp::xyz2jchqms_ciecam02float( vfloat &J, vfloat &C, vfloat &h, vfloat &Q, vfloat &M, vfloat &s, vfloat aw, vfloat fl, vfloat wh,
+									 vfloat x, vfloat y, vfloat z, vfloat xw, vfloat yw, vfloat zw,
+									 vfloat c, vfloat nc, vfloat pow1, vfloat nbb, vfloat ncb, vfloat pfl, vfloat cz, vfloat d )
+{
+    vfloat r, g, b;
+    vfloat rw, gw, bw;
+    vfloat rc, gc, bc;
+    vfloat rp, gp, bp;
+    vfloat rpa, gpa, bpa;
+    vfloat a, ca, cb;
+    vfloat e, t;
+    vfloat myh;
+    vfloat c1d = vsubf( F2V( 1.0f ), d );
+    xyz_to_cat02float( r, g, b, x, y, z );
+    xyz_to_cat02float( rw, gw, bw, xw, yw, zw );
+    vfloat ywd = vmulf( yw, d );
+    rc = vmulf( r, vaddf( vdivf( ywd, rw ), c1d ) );
+    gc = vmulf( g, vaddf( vdivf( ywd, gw ), c1d ) );
+    bc = vmulf( b, vaddf( vdivf( ywd, bw ), c1d ) );
+
+    ColorTemp::cat02_to_hpefloat( rp, gp, bp, rc, gc, bc );
+    //gamut correction M.H.Brill S.Susstrunk
+    rp = vmaxf( rp, ZEROV );
+    gp = vmaxf( gp, ZEROV );
+    bp = vmaxf( bp, ZEROV );
+    rpa = nonlinear_adaptationfloat( rp, fl );
+    gpa = nonlinear_adaptationfloat( gp, fl );
+    bpa = nonlinear_adaptationfloat( bp, fl );
+
+    ca = vsubf( rpa, vdivf( vsubf( vmulf( F2V( 12.0f ), gpa ), bpa ), F2V( 11.0f ) ) );
+    cb = vmulf( F2V( 0.11111111f ), vsubf( vaddf( rpa, gpa ), vaddf( bpa, bpa ) ) );
+
+    myh = xatan2f( cb, ca );
+    myh = vself( vmaskf_lt( myh, ZEROV ), vaddf( myh, F2V( 2.f * float(M_PI) ) ), myh );
+
+    a = vmulf( vsubf( vaddf( vaddf( vaddf( rpa, rpa ), gpa ), vmulf( F2V( 0.05f ), bpa ) ), F2V( 0.305f ) ), nbb );
+    a = vmaxf( a, ZEROV );//gamut correction M.H.Brill S.Susstrunk
+
+    J = xexpf( vmulf( vmulf( vmulf( c, cz ), F2V( 0.5f ) ), xlogf( vdivf( a, aw ) ) ) );
+
+    e = vmulf( vmulf( vmulf( F2V( 961.53846f ), nc ), ncb ), vaddf( xcosf( vaddf( myh, F2V( 2.0f ) ) ), F2V( 3.8f ) ) );
+    t = vdivf( vmulf( e, vsqrtf( vaddf( vmulf( ca, ca ), vmulf( cb, cb ) ) ) ), vaddf( vaddf( rpa, gpa ), vmulf( F2V( 1.05f ), bpa ) ) );
+
+    C = vmulf( vmulf( xexpf( vmulf( F2V( 0.9f ), xlogf( t ) ) ), J ), pow1 );
+
+    Q = vmulf( wh, J );
+    J = vmulf( vmulf( J, J ), F2V( 100.0f ) );
+    M = vmulf( C, pfl );
+    Q = vself( vmaskf_eq( Q, ZEROV ), F2V( 0.0001f ), Q ); // avoid division by zero
+    s = vmulf( F2V( 100.0f ), vsqrtf( vdivf( M, Q ) ) );
+    h = vmulf( myh, F2V( 180.f / float(M_PI) ) );
+}
+
+void ColorTemp::jch2xyz_ciecam02float( vfloat &x, vfloat &y, vfloat &z, vfloat J, vfloat C, vfloat h,
+								  vfloat xw, vfloat yw, vfloat zw,
+								  vfloat c, vfloat nc, vfloat pow1, vfloat nbb, vfloat ncb, vfloat fl, vfloat cz, vfloat d, vfloat aw )
+{
+    vfloat r, g, b;
+    vfloat rc, gc, bc;
+    vfloat rp, gp, bp;
+    vfloat rpa, gpa, bpa;
+    vfloat rw, gw, bw;
+    vfloat a, ca, cb;
+    vfloat e, t;
+    xyz_to_cat02float( rw, gw, bw, xw, yw, zw );
+    e = vmulf( vmulf( vmulf( F2V( 961.53846f ), nc ), ncb ), vaddf( xcosf( vaddf( vmulf( h, F2V( float(M_PI) / 180.0f ) ), F2V( 2.0f ) ) ), F2V( 3.8f ) ) );
+    a = vmulf( xexpf( vmulf( vdivf( F2V( 1.0f ), vmulf( c, cz ) ), xlogf( vmulf( J, F2V( 0.01f ) ) ) ) ), aw );
+    t = xexpf( vmulf( F2V( 1.1111111f ), xlogf( vdivf( vmulf( F2V( 10.f ), C ), vmulf( vsqrtf( J ), pow1 ) ) ) ) );
+
+    calculate_abfloat( ca, cb, h, e, t, nbb, a );
+    Aab_to_rgbfloat( rpa, gpa, bpa, a, ca, cb, nbb );
+
+    rp = inverse_nonlinear_adaptationfloat( rpa, fl );
+    gp = inverse_nonlinear_adaptationfloat( gpa, fl );
+    bp = inverse_nonlinear_adaptationfloat( bpa, fl );
+
+    ColorTemp::hpe_to_xyzfloat( x, y, z, rp, gp, bp );
+    ColorTemp::xyz_to_cat02float( rc, gc, bc, x, y, z );
+
+    vfloat ywd = vmulf( yw, d );
+    vfloat c1d = vsubf( F2V( 1.0f ), d );
+    r = vdivf( rc, vaddf( vdivf( ywd, rw ), c1d ) );
+    g = vdivf( gc, vaddf( vdivf( ywd, gw ), c1d ) );
+    b = vdivf( bc, vaddf( vdivf( ywd, bw ), c1d ) );
+
+    ColorTemp::cat02_to_xyzfloat( x, y, z, r, g, b );
+}
+#endif
 
 //end CIECAM Billy Bigg
 
@@ -167,11 +167,22 @@ class ColorTemp {
 		static void cat02_to_hpefloat ( float &rh, float &gh, float &bh, float r, float g, float b, int gamu );
 		static void cat02_to_xyzfloat ( float &x,  float &y,  float &z,  float r, float g, float b, int gamu );
 		static void hpe_to_xyzfloat   ( float &x,  float &y,  float &z,  float r, float g, float b );
+#ifdef __SSE2__
+		// SSE versions process 4 pixels at once, they always apply the gamut correction (gamu=1)
+		static void xyz_to_cat02float ( vfloat &r,  vfloat &g,  vfloat &b,  vfloat x, vfloat y, vfloat z );
+		static void cat02_to_hpefloat ( vfloat &rh, vfloat &gh, vfloat &bh, vfloat r, vfloat g, vfloat b );
+		static void cat02_to_xyzfloat ( vfloat &x,  vfloat &y,  vfloat &z,  vfloat r, vfloat g, vfloat b );
+		static void hpe_to_xyzfloat   ( vfloat &x,  vfloat &y,  vfloat &z,  vfloat r, vfloat g, vfloat b );
+#endif
 
 		static void Aab_to_rgb( double &r, double &g, double &b, double A, double aa, double bb, double nbb );
 		static void Aab_to_rgbfloat( float &r, float &g, float &b, float A, float aa, float bb, float nbb );
 		static void calculate_ab( double &aa, double &bb, double h, double e, double t, double nbb, double a );
 		static void calculate_abfloat( float &aa, float &bb, float h, float e, float t, float nbb, float a );
+#ifdef __SSE2__
+		static void Aab_to_rgbfloat( vfloat &r, vfloat &g, vfloat &b, vfloat A, vfloat aa, vfloat bb, vfloat nbb );
+		static void calculate_abfloat( vfloat &aa, vfloat &bb, vfloat h, vfloat e, vfloat t, vfloat nbb, vfloat a );
+#endif
 
 		
 		static double nonlinear_adaptation( double c, double fl ) {
@@ -194,6 +205,19 @@ class ColorTemp {
 		    if(c-0.1f < 0.f) fl*=-1.f;
 		    return (100.0f / fl) * pow_F( (27.13f * fabsf( c - 0.1f )) / (400.0f - fabsf( c - 0.1f )), 2.38095238f );
 		}
+#ifdef __SSE2__
+		static vfloat nonlinear_adaptationfloat( vfloat c, vfloat fl ) {
+			vfloat p = xexpf( vmulf( F2V( 0.42f ), xlogf( vmulf( vabsf( c ), vmulf( fl, F2V( 0.01f ) ) ) ) ) );
+			vfloat res = vdivf( vmulf( F2V( 400.0f ), p ), vaddf( F2V( 27.13f ), p ) );
+			return vaddf( vself( vmaskf_lt( c, ZEROV ), vnegf( res ), res ), F2V( 0.1f ) );
+		}
+		static vfloat inverse_nonlinear_adaptationfloat( vfloat c, vfloat fl ) {
+			vfloat c1 = vsubf( c, F2V( 0.1f ) );
+			vfloat absc1 = vabsf( c1 );
+			vfloat res = vmulf( vdivf( F2V( 100.0f ), fl ), xexpf( vmulf( F2V( 2.38095238f ), xlogf( vdivf( vmulf( F2V( 27.13f ), absc1 ), vsubf( F2V( 400.0f ), absc1 ) ) ) ) ) );
+			return vself( vmaskf_lt( c1, ZEROV ), vnegf( res ), res );
+		}
+#endif
 		
 		
 		static void curvecolor(double satind, double satval, double &sres, double parsat); 				
@@ -318,6 +342,12 @@ class ColorTemp {
 		                              float xw, float yw, float zw,
 		                              float yb, float la,
 		                              float f, float c, float nc,int gamu,float n, float nbb, float ncb, float fl, float cz, float d, float aw );
+#ifdef __SSE2__
+		static void jch2xyz_ciecam02float( vfloat &x, vfloat &y, vfloat &z,
+		                              vfloat J, vfloat C, vfloat h,
+		                              vfloat xw, vfloat yw, vfloat zw,
+		                              vfloat c, vfloat nc, vfloat n, vfloat nbb, vfloat ncb, vfloat fl, vfloat cz, vfloat d, vfloat aw );
+#endif
 									  
 /**
  * Forward transform from XYZ to CIECAM02 JCh.
@@ -347,6 +377,13 @@ class ColorTemp {
 		                                 float xw, float yw, float zw,
 		                                 float yb, float la,
 		                                 float f, float c, float nc,  float pilotd, int gamu, float n, float nbb, float ncb, float pfl, float cz, float d  );
+#ifdef __SSE2__
+		static void xyz2jchqms_ciecam02float( vfloat &J, vfloat &C, vfloat &h,
+		                                 vfloat &Q, vfloat &M, vfloat &s, vfloat aw, vfloat fl, vfloat wh,
+		                                 vfloat x, vfloat y, vfloat z,
+		                                 vfloat xw, vfloat yw, vfloat zw,
+		                                 vfloat c, vfloat nc, vfloat n, vfloat nbb, vfloat ncb, vfloat pfl, vfloat cz, vfloat d );
+#endif
 										 
 										 
 };
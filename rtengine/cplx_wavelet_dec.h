@@ -121,6 +121,9 @@ namespace rtengine {
 			}
 		}	
 
+		// lifting factorisation of the filters, used by the subsampled levels
+		const WaveletLifting *lifting = wavfilt_len == 6 ? &Daub4_lift : (wavfilt_len == 8 ? &Daub4_lift8 : NULL);
+
 		// after coefficient rotation, data structure is:
 		// wavelet_decomp[scale][channel={lo,hi1,hi2,hi3}][pixel_array]
 
@@ -141,7 +144,7 @@ namespace rtengine {
 		int bufferindex = 0;
 
 		wavelet_decomp[lvltot] = new wavelet_level<internal_type>(src, buffer[bufferindex^1], lvltot/*level*/, subsamp, m_w, m_h, \
-																  wavfilt_anal, wavfilt_anal, wavfilt_len, wavfilt_offset, skipcrop, numThreads);
+																  wavfilt_anal, wavfilt_anal, wavfilt_len, wavfilt_offset, skipcrop, numThreads, lifting);
 		if(wavelet_decomp[lvltot]->memoryAllocationFailed)
 			memoryAllocationFailed = true;
 		while(lvltot < maxlvl-1) {
@@ -149,7 +152,7 @@ namespace rtengine {
 			bufferindex ^= 1;
 			wavelet_decomp[lvltot] = new wavelet_level<internal_type>(buffer[bufferindex], buffer[bufferindex^1]/*lopass*/, lvltot/*level*/, subsamp, \
 																	  wavelet_decomp[lvltot-1]->width(), wavelet_decomp[lvltot-1]->height(), \
-																	  wavfilt_anal, wavfilt_anal, wavfilt_len, wavfilt_offset, skipcrop, numThreads);
+																	  wavfilt_anal, wavfilt_anal, wavfilt_len, wavfilt_offset, skipcrop, numThreads, lifting);
 			if(wavelet_decomp[lvltot]->memoryAllocationFailed)
 				memoryAllocationFailed = true;
 		}
@@ -17,6 +17,8 @@
  *  2012 Emil Martinec <ejmartin@uchicago.edu>
  */
 
+#ifndef CPLX_WAVELET_FILTER_COEFFS_H_INCLUDED
+#define CPLX_WAVELET_FILTER_COEFFS_H_INCLUDED
 
 namespace rtengine {
 
@@ -29,5 +31,39 @@ const float Daub4_anal[2][6] ALIGNED16 = {//analysis filter
 const float Daub4_anal8[2][8] ALIGNED16 = {//analysis filter	
 		{0.f,0.f, 0.235233605f, 0.57055846f, 0.3251825f, -0.09546721f, -0.060416105f, 0.02490875f}, 
 		{-0.02490875f,  -0.060416105f, 0.09546721f, 0.3251825f, -0.57055846f , 0.235233605f, 0.f, 0.f}};
+
+// lifting factorisations of the analysis filters above (Daubechies & Sweldens)
+// with x[2m] in phase 0 and x[2m-1] in phase 1, each step adds to phase 'target' the combination
+// coeff[0]*other[m+first] + coeff[1]*other[m+first+1] of the other phase;
+// then lopass[m] = loScale*phase loPhase[m+loShift] and hipass[m] = hiScale*phase hiPhase[m+hiShift]
+struct WaveletLiftingStep {
+	int target, first, taps;
+	float coeff[2];
+};
+
+struct WaveletLifting {
+	int numSteps;
+	WaveletLiftingStep steps[4];
+	int loPhase, loShift;
+	float loScale;
+	int hiPhase, hiShift;
+	float hiScale;
+};
+
+const WaveletLifting Daub4_lift = {3, {
+		{1, 0, 1, {0.577350269f, 0.f}},
+		{0, 0, 2, {-0.433012700f, 2.799038089f}},
+		{1, -1, 1, {-0.333333335f, 0.f}}},
+		0, -1, 0.211324866f,
+		1, 1, -2.366025387f};
+
+const WaveletLifting Daub4_lift8 = {4, {
+		{1, 0, 1, {0.412286595f, 0.f}},
+		{0, 0, 2, {-0.352387655f, 1.565136282f}},
+		{1, -1, 2, {-0.492151856f, 2.538141727f}},
+		{0, 0, 1, {-0.389620386f, 0.f}}},
+		1, -1, 0.143625688f,
+		0, 0, -3.481271429f};
 };
 
+#endif
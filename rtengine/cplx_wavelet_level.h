@@ -26,8 +26,14 @@
 #include "rt_math.h"
 #include "opthelper.h"
 #include "stdio.h"
+#include "cplx_wavelet_filter_coeffs.h"
 namespace rtengine {
 
+	// padding of the polyphase components (at least the reach of the lifting steps)
+	// and number of rows lifted at once by the vertical passes
+	const int liftingPad = 4;
+	const int liftingBand = 32;
+
 	template<typename T>
 	class wavelet_level
 	{
@@ -44,6 +50,10 @@ namespace rtengine {
 		int skip;
 
 		bool bigBlockOfMemory;
+
+		// lifting factorisation of the filters, NULL if the convolution code is used
+		const WaveletLifting *lifting;
+
 		// allocation and destruction of data storage
 		T ** create(int n);
 		void destroy(T ** subbands);
@@ -71,6 +81,12 @@ namespace rtengine {
 #else
 		void SynthesisFilterSubsampVertical (T * srcLo, T * srcHi, T * dst, float *filterLo, float *filterHi, const int taps, const int offset, const int width, const int srcheight, const int dstheight, const float blend);
 #endif
+
+		void LiftingSteps (T * phase[2], const int begin, const int end, const int unit, const bool inverse);
+		void AnalysisLiftingVertical (const T * const srcbuffer, T * phase[2], const int band, const int width, const int height, const int m0);
+		void AnalysisLiftingHorizontal (const T * const srcbuffer, T * dstLo, T * dstHi, T * buffer, const int srcwidth, const int dstwidth, const int row);
+		void SynthesisLiftingHorizontal (const T * const srcLo, const T * const srcHi, T * dst, const int srcwidth, const int dstwidth, const int height);
+		void SynthesisLiftingVertical (const T * const srcLo, const T * const srcHi, T * dst, const int width, const int srcheight, const int dstheight, const float blend);
 	public:
 		bool memoryAllocationFailed;
 
@@ -82,8 +98,8 @@ namespace rtengine {
 		int m_w2, m_h2;
 
 		template<typename E>
-		wavelet_level(E * src, E * dst, int level, int subsamp, int w, int h, float *filterV, float *filterH, int len, int offset, int skipcrop, int numThreads)
-		: lvl(level), subsamp_out((subsamp>>level)&1), numThreads(numThreads), skip(1<<level), bigBlockOfMemory(true), memoryAllocationFailed(false), wavcoeffs(NULL), m_w(w), m_h(h), m_w2(w), m_h2(h)
+		wavelet_level(E * src, E * dst, int level, int subsamp, int w, int h, float *filterV, float *filterH, int len, int offset, int skipcrop, int numThreads, const WaveletLifting *lift = NULL)
+		: lvl(level), subsamp_out((subsamp>>level)&1), numThreads(numThreads), skip(1<<level), bigBlockOfMemory(true), lifting(NULL), memoryAllocationFailed(false), wavcoeffs(NULL), m_w(w), m_h(h), m_w2(w), m_h2(h)
 		{
 			if (subsamp) {
 				skip = 1;
@@ -96,6 +112,9 @@ namespace rtengine {
 			}
 			m_w2 = (subsamp_out ? (w+1)/2 : w);
 			m_h2 = (subsamp_out ? (h+1)/2 : h);
+			// the lifting steps assume adjacent taps
+			if (subsamp_out && skip == 1)
+				lifting = lift;
 			
 			wavcoeffs = create((m_w2)*(m_h2));
 			if(!memoryAllocationFailed)
@@ -538,6 +557,193 @@ namespace rtengine {
 	}
 #endif
 
+	template<typename T> SSEFUNCTION void wavelet_level<T>::LiftingSteps (T * phase[2], const int begin, const int end, const int unit, const bool inverse) {
+
+		/* Applies the lifting steps (or their inverse) to the polyphase components
+		 * phase[0] and phase[1], defined from index begin to end (excluded).
+		 * A sample is made of 'unit' contiguous values (1 for a row, the width for a band
+		 * of rows), so each step is a single pass over contiguous memory.
+		 * The samples near begin and end don't get all the steps, the caller pads them.
+		 */
+		for (int s = 0; s < lifting->numSteps; s++) {
+			const WaveletLiftingStep &step = lifting->steps[inverse ? lifting->numSteps-1-s : s];
+			const int mbegin = max(begin, begin - step.first);
+			const int mend = min(end, end - step.first - step.taps + 1);
+			if (mend <= mbegin)
+				continue;
+			T * RESTRICT dst = phase[step.target] + mbegin*unit;
+			const T * RESTRICT src0 = phase[step.target^1] + (mbegin+step.first)*unit;
+			const int n = (mend-mbegin)*unit;
+			const float c0 = inverse ? -step.coeff[0] : step.coeff[0];
+			int i = 0;
+			if (step.taps == 1) {
+#ifdef __SSE2__
+				__m128 c0v = _mm_set1_ps(c0);
+				for (; i < n-3; i += 4)
+					_mm_storeu_ps(&dst[i], LVFU(dst[i]) + c0v * LVFU(src0[i]));
+#endif
+				for (; i < n; i++)
+					dst[i] += c0 * src0[i];
+			} else {
+				const T * RESTRICT src1 = src0 + unit;
+				const float c1 = inverse ? -step.coeff[1] : step.coeff[1];
+#ifdef __SSE2__
+				__m128 c0v = _mm_set1_ps(c0);
+				__m128 c1v = _mm_set1_ps(c1);
+				for (; i < n-3; i += 4)
+					_mm_storeu_ps(&dst[i], LVFU(dst[i]) + c0v * LVFU(src0[i]) + c1v * LVFU(src1[i]));
+#endif
+				for (; i < n; i++)
+					dst[i] += c0 * src0[i] + c1 * src1[i];
+			}
+		}
+	}
+
+	template<typename T> void wavelet_level<T>::AnalysisLiftingVertical (const T * const RESTRICT srcbuffer, T * phase[2], const int band, const int width, const int height, const int m0) {
+
+		/* Lifting scheme along the columns, for 'band' output rows from m0
+		 * phase[0] gets the rows 2m and phase[1] the rows 2m-1 (clamped BC's),
+		 * indexed from -liftingPad to band+liftingPad relative to m0
+		 */
+		for (int m = -liftingPad; m < band + liftingPad; m++) {
+			const T * even = srcbuffer + max(0,min(2*(m0+m),height-1))*width;
+			const T * odd = srcbuffer + max(0,min(2*(m0+m)-1,height-1))*width;
+			T * RESTRICT dstEven = phase[0] + m*width;
+			T * RESTRICT dstOdd = phase[1] + m*width;
+			for (int k = 0; k < width; k++) {
+				dstEven[k] = even[k];
+				dstOdd[k] = odd[k];
+			}
+		}
+		LiftingSteps (phase, -liftingPad, band + liftingPad, width, false);
+	}
+
+	template<typename T> void wavelet_level<T>::AnalysisLiftingHorizontal (const T * const RESTRICT srcbuffer, T * RESTRICT dstLo, T * RESTRICT dstHi, T * RESTRICT buffer, const int srcwidth, const int dstwidth, const int row) {
+
+		/* Lifting scheme along a row, same result as AnalysisFilterSubsampHorizontal
+		 * buffer holds 2*(dstwidth+2*liftingPad) values
+		 */
+		const int len = dstwidth + 2*liftingPad;
+		T * phase[2] = {buffer + liftingPad, buffer + len + liftingPad};
+		const int mbulk = (srcwidth-1)/2 + 1;
+		int m = -liftingPad;
+		for (; m < 1; m++) {
+			phase[0][m] = srcbuffer[max(0,2*m)];//clamped BC's
+			phase[1][m] = srcbuffer[max(0,2*m-1)];
+		}
+		for (; m < mbulk; m++) {
+			phase[0][m] = srcbuffer[2*m];
+			phase[1][m] = srcbuffer[2*m-1];
+		}
+		for (; m < dstwidth + liftingPad; m++) {
+			phase[0][m] = srcbuffer[min(2*m,srcwidth-1)];//clamped BC's
+			phase[1][m] = srcbuffer[min(2*m-1,srcwidth-1)];
+		}
+		LiftingSteps (phase, -liftingPad, dstwidth + liftingPad, 1, false);
+
+		const T * lo = phase[lifting->loPhase] + lifting->loShift;
+		const T * hi = phase[lifting->hiPhase] + lifting->hiShift;
+		const float loScale = lifting->loScale;
+		const float hiScale = lifting->hiScale;
+		for (int m = 0; m < dstwidth; m++) {
+			dstLo[row*dstwidth+m] = loScale * lo[m];
+			dstHi[row*dstwidth+m] = hiScale * hi[m];
+		}
+	}
+
+	template<typename T> void wavelet_level<T>::SynthesisLiftingHorizontal (const T * const RESTRICT srcLo, const T * const RESTRICT srcHi, T * RESTRICT dst, const int srcwidth, const int dstwidth, const int height) {
+
+		/* Inverse lifting scheme along the rows, same result as SynthesisFilterSubsampHorizontal:
+		 * the synthesis filters being the adjoint of the orthogonal analysis filters,
+		 * their result is half the inverse transform of the clamped lopass and hipass rows
+		 */
+		const float loFactor = 0.5f / lifting->loScale;
+		const float hiFactor = 0.5f / lifting->hiScale;
+		const int loShift = lifting->loShift;
+		const int hiShift = lifting->hiShift;
+		const int mend = dstwidth/2 + 1;
+		const int len = mend + 2*liftingPad;
+#ifdef _OPENMP
+#pragma omp parallel num_threads(numThreads) if(numThreads>1)
+#endif
+{
+		T * buffer = new T[2*len];
+		T * phase[2] = {buffer + liftingPad, buffer + len + liftingPad};
+		T * lo = phase[lifting->loPhase];
+		T * hi = phase[lifting->hiPhase];
+#ifdef _OPENMP
+#pragma omp for
+#endif
+		for (int k=0; k<height; k++) {
+			for (int m = -liftingPad; m < mend + liftingPad; m++) {
+				lo[m] = loFactor * srcLo[k*srcwidth+max(0,min(m-loShift,srcwidth-1))];//clamped BC's
+				hi[m] = hiFactor * srcHi[k*srcwidth+max(0,min(m-hiShift,srcwidth-1))];
+			}
+			LiftingSteps (phase, -liftingPad, mend + liftingPad, 1, true);
+			dst[k*dstwidth] = phase[0][0];
+			for (int i = 1; i < dstwidth; i++)
+				dst[k*dstwidth+i] = (i&1) ? phase[1][(i+1)/2] : phase[0][i/2];
+		}
+		delete[] buffer;
+}
+	}
+
+	template<typename T> SSEFUNCTION void wavelet_level<T>::SynthesisLiftingVertical (const T * const RESTRICT srcLo, const T * const RESTRICT srcHi, T * RESTRICT dst, const int width, const int srcheight, const int dstheight, const float blend) {
+
+		/* Inverse lifting scheme along the columns by bands of liftingBand rows,
+		 * same result as SynthesisFilterSubsampVertical (twice the inverse transform)
+		 */
+		const float srcFactor = 1.f - blend;
+		const float loFactor = 2.f / lifting->loScale;
+		const float hiFactor = 2.f / lifting->hiScale;
+		const int loShift = lifting->loShift;
+		const int hiShift = lifting->hiShift;
+		const int mend = dstheight/2 + 1;
+		const int bandsize = (liftingBand + 2*liftingPad)*width;
+#ifdef _OPENMP
+#pragma omp parallel num_threads(numThreads) if(numThreads>1)
+#endif
+{
+		T * buffer = new T[2*bandsize];
+		T * phase[2] = {buffer + liftingPad*width, buffer + bandsize + liftingPad*width};
+		T * lo = phase[lifting->loPhase];
+		T * hi = phase[lifting->hiPhase];
+#ifdef _OPENMP
+#pragma omp for
+#endif
+		for (int m0 = 0; m0 < mend; m0 += liftingBand) {
+			const int band = min(liftingBand, mend-m0);
+			for (int m = -liftingPad; m < band + liftingPad; m++) {
+				const T * srcLoRow = srcLo + max(0,min(m0+m-loShift,srcheight-1))*width;//clamped BC's
+				const T * srcHiRow = srcHi + max(0,min(m0+m-hiShift,srcheight-1))*width;
+				for (int k = 0; k < width; k++) {
+					lo[m*width+k] = loFactor * srcLoRow[k];
+					hi[m*width+k] = hiFactor * srcHiRow[k];
+				}
+			}
+			LiftingSteps (phase, -liftingPad, band + liftingPad, width, true);
+			for (int m = 0; m < band; m++) {
+				for (int p = 0; p < 2; p++) {
+					const int i = 2*(m0+m) - p;
+					if (i < 0 || i >= dstheight)
+						continue;
+					const T * src = phase[p] + m*width;
+					int k = 0;
+#ifdef __SSE2__
+					__m128 srcFactorv = _mm_set1_ps(srcFactor);
+					__m128 blendv = _mm_set1_ps(blend);
+					for (; k < width-3; k += 4)
+						_mm_storeu_ps(&dst[width*i+k], LVFU(dst[width*i+k]) * srcFactorv + blendv * LVFU(src[k]));
+#endif
+					for (; k < width; k++)
+						dst[width*i+k] = dst[width*i+k] * srcFactor + blend * src[k];
+				}
+			}
+		}
+		delete[] buffer;
+}
+	}
+
 #ifdef __SSE2__
 	template<typename T> template<typename E> SSEFUNCTION void wavelet_level<T>::decompose_level(E *src, E *dst, float *filterV, float *filterH, int taps, int offset) { 
 
@@ -556,7 +762,33 @@ namespace rtengine {
 {
 		T tmpLo[m_w] ALIGNED64;
 		T tmpHi[m_w] ALIGNED64;
-		if(subsamp_out) {
+		if(subsamp_out && lifting) {
+			// rows lifted by bands, then each output row lifted along its length
+			T * buffer = new T[2*(liftingBand + 2*liftingPad)*m_w];
+			T * rowbuffer = new T[2*(m_w2 + 2*liftingPad)];
+			T * phase[2] = {buffer + liftingPad*m_w, buffer + (liftingBand + 3*liftingPad)*m_w};
+			const T * lo = phase[lifting->loPhase] + lifting->loShift*m_w;
+			const T * hi = phase[lifting->hiPhase] + lifting->hiShift*m_w;
+			const float loScale = lifting->loScale;
+			const float hiScale = lifting->hiScale;
+#ifdef _OPENMP
+#pragma omp for
+#endif
+			for(int m0=0;m0<m_h2;m0+=liftingBand) {
+				const int band = min(liftingBand, m_h2-m0);
+				AnalysisLiftingVertical (src, phase, band, m_w, m_h, m0);
+				for(int m=0;m<band;m++) {
+					for(int k=0;k<m_w;k++) {
+						tmpLo[k] = loScale * lo[m*m_w+k];
+						tmpHi[k] = hiScale * hi[m*m_w+k];
+					}
+					AnalysisLiftingHorizontal (tmpLo, dst, wavcoeffs[1], rowbuffer, m_w, m_w2, m0+m);
+					AnalysisLiftingHorizontal (tmpHi, wavcoeffs[2], wavcoeffs[3], rowbuffer, m_w, m_w2, m0+m);
+				}
+			}
+			delete[] rowbuffer;
+			delete[] buffer;
+		} else if(subsamp_out) {
 #ifdef _OPENMP
 #pragma omp for
 #endif
@@ -587,7 +819,33 @@ namespace rtengine {
 		T tmpLo[m_w] ALIGNED64;
 		T tmpHi[m_w] ALIGNED64;
 		/* filter along rows and columns */
-		if(subsamp_out) {
+		if(subsamp_out && lifting) {
+			// rows lifted by bands, then each output row lifted along its length
+			T * buffer = new T[2*(liftingBand + 2*liftingPad)*m_w];
+			T * rowbuffer = new T[2*(m_w2 + 2*liftingPad)];
+			T * phase[2] = {buffer + liftingPad*m_w, buffer + (liftingBand + 3*liftingPad)*m_w};
+			const T * lo = phase[lifting->loPhase] + lifting->loShift*m_w;
+			const T * hi = phase[lifting->hiPhase] + lifting->hiShift*m_w;
+			const float loScale = lifting->loScale;
+			const float hiScale = lifting->hiScale;
+#ifdef _OPENMP
+#pragma omp for
+#endif
+			for(int m0=0;m0<m_h2;m0+=liftingBand) {
+				const int band = min(liftingBand, m_h2-m0);
+				AnalysisLiftingVertical (src, phase, band, m_w, m_h, m0);
+				for(int m=0;m<band;m++) {
+					for(int k=0;k<m_w;k++) {
+						tmpLo[k] = loScale * lo[m*m_w+k];
+						tmpHi[k] = hiScale * hi[m*m_w+k];
+					}
+					AnalysisLiftingHorizontal (tmpLo, dst, wavcoeffs[1], rowbuffer, m_w, m_w2, m0+m);
+					AnalysisLiftingHorizontal (tmpHi, wavcoeffs[2], wavcoeffs[3], rowbuffer, m_w, m_w2, m0+m);
+				}
+			}
+			delete[] rowbuffer;
+			delete[] buffer;
+		} else if(subsamp_out) {
 #ifdef _OPENMP
 #pragma omp for
 #endif
@@ -617,7 +875,11 @@ namespace rtengine {
 			return;
 
 		/* filter along rows and columns */
-		if (subsamp_out) {
+		if (subsamp_out && lifting) {
+			SynthesisLiftingHorizontal (wavcoeffs[2], wavcoeffs[3], tmpHi, m_w2, m_w, m_h2);
+			SynthesisLiftingHorizontal (src, wavcoeffs[1], tmpLo, m_w2, m_w, m_h2);
+			SynthesisLiftingVertical (tmpLo, tmpHi, dst, m_w, m_h2, m_h, blend);
+		} else if (subsamp_out) {
 			float filterVarray[2*taps][4] ALIGNED64;
 			for(int i=0;i<2*taps;i++) {
 				for(int j=0;j<4;j++) {
@@ -638,7 +900,11 @@ namespace rtengine {
 		if(memoryAllocationFailed)
 			return;
 		/* filter along rows and columns */
-		if (subsamp_out) {
+		if (subsamp_out && lifting) {
+			SynthesisLiftingHorizontal (wavcoeffs[2], wavcoeffs[3], tmpHi, m_w2, m_w, m_h2);
+			SynthesisLiftingHorizontal (src, wavcoeffs[1], tmpLo, m_w2, m_w, m_h2);
+			SynthesisLiftingVertical (tmpLo, tmpHi, dst, m_w, m_h2, m_h, blend);
+		} else if (subsamp_out) {
 			SynthesisFilterSubsampHorizontal (wavcoeffs[2], wavcoeffs[3], tmpHi, filterH, filterH+taps, taps, offset, m_w2, m_w, m_h2);
 			SynthesisFilterSubsampHorizontal (src, wavcoeffs[1], tmpLo, filterH, filterH+taps, taps, offset, m_w2, m_w, m_h2);
 			SynthesisFilterSubsampVertical (tmpLo, tmpHi, dst, filterV, filterV+taps, taps, offset, m_w, m_h2, m_h, blend);
@@ -0,0 +1,142 @@
+/*
+ *  This file is part of RawTherapee.
+ *
+ *  RawTherapee is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  RawTherapee is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with RawTherapee.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "curvecache.h"
+#include "settings.h"
+#include "rt_math.h"
+#include <cstdio>
+#include <cstring>
+
+namespace rtengine {
+
+extern const Settings* settings;
+
+CurveCache curveCache;
+
+CurveKey::CurveKey (const char* kind) : hash(14695981039346656037ull) {
+
+    addBytes (kind, strlen (kind) + 1);
+}
+
+void CurveKey::addBytes (const void* bytes, size_t size) {
+
+    // FNV-1a, 64 bits
+    const unsigned char* b = static_cast<const unsigned char*>(bytes);
+    for (size_t i = 0; i < size; i++) {
+        hash ^= b[i];
+        hash *= 1099511628211ull;
+    }
+}
+
+CurveKey& CurveKey::operator<< (double value) {
+
+    if (value == 0.0)
+        value = 0.0;    // -0 and +0 give the same curves
+    addBytes (&value, sizeof (value));
+    return *this;
+}
+
+CurveKey& CurveKey::operator<< (int value) {
+
+    addBytes (&value, sizeof (value));
+    return *this;
+}
+
+CurveKey& CurveKey::operator<< (const std::vector<double>& values) {
+
+    *this << (int)values.size();
+    for (size_t i = 0; i < values.size(); i++)
+        *this << values[i];
+    return *this;
+}
+
+CurveCache::CurveCache () : memory(0), useCount(0), hits(0), misses(0) {}
+
+bool CurveCache::get (const CurveKey& key, LUTf& lut) {
+
+    MyMutex::MyLock lock (mutex);
+
+    Entries::iterator it = entries.find (key.value());
+    if (it == entries.end()) {
+        misses++;
+        return false;
+    }
+    hits++;
+
+    Entry& entry = it->second;
+    entry.lastUse = ++useCount;
+    const int size = entry.data.size();
+    if (!lut || lut.getSize() != size)
+        lut (size, entry.clip);
+    else
+        lut.setClip (entry.clip);
+    memcpy (&lut[0], &entry.data[0], size * sizeof (float));
+    return true;
+}
+
+void CurveCache::put (const CurveKey& key, LUTf& lut) {
+
+    if (!lut)
+        return;
+
+    const size_t limit = (size_t)max(settings->curveCacheSize, 0) << 20;
+    const int size = lut.getSize();
+    const size_t bytes = size * sizeof (float);
+    if (bytes > limit)
+        return;
+
+    MyMutex::MyLock lock (mutex);
+
+    Entry& entry = entries[key.value()];
+    memory -= entry.data.size() * sizeof (float);
+    entry.data.resize (size);
+    memcpy (&entry.data[0], &lut[0], bytes);
+    entry.clip = lut.getClip();
+    entry.lastUse = ++useCount;
+    memory += bytes;
+
+    // drop the least recently used curves
+    while (memory > limit) {
+        Entries::iterator oldest = entries.begin();
+        for (Entries::iterator it = entries.begin(); it != entries.end(); ++it)
+            if (it->second.lastUse < oldest->second.lastUse)
+                oldest = it;
+        memory -= oldest->second.data.size() * sizeof (float);
+        entries.erase (oldest);
+    }
+}
+
+size_t CurveCache::getMemoryUsage () {
+
+    MyMutex::MyLock lock (mutex);
+    return memory;
+}
+
+void CurveCache::printStats () {
+
+    MyMutex::MyLock lock (mutex);
+    printf ("Curve cache: %d hit(s), %d miss(es), %d curve(s) using %d KB\n", hits, misses, (int)entries.size(), (int)(memory >> 10));
+    hits = misses = 0;
+}
+
+void CurveCache::clear () {
+
+    MyMutex::MyLock lock (mutex);
+    entries.clear();
+    memory = 0;
+}
+
+}
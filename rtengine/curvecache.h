@@ -0,0 +1,91 @@
+/*
+ *  This file is part of RawTherapee.
+ *
+ *  RawTherapee is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  RawTherapee is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with RawTherapee.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef _CURVECACHE_H_
+#define _CURVECACHE_H_
+
+#include <map>
+#include <vector>
+#include <cstddef>
+#include "../rtgui/threadutils.h"
+#include "LUT.h"
+
+namespace rtengine {
+
+/** @brief Hash of everything a curve is computed from
+  *
+  * The kind of curve is hashed first, so that curves computed differently from the same values get different keys. */
+class CurveKey {
+
+    unsigned long long hash;
+
+    void addBytes (const void* bytes, size_t size);
+
+  public:
+    explicit CurveKey (const char* kind);
+
+    CurveKey& operator<< (double value);
+    CurveKey& operator<< (int value);
+    CurveKey& operator<< (const std::vector<double>& values);
+
+    unsigned long long value () const { return hash; }
+};
+
+/** @brief Process wide cache of the LUTs compiled from the curves
+  *
+  * The preview, the detail windows, the thumbnails and the batch queue compute the same curves from the same
+  * parameters over and over; the LUTs are kept here under the key of their inputs, the least recently used ones
+  * being dropped when the cache exceeds Settings::curveCacheSize. */
+class CurveCache {
+
+    struct Entry {
+        std::vector<float> data;
+        int clip;
+        unsigned long long lastUse;
+    };
+    typedef std::map<unsigned long long, Entry> Entries;
+
+    Entries entries;
+    size_t memory;
+    unsigned long long useCount;
+    unsigned int hits, misses;
+    MyMutex mutex;
+
+  public:
+    CurveCache ();
+
+    /** @brief Copies the LUT stored under key into lut
+      * @param key key of the curve
+      * @param lut LUT receiving the curve, (re)allocated if its size doesn't match
+      * @return true if the curve was in the cache, lut being unchanged otherwise */
+    bool get (const CurveKey& key, LUTf& lut);
+
+    /** @brief Stores a copy of lut under key, replacing the previous curve of that key if any */
+    void put (const CurveKey& key, LUTf& lut);
+
+    /** @brief Memory used by the cached LUTs, in bytes */
+    size_t getMemoryUsage ();
+
+    /** @brief Prints the number of curves, the memory used and the hits and misses since the last call */
+    void printStats ();
+
+    void clear ();
+};
+
+extern CurveCache curveCache;
+
+}
+#endif
@@ -29,6 +29,7 @@
 #include "array2D.h"
 #include "LUT.h"
 #include "curves.h"
+#include "curvecache.h"
 #include "opthelper.h"
 #undef CLIPD
 #define CLIPD(a) ((a)>0.0f?((a)<1.0f?(a):1.0f):0.0f)
@@ -183,6 +184,23 @@ namespace rtengine {
 
 	}
 
+	// same as above for the curve of curvePoints, taken from the curve cache when it has already been computed
+	// returns false if the curve is the identity, outCurve being left unchanged in that case
+	bool fillCurveArray(const std::vector<double>& curvePoints, LUTf &outCurve, int skip) {
+
+		CurveKey key ("diagonal");
+		key << curvePoints << skip;
+		if (curveCache.get (key, outCurve))
+			return true;
+
+		DiagonalCurve dCurve (curvePoints, CURVES_MIN_POLY_POINTS/skip);
+		if (dCurve.isIdentity())
+			return false;
+		fillCurveArray(&dCurve, outCurve, skip, true);
+		curveCache.put (key, outCurve);
+		return true;
+	}
+
 void CurveFactory::updatechroma (
 		const std::vector<double>& cccurvePoints,
 		LUTu & histogramC, LUTu & outBeforeCCurveHistogramC,//for chroma
@@ -231,64 +249,32 @@ void CurveFactory::curveLightBrightColor (
 	bool histNeededC = false;
 	
 	bool histNeeded = false;
-	DiagonalCurve* tcurve = NULL;
 	customColCurve3.Reset();
 
 	if (!curvePoints3.empty() && curvePoints3[0]>DCT_Linear && curvePoints3[0]<DCT_Unchanged) {
-		tcurve = new DiagonalCurve (curvePoints3, CURVES_MIN_POLY_POINTS/skip);
+		customColCurve3.Set(curvePoints3, skip);
 		if (outBeforeCCurveHistogramC /*&& histogramCropped*/)
 				histNeededC = true;
 		
 	}
-	if (tcurve) {
-		if (tcurve->isIdentity()) {
-			delete tcurve;
-			tcurve = NULL;
-		}
-		else
-			customColCurve3.Set(tcurve);
-		delete tcurve;
-		tcurve = NULL;
-	}
 
 	customColCurve2.Reset();
 
 	if (!curvePoints2.empty() && curvePoints2[0]>DCT_Linear && curvePoints2[0]<DCT_Unchanged) {
-		tcurve = new DiagonalCurve (curvePoints2, CURVES_MIN_POLY_POINTS/skip);
+		customColCurve2.Set(curvePoints2, skip);
 		if (outBeforeCCurveHistogram /*&& histogramCropped*/)
 				histNeeded = true;
 		
 	}
-	if (tcurve) {
-		if (tcurve->isIdentity()) {
-			delete tcurve;
-			tcurve = NULL;
-		}
-		else
-			customColCurve2.Set(tcurve);
-		delete tcurve;
-		tcurve = NULL;
-	}
 	// create first curve if needed
 	customColCurve1.Reset();
 
 	if (!curvePoints1.empty() && curvePoints1[0]>DCT_Linear && curvePoints1[0]<DCT_Unchanged) {
-		tcurve = new DiagonalCurve (curvePoints1, CURVES_MIN_POLY_POINTS/skip);
+		customColCurve1.Set(curvePoints1, skip);
 		if (outBeforeCCurveHistogram /*&& histogramCropped*/)
 				histNeeded = true;
 		
 	}
-	if (tcurve) {
-		if (tcurve->isIdentity()) {
-			delete tcurve;
-			tcurve = NULL;
-		}
-		else  {
-			customColCurve1.Set(tcurve);
-			delete tcurve;
-			tcurve = NULL;
-		}
-	}
 	if (histNeeded) {
 		for (int i=0; i<32768; i++) {
 			double hval = CLIPD((double)i / 32767.0);
@@ -303,14 +289,11 @@ void CurveFactory::curveLightBrightColor (
 			outBeforeCCurveHistogramC[hi] += histogramC[i] ;
 		}
 	}
-	
-	if (tcurve) delete tcurve;
 
 }
 // add curve Denoise : C=f(C)
 void CurveFactory::denoiseCC ( bool & ccdenoiseutili,const std::vector<double>& cccurvePoints, LUTf & NoiseCCcurve,int skip){
 		bool needed;
-		DiagonalCurve* dCurve = NULL;
 		LUTf dCcurve(65536,0);
 	
 		float val;
@@ -319,19 +302,11 @@ void CurveFactory::denoiseCC ( bool & ccdenoiseutili,const std::vector<double>&
 		}
 		
 		needed = false;
-		if (!cccurvePoints.empty() && cccurvePoints[0]!=0) {
-			dCurve = new DiagonalCurve (cccurvePoints, CURVES_MIN_POLY_POINTS/skip);
-			
-			if (dCurve && !dCurve->isIdentity())
-				{needed = true;ccdenoiseutili=true;}
-		}
-		fillCurveArray(dCurve, NoiseCCcurve, skip, needed);
+		if (!cccurvePoints.empty() && cccurvePoints[0]!=0 && fillCurveArray(cccurvePoints, NoiseCCcurve, skip))
+			{needed = true;ccdenoiseutili=true;}
+		if (!needed)
+			fillCurveArray(NULL, NoiseCCcurve, skip, false);
 		//NoiseCCcurve.dump("Noise");
-		
-		if (dCurve) {
-			delete dCurve;
-			dCurve = NULL;
-		}
 }
 
 
@@ -344,36 +319,23 @@ void CurveFactory::curveBW (
 	outBeforeCCurveHistogrambw.clear();
 	bool histNeeded = false;
 	
-	DiagonalCurve* tcurve = NULL;
 	customToneCurvebw2.Reset();
 
 	if (!curvePointsbw2.empty() && curvePointsbw2[0]>DCT_Linear && curvePointsbw2[0]<DCT_Unchanged) {
-		tcurve = new DiagonalCurve (curvePointsbw2, CURVES_MIN_POLY_POINTS/skip);
+		customToneCurvebw2.Set(curvePointsbw2, skip);
 		if (outBeforeCCurveHistogrambw /*&& histogramCropped*/)
 				histNeeded = true;
 		
 	}
-	if (tcurve) {
-		if (!tcurve->isIdentity())
-			customToneCurvebw2.Set(tcurve);
-		delete tcurve;
-		tcurve = NULL;
-	}
 
 	customToneCurvebw1.Reset();
 
 	if (!curvePointsbw.empty() && curvePointsbw[0]>DCT_Linear && curvePointsbw[0]<DCT_Unchanged) {
-		tcurve = new DiagonalCurve (curvePointsbw, CURVES_MIN_POLY_POINTS/skip);
+		customToneCurvebw1.Set(curvePointsbw, skip);
 		if (outBeforeCCurveHistogrambw /*&& histogramCropped*/)
 				histNeeded = true;
 		
 	}
-	if (tcurve) {
-		if (!tcurve->isIdentity())
-			customToneCurvebw1.Set(tcurve);
-		delete tcurve;
-		tcurve = NULL;
-	}
 	// create first curve if needed
 	if (histNeeded) {
 		LUTf dcurve(65536,0);
@@ -390,14 +352,11 @@ void CurveFactory::curveBW (
 			outBeforeCCurveHistogrambw[hi] += histogrambw[i] ;
 		}
 	}
-	
-	if (tcurve) delete tcurve;
 
 }
 // add curve Lab : C=f(L)
 void CurveFactory::curveCL ( bool & clcutili,const std::vector<double>& clcurvePoints, LUTf & clCurve, LUTu & histogramcl, LUTu & outBeforeCLurveHistogram,int skip){
 		bool needed;
-		DiagonalCurve* dCurve = NULL;
 		
 		if (outBeforeCLurveHistogram)		
 			outBeforeCLurveHistogram.clear();
@@ -405,11 +364,10 @@ void CurveFactory::curveCL ( bool & clcutili,const std::vector<double>& clcurveP
 
 		needed = false;
 		if (!clcurvePoints.empty() && clcurvePoints[0]!=0) {
-			dCurve = new DiagonalCurve (clcurvePoints, CURVES_MIN_POLY_POINTS/skip);
 			if (outBeforeCLurveHistogram)
 				histNeededCL = true;
 			
-			if (dCurve && !dCurve->isIdentity())
+			if (fillCurveArray(clcurvePoints, clCurve, skip))
 				{needed = true;clcutili=true;}
 		}
 		if(histNeededCL)
@@ -419,52 +377,32 @@ void CurveFactory::curveCL ( bool & clcutili,const std::vector<double>& clcurveP
 			}
 
 		
-		fillCurveArray(dCurve, clCurve, skip, needed);
-		if (dCurve) {
-			delete dCurve;
-			dCurve = NULL;
-		}
+		if (!needed)
+			fillCurveArray(NULL, clCurve, skip, false);
 }
 
 // add curve Colortoning : C=f(L)
 void CurveFactory::curveToningCL ( bool & clctoningutili,const std::vector<double>& clcurvePoints, LUTf & clToningCurve,int skip){
 		bool needed;
-		DiagonalCurve* dCurve = NULL;
-		
+
 		needed = false;
-		if (!clcurvePoints.empty() && clcurvePoints[0]!=0) {
-			dCurve = new DiagonalCurve (clcurvePoints, CURVES_MIN_POLY_POINTS/skip);
-			
-			if (dCurve && !dCurve->isIdentity())
-				{needed = true;clctoningutili=true;}
-		}
-		fillCurveArray(dCurve, clToningCurve, skip, needed);
+		if (!clcurvePoints.empty() && clcurvePoints[0]!=0 && fillCurveArray(clcurvePoints, clToningCurve, skip))
+			{needed = true;clctoningutili=true;}
+		if (!needed)
+			fillCurveArray(NULL, clToningCurve, skip, false);
 	//	clToningCurve.dump("CLToning");
-		if (dCurve) {
-			delete dCurve;
-			dCurve = NULL;
-		}
 }
 
 // add curve Colortoning : CLf(L)
 void CurveFactory::curveToningLL ( bool & llctoningutili,const std::vector<double>& llcurvePoints, LUTf & llToningCurve, int skip){
 		bool needed;
-		DiagonalCurve* dCurve = NULL;
 
 		needed = false;
-		if (!llcurvePoints.empty() && llcurvePoints[0]!=0) {
-			dCurve = new DiagonalCurve (llcurvePoints, CURVES_MIN_POLY_POINTS/skip);
-			
-			if (dCurve && !dCurve->isIdentity())
-				{needed = true;llctoningutili=true;}
-		}
-		fillCurveArray(dCurve, llToningCurve, skip, needed);
+		if (!llcurvePoints.empty() && llcurvePoints[0]!=0 && fillCurveArray(llcurvePoints, llToningCurve, skip))
+			{needed = true;llctoningutili=true;}
+		if (!needed)
+			fillCurveArray(NULL, llToningCurve, skip, false);
 //		llToningCurve.dump("LLToning");
-
-		if (dCurve) {
-			delete dCurve;
-			dCurve = NULL;
-		}
 }
 
 	//%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
@@ -478,7 +416,6 @@ void CurveFactory::curveToningLL ( bool & llctoningutili,const std::vector<doubl
 		//-----------------------------------------------------
 
 		bool needed;
-		DiagonalCurve* dCurve = NULL;
 		LUTf dCcurve(65536,0);
 		int k=48000;//32768*1.41
 		if(outBeforeCCurveHistogram || outBeforeLCurveHistogram) {
@@ -498,45 +435,31 @@ void CurveFactory::curveToningLL ( bool & llctoningutili,const std::vector<doubl
 
 		needed = false;
 		// create a curve if needed
-		if (!acurvePoints.empty() && acurvePoints[0]!=0) {
-			dCurve = new DiagonalCurve (acurvePoints, CURVES_MIN_POLY_POINTS/skip);
-			if (dCurve && !dCurve->isIdentity()) {
-				needed = true;
-				autili=true;
-			}
+		if (!acurvePoints.empty() && acurvePoints[0]!=0 && fillCurveArray(acurvePoints, aoutCurve, skip)) {
+			needed = true;
+			autili=true;
 		}
-		fillCurveArray(dCurve, aoutCurve, skip, needed);
+		if (!needed)
+			fillCurveArray(NULL, aoutCurve, skip, false);
 		//if(autili) aoutCurve.dump("acurve");
 
-		if (dCurve) {
-			delete dCurve;
-			dCurve = NULL;
-		}
-
 		//-----------------------------------------------------
 
 		needed = false;
-		if (!bcurvePoints.empty() && bcurvePoints[0]!=0) {
-			dCurve = new DiagonalCurve (bcurvePoints, CURVES_MIN_POLY_POINTS/skip);
-			if (dCurve && !dCurve->isIdentity()) {
-				needed = true;
-				butili=true;
-			}
-		}
-		fillCurveArray(dCurve, boutCurve, skip, needed);
-		if (dCurve) {
-			delete dCurve;
-			dCurve = NULL;
+		if (!bcurvePoints.empty() && bcurvePoints[0]!=0 && fillCurveArray(bcurvePoints, boutCurve, skip)) {
+			needed = true;
+			butili=true;
 		}
+		if (!needed)
+			fillCurveArray(NULL, boutCurve, skip, false);
 		
 		//-----------------------------------------------
 		needed = false;
 		if (!cccurvePoints.empty() && cccurvePoints[0]!=0) {
-			dCurve = new DiagonalCurve (cccurvePoints, CURVES_MIN_POLY_POINTS/skip);
 			if (outBeforeCCurveHistogram /*&& histogramCropped*/)
 				histNeededC = true;
 			
-			if (dCurve && !dCurve->isIdentity())
+			if (fillCurveArray(cccurvePoints, satCurve, skip))
 				{needed = true;ccutili=true;}
 		}
 		if (histNeededC) {
@@ -547,19 +470,15 @@ void CurveFactory::curveToningLL ( bool & llctoningutili,const std::vector<doubl
 			}
 		}
 		
-		fillCurveArray(dCurve, satCurve, skip, needed);
-		if (dCurve) {
-			delete dCurve;
-			dCurve = NULL;
-		}
+		if (!needed)
+			fillCurveArray(NULL, satCurve, skip, false);
 		//----------------------------
 		needed = false;
 		if (!lccurvePoints.empty() && lccurvePoints[0]!=0) {
-			dCurve = new DiagonalCurve (lccurvePoints, CURVES_MIN_POLY_POINTS/skip);
 			if (outBeforeLCurveHistogram /*&& histogramCropped*/)
 				histNeededLC = true;
 			
-			if (dCurve && !dCurve->isIdentity())
+			if (fillCurveArray(lccurvePoints, lhskCurve, skip))
 				{needed = true;cclutili=true;}
 		}
 		if (histNeededLC) {
@@ -571,11 +490,8 @@ void CurveFactory::curveToningLL ( bool & llctoningutili,const std::vector<doubl
 		}
 		
 		
-		fillCurveArray(dCurve, lhskCurve, skip, needed);
-		if (dCurve) {
-			delete dCurve;
-			dCurve = NULL;
-		}
+		if (!needed)
+			fillCurveArray(NULL, lhskCurve, skip, false);
 		
 	}
 
@@ -627,106 +543,124 @@ void CurveFactory::curveToningLL ( bool & llctoningutili,const std::vector<doubl
 		// tone curve base. a: slope (from exp.comp.), b: black, def_mul: max. x value (can be>1), hr,sr: highlight,shadow recovery
 		//%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
 		
-		DiagonalCurve* brightcurve = NULL;
-
-		// check if brightness curve is needed
-		if (br>0.00001 || br<-0.00001) {
-
-			std::vector<double> brightcurvePoints;
-			brightcurvePoints.resize(9);
-			brightcurvePoints.at(0) = double(DCT_NURBS);
-
-			brightcurvePoints.at(1) = 0.; //black point.  Value in [0 ; 1] range
-			brightcurvePoints.at(2) = 0.; //black point.  Value in [0 ; 1] range
-			
-			if(br>0) {
-				brightcurvePoints.at(3) = 0.1; //toe point
-				brightcurvePoints.at(4) = 0.1+br/150.0; //value at toe point
-
-				brightcurvePoints.at(5) = 0.7; //shoulder point
-				brightcurvePoints.at(6) = min(1.0,0.7+br/300.0); //value at shoulder point
-			} else {
-				brightcurvePoints.at(3) = max(0.0,0.1-br/150.0); //toe point
-				brightcurvePoints.at(4) = 0.1; //value at toe point
-
-				brightcurvePoints.at(5) = 0.7-br/300.0; //shoulder point
-				brightcurvePoints.at(6) = 0.7; //value at shoulder point
-			}
-			brightcurvePoints.at(7) = 1.; // white point
-			brightcurvePoints.at(8) = 1.; // value at white point
-			
-			brightcurve = new DiagonalCurve (brightcurvePoints, CURVES_MIN_POLY_POINTS/skip);
-		}
-		//%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+		// all these LUTs but the contrasted one only depend on the parameters, they are taken from the curve cache when possible
+		CurveKey hlKey ("highlight compression");
+		hlKey << ecomp << hlcompr << hlcomprthresh;
+		CurveKey shKey ("shadow compression");
+		shKey << black << shcompr;
+		// key of dcurve, extended by the contrast and then by the inverse gamma for outCurve
+		CurveKey outKey ("tone curve");
+		outKey << gamma_ << br << skip;
 
 		hlCurve.setClip(LUT_CLIP_BELOW); // used LUT_CLIP_BELOW, because we want to have a baseline of 2^expcomp in this curve. If we don't clip the lut we get wrong values, see Issue 2621 #14 for details
-		float exp_scale = a;
-		float scale = 65536.0;
-		float comp = (max(0.0,ecomp) + 1.0)*hlcompr/100.0;
-		float shoulder = ((scale/max(1.0f,exp_scale))*(hlcomprthresh/200.0))+0.1;
-		//printf("shoulder = %e\n",shoulder);
-		//printf ("exp_scale= %f comp= %f def_mul=%f a= %f \n",exp_scale,comp,def_mul,a);
+		if (!curveCache.get (hlKey, hlCurve)) {
+			float exp_scale = a;
+			float scale = 65536.0;
+			float comp = (max(0.0,ecomp) + 1.0)*hlcompr/100.0;
+			float shoulder = ((scale/max(1.0f,exp_scale))*(hlcomprthresh/200.0))+0.1;
+			//printf("shoulder = %e\n",shoulder);
+			//printf ("exp_scale= %f comp= %f def_mul=%f a= %f \n",exp_scale,comp,def_mul,a);
 		
-		if (comp<=0.0f)
-			for (int i=0; i<0x10000; i++)
-				hlCurve[i]=exp_scale;
-		else {
-			for (int i=0; i<=shoulder; i++)
-				hlCurve[i]=exp_scale;
-			float scalemshoulder = scale - shoulder;
-
-			for (int i=shoulder+1; i<0x10000; i++) {
-				// change to [0,1] range
-				float val = (float)i-shoulder;
-				float R = val*comp/(scalemshoulder);
-				hlCurve[i] = xlog(1.0+R*exp_scale)/R; // don't use xlogf or 1.f here. Leads to errors caused by too low precision
+			if (comp<=0.0f)
+				for (int i=0; i<0x10000; i++)
+					hlCurve[i]=exp_scale;
+			else {
+				for (int i=0; i<=shoulder; i++)
+					hlCurve[i]=exp_scale;
+				float scalemshoulder = scale - shoulder;
+
+				for (int i=shoulder+1; i<0x10000; i++) {
+					// change to [0,1] range
+					float val = (float)i-shoulder;
+					float R = val*comp/(scalemshoulder);
+					hlCurve[i] = xlog(1.0+R*exp_scale)/R; // don't use xlogf or 1.f here. Leads to errors caused by too low precision
+				}
 			}
+			curveCache.put (hlKey, hlCurve);
 		}
 
-
 		// curve without contrast
 		LUTf dcurve(0x10000);
 
-		//%%%%%%%%%%%%%%%%%%%%%%%%%%
-		// change to [0,1] range
 		shCurve.setClip(LUT_CLIP_ABOVE); // used LUT_CLIP_ABOVE, because the curve converges to 1.0 at the upper end and we don't want to exceed this value.
-		float val = 1.f/65535.f;
-		float	val2 = simplebasecurve (val, black, 0.015*shcompr);
-		shCurve[0] = CLIPD(val2)/val;
-		val = 0.0;
-				// gamma correction
-		if (gamma_>1.)
-			val = gamma (val, gamma_, start, slope, mul, add);
-		
-		// apply brightness curve
-		if (brightcurve)
-			val = brightcurve->getVal (val);  // TODO: getVal(double) is very slow! Optimize with a LUTf
+		bool shCached = curveCache.get (shKey, shCurve);
+		bool dCached = curveCache.get (outKey, dcurve);
+		if (!shCached || !dCached) {
+			DiagonalCurve* brightcurve = NULL;
 
-		// store result in a temporary array
-		dcurve[0] = CLIPD(val);
+			// check if brightness curve is needed
+			if (br>0.00001 || br<-0.00001) {
 
-#pragma omp parallel for
-		for (int i=1; i<0x10000; i++) {
-			float val;
-				val = (float)i / 65535.0f;
+				std::vector<double> brightcurvePoints;
+				brightcurvePoints.resize(9);
+				brightcurvePoints.at(0) = double(DCT_NURBS);
+
+				brightcurvePoints.at(1) = 0.; //black point.  Value in [0 ; 1] range
+				brightcurvePoints.at(2) = 0.; //black point.  Value in [0 ; 1] range
 			
-			float	val2 = simplebasecurve (val, black, 0.015*shcompr);
-			shCurve[i] = CLIPD(val2)/val;
+				if(br>0) {
+					brightcurvePoints.at(3) = 0.1; //toe point
+					brightcurvePoints.at(4) = 0.1+br/150.0; //value at toe point
+
+					brightcurvePoints.at(5) = 0.7; //shoulder point
+					brightcurvePoints.at(6) = min(1.0,0.7+br/300.0); //value at shoulder point
+				} else {
+					brightcurvePoints.at(3) = max(0.0,0.1-br/150.0); //toe point
+					brightcurvePoints.at(4) = 0.1; //value at toe point
+
+					brightcurvePoints.at(5) = 0.7-br/300.0; //shoulder point
+					brightcurvePoints.at(6) = 0.7; //value at shoulder point
+				}
+				brightcurvePoints.at(7) = 1.; // white point
+				brightcurvePoints.at(8) = 1.; // value at white point
+			
+				brightcurve = new DiagonalCurve (brightcurvePoints, CURVES_MIN_POLY_POINTS/skip);
+			}
+			//%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
 
-			// gamma correction
+			// change to [0,1] range
+			float val = 1.f/65535.f;
+			float	val2 = simplebasecurve (val, black, 0.015*shcompr);
+			shCurve[0] = CLIPD(val2)/val;
+			val = 0.0;
+					// gamma correction
 			if (gamma_>1.)
 				val = gamma (val, gamma_, start, slope, mul, add);
-			
+		
 			// apply brightness curve
 			if (brightcurve)
 				val = brightcurve->getVal (val);  // TODO: getVal(double) is very slow! Optimize with a LUTf
 
 			// store result in a temporary array
-			dcurve[i] = CLIPD(val);
-		}
+			dcurve[0] = CLIPD(val);
 
-		if (brightcurve)
-			delete brightcurve;
+#pragma omp parallel for
+			for (int i=1; i<0x10000; i++) {
+				float val;
+					val = (float)i / 65535.0f;
+			
+				float	val2 = simplebasecurve (val, black, 0.015*shcompr);
+				shCurve[i] = CLIPD(val2)/val;
+
+				// gamma correction
+				if (gamma_>1.)
+					val = gamma (val, gamma_, start, slope, mul, add);
+			
+				// apply brightness curve
+				if (brightcurve)
+					val = brightcurve->getVal (val);  // TODO: getVal(double) is very slow! Optimize with a LUTf
+
+				// store result in a temporary array
+				dcurve[i] = CLIPD(val);
+			}
+
+			if (brightcurve)
+				delete brightcurve;
+			if (!shCached)
+				curveCache.put (shKey, shCurve);
+			if (!dCached)
+				curveCache.put (outKey, dcurve);
+		}
 
 		//%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
 		
@@ -751,51 +685,48 @@ void CurveFactory::curveToningLL ( bool & llctoningutili,const std::vector<doubl
 			//sqavg /= sum;
 			//double stddev = sqrt(sqavg-avg*avg);
 			
-			//%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
-			std::vector<double> contrastcurvePoints;
-			contrastcurvePoints.resize(9);
-			contrastcurvePoints.at(0) = double(DCT_NURBS);
+			outKey << contr << (double)avg;
+			if (!curveCache.get (outKey, dcurve)) {
+				//%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+				std::vector<double> contrastcurvePoints;
+				contrastcurvePoints.resize(9);
+				contrastcurvePoints.at(0) = double(DCT_NURBS);
 			
-			contrastcurvePoints.at(1) = 0; //black point.  Value in [0 ; 1] range
-			contrastcurvePoints.at(2) = 0; //black point.  Value in [0 ; 1] range
+				contrastcurvePoints.at(1) = 0; //black point.  Value in [0 ; 1] range
+				contrastcurvePoints.at(2) = 0; //black point.  Value in [0 ; 1] range
 			
-			contrastcurvePoints.at(3) = avg-avg*(0.6-contr/250.0); //toe point
-			contrastcurvePoints.at(4) = avg-avg*(0.6+contr/250.0); //value at toe point
+				contrastcurvePoints.at(3) = avg-avg*(0.6-contr/250.0); //toe point
+				contrastcurvePoints.at(4) = avg-avg*(0.6+contr/250.0); //value at toe point
 			
-			contrastcurvePoints.at(5) = avg+(1-avg)*(0.6-contr/250.0); //shoulder point
-			contrastcurvePoints.at(6) = avg+(1-avg)*(0.6+contr/250.0); //value at shoulder point
+				contrastcurvePoints.at(5) = avg+(1-avg)*(0.6-contr/250.0); //shoulder point
+				contrastcurvePoints.at(6) = avg+(1-avg)*(0.6+contr/250.0); //value at shoulder point
 			
-			contrastcurvePoints.at(7) = 1.; // white point
-			contrastcurvePoints.at(8) = 1.; // value at white point
+				contrastcurvePoints.at(7) = 1.; // white point
+				contrastcurvePoints.at(8) = 1.; // value at white point
 			
-			DiagonalCurve* contrastcurve = new DiagonalCurve (contrastcurvePoints, CURVES_MIN_POLY_POINTS/skip);
-			//%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
-			// apply contrast enhancement
-			for (int i=0; i<=0xffff; i++) {
-				dcurve[i]  = contrastcurve->getVal (dcurve[i]);
-			}
+				DiagonalCurve* contrastcurve = new DiagonalCurve (contrastcurvePoints, CURVES_MIN_POLY_POINTS/skip);
+				//%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+				// apply contrast enhancement
+				for (int i=0; i<=0xffff; i++) {
+					dcurve[i]  = contrastcurve->getVal (dcurve[i]);
+				}
 
-			delete contrastcurve;
+				delete contrastcurve;
+				curveCache.put (outKey, dcurve);
+			}
 		}
 
 		//%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
 
 		// create second curve if needed
 		bool histNeeded = false;
-		DiagonalCurve* tcurve = NULL;
 		customToneCurve2.Reset();
 
 		if (!curvePoints2.empty() && curvePoints2[0]>DCT_Linear && curvePoints2[0]<DCT_Unchanged) {
-			tcurve = new DiagonalCurve (curvePoints2, CURVES_MIN_POLY_POINTS/skip);
+			customToneCurve2.Set(curvePoints2, skip);
 			if (outBeforeCCurveHistogram /*&& histogramCropped*/)
 				histNeeded = true;
 		}
-		if (tcurve) {
-			if (!tcurve->isIdentity())
-				customToneCurve2.Set(tcurve);
-			delete tcurve;
-			tcurve = NULL;
-		}
 
 		//%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
 
@@ -805,16 +736,10 @@ void CurveFactory::curveToningLL ( bool & llctoningutili,const std::vector<doubl
 		customToneCurve1.Reset();
 
 		if (!curvePoints.empty() && curvePoints[0]>DCT_Linear && curvePoints[0]<DCT_Unchanged) {
-			tcurve = new DiagonalCurve (curvePoints, CURVES_MIN_POLY_POINTS/skip);
+			customToneCurve1.Set(curvePoints, skip);
 			if (outBeforeCCurveHistogram /*&& histogramCropped*/)
 				histNeeded = true;
 		}
-		if (tcurve) {
-			if (!tcurve->isIdentity())
-				customToneCurve1.Set(tcurve);
-			delete tcurve;
-			tcurve = NULL;
-		}
 		//%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
 
 		// create curve bw
@@ -859,10 +784,8 @@ void CurveFactory::curveToningLL ( bool & llctoningutili,const std::vector<doubl
 	*/	
 		//%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
 
-		for (int i=0; i<=0xffff; i++) {
-			float val = dcurve[i];
-
-			if (histNeeded) {
+		if (histNeeded) {
+			for (int i=0; i<=0xffff; i++) {
 				float fi=i;
 				float hval = hlCurve[i]*fi;
 				hval = dcurve[shCurve[hval]*hval];
@@ -871,15 +794,21 @@ void CurveFactory::curveToningLL ( bool & llctoningutili,const std::vector<doubl
 				int hi = (int)(255.0*(hval));
 				outBeforeCCurveHistogram[hi] += histogram/*Cropped*/[i] ;
 			}
+		}
 
-			// if inverse gamma is needed, do it (standard sRGB inverse gamma is applied)
-			if (needigamma)
-				val = igamma (val, gamma_, start, slope, mul, add);
+		outKey << (int)needigamma;
+		if (!curveCache.get (outKey, outCurve)) {
+			for (int i=0; i<=0xffff; i++) {
+				float val = dcurve[i];
 
-			outCurve[i] = (65535.f * val);
-		}
+				// if inverse gamma is needed, do it (standard sRGB inverse gamma is applied)
+				if (needigamma)
+					val = igamma (val, gamma_, start, slope, mul, add);
 
-		if (tcurve) delete tcurve;
+				outCurve[i] = (65535.f * val);
+			}
+			curveCache.put (outKey, outCurve);
+		}
 
 		/*if (outBeforeCCurveHistogram) {
 			for (int i=0; i<256; i++) printf("i= %d bchist= %d \n",i,outBeforeCCurveHistogram[i]);
@@ -1091,7 +1020,11 @@ void CurveFactory::curveToningLL ( bool & llctoningutili,const std::vector<doubl
 						
 		// create a curve if needed
 		DiagonalCurve* tcurve = NULL;
+		CurveKey key ("rgb");
+		key << curvePoints << skip;
 		if (!curvePoints.empty() && curvePoints[0]!=0) {
+			if (curveCache.get (key, outCurve))
+				return;
 			tcurve = new DiagonalCurve (curvePoints, CURVES_MIN_POLY_POINTS/skip);
 		}
 		if (tcurve && tcurve->isIdentity()) {
@@ -1108,6 +1041,7 @@ void CurveFactory::curveToningLL ( bool & llctoningutili,const std::vector<doubl
 				outCurve[i] = (65536.0f * val);
 			}
 			delete tcurve;
+			curveCache.put (key, outCurve);
 		}
 		// let the LUTf empty for identity curves
 		else {
@@ -1127,6 +1061,21 @@ void ColorAppearance::Set(Curve *pCurve) {
     for (int i=0; i<65536; i++) lutColCurve[i] = pCurve->getVal(double(i)/65535.) * 65535.;
 }
 
+void ColorAppearance::Set(const std::vector<double>& curvePoints, int skip) {
+    // same LUT as ToneCurve, hence the same kind of key
+    CurveKey key ("tone");
+    key << curvePoints << skip;
+    if (curveCache.get (key, lutColCurve))
+        return;
+    DiagonalCurve tcurve (curvePoints, CURVES_MIN_POLY_POINTS/skip);
+    if (tcurve.isIdentity()) {
+        Reset();
+        return;
+    }
+    Set (&tcurve);
+    curveCache.put (key, lutColCurve);
+}
+
 void ToneCurve::Reset() {
     lutToneCurve.reset();
 }
@@ -1137,6 +1086,20 @@ void ToneCurve::Set(Curve *pCurve) {
     for (int i=0; i<65536; i++) lutToneCurve[i] = pCurve->getVal(double(i)/65535.) * 65535.;
 }
 
+void ToneCurve::Set(const std::vector<double>& curvePoints, int skip) {
+    CurveKey key ("tone");
+    key << curvePoints << skip;
+    if (curveCache.get (key, lutToneCurve))
+        return;
+    DiagonalCurve tcurve (curvePoints, CURVES_MIN_POLY_POINTS/skip);
+    if (tcurve.isIdentity()) {
+        Reset();
+        return;
+    }
+    Set (&tcurve);
+    curveCache.put (key, lutToneCurve);
+}
+
 void OpacityCurve::Reset() {
 	lutOpacityCurve.reset();
 }
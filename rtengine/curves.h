@@ -346,6 +346,8 @@ class ToneCurve {
 
     void Reset();
     void Set(Curve *pCurve);
+    // same as above for the diagonal curve of curvePoints, taken from the curve cache if possible; reset if it is the identity
+    void Set(const std::vector<double>& curvePoints, int skip);
     operator bool (void) const { return lutToneCurve; }
 };
 
@@ -475,6 +477,8 @@ class ColorAppearance {
 
     void Reset();
     void Set(Curve *pCurve);
+    // same as above for the diagonal curve of curvePoints, taken from the curve cache if possible; reset if it is the identity
+    void Set(const std::vector<double>& curvePoints, int skip);
     operator bool (void) const { return lutColCurve; }
 };
 
@@ -25,6 +25,7 @@
 #include "rawimagesource.h"
 #include "improcfun.h"
 #include "rt_math.h"
+#include "myfile.h"
 
 using namespace std;
 using namespace rtengine;
@@ -475,7 +476,7 @@ DCPProfile::DCPProfile(Glib::ustring fname, bool isRTProfile) {
 
     aDeltas1=aDeltas2=aLookTable=NULL;
 
-    FILE *pFile = safe_g_fopen(fname, "rb");
+    IMFILE *pFile = gfopen(fname.c_str());
 
     TagDirectory *tagDir=ExifManager::parseTIFF(pFile, false);
 
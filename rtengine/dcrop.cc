@@ -33,7 +33,7 @@ extern const Settings* settings;
 Crop::Crop (ImProcCoordinator* parent, EditDataProvider *editDataProvider, bool isDetailWindow)
     : EditBuffer(editDataProvider), origCrop(NULL), laboCrop(NULL), labnCrop(NULL),
       cropImg(NULL), cbuf_real(NULL), cshmap(NULL), transCrop(NULL), cieCrop(NULL), cbuffer(NULL),
-      updating(false), newUpdatePending(false), skip(10),
+      updating(false), newUpdatePending(false), cancelFlag(&parent->obsolete), pendingTodo(0), skip(10),
       cropx(0), cropy(0), cropw(-1), croph(-1),
       trafx(0), trafy(0), trafw(-1), trafh(-1),
       rqcropx(0), rqcropy(0), rqcropw(-1), rqcroph(-1),
@@ -113,6 +113,10 @@ void Crop::update (int todo) {
     ProcParams& params = parent->params;
  //       CropGUIListener* cropgl;
 
+    // stages of a cancelled update have to be done too
+    todo |= pendingTodo;
+    pendingTodo = 0;
+
     // No need to update todo here, since it has already been changed in ImprocCoordinator::updatePreviewImage,
     // and Crop::update ask to do ALL anyway
 
@@ -153,6 +157,9 @@ void Crop::update (int todo) {
 
         if (!needsinitupdate)
             setCropSizes (rqcropx, rqcropy, rqcropw, rqcroph, skip, true);
+
+        // below 100%, the color converted image is read from the parent's pyramid instead of being rendered for this crop
+        bool fromPyramid = parent->getPyramidRegion (origCrop, tr, PreviewProps (trafx, trafy, trafw*skip, trafh*skip, skip));
 			
 		//	printf("x=%d y=%d crow=%d croh=%d skip=%d\n",rqcropx, rqcropy, rqcropw, rqcroph, skip);
 		//	printf("trafx=%d trafyy=%d trafwsk=%d trafHs=%d \n",trafx, trafy, trafw*skip, trafh*skip);
@@ -199,18 +206,21 @@ void Crop::update (int todo) {
 		if(settings->leveldnautsimpl==1){
 			if(params.dirpyrDenoise.Cmethod=="MAN" || params.dirpyrDenoise.Cmethod=="PON" )  {
 				PreviewProps pp (trafx, trafy, trafw*skip, trafh*skip, skip);
-				parent->imgsrc->getImage (parent->currWB, tr, origCrop, pp, params.toneCurve, params.icm, params.raw );
+				if (!fromPyramid)
+					parent->imgsrc->getImage (parent->currWB, tr, origCrop, pp, params.toneCurve, params.icm, params.raw );
 			}
 		} else {
 			if(params.dirpyrDenoise.C2method=="MANU")  {
 				PreviewProps pp (trafx, trafy, trafw*skip, trafh*skip, skip);
-				parent->imgsrc->getImage (parent->currWB, tr, origCrop, pp, params.toneCurve, params.icm, params.raw );
+				if (!fromPyramid)
+					parent->imgsrc->getImage (parent->currWB, tr, origCrop, pp, params.toneCurve, params.icm, params.raw );
 			}
 		}
 
 		if((settings->leveldnautsimpl==1 && params.dirpyrDenoise.Cmethod=="PRE") || (settings->leveldnautsimpl==0 && params.dirpyrDenoise.C2method=="PREV")) {
 			PreviewProps pp (trafx, trafy, trafw*skip, trafh*skip, skip);
-			parent->imgsrc->getImage (parent->currWB, tr, origCrop, pp, params.toneCurve, params.icm, params.raw );
+			if (!fromPyramid)
+				parent->imgsrc->getImage (parent->currWB, tr, origCrop, pp, params.toneCurve, params.icm, params.raw );
 			if((!isDetailWindow) && parent->adnListener && skip==1 && params.dirpyrDenoise.enabled) {
 				float lowdenoise=1.f;
 				int levaut=settings->leveldnaut;
@@ -480,7 +490,8 @@ void Crop::update (int todo) {
 	//	if(params.dirpyrDenoise.Cmethod=="AUT" || params.dirpyrDenoise.Cmethod=="PON") {//reinit origCrop after Auto
 		if((settings->leveldnautsimpl==1 && params.dirpyrDenoise.Cmethod=="AUT")  || (settings->leveldnautsimpl==0 && params.dirpyrDenoise.C2method=="AUTO")) {//reinit origCrop after Auto
 			PreviewProps pp (trafx, trafy, trafw*skip, trafh*skip, skip);
-			parent->imgsrc->getImage (parent->currWB, tr, origCrop, pp, params.toneCurve, params.icm, params.raw );
+			if (!fromPyramid)
+				parent->imgsrc->getImage (parent->currWB, tr, origCrop, pp, params.toneCurve, params.icm, params.raw );
 		}
 		DirPyrDenoiseParams denoiseParams = params.dirpyrDenoise;
 
@@ -515,7 +526,7 @@ void Crop::update (int todo) {
 				int kall=0;
 
 				float chaut, redaut, blueaut, maxredaut, maxblueaut, nresi, highresi;
-                parent->ipf.RGB_denoise(kall, origCrop, origCrop, calclum, ch_M, max_r, max_b, parent->imgsrc->isRAW(), /*Roffset,*/ denoiseParams, parent->imgsrc->getDirPyrDenoiseExpComp(), noiseLCurve, noiseCCurve, chaut, redaut, blueaut, maxredaut, maxblueaut, nresi, highresi);
+                parent->ipf.RGB_denoise(kall, origCrop, origCrop, calclum, ch_M, max_r, max_b, parent->imgsrc->isRAW(), /*Roffset,*/ denoiseParams, parent->imgsrc->getDirPyrDenoiseExpComp(), noiseLCurve, noiseCCurve, chaut, redaut, blueaut, maxredaut, maxblueaut, nresi, highresi, cancelFlag);
 				if (parent->adnListener) parent->adnListener->noiseChanged(nresi, highresi);	
 				if (settings->leveldnautsimpl == 1) {
 					if ((denoiseParams.Cmethod == "AUT" || denoiseParams.Cmethod == "PRE") && (parent->adnListener)) // force display value of sliders
@@ -527,7 +538,8 @@ void Crop::update (int todo) {
 				
 			}
 		}	
-        parent->imgsrc->convertColorSpace(origCrop, params.icm, parent->currWB, params.raw);
+        if (!fromPyramid)
+            parent->imgsrc->convertColorSpace(origCrop, params.icm, parent->currWB, params.raw);
 
 	delete [] ch_M;
 	delete [] max_r;
@@ -544,6 +556,11 @@ void Crop::update (int todo) {
 		
 	}
 
+    if (*cancelFlag) {
+        pendingTodo |= todo;
+        return;
+    }
+
     // has to be called after setCropSizes! Tools prior to this point can't handle the Edit mechanism, but that shouldn't be a problem.
     createBuffer(cropw, croph);
 
@@ -576,6 +593,11 @@ void Crop::update (int todo) {
             cshmap->forceStat (parent->shmap->max_f, parent->shmap->min_f, parent->shmap->avg);
     }
 
+    if (*cancelFlag) {
+        pendingTodo |= todo;
+        return;
+    }
+
     // shadows & highlights & tone curve & convert to cielab
     /*int xref,yref;
     xref=000;yref=000;
@@ -626,6 +648,11 @@ void Crop::update (int todo) {
         }
     }*/
 
+    if (*cancelFlag) {
+        pendingTodo |= todo;
+        return;
+    }
+
     // apply luminance operations
     if (todo & (M_LUMINANCE+M_COLOR)) {
         //I made a little change here. Rather than have luminanceCurve (and others) use in/out lab images, we can do more if we copy right here.
@@ -723,7 +750,7 @@ void Crop::update (int todo) {
 			
 			params.wavelet.getCurves(wavCLVCurve, waOpacityCurveRG, waOpacityCurveBY);
 
-			parent->ipf.ip_wavelet(labnCrop, labnCrop, kall, WaveParams, wavCLVCurve, waOpacityCurveRG, waOpacityCurveBY, skip);
+			parent->ipf.ip_wavelet(labnCrop, labnCrop, kall, WaveParams, wavCLVCurve, waOpacityCurveRG, waOpacityCurveBY, skip, cancelFlag);
 		}
 
 		//     }
@@ -771,6 +798,11 @@ void Crop::update (int todo) {
         }
     }
 
+    if (*cancelFlag) {
+        pendingTodo |= todo;
+        return;
+    }
+
     // all pipette buffer processing should be finished now
     EditBuffer::setReady();
 
@@ -1026,6 +1058,9 @@ void Crop::fullUpdate () {
     if (parent->plistener)
         parent->plistener->setProgressState (true);
 
+    // a new request makes the running update obsolete
+    cancelFlag = &newUpdatePending;
+
     // If there are more update request, the following WHILE will collect it
     newUpdatePending = true;
     while (newUpdatePending) {
@@ -1034,6 +1069,8 @@ void Crop::fullUpdate () {
     }
     updating = false;  // end of crop update
 
+    cancelFlag = &parent->obsolete;
+
     if (parent->plistener)
         parent->plistener->setProgressState (false);
     parent->updaterThreadStart.unlock ();
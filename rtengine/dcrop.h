@@ -53,7 +53,9 @@ class Crop : public DetailedCrop, public EditBuffer {
         float**      cbuffer;
 
         bool updating;         /// Flag telling if an updater thread is currently processing
-        bool newUpdatePending; /// Flag telling the updater thread that a new update is pending
+        volatile bool newUpdatePending; /// Flag telling the updater thread that a new update is pending
+        const volatile bool* cancelFlag; /// Flag cancelling the running update: parent->obsolete, or newUpdatePending in fullUpdate
+        int pendingTodo;       /// Stages left undone by a cancelled update, they are added to the next update
         int skip;
         int cropx, cropy, cropw, croph;         /// size of the detail crop image ('skip' taken into account), with border
         int trafx, trafy, trafw, trafh;         /// the size and position to get from the imagesource that is transformed to the requested crop area
@@ -80,6 +82,8 @@ class Crop : public DetailedCrop, public EditBuffer {
         void setEditSubscriber(EditSubscriber* newSubscriber);
         bool hasListener () { return cropImageListener; }
         void update      (int todo);
+        /** @brief Schedules the given stages for the next update, used when an update is cancelled */
+        void postponeUpdate (int todo) { pendingTodo |= todo; }
         void setWindow   (int cx, int cy, int cw, int ch, int skip) { setCropSizes (cx, cy, cw, ch, skip, false); }
 
         /** @brief Synchronously look out if a full update is necessary
@@ -40,6 +40,9 @@
 #ifdef _OPENMP
 #include <omp.h>
 #endif
+#ifndef WIN32
+#include <unistd.h>
+#endif
 
 using namespace std;
 
@@ -3431,9 +3434,43 @@ void RawImageSource::cielab (const float (*rgb)[3], float* l, float* a, float *b
 		return;
 	}
 
-	int rgbOffset = (width - labWidth);
+#ifdef __SSE2__
+	vfloat zerov = ZEROV;
+	vfloat maxvalv = F2V(65535.f);
+	vfloat c116v = F2V(116.f);
+	vfloat c16v = F2V(16.f);
+	vfloat c500v = F2V(500.f);
+	vfloat c200v = F2V(200.f);
+	vfloat xyz_camv[3][3];
+	for(int i=0;i<3;i++)
+		for(int j=0;j<3;j++)
+			xyz_camv[i][j] = F2V(xyz_cam[i][j]);
+#endif
 	for(int i=0;i<height;i++) {
-		for(int j=0;j<labWidth;j++) {
+		int j=0;
+#ifdef __SSE2__
+		for(;j<labWidth-3;j+=4) {
+			vfloat redv, greenv, bluev;
+			vconvertrgbrgbrgbrgb2rrrrggggbbbb(rgb[i*width+j], redv, greenv, bluev);
+			vfloat xyzv[3];
+			int idx[3][4];
+			for(int k=0;k<3;k++) {
+				// same order of operations as below, the first component starting at 0.5f
+				xyzv[k] = xyz_camv[k][0] * redv;
+				if(k==0)
+					xyzv[k] = F2V(0.5f) + xyzv[k];
+				xyzv[k] += xyz_camv[k][1] * greenv;
+				xyzv[k] += xyz_camv[k][2] * bluev;
+				// clipping before the truncation gives the same index as CLIP((int) x)
+				_mm_storeu_si128((__m128i*)idx[k], _mm_cvttps_epi32(vminf(vmaxf(xyzv[k], zerov), maxvalv)));
+				xyzv[k] = _mm_setr_ps(cbrt[idx[k][0]], cbrt[idx[k][1]], cbrt[idx[k][2]], cbrt[idx[k][3]]);
+			}
+			_mm_storeu_ps(&l[i*labWidth+j], c116v * xyzv[1] - c16v);
+			_mm_storeu_ps(&a[i*labWidth+j], c500v * (xyzv[0] - xyzv[1]));
+			_mm_storeu_ps(&b[i*labWidth+j], c200v * (xyzv[1] - xyzv[2]));
+		}
+#endif
+		for(;j<labWidth;j++) {
 			float xyz[3] = {0.5f};
 			int c;
 			FORC3 {
@@ -3500,6 +3537,20 @@ void RawImageSource::xtransborder_interpolate (int border)
 
 #define TS 122		/* Tile Size */
 
+// Size of the tiles of xtrans_interpolate, the buffers of a tile (TS*TS*(ndir*3+11) floats at most) fitting in the L2 cache.
+// The buffers keep the stride TS, only the part of them used by a smaller tile is touched.
+static int xtransTileSize (int ndir)
+{
+	long l2size = 0;
+#ifdef _SC_LEVEL2_CACHE_SIZE
+	l2size = sysconf (_SC_LEVEL2_CACHE_SIZE);
+#endif
+	if (l2size <= 0)
+		return TS;	// unknown, keep the tile size the algorithm was tuned with
+	int tileSize = sqrt ((double)l2size / ((ndir*3+11)*sizeof(float)));
+	return LIM(tileSize, 64, TS);
+}
+
 void RawImageSource::xtrans_interpolate (int passes, bool useCieLab)
 {
 	double progress = 0.0;
@@ -3577,8 +3628,11 @@ void RawImageSource::xtrans_interpolate (int passes, bool useCieLab)
 	} 
 
 
-	double progressInc = 36.0*(1.0-progress)/((H*W)/((TS-16)*(TS-16)));
 	const int ndir = 4 << (passes > 1);
+	const int tileSize = xtransTileSize (ndir);
+	double progressInc = 36.0*(1.0-progress)/((H*W)/((tileSize-16)*(tileSize-16)));
+	if (settings->verbose)
+		printf("X-Trans interpolation using tiles of %d x %d\n", tileSize, tileSize);
 	cielab (0,0,0,0,0,0,0,0);
 	struct s_minmaxgreen {
 		float min;
@@ -3616,12 +3670,19 @@ void RawImageSource::xtrans_interpolate (int passes, bool useCieLab)
 	homo = (uint8_t  (*)[TS][TS])   (lab); // we can reuse the lab-buffer because they are not used together
 	greenminmaxtile = (s_minmaxgreen(*)[TS]) (lab); // we can reuse the lab-buffer because they are not used together
 	homosum = (uint8_t (*)[TS][TS]) (drv); // we can reuse the drv-buffer because they are not used together
+#ifdef __SSE2__
+	vfloat twov = F2V(2.f);
+	vfloat eightv = F2V(8.f);
+	vfloat onev = F2V(1.f);
+	vmask zerov = _mm_setzero_si128();
+	uint8_t colsum[TS+16];
+#endif
 
 #pragma omp for collapse(2)	schedule(dynamic) nowait
-	for (int top=3; top < height-19; top += TS-16)
-		for (int left=3; left < width-19; left += TS-16) {
-			int mrow = MIN (top+TS, height-3);
-			int mcol = MIN (left+TS, width-3);
+	for (int top=3; top < height-19; top += tileSize-16)
+		for (int left=3; left < width-19; left += tileSize-16) {
+			int mrow = MIN (top+tileSize, height-3);
+			int mcol = MIN (left+tileSize, width-3);
 			memset(rgb,0,TS*TS*3*sizeof(float));
 			for (int row=top; row < mrow; row++)
 				for (int col=left; col < mcol; col++) {
@@ -3808,8 +3869,21 @@ void RawImageSource::xtrans_interpolate (int passes, bool useCieLab)
 					cielab(&rgb[d][4][4],l,a,b,TS,mrow-8,TS-8,xyz_cam);
 					int f = dir[d & 3];
 					f = f == 1 ? 1 : f-8;
-					for (int row=5; row < mrow-5; row++)
-						for (int col=5; col < mcol-5; col++) {
+					for (int row=5; row < mrow-5; row++) {
+						int col=5;
+#ifdef __SSE2__
+						for (; col < mcol-8; col+=4) {
+							float *l = &lab[0][row-4][col-4];
+							float *a = &lab[1][row-4][col-4];
+							float *b = &lab[2][row-4][col-4];
+
+							vfloat gv = twov*LVFU(l[0]) - LVFU(l[f]) - LVFU(l[-f]);
+							vfloat av = twov*LVFU(a[0]) - LVFU(a[f]) - LVFU(a[-f]) + gv*F2V(2.1551724f);
+							vfloat bv = twov*LVFU(b[0]) - LVFU(b[f]) - LVFU(b[-f]) - gv*F2V(0.86206896f);
+							_mm_storeu_ps(&drv[d][row-5][col-5], SQRV(gv) + SQRV(av) + SQRV(bv));
+						}
+#endif
+						for (; col < mcol-5; col++) {
 							float *l = &lab[0][row-4][col-4];
 							float *a = &lab[1][row-4][col-4];
 							float *b = &lab[2][row-4][col-4];
@@ -3819,6 +3893,7 @@ void RawImageSource::xtrans_interpolate (int passes, bool useCieLab)
 												+ SQR((2*a[0] - a[f] - a[-f] + g*2.1551724f))
 												+ SQR((2*b[0] - b[f] - b[-f] - g*0.86206896f));
 						}
+					}
 
 				}
 			} else {
@@ -3828,8 +3903,23 @@ void RawImageSource::xtrans_interpolate (int passes, bool useCieLab)
 				// 
 				for (d=0; d < ndir; d++) {
 					float (*yuv)[TS-8][TS-8] = lab; // we use the lab buffer, which has the same dimensions
-					for (int row=4; row < mrow-4; row++)
-						for (int col=4; col < mcol-4; col++) {
+#ifdef __SSE2__
+					vfloat c1v = F2V(0.2627f), c2v = F2V(0.6780f), c3v = F2V(0.0593f);
+					vfloat pbv = F2V(0.56433f), prv = F2V(0.67815f);
+#endif
+					for (int row=4; row < mrow-4; row++) {
+						int col=4;
+#ifdef __SSE2__
+						for (; col < mcol-7; col+=4) {
+							vfloat redv, greenv, bluev;
+							vconvertrgbrgbrgbrgb2rrrrggggbbbb(rgb[d][row][col], redv, greenv, bluev);
+							vfloat yv = c1v * redv + c2v * greenv + c3v * bluev;
+							_mm_storeu_ps(&yuv[0][row-4][col-4], yv);
+							_mm_storeu_ps(&yuv[1][row-4][col-4], (bluev-yv)*pbv);
+							_mm_storeu_ps(&yuv[2][row-4][col-4], (redv-yv)*prv);
+						}
+#endif
+						for (; col < mcol-4; col++) {
 							// use ITU-R BT.2020 YPbPr, which is great, but could use
 							// a better/simpler choice? note that imageop.h provides
 							// dt_iop_RGB_to_YCbCr which uses Rec. 601 conversion,
@@ -3839,24 +3929,56 @@ void RawImageSource::xtrans_interpolate (int passes, bool useCieLab)
 							yuv[1][row-4][col-4] = (rgb[d][row][col][2]-y)*0.56433f;
 							yuv[2][row-4][col-4] = (rgb[d][row][col][0]-y)*0.67815f;
 						}
+					}
 					int f=dir[d & 3];
 					f = f == 1 ? 1 : f-8;
-					for (int row=5; row < mrow-5; row++)
-						for (int col=5; col < mcol-5; col++) {
+					for (int row=5; row < mrow-5; row++) {
+						int col=5;
+#ifdef __SSE2__
+						for (; col < mcol-8; col+=4) {
+							float *y = &yuv[0][row-4][col-4];
+							float *u = &yuv[1][row-4][col-4];
+							float *v = &yuv[2][row-4][col-4];
+							_mm_storeu_ps(&drv[d][row-5][col-5], SQRV(twov*LVFU(y[0]) - LVFU(y[f]) - LVFU(y[-f]))
+												 + SQRV(twov*LVFU(u[0]) - LVFU(u[f]) - LVFU(u[-f]))
+												 + SQRV(twov*LVFU(v[0]) - LVFU(v[f]) - LVFU(v[-f])));
+						}
+#endif
+						for (; col < mcol-5; col++) {
 							float *y = &yuv[0][row-4][col-4];
 							float *u = &yuv[1][row-4][col-4];
 							float *v = &yuv[2][row-4][col-4];
 							drv[d][row-5][col-5] = SQR(2*y[0] - y[f] - y[-f])
 												 + SQR(2*u[0] - u[f] - u[-f])
 												 + SQR(2*v[0] - v[f] - v[-f]);
-					  }
+						}
+					}
 				}
 			}
 
 /* Build homogeneity maps from the derivatives:			*/
 			memset(homo, 0, ndir*TS*TS*sizeof(uint8_t));
-			for (int row=6; row < mrow-6; row++)
-				for (int col=6; col < mcol-6; col++) {
+			for (int row=6; row < mrow-6; row++) {
+				int col=6;
+#ifdef __SSE2__
+				for (; col < mcol-9; col+=4) {
+					vfloat trv = LVFU(drv[0][row-5][col-5]);
+					for (d=1; d < ndir; d++)
+						trv = vminf(trv, LVFU(drv[d][row-5][col-5]));
+					trv *= eightv;
+					for (d=0; d < ndir; d++) {
+						// the masks are -1 where the condition is true
+						vmask countv = zerov;
+						for (v=-1; v <= 1; v++)
+							for (h=-1; h <= 1; h++)
+								countv = _mm_sub_epi32(countv, vmaskf_le(LVFU(drv[d][row+v-5][col+h-5]), trv));
+						countv = _mm_packs_epi32(countv, countv);
+						int count4 = _mm_cvtsi128_si32(_mm_packus_epi16(countv, countv));
+						memcpy(&homo[d][row][col], &count4, 4);
+					}
+				}
+#endif
+				for (; col < mcol-6; col++) {
 					for (tr=FLT_MAX, d=0; d < ndir; d++)
 						tr = (drv[d][row-5][col-5] < tr ? drv[d][row-5][col-5] : tr);
 					tr *= 8;
@@ -3865,18 +3987,40 @@ void RawImageSource::xtrans_interpolate (int passes, bool useCieLab)
 							for (h=-1; h <= 1; h++)
 								homo[d][row][col] += (drv[d][row+v-5][col+h-5] <= tr ? 1:0) ;
 				}
+			}
 
-			if (height-top < TS+4)
+			if (height-top < tileSize+4)
 				mrow = height-top+2;
-			if (width-left < TS+4)
+			if (width-left < tileSize+4)
 				mcol = width-left+2;
 
 
 /* Build 5x5 sum of homogeneity maps */
 			for(d=0;d<ndir;d++) {
 				for (int row = MIN(top,8); row < mrow-8; row++) {
-					int v5sum[5] = {0};
 					const int startcol = MIN(left,8);
+#ifdef __SSE2__
+					// sums of 5 rows and then of 5 columns, 16 pixels at a time. They fit in 8 bits, homo being at most 9
+					for (int col = startcol-2; col < mcol-6; col+=16) {
+						vmask sumv = _mm_loadu_si128((vmask*)&homo[d][row-2][col]);
+						for(v=-1;v<=2;v++)
+							sumv = _mm_add_epi8(sumv, _mm_loadu_si128((vmask*)&homo[d][row+v][col]));
+						_mm_storeu_si128((vmask*)&colsum[col-startcol+2], sumv);
+					}
+					int col = startcol;
+					for (; col < mcol-8-15; col+=16) {
+						uint8_t *cs = &colsum[col-startcol];
+						vmask sumv = _mm_loadu_si128((vmask*)cs);
+						for(h=1;h<=4;h++)
+							sumv = _mm_add_epi8(sumv, _mm_loadu_si128((vmask*)&cs[h]));
+						_mm_storeu_si128((vmask*)&homosum[d][row][col], sumv);
+					}
+					for (; col < mcol-8; col++) {
+						uint8_t *cs = &colsum[col-startcol];
+						homosum[d][row][col] = cs[0] + cs[1] + cs[2] + cs[3] + cs[4];
+					}
+#else
+					int v5sum[5] = {0};
 					for(v=-2;v<=2;v++)
 						for(h=-2;h<=2;h++)
 							v5sum[2+h] += homo[d][row+v][startcol+h];
@@ -3895,12 +4039,49 @@ void RawImageSource::xtrans_interpolate (int passes, bool useCieLab)
 						v5sum[voffset] = colsum;
 						homosum[d][row][col] = blocksum;
 					}
+#endif
 				}
 			}
 
 /* Average the most homogenous pixels for the final result:	*/
-			for (int row = MIN(top,8); row < mrow-8; row++)
-				for (int col = MIN(left,8); col < mcol-8; col++) {
+			for (int row = MIN(top,8); row < mrow-8; row++) {
+				int col = MIN(left,8);
+#ifdef __SSE2__
+				for (; col < mcol-11; col+=4) {
+					// 16 bits per pixel, only the lower 4 are used
+					vmask hmv[8];
+					vmask maxvalv = zerov;
+					for (d=0; d < ndir; d++) {
+						int hm4;
+						memcpy(&hm4, &homosum[d][row][col], 4);
+						hmv[d] = _mm_unpacklo_epi8(_mm_cvtsi32_si128(hm4), zerov);
+						maxvalv = _mm_max_epi16(maxvalv, hmv[d]);
+					}
+					for (d=4; d < ndir; d++) {
+						vmask ltv = _mm_cmplt_epi16(hmv[d-4], hmv[d]);
+						vmask gtv = _mm_cmpgt_epi16(hmv[d-4], hmv[d]);
+						hmv[d-4] = _mm_andnot_si128(ltv, hmv[d-4]);
+						hmv[d] = _mm_andnot_si128(gtv, hmv[d]);
+					}
+					maxvalv = _mm_sub_epi16(maxvalv, _mm_srli_epi16(maxvalv, 3));
+					vfloat avgv[4] = {ZEROV, ZEROV, ZEROV, ZEROV};
+					for (d=0; d < ndir; d++) {
+						vmask selv = _mm_cmplt_epi16(hmv[d], maxvalv);
+						// widen to 32 bits and invert to get hm[d] >= maxval
+						selv = _mm_unpacklo_epi16(selv, selv);
+						vfloat redv, greenv, bluev;
+						vconvertrgbrgbrgbrgb2rrrrggggbbbb(rgb[d][row][col], redv, greenv, bluev);
+						avgv[0] += _mm_andnot_ps((vfloat)selv, redv);
+						avgv[1] += _mm_andnot_ps((vfloat)selv, greenv);
+						avgv[2] += _mm_andnot_ps((vfloat)selv, bluev);
+						avgv[3] += _mm_andnot_ps((vfloat)selv, onev);
+					}
+					_mm_storeu_ps(&red[row+top][col+left], avgv[0]/avgv[3]);
+					_mm_storeu_ps(&green[row+top][col+left], avgv[1]/avgv[3]);
+					_mm_storeu_ps(&blue[row+top][col+left], avgv[2]/avgv[3]);
+				}
+#endif
+				for (; col < mcol-8; col++) {
 					uint8_t hm[8];
 					uint8_t maxval = 0;
 					for (d=0; d < 4; d++) {
@@ -3926,6 +4107,7 @@ void RawImageSource::xtrans_interpolate (int passes, bool useCieLab)
 					red[row+top][col+left] = (avg[0]/avg[3]);
 					green[row+top][col+left] = (avg[1]/avg[3]);
 					blue[row+top][col+left] = (avg[2]/avg[3]);
+				}
 			}
 			
 			if(plistenerActive && ((++progressCounter) % 32 == 0)) {
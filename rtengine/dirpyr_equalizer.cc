@@ -29,14 +29,13 @@
 #include "array2D.h"
 #include "rt_math.h"
 #include "opthelper.h"
+#include "dirpyrfilter.h"
 #ifdef _OPENMP
 #include <omp.h>
 #endif
 #define CLIPI(a) ((a)>0 ?((a)<32768 ?(a):32768):0)
 
-#define RANGEFN(i) ((1000.0f / (i + 1000.0f)))
 #define CLIPC(a) ((a)>-32000?((a)<32000?(a):32000):-32000)
-#define DIRWT(i1,j1,i,j) ( domker[(i1-i)/scale+halfwin][(j1-j)/scale+halfwin] * RANGEFN(fabsf((data_fine[i1][j1]-data_fine[i][j]))) )
 
 namespace rtengine {
 	
@@ -83,30 +82,6 @@ SSEFUNCTION void ImProcFunctions :: dirpyr_equalizer(float ** src, float ** dst,
 			}
 		if(settings->verbose) printf("CbDL mult0=%f  1=%f 2=%f 3=%f 4=%f 5=%f\n",multi[0],multi[1],multi[2],multi[3],multi[4],multi[5]);
 		
-		multi_array2D<float,maxlevel> dirpyrlo (srcwidth, srcheight);
-
-		level = 0;
-		
-		//int thresh = 100 * mult[5];
-		int scale = (int)(scales[level])/scaleprev;
-		if(scale < 1) scale=1;
-
-				
-		dirpyr_channel(src, dirpyrlo[0], srcwidth, srcheight, 0, scale);
-		
-		level = 1;
-		
-		while(level < lastlevel)
-		{
-			
-			scale = (int)(scales[level])/scaleprev;
-			if(scale < 1) scale=1;
-			
-			dirpyr_channel(dirpyrlo[level-1], dirpyrlo[level], srcwidth, srcheight, level, scale);
-			
-			level ++;
-		}
-		
 		float **tmpHue,**tmpChr;
 		if(skinprot != 0.f) {
 			// precalculate hue and chroma, use SSE, if available
@@ -165,17 +140,21 @@ SSEFUNCTION void ImProcFunctions :: dirpyr_equalizer(float ** src, float ** dst,
 #endif
 		}
 
-		// with the current implementation of idirpyr_eq_channel we can safely use the buffer from last level as buffer, saves some memory
-		float ** buffer = dirpyrlo[lastlevel-1];
-		
-		for(int level = lastlevel - 1; level > 0; level--)
+		// the details of each level are accumulated as soon as the level is computed, so that only the last two levels
+		// are kept instead of the whole pyramid
+		multi_array2D<float,2> dirpyrlo (srcwidth, srcheight);
+		array2D<float> buffer (srcwidth, srcheight, ARRAY2D_CLEAR_DATA);
+
+		for(level = 0; level < lastlevel; level++)
 		{
-			idirpyr_eq_channel(dirpyrlo[level], dirpyrlo[level-1], buffer, srcwidth, srcheight, level, multi, dirpyrThreshold, tmpHue, tmpChr, skinprot, gamutlab, b_l,t_l,t_r,b_r, choice );
-		}
+			int scale = (int)(scales[level])/scaleprev;
+			if(scale < 1) scale=1;
 
-		scale = scales[0];
-		
-		idirpyr_eq_channel(dirpyrlo[0], dst, buffer, srcwidth, srcheight, 0, multi, dirpyrThreshold, tmpHue, tmpChr, skinprot, gamutlab, b_l,t_l,t_r,b_r, choice );
+			float ** data_fine = level == 0 ? src : (float **)dirpyrlo[(level-1)&1];
+			dirpyr_channel(data_fine, dirpyrlo[level&1], srcwidth, srcheight, level, scale);
+			idirpyr_eq_channel(dirpyrlo[level&1], data_fine, buffer, srcwidth, srcheight, level, multi, dirpyrThreshold, tmpHue, tmpChr, skinprot, gamutlab, b_l,t_l,t_r,b_r, choice );
+		}
+		float ** residual = dirpyrlo[(lastlevel-1)&1];
 
 		if(skinprot != 0.f) {
 			for (int i=0; i<srcheight; i++)
@@ -190,7 +169,7 @@ SSEFUNCTION void ImProcFunctions :: dirpyr_equalizer(float ** src, float ** dst,
 #pragma omp parallel for
 		for (int i=0; i<srcheight; i++) 
 			for (int j=0; j<srcwidth; j++) {
-				dst[i][j] = CLIP(buffer[i][j]);  // TODO: Really a clip necessary?
+				dst[i][j] = CLIP(buffer[i][j] + residual[i][j]);  // TODO: Really a clip necessary?
 			}
 
 	}
@@ -236,41 +215,20 @@ SSEFUNCTION void ImProcFunctions :: dirpyr_equalizer(float ** src, float ** dst,
 		
 		
 		
-		multi_array2D<float,maxlevel> dirpyrlo (srcwidth, srcheight);
+		// the details of each level are accumulated as soon as the level is computed, as in dirpyr_equalizer
+		multi_array2D<float,2> dirpyrlo (srcwidth, srcheight);
+		array2D<float> buffer (srcwidth, srcheight, ARRAY2D_CLEAR_DATA);
 
-		level = 0;
-		
-		int scale = (int)(scales[level])/scaleprev;
-		if(scale < 1) scale=1;
-
-		dirpyr_channel(src, dirpyrlo[0], srcwidth, srcheight, 0, scale);
-		
-		level = 1;
-		
-		while(level < lastlevel)
+		for(level = 0; level < lastlevel; level++)
 		{
-			scale = (int)(scales[level])/scaleprev;
+			int scale = (int)(scales[level])/scaleprev;
 			if(scale < 1) scale=1;
 
-			dirpyr_channel(dirpyrlo[level-1], dirpyrlo[level], srcwidth, srcheight, level, scale);
-			
-			level ++;
+			float ** data_fine = level == 0 ? src : (float **)dirpyrlo[(level-1)&1];
+			dirpyr_channel(data_fine, dirpyrlo[level&1], srcwidth, srcheight, level, scale);
+			idirpyr_eq_channelcam(dirpyrlo[level&1], data_fine, buffer, srcwidth, srcheight, level, multi, dirpyrThreshold, h_p, C_p, skinprot, b_l,t_l,t_r);
 		}
-		
-		
-		// with the current implementation of idirpyr_eq_channel we can safely use the buffer from last level as buffer, saves some memory
-		float ** buffer = dirpyrlo[lastlevel-1];
-		
-		for(int level = lastlevel - 1; level > 0; level--)
-		{
-			idirpyr_eq_channelcam(dirpyrlo[level], dirpyrlo[level-1], buffer, srcwidth, srcheight, level, multi, dirpyrThreshold , h_p, C_p, skinprot, b_l,t_l,t_r);
-		}
-		
-		
-		scale = scales[0];
-		
-		idirpyr_eq_channelcam(dirpyrlo[0], dst, buffer, srcwidth, srcheight, 0, multi, dirpyrThreshold,  h_p, C_p, skinprot, b_l,t_l,t_r);
-		
+		float ** residual = dirpyrlo[(lastlevel-1)&1];
 		
 		//%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
 		if(execdir){
@@ -280,228 +238,34 @@ SSEFUNCTION void ImProcFunctions :: dirpyr_equalizer(float ** src, float ** dst,
 			for (int i=0; i<srcheight; i++) 
 				for (int j=0; j<srcwidth; j++) {
 					if(ncie->J_p[i][j] > 8.f && ncie->J_p[i][j] < 92.f)
-						dst[i][j] = CLIP( buffer[i][j] );  // TODO: Really a clip necessary?
+						dst[i][j] = CLIP( buffer[i][j] + residual[i][j] );  // TODO: Really a clip necessary?
 					else
 						dst[i][j]=src[i][j];
 				}
 		}
 		else
+#ifdef _OPENMP
+#pragma omp parallel for
+#endif
 			for (int i=0; i<srcheight; i++) 
 				for (int j=0; j<srcwidth; j++) {
-					dst[i][j] = CLIP( buffer[i][j] );  // TODO: Really a clip necessary?
+					dst[i][j] = CLIP( buffer[i][j] + residual[i][j] );  // TODO: Really a clip necessary?
 				}
 		//%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
 	}
 
 
-SSEFUNCTION void ImProcFunctions::dirpyr_channel(float ** data_fine, float ** data_coarse, int width, int height, int level, int scale)
+void ImProcFunctions::dirpyr_channel(float ** data_fine, float ** data_coarse, int width, int height, int level, int scale)
 {
 		//scale is spacing of directional averaging weights
 		//%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
 		// calculate weights, compute directionally weighted average
-		
-	if(level > 1) {
-		//generate domain kernel 
-		int domker[5][5] = {{1,1,1,1,1},{1,2,2,2,1},{1,2,2,2,1},{1,2,2,2,1},{1,1,1,1,1}};
-	//	int domker[5][5] = {{1,1,1,1,1},{1,1,1,1,1},{1,1,1,1,1},{1,1,1,1,1},{1,1,1,1,1}};
-		static const int halfwin=2;
-		const int scalewin = halfwin*scale;
-#ifdef _OPENMP
-#pragma omp parallel
-#endif
-{
-#ifdef __SSE2__
-	__m128 thousandv = _mm_set1_ps( 1000.0f );
-	__m128 dirwtv, valv, normv, dftemp1v, dftemp2v;
-//	multiplied each value of domkerv by 1000 to avoid multiplication by 1000 inside the loop
-	float domkerv[5][5][4] __attribute__ ((aligned (16))) = {{{1000,1000,1000,1000},{1000,1000,1000,1000},{1000,1000,1000,1000},{1000,1000,1000,1000},{1000,1000,1000,1000}},{{1000,1000,1000,1000},{2000,2000,2000,2000},{2000,2000,2000,2000},{2000,2000,2000,2000},{1000,1000,1000,1000}},{{1000,1000,1000,1000},{2000,2000,2000,2000},{2000,2000,2000,2000},{2000,2000,2000,2000},{1000,1000,1000,1000}},{{1000,1000,1000,1000},{2000,2000,2000,2000},{2000,2000,2000,2000},{2000,2000,2000,2000},{1000,1000,1000,1000}},{{1000,1000,1000,1000},{1000,1000,1000,1000},{1000,1000,1000,1000},{1000,1000,1000,1000},{1000,1000,1000,1000}}};
-#endif // __SSE2__
-
-	int j;
-#ifdef _OPENMP
-#pragma omp for //schedule (dynamic,8)
-#endif
-		for(int i = 0; i < height; i++) {
-			float dirwt;
-			for(j = 0; j < scalewin; j++) {
-				float val=0.f;
-				float norm=0.f;
-				
-				
-				for(int inbr=max(0,i-scalewin); inbr<=min(height-1,i+scalewin); inbr+=scale) {
-					for (int jnbr=max(0,j-scalewin); jnbr<=j+scalewin; jnbr+=scale) {
-					    //printf("i=%d ",(inbr-i)/scale+halfwin);
-						dirwt = DIRWT(inbr, jnbr, i, j);
-						val += dirwt*data_fine[inbr][jnbr];
-						norm += dirwt;
-					}
-				}
-				data_coarse[i][j]=val/norm;//low pass filter
-			}
-#ifdef __SSE2__
-			for(; j < width-scalewin-3; j+=4)
-			{
-				valv = _mm_setzero_ps();
-				normv = _mm_setzero_ps();
-				dftemp1v = LVFU(data_fine[i][j]);
-				for(int inbr=MAX(0,i-scalewin); inbr<=MIN(height-1,i+scalewin); inbr+=scale) {
-					int indexihlp = (inbr-i)/scale+halfwin;
-					for (int jnbr=j-scalewin, indexjhlp = 0; jnbr<=j+scalewin; jnbr+=scale,indexjhlp++) {
-						dftemp2v = LVFU(data_fine[inbr][jnbr]);
-						dirwtv = _mm_load_ps((float*)&domkerv[indexihlp][indexjhlp]) / (vabsf(dftemp1v-dftemp2v) + thousandv);
-						valv += dirwtv*dftemp2v;
-						normv += dirwtv;
-					}
-				}
-				_mm_storeu_ps( &data_coarse[i][j],valv/normv);//low pass filter
-			}
-			for(; j < width-scalewin; j++)
-			{
-				float val=0.f;
-				float norm=0.f;
-				
-				for(int inbr=max(0,i-scalewin); inbr<=min(height-1,i+scalewin); inbr+=scale) {
-					for (int jnbr=j-scalewin; jnbr<=j+scalewin; jnbr+=scale) {
-						dirwt = DIRWT(inbr, jnbr, i, j);
-						val += dirwt*data_fine[inbr][jnbr];
-						norm += dirwt;
-					}
-				}
-				data_coarse[i][j]=val/norm;//low pass filter
-			}
-#else
-
-			for(; j < width-scalewin; j++)
-			{
-				float val=0.f;
-				float norm=0.f;
-				
-				for(int inbr=max(0,i-scalewin); inbr<=min(height-1,i+scalewin); inbr+=scale) {
-					for (int jnbr=j-scalewin; jnbr<=j+scalewin; jnbr+=scale) {
-						dirwt = DIRWT(inbr, jnbr, i, j);
-						val += dirwt*data_fine[inbr][jnbr];
-						norm += dirwt;
-					}
-				}
-				data_coarse[i][j]=val/norm;//low pass filter
-			}
-#endif
-			for(; j < width; j++)
-			{
-				float val=0.f;
-				float norm=0.f;
-				
-				for(int inbr=max(0,i-scalewin); inbr<=min(height-1,i+scalewin); inbr+=scale) {
-					for (int jnbr=j-scalewin; jnbr<=min(width-1,j+scalewin); jnbr+=scale) {
-						dirwt = DIRWT(inbr, jnbr, i, j);
-						val += dirwt*data_fine[inbr][jnbr];
-						norm += dirwt;
-					}
-				}
-				data_coarse[i][j]=val/norm;//low pass filter
-			}
-		}
-}
-	} else {	// level <=1 means that all values of domker would be 1.0f, so no need for multiplication
-//		const int scalewin = scale;
-#ifdef _OPENMP
-#pragma omp parallel
-#endif
-{
-#ifdef __SSE2__
-	__m128 thousandv = _mm_set1_ps( 1000.0f );
-	__m128 dirwtv, valv, normv, dftemp1v, dftemp2v;
-#endif // __SSE2__
-	int j;
-#ifdef _OPENMP
-#pragma omp for schedule(dynamic,16)
-#endif
-		for(int i = 0; i < height; i++) {
-			float dirwt;
-			for(j = 0; j < scale; j++)
-			{
-				float val=0.f;
-				float norm=0.f;
-				
-				for(int inbr=max(0,i-scale); inbr<=min(height-1,i+scale); inbr+=scale) {
-					for (int jnbr=max(0,j-scale); jnbr<=j+scale; jnbr+=scale) {
-						dirwt = RANGEFN(fabsf(data_fine[inbr][jnbr]-data_fine[i][j]));
-						val += dirwt*data_fine[inbr][jnbr];
-						norm += dirwt;
-					}
-				}
-				data_coarse[i][j]=val/norm;//low pass filter
-			}
-#ifdef __SSE2__
-			for(; j < width-scale-3; j+=4)
-			{
-				valv = _mm_setzero_ps();
-				normv = _mm_setzero_ps();
-				dftemp1v = LVFU(data_fine[i][j]);
-				for(int inbr=MAX(0,i-scale); inbr<=MIN(height-1,i+scale); inbr+=scale) {
-					for (int jnbr=j-scale; jnbr<=j+scale; jnbr+=scale) {
-						dftemp2v = LVFU(data_fine[inbr][jnbr]);
-						dirwtv = thousandv / (vabsf(dftemp2v-dftemp1v) + thousandv);
-						valv += dirwtv*dftemp2v;
-						normv += dirwtv;
-					}
-				}
-				_mm_storeu_ps( &data_coarse[i][j], valv/normv);//low pass filter
-			}
-
-			for(; j < width-scale; j++)
-			{
-				float val=0.f;
-				float norm=0.f;
-				
-				for(int inbr=max(0,i-scale); inbr<=min(height-1,i+scale); inbr+=scale) {
-					for (int jnbr=j-scale; jnbr<=j+scale; jnbr+=scale) {
-						dirwt = RANGEFN(fabsf(data_fine[inbr][jnbr]-data_fine[i][j]));
-						val += dirwt*data_fine[inbr][jnbr];
-						norm += dirwt;
-					}
-				}
-				data_coarse[i][j]=val/norm;//low pass filter
-			}
-#else
-
-			for(; j < width-scale; j++)
-			{
-				float val=0.f;
-				float norm=0.f;
-				
-				for(int inbr=max(0,i-scale); inbr<=min(height-1,i+scale); inbr+=scale) {
-					for (int jnbr=j-scale; jnbr<=j+scale; jnbr+=scale) {
-						dirwt = RANGEFN(fabsf(data_fine[inbr][jnbr]-data_fine[i][j]));
-						val += dirwt*data_fine[inbr][jnbr];
-						norm += dirwt;
-					}
-				}
-				data_coarse[i][j]=val/norm;//low pass filter
-			}
-#endif
-			for(; j < width; j++)
-			{
-				float val=0.f;
-				float norm=0.f;
-				
-				for(int inbr=max(0,i-scale); inbr<=min(height-1,i+scale); inbr+=scale) {
-					for (int jnbr=j-scale; jnbr<=min(width-1,j+scale); jnbr+=scale) {
-						dirwt = RANGEFN(fabsf(data_fine[inbr][jnbr]-data_fine[i][j]));
-						val += dirwt*data_fine[inbr][jnbr];
-						norm += dirwt;
-					}
-				}
-				data_coarse[i][j]=val/norm;//low pass filter
-			}
-		}
-}
-	}
+		dirpyrFilter (data_fine, data_coarse, width, height, level, scale, false, DirpyrRationalRange());
 }
 	
 	//%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
 	
-	void ImProcFunctions::idirpyr_eq_channel(float ** data_coarse, float ** data_fine, float ** buffer, int width, int height, int level, float mult[5], const double dirpyrThreshold, float ** hue, float ** chrom, const double skinprot, const bool gamutlab, float b_l, float t_l, float t_r, float b_r , int choice)
+SSEFUNCTION	void ImProcFunctions::idirpyr_eq_channel(float ** data_coarse, float ** data_fine, float ** buffer, int width, int height, int level, float mult[5], const double dirpyrThreshold, float ** hue, float ** chrom, const double skinprot, const bool gamutlab, float b_l, float t_l, float t_r, float b_r , int choice)
 	{
 	const float skinprotneg = -skinprot;
 	const float factorHard = (1.f - skinprotneg/100.f);
@@ -540,7 +304,15 @@ SSEFUNCTION void ImProcFunctions::dirpyr_channel(float ** data_fine, float ** da
 #pragma omp parallel for schedule(dynamic,16)
 #endif
 		for(int i = 0; i < height; i++) {
-			for(int j = 0; j < width; j++) {
+			int j = 0;
+#if defined( __SSE2__ ) && defined( __x86_64__ )
+			const __m128 offsetv = _mm_set1_ps( 0x10000 );
+			for(; j < width-3; j+=4) {
+				__m128 hipassv = LVFU(data_fine[i][j]) - LVFU(data_coarse[i][j]);
+				_mm_storeu_ps( &buffer[i][j], LVFU(buffer[i][j]) + irangefn[hipassv+offsetv] * hipassv );
+			}
+#endif
+			for(; j < width; j++) {
 				float hipass = (data_fine[i][j]-data_coarse[i][j]);
 				buffer[i][j] += irangefn[hipass+0x10000] * hipass;
 			}
@@ -584,7 +356,7 @@ SSEFUNCTION void ImProcFunctions::dirpyr_channel(float ** data_fine, float ** da
 	}
 		
 	
-	void ImProcFunctions::idirpyr_eq_channelcam(float ** data_coarse, float ** data_fine, float ** buffer, int width, int height, int level, float mult[5], const double dirpyrThreshold, float ** l_a_h, float ** l_b_c, const double skinprot, float b_l, float t_l, float t_r)
+SSEFUNCTION	void ImProcFunctions::idirpyr_eq_channelcam(float ** data_coarse, float ** data_fine, float ** buffer, int width, int height, int level, float mult[5], const double dirpyrThreshold, float ** l_a_h, float ** l_b_c, const double skinprot, float b_l, float t_l, float t_r)
 	{
 
 	const float skinprotneg = -skinprot;
@@ -622,7 +394,15 @@ SSEFUNCTION void ImProcFunctions::dirpyr_channel(float ** data_fine, float ** da
 #pragma omp parallel for schedule(dynamic,16)
 #endif
 		for(int i = 0; i < height; i++) {
-			for(int j = 0; j < width; j++) {
+			int j = 0;
+#if defined( __SSE2__ ) && defined( __x86_64__ )
+			const __m128 offsetv = _mm_set1_ps( 0x10000 );
+			for(; j < width-3; j+=4) {
+				__m128 hipassv = LVFU(data_fine[i][j]) - LVFU(data_coarse[i][j]);
+				_mm_storeu_ps( &buffer[i][j], LVFU(buffer[i][j]) + irangefn[hipassv+offsetv] * hipassv );
+			}
+#endif
+			for(; j < width; j++) {
 				float hipass = (data_fine[i][j]-data_coarse[i][j]);
 				buffer[i][j] += irangefn[hipass+0x10000] * hipass ;
 			}
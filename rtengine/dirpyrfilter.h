@@ -0,0 +1,129 @@
+/*
+ *  This file is part of RawTherapee.
+ *
+ *  RawTherapee is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  RawTherapee is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with RawTherapee.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef _DIRPYRFILTER_H_
+#define _DIRPYRFILTER_H_
+
+#include <cmath>
+#include "LUT.h"
+#include "rt_math.h"
+#include "opthelper.h"
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+namespace rtengine {
+
+/** @brief Range weight of contrast by detail levels, 1000 / (1000 + difference) */
+class DirpyrRationalRange {
+  public:
+    float operator() (float absDiff) const { return 1000.0f / (absDiff + 1000.0f); }
+#ifdef __SSE2__
+    vfloat operator() (vfloat absDiff) const { return F2V(1000.0f) / (absDiff + F2V(1000.0f)); }
+#endif
+};
+
+/** @brief Range weight read in a table at the integer part of the difference, as the shadows/highlights map does */
+class DirpyrTableRange {
+    const LUTf& table;
+  public:
+    explicit DirpyrTableRange (const LUTf& table) : table(table) {}
+    float operator() (float absDiff) const { return table[(int)absDiff]; }
+#ifdef __SSE2__
+    vfloat operator() (vfloat absDiff) const {
+#ifdef __x86_64__
+        return table[_mm_cvttps_epi32(absDiff)];
+#else
+        float d[4];
+        _mm_storeu_ps (d, absDiff);
+        return _mm_setr_ps (table[(int)d[0]], table[(int)d[1]], table[(int)d[2]], table[(int)d[3]]);
+#endif
+    }
+#endif
+};
+
+// weights of the neighbours in the 5x5 window of the levels beyond the second one
+static const float dirpyrDomker[5][5] = {{1,1,1,1,1},{1,2,2,2,1},{1,2,2,2,1},{1,2,2,2,1},{1,1,1,1,1}};
+
+/** @brief One level of the edge preserving pyramids of contrast by detail levels and of the shadows/highlights map
+  *
+  * Each pixel of coarse is the average of the pixels of fine spaced by scale around it, weighted by the range function of
+  * their difference with the pixel: 3x3 neighbours for the first two levels, 5x5 neighbours beyond, the 3x3 center of the
+  * window counting twice. The 4 pixels of a vector share the neighbours' offsets, so that the interior of the rows is
+  * computed with unaligned loads and no gather but the range function's.
+  * @param level level computed, 0 for the first one
+  * @param alignBorders true to keep the neighbours of the pixels close to the borders on the grid of the pixel, false to
+  *        start them at the first row and column */
+template<class RangeFn> SSEFUNCTION void dirpyrFilter (float** fine, float** coarse, int width, int height, int level, int scale, bool alignBorders, const RangeFn& range) {
+
+    const int halfwin = level > 1 ? 2 : 1;
+    const int scalewin = halfwin * scale;
+    float domker[5][5];
+    for (int i=0; i<5; i++)
+        for (int j=0; j<5; j++)
+            domker[i][j] = halfwin == 2 ? dirpyrDomker[i][j] : 1.f;
+
+#ifdef _OPENMP
+    #pragma omp parallel for schedule(dynamic,16)
+#endif
+    for (int i=0; i<height; i++) {
+        const int rowStart = alignBorders ? max(i-scalewin, i%scale) : max(0, i-scalewin);
+        const int rowEnd = min(height-1, i+scalewin);
+
+        int j = 0;
+        for (; j<width; j++) {
+            if (j == scalewin) {
+#ifdef __SSE2__
+                // interior of the row, the neighbours of 4 pixels at once
+                for (; j<width-scalewin-3; j+=4) {
+                    vfloat valv = ZEROV;
+                    vfloat normv = ZEROV;
+                    const vfloat centrev = LVFU(fine[i][j]);
+                    for (int inbr=rowStart; inbr<=rowEnd; inbr+=scale) {
+                        const float* domkerRow = domker[(inbr-i)/scale+halfwin];
+                        for (int jnbr=j-scalewin, k=0; jnbr<=j+scalewin; jnbr+=scale, k++) {
+                            const vfloat nbrv = LVFU(fine[inbr][jnbr]);
+                            const vfloat dirwtv = F2V(domkerRow[k]) * range(vabsf(nbrv-centrev));
+                            valv += dirwtv*nbrv;
+                            normv += dirwtv;
+                        }
+                    }
+                    _mm_storeu_ps (&coarse[i][j], valv/normv); // low pass filter
+                }
+#endif
+                if (j >= width)
+                    break;
+            }
+
+            const int colStart = alignBorders ? max(j-scalewin, j%scale) : max(0, j-scalewin);
+            const int colEnd = min(width-1, j+scalewin);
+            float val = 0.f;
+            float norm = 0.f;
+            for (int inbr=rowStart; inbr<=rowEnd; inbr+=scale) {
+                const float* domkerRow = domker[(inbr-i)/scale+halfwin];
+                for (int jnbr=colStart; jnbr<=colEnd; jnbr+=scale) {
+                    const float dirwt = domkerRow[(jnbr-j)/scale+halfwin] * range(fabsf(fine[inbr][jnbr]-fine[i][j]));
+                    val += dirwt*fine[inbr][jnbr];
+                    norm += dirwt;
+                }
+            }
+            coarse[i][j] = val/norm; // low pass filter
+        }
+    }
+}
+
+}
+#endif
@@ -217,7 +217,7 @@ ffInfo *FFManager::addFileInfo(const Glib::ustring &filename, bool pool )
 	size_t lastdot = info->get_name().find_last_of ('.');
         if (options.is_extention_enabled(lastdot!=Glib::ustring::npos ? info->get_name().substr (lastdot+1) : "")){
         	RawImage ri(filename);
-        	int res = ri.loadRaw(false); // Read informations about shot
+        	int res = ri.loadRaw(false, false); // Read informations about shot
         	if( !res ){
         	   ffList_t::iterator iter;
         	   if(!pool){
@@ -229,7 +229,7 @@ ffInfo *FFManager::addFileInfo(const Glib::ustring &filename, bool pool )
          	   rml.exifBase = ri.get_exifBase();
          	   rml.ciffBase = ri.get_ciffBase();
          	   rml.ciffLength = ri.get_ciffLen();
-         	   ImageData idata(filename, &rml);
+         	   ImageData idata(filename, &rml, ri.releaseFile());
          	   /* Files are added in the map, divided by same maker/model,lens and aperture*/
         	   std::string key( ffInfo::key(idata.getMake(),idata.getModel(),idata.getLens(),idata.getFocalLen(),idata.getFNumber()) );
         	   iter = ffList.find( key );
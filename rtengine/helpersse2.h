@@ -64,6 +64,21 @@ typedef __m128i vint2;
 #endif
 
 #define ZEROV _mm_setzero_ps()
+#define F2V(a) _mm_set1_ps((a))
+
+// Split 4 interleaved rgb pixels (12 floats from src) into a vector of reds, a vector of greens and a vector of blues
+static INLINE void vconvertrgbrgbrgbrgb2rrrrggggbbbb (const float * src, __m128 &rv, __m128 &gv, __m128 &bv) {
+	__m128 rgb0 = _mm_loadu_ps(src);		// r0 g0 b0 r1
+	__m128 rgb1 = _mm_loadu_ps(src + 4);	// g1 b1 r2 g2
+	__m128 rgb2 = _mm_loadu_ps(src + 8);	// b2 r3 g3 b3
+	__m128 lov = _mm_shuffle_ps(rgb1, rgb2, _MM_SHUFFLE(1,1,2,2));	// r2 r2 r3 r3
+	rv = _mm_shuffle_ps(rgb0, lov, _MM_SHUFFLE(2,0,3,0));
+	lov = _mm_shuffle_ps(rgb0, rgb1, _MM_SHUFFLE(0,0,1,1));			// g0 g0 g1 g1
+	__m128 hiv = _mm_shuffle_ps(rgb1, rgb2, _MM_SHUFFLE(2,2,3,3));	// g2 g2 g3 g3
+	gv = _mm_shuffle_ps(lov, hiv, _MM_SHUFFLE(2,0,2,0));
+	lov = _mm_shuffle_ps(rgb0, rgb1, _MM_SHUFFLE(1,1,2,2));			// b0 b0 b1 b1
+	bv = _mm_shuffle_ps(lov, rgb2, _MM_SHUFFLE(3,0,2,0));
+}
 
 static INLINE vint vrint_vi_vd(vdouble vd) { return _mm_cvtpd_epi32(vd); }
 static INLINE vint vtruncate_vi_vd(vdouble vd) { return _mm_cvttpd_epi32(vd); }
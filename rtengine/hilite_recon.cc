@@ -362,33 +362,74 @@ void RawImageSource :: HLRecovery_inpaint (float** red, float** green, float** b
 	float camwb[4];
 	for (int c=0; c<4; c++) camwb[c]=ri->get_cam_mul(c);
 
-	multi_array2D<float,3> channelblur(width,height,ARRAY2D_CLEAR_DATA);
-	multi_array2D<float,5> hilite_full(width,height,ARRAY2D_CLEAR_DATA);
-	if(plistener){
-		progress += 0.05;
-		plistener->setProgress(progress);
+	// Only the clipped pixels are changed: find their bounding box, and leave if there are none
+	int minrow = height, maxrow = -1, mincol = width, maxcol = -1;
+#ifdef _OPENMP
+#pragma omp parallel
+#endif
+{
+	int minrowt = height, maxrowt = -1, mincolt = width, maxcolt = -1;
+#ifdef _OPENMP
+#pragma omp for nowait
+#endif
+	for (int i=0; i<height; i++) {
+		for (int j=0; j<width; j++) {
+			if (red[i][j]>=max_f[0] || green[i][j]>=max_f[1] || blue[i][j]>=max_f[2]) {
+				if (maxrowt < 0)
+					minrowt = i;
+				maxrowt = i;
+				mincolt = min(mincolt,j);
+				maxcolt = max(maxcolt,j);
+			}
+		}
 	}
-		
-	// blur RGB channels
-	boxblur2(red  ,channelblur[0],height,width,4);
-	if(plistener){
-		progress += 0.05;
-		plistener->setProgress(progress);
+#ifdef _OPENMP
+#pragma omp critical
+#endif
+{
+	if (maxrowt >= 0) {
+		minrow = min(minrow,minrowt);
+		maxrow = max(maxrow,maxrowt);
+		mincol = min(mincol,mincolt);
+		maxcol = max(maxcol,maxcolt);
 	}
-	boxblur2(green,channelblur[1],height,width,4);
-	if(plistener){
-		progress += 0.05;
-		plistener->setProgress(progress);
+}
+}
+	if (maxrow < 0) {
+		if(plistener) plistener->setProgress(1.00);
+		return;
 	}
-	boxblur2(blue ,channelblur[2],height,width,4);
 	if(plistener){
 		progress += 0.05;
 		plistener->setProgress(progress);
 	}
-	
+
+	// high pass of the RGB channels, to leave out the busy parts of the highlights;
+	// one channel is blurred at a time, which needs much less memory than keeping the three blurred channels
+	array2D<float> hipass(width,height);
+	{
+		array2D<float> channelblur(width,height);
+		float** channels[3] = {red, green, blue};
+		for (int c=0; c<3; c++) {
+			// blur RGB channels
+			boxblur2(channels[c],channelblur,height,width,4);
+#ifdef _OPENMP
+#pragma omp parallel for
+#endif
+			for (int i=0; i<height; i++)
+				for (int j=0; j<width; j++)
+					hipass[i][j] = (c == 0 ? 0.f : hipass[i][j]) + fabs(channelblur[i][j]-channels[c][i][j]);
+			if(plistener){
+				progress += 0.05;
+				plistener->setProgress(progress);
+			}
+		}
+	}
+
 	float hipass_sum=0, hipass_norm=0.00;
 	
 	// set up which pixels are clipped or near clipping
+	array2D<uint8_t> hilite_map(width,height);
 #ifdef _OPENMP
 #pragma omp parallel for reduction(+:hipass_sum,hipass_norm) schedule(dynamic,16)
 #endif
@@ -400,20 +441,13 @@ void RawImageSource :: HLRecovery_inpaint (float** red, float** green, float** b
 			if ((red[i][j]>thresh[0] || green[i][j]>thresh[1] || blue[i][j]>thresh[2]) &&
 				(red[i][j]<max_f[0] && green[i][j]<max_f[1] && blue[i][j]<max_f[2])) {
 				
-				hipass_sum += fabs(channelblur[0][i][j]-red[i][j]) + fabs(channelblur[1][i][j]-green[i][j]) + fabs(channelblur[2][i][j]-blue[i][j]);
+				hipass_sum += hipass[i][j];
 				hipass_norm++;
-				
-				hilite_full[0][i][j] = red[i][j];
-				hilite_full[1][i][j] = green[i][j];
-				hilite_full[2][i][j] = blue[i][j];
-				hilite_full[3][i][j] = 1;
-				hilite_full[4][i][j] = 1;
-				
-			}
-			//if (i%100==0 && j%100==0)
-			//	printf("row=%d  col=%d  r=%f  g=%f  b=%f hilite=%f  \n",i,j,hilite_full[0][i][j],hilite_full[1][i][j],hilite_full[2][i][j],hilite_full[3][i][j]);
+				hilite_map[i][j] = 1;
+			} else
+				hilite_map[i][j] = 0;
 		}
-	}//end of filling highlight array
+	}//end of filling highlight map
 
 	hipass_norm += 0.01;
 
@@ -424,49 +458,67 @@ void RawImageSource :: HLRecovery_inpaint (float** red, float** green, float** b
 		plistener->setProgress(progress);
 	}
 
-	//%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
-	//blur highlight data
-	boxblur2(hilite_full[4],hilite_full[4],height,width,1);
-	if(plistener){
-		progress += 0.05;
-		plistener->setProgress(progress);
-	}
-
+	// A highlight is used for the reconstruction if it isn't too busy, and if all its neighbours are highlights too,
+	// else it is too near an edge and could risk using CA affected pixels (this is what blurring the highlight map
+	// and omitting the pixels below 0.95 did)
+	array2D<uint8_t> usable(width,height);
 #ifdef _OPENMP
 #pragma omp parallel for schedule(dynamic,16)
 #endif
 	for (int i=0; i<height; i++) {
 		for (int j=0; j<width; j++) {
-			
-			float hipass = fabs(channelblur[0][i][j]-red[i][j]) + fabs(channelblur[1][i][j]-green[i][j]) + fabs(channelblur[2][i][j]-blue[i][j]);
-
-			if (hipass > 2*hipass_ave) {
-				//too much variation
-				hilite_full[0][i][j] = hilite_full[1][i][j] = hilite_full[2][i][j] = hilite_full[3][i][j] = 0;
-				continue;
-			}
-						
-			if (hilite_full[4][i][j]>0.00001 && hilite_full[4][i][j]<0.95) {
-				//too near an edge, could risk using CA affected pixels, therefore omit
-				hilite_full[0][i][j] = hilite_full[1][i][j] = hilite_full[2][i][j] = hilite_full[3][i][j] = 0;
-			}
+			bool use = hilite_map[i][j] && hipass[i][j] <= 2*hipass_ave;
+			for (int i2=max(i-1,0); use && i2<=min(i+1,height-1); i2++)
+				for (int j2=max(j-1,0); j2<=min(j+1,width-1); j2++)
+					use = use && hilite_map[i2][j2];
+			usable[i][j] = use;
 		}
 	}
-	
-	for (int c=0; c<3; c++) channelblur[c](1,1);//free up some memory
-	
+	hipass(1,1);//free up some memory
+	hilite_map(1,1);
+
+	if(plistener){
+		progress += 0.05;
+		plistener->setProgress(progress);
+	}
+
 	multi_array2D<float,4> hilite(hfw+1,hfh+1,ARRAY2D_CLEAR_DATA);
 		
 	//%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
 	// blur and resample highlight data; range=size of blur, pitch=sample spacing
-	for (int m=0; m<4; m++) {
-		boxblur_resamp(hilite_full[m],hilite[m],height,width,range,pitch);
-		if(plistener){
-			progress += 0.05;
-			plistener->setProgress(progress);
+	// The means of the usable highlights in (2*range+1)^2 windows are computed directly at the samples,
+	// the full resolution highlight data isn't needed
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic,16)
+#endif
+	for (int i1=0; i1<=(height-1)/pitch; i1++) {
+		const int top = max(i1*pitch-range,0), bottom = min(i1*pitch+range,height-1);
+		for (int j1=0; j1<width/pitch; j1++) {
+			const int left = max(j1*pitch-range,0), right = min(j1*pitch+range,width-1);
+			float sum[3] = {0.f,0.f,0.f};
+			int count = 0;
+			for (int i=top; i<=bottom; i++)
+				for (int j=left; j<=right; j++)
+					if (usable[i][j]) {
+						sum[0] += red[i][j];
+						sum[1] += green[i][j];
+						sum[2] += blue[i][j];
+						count++;
+					}
+			if (count) {
+				const float norm = 1.f/((bottom-top+1)*(right-left+1));
+				hilite[0][i1][j1] = sum[0]*norm;
+				hilite[1][i1][j1] = sum[1]*norm;
+				hilite[2][i1][j1] = sum[2]*norm;
+				hilite[3][i1][j1] = count*norm;
+			}
 		}
 	}
-	for (int c=0; c<5; c++) hilite_full[c](1,1);//free up some memory
+	usable(1,1);//free up some memory
+	if(plistener){
+		progress += 0.05;
+		plistener->setProgress(progress);
+	}
 	
 	multi_array2D<float,4*numdirs> hilite_dir(hfw,hfh,ARRAY2D_CLEAR_DATA);
 	
@@ -630,9 +682,9 @@ void RawImageSource :: HLRecovery_inpaint (float** red, float** green, float** b
 #ifdef _OPENMP
 #pragma omp parallel for schedule(dynamic,16)
 #endif
-	for (int i=0; i<height; i++) {
+	for (int i=minrow; i<=maxrow; i++) {
 		int i1 = min((i-(i%pitch))/pitch,hfh-1);
-		for (int j=0; j<width; j++) {
+		for (int j=mincol; j<=maxcol; j++) {
 			int j1 = min((j-(j%pitch))/pitch,hfw-1);
 			
 			float pixel[3]={red[i][j],green[i][j],blue[i][j]};
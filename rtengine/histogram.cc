@@ -0,0 +1,99 @@
+/*
+ *  This file is part of RawTherapee.
+ *
+ *  RawTherapee is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  RawTherapee is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with RawTherapee.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "histogram.h"
+#include "rt_math.h"
+#include <cstring>
+#include <cmath>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+namespace rtengine {
+
+ParallelHistogram::ParallelHistogram (int size, int copies, int numThreads)
+    : size(size), copies(copies), numThreads(numThreads) {
+
+#ifdef _OPENMP
+    if (this->numThreads <= 0)
+        this->numThreads = omp_get_max_threads();
+#endif
+    if (this->numThreads <= 0)
+        this->numThreads = 1;
+
+    // 16 bins = 64 bytes, the threads don't share any cache line
+    stride = ((size_t)size * copies + 15) & ~(size_t)15;
+    bins = new unsigned int[stride * this->numThreads];
+    used.assign (this->numThreads, 0);
+}
+
+ParallelHistogram::~ParallelHistogram () {
+
+    delete [] bins;
+}
+
+unsigned int* ParallelHistogram::threadBins () {
+
+#ifdef _OPENMP
+    int tid = omp_get_thread_num();
+#else
+    int tid = 0;
+#endif
+    unsigned int* threadBins = bins + tid * stride;
+    // cleared by its thread, the memory gets close to it
+    if (!used[tid]) {
+        memset (threadBins, 0, size * copies * sizeof(unsigned int));
+        used[tid] = 1;
+    }
+    return threadBins;
+}
+
+void ParallelHistogram::addTo (LUTu& histogram, unsigned int weight) {
+
+    const int blockSize = 1024;
+    const int numBlocks = (size + blockSize - 1) / blockSize;
+
+#ifdef _OPENMP
+    #pragma omp parallel for if (numBlocks > 1)
+#endif
+    for (int block = 0; block < numBlocks; block++) {
+        const int begin = block * blockSize;
+        const int end = min(begin + blockSize, size);
+        unsigned int sum[blockSize];
+        memset (sum, 0, sizeof(sum));
+
+        for (int t = 0; t < numThreads; t++) {
+            if (!used[t])
+                continue;
+            for (int c = 0; c < copies; c++) {
+                const unsigned int* src = bins + t * stride + c * size;
+                for (int i = begin; i < end; i++)
+                    sum[i - begin] += src[i];
+            }
+        }
+        for (int i = begin; i < end; i++)
+            histogram[i] += sum[i - begin] * weight;
+    }
+}
+
+int ParallelHistogram::subsampling (int width, int height, int maxPixels) {
+
+    if (maxPixels <= 0 || (double)width * height <= maxPixels)
+        return 1;
+    return (int)ceil (sqrt ((double)width * height / maxPixels));
+}
+
+}
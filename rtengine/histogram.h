@@ -0,0 +1,66 @@
+/*
+ *  This file is part of RawTherapee.
+ *
+ *  RawTherapee is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  RawTherapee is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with RawTherapee.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef _HISTOGRAM_H_
+#define _HISTOGRAM_H_
+
+#include <vector>
+#include <cstddef>
+#include "LUT.h"
+
+namespace rtengine {
+
+/** @brief Histogram counted by all the threads of a parallel region at once
+  *
+  * Each thread counts in its own bins, which are summed at the end in parallel over the bins instead of one thread
+  * after the other in a critical section. A thread may use several copies of its bins, the 4 lanes of a vector of
+  * indices going each to its own copy, so that runs of pixels falling in the same bin don't wait on one counter.
+  * The indices aren't checked, the caller clamps them to [0, size-1]. */
+class ParallelHistogram {
+
+    unsigned int* bins;
+    int size;           // number of bins
+    int copies;         // copies of the bins per thread
+    int numThreads;
+    size_t stride;      // bins of one thread, rounded up to a cache line
+    std::vector<char> used;
+
+    ParallelHistogram (const ParallelHistogram&);
+    ParallelHistogram& operator= (const ParallelHistogram&);
+
+  public:
+    /** @param size number of bins
+      * @param copies copies of the bins per thread, 1 or 4
+      * @param numThreads maximum number of threads counting, omp_get_max_threads() if 0 */
+    explicit ParallelHistogram (int size, int copies = 1, int numThreads = 0);
+    ~ParallelHistogram ();
+
+    /** @brief Bins of the calling thread, cleared on the first call of each thread; copy c starts at c * getSize() */
+    unsigned int* threadBins ();
+
+    int getSize () const { return size; }
+
+    /** @brief Adds the counts of all the threads and copies to histogram
+      * @param histogram destination, at least getSize() bins, not cleared
+      * @param weight factor applied to the counts, the square of the step of a subsampled count */
+    void addTo (LUTu& histogram, unsigned int weight = 1);
+
+    /** @brief Step of the rows and columns keeping at most maxPixels of a width x height area, at least 1 */
+    static int subsampling (int width, int height, int maxPixels);
+};
+
+}
+#endif
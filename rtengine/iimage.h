@@ -26,6 +26,7 @@
 #include "../rtgui/threadutils.h"
 #include "rt_math.h"
 #include "alignedbuffer.h"
+#include "planaralloc.h"
 #include "imagedimensions.h"
 #include "LUT.h"
 #include "coord2d.h"
@@ -199,8 +200,8 @@ namespace rtengine {
         T* data;
         PlanarPtr<T> v;  // v stands for "value", whatever it represent
 
-        PlanarWhateverData() : rowstride(0), data (NULL) {}
-        PlanarWhateverData(int w, int h) : rowstride(0), data (NULL) {
+        PlanarWhateverData() : abData(0, planeAlignment), rowstride(0), data (NULL) {}
+        PlanarWhateverData(int w, int h) : abData(0, planeAlignment), rowstride(0), data (NULL) {
             allocate(w, h);
         }
 
@@ -210,6 +211,9 @@ namespace rtengine {
         void swap(PlanarWhateverData<T> &other) {
             abData.swap(other.abData);
             v.swap(other.v);
+            int tmpRowstride = other.rowstride;
+            other.rowstride = rowstride;
+            rowstride = tmpRowstride;
             T* tmpData = other.data;
             other.data = data;
             data = tmpData;
@@ -243,16 +247,15 @@ namespace rtengine {
             #endif
 
             if (sizeof(T) > 1) {
-                // 128 bits memory alignment for >8bits data
-                rowstride = ( width*sizeof(T)+15 )/16*16;
+                // rows aligned on cache lines for >8bits data
+                rowstride = planeRowStride(width*sizeof(T));
             }
             else {
                 // No memory alignment for 8bits data
                 rowstride = width*sizeof(T);
             }
 
-            // find the padding length to ensure a 128 bits alignment for each row
-            size_t size = rowstride * height;
+            size_t size = (size_t)rowstride * height;
             if (!width) {
                 size = 0;
                 rowstride = 0;
@@ -527,8 +530,8 @@ namespace rtengine {
         PlanarPtr<T> g;
         PlanarPtr<T> b;
 
-        PlanarRGBData() : rowstride(0), planestride(0), data (NULL) {}
-        PlanarRGBData(int w, int h) : rowstride(0), planestride(0), data (NULL) {
+        PlanarRGBData() : abData(0, planeAlignment), rowstride(0), planestride(0), data (NULL) {}
+        PlanarRGBData(int w, int h) : abData(0, planeAlignment), rowstride(0), planestride(0), data (NULL) {
             allocate(w, h);
         }
 
@@ -542,6 +545,12 @@ namespace rtengine {
             r.swap(other.r);
             g.swap(other.g);
             b.swap(other.b);
+            int tmpStride = other.rowstride;
+            other.rowstride = rowstride;
+            rowstride = tmpStride;
+            tmpStride = other.planestride;
+            other.planestride = planestride;
+            planestride = tmpStride;
             T* tmpData = other.data;
             other.data = data;
             data = tmpData;
@@ -577,9 +586,9 @@ namespace rtengine {
             #endif
 
             if (sizeof(T) > 1) {
-                // 128 bits memory alignment for >8bits data
-                rowstride = ( width*sizeof(T)+15 )/16*16;
-                planestride = rowstride * height;
+                // rows aligned on cache lines for >8bits data, planes staggered so that they don't alias in the caches
+                rowstride = planeRowStride(width*sizeof(T));
+                planestride = planeStride((size_t)rowstride * height);
             }
             else {
                 // No memory alignment for 8bits data
@@ -587,8 +596,7 @@ namespace rtengine {
                 planestride = rowstride * height;
             }
 
-            // find the padding length to ensure a 128 bits alignment for each row
-            size_t size = (size_t)rowstride*3*(size_t)height;
+            size_t size = (size_t)planestride*2 + (size_t)rowstride*height;
             if (!width) {
                 size = 0;
                 rowstride = 0;
@@ -1549,7 +1557,7 @@ namespace rtengine {
     };
 
     /** @brief This class represents an image having a float pixel planar representation.
-        The planes are stored as two dimensional arrays. All the rows have a 128 bits alignment. */
+        The planes are stored as two dimensional arrays. All the rows are aligned on 64 bytes. */
     class IImagefloat : public IImage, public PlanarRGBData<float> {
       public:
         virtual ~IImagefloat() {}
@@ -1562,7 +1570,7 @@ namespace rtengine {
     };
 
     /** @brief This class represents an image having a 16 bits/pixel planar representation.
-      The planes are stored as two dimensional arrays. All the rows have a 128 bits alignment. */
+      The planes are stored as two dimensional arrays. All the rows are aligned on 64 bytes. */
     class IImage16 : public IImage, public PlanarRGBData<unsigned short> {
       public:
         virtual ~IImage16() {}
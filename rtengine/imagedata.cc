@@ -20,6 +20,7 @@
 #include "iptcpairs.h"
 #include <glib/gstdio.h>
 #include "safegtk.h"
+#include "myfile.h"
 
 #ifndef GLIBMM_EXCEPTIONS_ENABLED
 #include <memory>
@@ -29,22 +30,43 @@ using namespace rtengine;
 
 extern "C" IptcData *iptc_data_new_from_jpeg_file (FILE* infile);
 
+#ifdef MYFILE_MMAP
+// keeping a mapped file open until the makernotes are needed is cheap, so they are only decoded on demand
+static const bool deferMakerNotes = true;
+#else
+static const bool deferMakerNotes = false;
+#endif
+
 ImageMetaData* ImageMetaData::fromFile (const Glib::ustring& fname, RawMetaDataLocation* rml) {
 
     return new ImageData (fname, rml);
 }
 
-ImageData::ImageData (Glib::ustring fname, RawMetaDataLocation* ri) {
+ImageData::ImageData (Glib::ustring fname, RawMetaDataLocation* ri, IMFILE* f) {
 
     size_t dotpos = fname.find_last_of ('.');
     root = NULL;
     iptc = NULL;
+    exifSource = NULL;
+    serialInMakerNote = false;
+
+    const bool rawMetaData = ri && (ri->exifBase>=0 || ri->ciffBase>=0);
+    if (f && !rawMetaData) {
+        // the file handed over by RawImage is only read for the raw metadata
+        fclose (f);
+        f = NULL;
+    }
 
-    if (ri && (ri->exifBase>=0 || ri->ciffBase>=0)) {
-        FILE* f = safe_g_fopen (fname, "rb");
+    if (rawMetaData) {
+        if (f)
+            imfile_set_plistener (f, NULL, 0.0);  // the listener of RawImage::loadRaw may not outlive us
+        else
+            f = gfopen (fname.c_str());
         if (f) {
+            bool deferred = false;
             if (ri->exifBase>=0) {
-                root = rtexif::ExifManager::parse (f, ri->exifBase);
+                root = rtexif::ExifManager::parse (f, ri->exifBase, true, deferMakerNotes);
+                deferred = deferMakerNotes;
                 if (root) {
                     rtexif::Tag* t = root->getTag (0x83BB);
                     if (t)
@@ -53,26 +75,26 @@ ImageData::ImageData (Glib::ustring fname, RawMetaDataLocation* ri) {
             }
             else if (ri->ciffBase>=0)
                 root = rtexif::ExifManager::parseCIFF (f, ri->ciffBase, ri->ciffLength);
-            fclose (f);
+            keepExifSource (f, deferred);
             extractInfo ();
         }
     }
     else if ((dotpos<fname.size()-3 && !fname.casefold().compare (dotpos, 4, ".jpg")) || (dotpos<fname.size()-4 && !fname.casefold().compare (dotpos, 5, ".jpeg"))) {
-        FILE* f = safe_g_fopen (fname, "rb");
+        IMFILE* f = gfopen (fname.c_str());
         if (f) {
-            root = rtexif::ExifManager::parseJPEG (f);
+            root = rtexif::ExifManager::parseJPEG (f, deferMakerNotes);
+            keepExifSource (f, deferMakerNotes);
             extractInfo ();
-            fclose (f);
             FILE* ff = safe_g_fopen (fname, "rb");
             iptc = iptc_data_new_from_jpeg_file (ff);
             fclose (ff);
         }
     }
     else if ((dotpos<fname.size()-3 && !fname.casefold().compare (dotpos, 4, ".tif")) || (dotpos<fname.size()-4 && !fname.casefold().compare (dotpos, 5, ".tiff"))) {
-        FILE* f = safe_g_fopen (fname, "rb");
+        IMFILE* f = gfopen (fname.c_str());
         if (f) {
-            root = rtexif::ExifManager::parseTIFF (f);
-            fclose (f);
+            root = rtexif::ExifManager::parseTIFF (f, true, deferMakerNotes);
+            keepExifSource (f, deferMakerNotes);
             extractInfo ();
             if (root) {
                 rtexif::Tag* t = root->getTag (0x83BB);
@@ -209,11 +231,16 @@ void ImageData::extractInfo () {
             timeStamp = mktime(&time);
         }
     }
+    // findTag doesn't enter a makernote which is not decoded yet, getSerialNumber looks there when it is asked for
     rtexif::Tag *snTag = exif->findTag ("SerialNumber");
     if(!snTag)
     	snTag = exif->findTag ("InternalSerialNumber");
     if ( snTag )
         serial = snTag->valueToString();
+    else {
+        rtexif::Tag* mn = exif->getTag ("MakerNote");
+        serialInMakerNote = mn && mn->hasDeferredMakerNote ();
+    }
     // guess lens...
     lens = "Unknown";
 
@@ -224,7 +251,13 @@ void ImageData::extractInfo () {
 			lens = exif->getTag ("LensModel")->valueToString ();
 		}
 	} else if (root->findTag("MakerNote")) {
-        rtexif::TagDirectory* mnote = root->findTag("MakerNote")->getDirectory();
+        // only decode the makernote for the makes whose lens or ISO is read from it
+        rtexif::TagDirectory* mnote = NULL;
+        if (!make.compare (0, 5, "NIKON") || !make.compare (0, 5, "Canon") || !make.compare (0, 6, "PENTAX") || (!make.compare (0, 5, "RICOH") && !model.compare (0, 6, "PENTAX"))
+                || !make.compare (0, 4, "SONY") || !make.compare (0, 6, "KONICA") || !make.compare (0, 7, "OLYMPUS")) {
+            MyMutex::MyLock lock(exifMutex);
+            mnote = decodeMakerNote (root->findTag("MakerNote"));
+        }
         if (mnote && !make.compare (0, 5, "NIKON")) {
             // ISO at max value supported, check manufacturer specific
             if (iso_speed == 65535 || iso_speed == 0) {
@@ -349,9 +382,61 @@ void ImageData::extractInfo () {
   }
 }
 
+void ImageData::keepExifSource (IMFILE* f, bool deferred) {
+
+    if (deferred && root && root->getMakerNoteSource())
+        exifSource = f;
+    else
+        fclose (f);
+}
+
+// exifMutex has to be locked by the caller
+rtexif::TagDirectory* ImageData::decodeMakerNote (rtexif::Tag* mn) const {
+
+    rtexif::TagDirectory* mnote = mn->getDirectory ();
+    if (exifSource && !root->getMakerNoteSource()) {
+        // that was the last pending makernote
+        fclose (exifSource);
+        exifSource = NULL;
+    }
+    return mnote;
+}
+
+const rtexif::TagDirectory* ImageData::getExifData () const {
+
+    MyMutex::MyLock lock(exifMutex);
+    if (exifSource) {
+        // the whole tree is requested: decode the pending makernotes, the file isn't needed afterward
+        root->parseDeferredMakerNotes ();
+        fclose (exifSource);
+        exifSource = NULL;
+    }
+    return root;
+}
+
+std::string ImageData::getSerialNumber () const {
+
+    MyMutex::MyLock lock(exifMutex);
+    if (serialInMakerNote) {
+        // the dark frame matching is the only user of it, so the makernote is only decoded here when needed
+        rtexif::TagDirectory* mnote = decodeMakerNote (root->getTag ("Exif")->getDirectory()->getTag ("MakerNote"));
+        if (mnote) {
+            rtexif::Tag *snTag = mnote->findTag ("SerialNumber");
+            if(!snTag)
+                snTag = mnote->findTag ("InternalSerialNumber");
+            if ( snTag )
+                serial = snTag->valueToString();
+        }
+        serialInMakerNote = false;
+    }
+    return serial;
+}
+
 ImageData::~ImageData () {
 
     delete root;
+    if (exifSource)
+        fclose (exifSource);
     if (iptc)
         iptc_data_free (iptc);
 }
@@ -27,6 +27,7 @@
 #include "procparams.h"
 #include <libiptcdata/iptc-data.h>
 #include "rtengine.h"
+#include "myfile.h"
 
 namespace rtengine {
 
@@ -35,6 +36,8 @@ class ImageData : public ImageMetaData {
   protected:
     rtexif::TagDirectory* root;
     IptcData* iptc;
+    mutable IMFILE* exifSource;     // kept open while the makernotes of root are not decoded yet
+    mutable MyMutex exifMutex;      // serializes the decoding of the makernotes, which reads exifSource
 
     struct tm time;
     time_t timeStamp;
@@ -44,18 +47,25 @@ class ImageData : public ImageMetaData {
     float focus_dist;  // dist: 0=unknown, 10000=infinity
     double shutter;
     double expcomp;
-    std::string make, model, serial;
+    std::string make, model;
+    mutable std::string serial;
+    mutable bool serialInMakerNote; // the serial number has to be looked up in a makernote not decoded yet
     std::string orientation;
     std::string lens;
 
     void extractInfo ();
+    void keepExifSource (IMFILE* f, bool deferred);
+    rtexif::TagDirectory* decodeMakerNote (rtexif::Tag* mn) const;
     
   public:
 
-    ImageData (Glib::ustring fname, RawMetaDataLocation* rml=NULL);
+    /** @param f the raw file already opened by RawImage::loadRaw (see RawImage::releaseFile), only used together with rml.
+      * ImageData takes the ownership of it in any case (it closes it when it isn't needed), the file is then not opened a
+      * second time. */
+    ImageData (Glib::ustring fname, RawMetaDataLocation* rml=NULL, IMFILE* f=NULL);
     virtual ~ImageData ();
 
-    const rtexif::TagDirectory*   getExifData () const { return root; }
+    const rtexif::TagDirectory*   getExifData () const;
     const procparams::IPTCPairs   getIPTCData () const;
 
     bool hasExif () const { return root && root->getCount(); }
@@ -73,7 +83,7 @@ class ImageData : public ImageMetaData {
     std::string getMake     () const { return make;      }
     std::string getModel    () const { return model;     }
     std::string getLens     () const { return lens;      }
-    std::string getSerialNumber () const { return serial;}
+    std::string getSerialNumber () const;
     std::string getOrientation () const { return orientation; }
 };
 }
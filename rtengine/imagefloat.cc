@@ -27,6 +27,7 @@
 #include "alignedbuffer.h"
 #include "rt_math.h"
 #include "color.h"
+#include "histogram.h"
 
 using namespace rtengine;
 
@@ -360,10 +361,10 @@ void Imagefloat::calcCroppedHistogram(const ProcParams &params, float scale, LUT
     int x1, x2, y1, y2;
     params.crop.mapToResized(width, height, scale, x1, x2, y1, y2);
 
+    ParallelHistogram histPar (65536);
 #pragma omp parallel
 {
-	LUTu histThr(65536);
-	histThr.clear();
+	unsigned int* histThr = histPar.threadBins();
 #pragma omp for nowait
     for (int y=y1; y<y2; y++) {
         int i;
@@ -376,12 +377,8 @@ void Imagefloat::calcCroppedHistogram(const ProcParams &params, float scale, LUT
             histThr[i]++;
         }
     }
-#pragma omp critical
-{
-	for(int i=0;i<=0xffff;i++)
-		hist[i] += histThr[i];
-}
 }
+    histPar.addTo (hist);
 
 }
 
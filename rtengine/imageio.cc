@@ -338,7 +338,25 @@ int ImageIO::loadPNG  (Glib::ustring fname) {
     return IMIO_SUCCESS;
 }
 
-int ImageIO::loadJPEGFromMemory (const char* buffer, int bufsize)
+// Requests the smallest scale libjpeg can decode at in the DCT domain (1/8, 1/4 or 1/2) giving at least
+// minWidth x minHeight pixels, 0 meaning any size; returns the denominator of the scale
+static int setJPEGScale (jpeg_decompress_struct &cinfo, int minWidth, int minHeight)
+{
+    if (minWidth <= 0 && minHeight <= 0)
+        return 1;
+
+    for (int denom = 8; denom > 1; denom /= 2) {
+        // libjpeg rounds the scaled dimensions up
+        if ((int)((cinfo.image_width + denom - 1) / denom) >= minWidth && (int)((cinfo.image_height + denom - 1) / denom) >= minHeight) {
+            cinfo.scale_num = 1;
+            cinfo.scale_denom = denom;
+            return denom;
+        }
+    }
+    return 1;
+}
+
+int ImageIO::loadJPEGFromMemory (const char* buffer, int bufsize, int minWidth, int minHeight)
 {
     jpeg_decompress_struct cinfo;
     jpeg_error_mgr jerr;
@@ -367,6 +385,7 @@ int ImageIO::loadJPEGFromMemory (const char* buffer, int bufsize)
         else 
             embProfile = NULL;
 
+        loadedScale = 1.0 / setJPEGScale (cinfo, minWidth, minHeight);
         jpeg_start_decompress(&cinfo);
 
         unsigned int width = cinfo.output_width;
@@ -403,7 +422,7 @@ int ImageIO::loadJPEGFromMemory (const char* buffer, int bufsize)
     }
 }
 
-int ImageIO::loadJPEG (Glib::ustring fname) {
+int ImageIO::loadJPEG (Glib::ustring fname, int minWidth, int minHeight) {
     FILE *file=safe_g_fopen(fname,"rb");
     if (!file)
         return IMIO_CANNOTREADFILE;
@@ -440,6 +459,7 @@ int ImageIO::loadJPEG (Glib::ustring fname) {
         else 
             embProfile = NULL;
 
+        loadedScale = 1.0 / setJPEGScale (cinfo, minWidth, minHeight);
         jpeg_start_decompress(&cinfo);
 
         unsigned int width = cinfo.output_width;
@@ -77,6 +77,7 @@ class ImageIO : virtual public ImageDatas {
         char* loadedProfileData;
         bool loadedProfileDataJpg;
         int loadedProfileLength;
+        double loadedScale;
         procparams::ExifPairs exifChange;
         IptcData* iptc;
         const rtexif::TagDirectory* exifRoot;
@@ -90,7 +91,7 @@ class ImageIO : virtual public ImageDatas {
         static Glib::ustring errorMsg[6];
 
         ImageIO () : pl (NULL), embProfile(NULL), profileData(NULL), profileLength(0), loadedProfileData(NULL),loadedProfileDataJpg(false),
-                     loadedProfileLength(0), iptc(NULL), exifRoot (NULL), sampleFormat(IIOSF_UNKNOWN),
+                     loadedProfileLength(0), loadedScale(1.0), iptc(NULL), exifRoot (NULL), sampleFormat(IIOSF_UNKNOWN),
                      sampleArrangement(IIOSA_UNKNOWN) {}
 
         virtual ~ImageIO ();
@@ -117,18 +118,21 @@ class ImageIO : virtual public ImageDatas {
         int save (Glib::ustring fname);
 
         int loadPNG  (Glib::ustring fname);
-        int loadJPEG (Glib::ustring fname);
+        // minWidth, minHeight: smallest size needed, the JPEG being decoded at 1/2, 1/4 or 1/8 of its size if possible
+        int loadJPEG (Glib::ustring fname, int minWidth = 0, int minHeight = 0);
         int loadTIFF (Glib::ustring fname);
         static int getPNGSampleFormat  (Glib::ustring fname, IIOSampleFormat &sFormat, IIOSampleArrangement &sArrangement);
         static int getTIFFSampleFormat (Glib::ustring fname, IIOSampleFormat &sFormat, IIOSampleArrangement &sArrangement);
 
-        int loadJPEGFromMemory (const char* buffer, int bufsize);
+        int loadJPEGFromMemory (const char* buffer, int bufsize, int minWidth = 0, int minHeight = 0);
         int loadPPMFromMemory(const char* buffer,int width,int height, bool swap, int bps);
 
         int savePNG  (Glib::ustring fname, int compression = -1, volatile int bps = -1);
         int saveJPEG (Glib::ustring fname, int quality = 100, int subSamp=3);
         int saveTIFF (Glib::ustring fname, int bps = -1, bool uncompressed = false);
 
+        // ratio between the size of the last loaded image and its size in the file
+        double      getLoadedScale () { return loadedScale; }
         cmsHPROFILE getEmbeddedProfile () { return embProfile; }
         void        getEmbeddedProfileData (int& length, unsigned char*& pdata) { length = loadedProfileLength; pdata = (unsigned char*)loadedProfileData; }
 
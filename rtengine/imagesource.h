@@ -65,6 +65,8 @@ class ImageSource : public InitialImage {
         virtual int         load        (Glib::ustring fname, bool batch = false) =0;
         virtual void        preprocess  (const RAWParams &raw, const LensProfParams &lensProf, const CoarseTransformParams& coarse){};
         virtual void        demosaic    (const RAWParams &raw){};
+        // preprocesses and demosaics ahead of time; the next preprocess and demosaic calls with the same parameters do nothing
+        virtual void        prepare     (const RAWParams &raw, const LensProfParams &lensProf, const CoarseTransformParams& coarse, volatile bool* cancel = NULL) {}
         virtual void        flushRawData       (){};
         virtual void        flushRGB           (){};
         virtual void        HLRecovery_Global  (ToneCurveParams hrp){};
@@ -90,6 +92,9 @@ class ImageSource : public InitialImage {
         virtual void        getFullSize (int& w, int& h, int tr = TR_NONE) {}
         virtual void        getSize     (int tran, PreviewProps pp, int& w, int& h) {}
         virtual int         getRotateDegree() const { return 0; }
+        // position in the source of the first pixel averaged into pixel (i,j) of the width x height image returned by
+        // getImage(tran,pp); false if the source doesn't sample a region like the same part of the whole image
+        virtual bool        getSamplePosition (int tran, PreviewProps pp, int width, int height, int i, int j, int& sx, int& sy) { return false; }
 
         virtual ImageData*     getImageData () =0;
         virtual ImageMatrices* getImageMatrices () =0;
@@ -18,21 +18,33 @@
  */
 #include "improccoordinator.h"
 #include "curves.h"
+#include "curvecache.h"
 #include "mytime.h"
 #include "refreshmap.h"
 #include "simpleprocess.h"
 #include "../rtgui/ppversion.h"
 #include "colortemp.h"
 #include "improcfun.h"
+#include "histogram.h"
+#include "opthelper.h"
 
 namespace rtengine {
 
 extern const Settings* settings;
 
+// pp3 groups used to build orig_prev: raw processing, white balance, highlight reconstruction, denoise and color space conversion
+static const char* const initGroups[] = { "RAW", "RAW Bayer", "RAW X-Trans", "LensProfile", "Coarse Transformation", "White Balance",
+                                          "HLRecovery", "Directional Pyramid Denoising", "Color Management", NULL };
+// pp3 groups only used by the Lab part of the pipeline (or not at all by the preview), they don't change oprevl
+static const char* const labGroups[] = { "Version", "General", "Luminance Curve", "Sharpening", "Vibrance", "SharpenEdge", "SharpenMicro",
+                                         "Color Boost", "Color Shift", "Color appearance", "Impulse Denoising", "Defringing", "EPD",
+                                         "Luminance Denoising", "Chrominance Denoising", "Wavelet", "Directional Pyramid Equalizer",
+                                         "Resize", "Exif", "IPTC", NULL };
+
 ImProcCoordinator::ImProcCoordinator ()
     : orig_prev(NULL), oprevi(NULL), oprevl(NULL), nprevl(NULL), previmg(NULL), workimg(NULL),
       ncie(NULL), imgsrc(NULL), shmap(NULL), lastAwbEqual(0.), ipf(&params, true), scale(10),
-      highDetailPreprocessComputed(false), highDetailRawComputed(false), allocated(false),
+      highDetailPreprocessComputed(false), highDetailRawComputed(false), allocated(false), pyramidTr(TR_NONE), pyramidTasks(new TaskGroup (TASK_BACKGROUND, 1)),
       bwAutoR(-9000.f), bwAutoG(-9000.f), bwAutoB(-9000.f), CAMMean(0.),
 
       hltonecurve(65536),
@@ -85,15 +97,39 @@ ImProcCoordinator::ImProcCoordinator ()
 	  fullw(1),fullh(1),
       pW(-1), pH(-1),
       plistener(NULL), imageListener(NULL), aeListener(NULL), acListener(NULL),abwListener(NULL),actListener(NULL),adnListener(NULL), awavListener(NULL), hListener(NULL), 
-      resultValid(false), changeSinceLast(0), updaterRunning(false), destroying(false),utili(false),autili(false),
+      resultValid(false), changeSinceLast(0), updaterRunning(false), obsolete(false), destroying(false),utili(false),autili(false),
 	  butili(false),ccutili(false),cclutili(false),clcutili(false),opautili(false)
-
-    {}
+{
+}
 
 void ImProcCoordinator::assign (ImageSource* imgsrc) {
     this->imgsrc = imgsrc;
 }
 
+RAWParams ImProcCoordinator::previewRawParams (const RAWParams& raw, bool highDetailNeeded) {
+
+    RAWParams rp = raw;
+    if( !highDetailNeeded ){
+        // if below 100% magnification, take a fast path
+        if(rp.bayersensor.method != RAWParams::BayerSensor::methodstring[RAWParams::BayerSensor::none] && rp.bayersensor.method != RAWParams::BayerSensor::methodstring[RAWParams::BayerSensor::mono])
+            rp.bayersensor.method = RAWParams::BayerSensor::methodstring[RAWParams::BayerSensor::fast];
+        //bayerrp.all_enhance = false;
+
+        if(rp.xtranssensor.method != RAWParams::XTransSensor::methodstring[RAWParams::XTransSensor::none] && rp.xtranssensor.method != RAWParams::XTransSensor::methodstring[RAWParams::XTransSensor::mono])
+            rp.xtranssensor.method = RAWParams::XTransSensor::methodstring[RAWParams::XTransSensor::fast];
+
+        rp.bayersensor.ccSteps = 0;
+        rp.xtranssensor.ccSteps = 0;
+        //rp.deadPixelFilter = rp.hotPixelFilter = false;
+    }
+    return rp;
+}
+
+bool ImProcCoordinator::previewNeedsHighDetail () {
+
+    return options.prevdemo==PD_Sidecar; //i#2664
+}
+
 ImProcCoordinator::~ImProcCoordinator () {
 
     destroying = true;
@@ -102,7 +138,10 @@ ImProcCoordinator::~ImProcCoordinator () {
         thread->join ();
     mProcessing.lock(); 
     mProcessing.unlock(); 
+    pyramidTasks->cancel ();
+    delete pyramidTasks;    // waits for the level being built
     freeAll ();
+    freePyramid ();
 
     std::vector<Crop*> toDel = crops;
     for (size_t i=0; i<toDel.size(); i++)
@@ -123,6 +162,15 @@ DetailedCrop* ImProcCoordinator::createCrop  (::EditDataProvider *editDataProvid
 void ImProcCoordinator::updatePreviewImage (int todo, Crop* cropCall) {
 
     MyMutex::MyLock processingLock(mProcessing);
+
+    // the pyramid levels are rendered from the image source, which is about to change
+    pyramidTasks->cancel ();
+    pyramidTasks->wait ();
+    {
+        MyMutex::MyLock pyramidLock(pyramidMutex);
+        pyramidQueued.clear ();
+    }
+
     int numofphases = 14;
     int readyphase = 0;
 
@@ -138,7 +186,7 @@ void ImProcCoordinator::updatePreviewImage (int todo, Crop* cropCall) {
 
     bool highDetailNeeded = false;
 
-    if (options.prevdemo==PD_Sidecar) highDetailNeeded = true; //i#2664
+    if (previewNeedsHighDetail ()) highDetailNeeded = true;
     else highDetailNeeded = (todo & M_HIGHQUAL);
 
     // Check if any detail crops need high detail. If not, take a fast path short cut
@@ -150,26 +198,15 @@ void ImProcCoordinator::updatePreviewImage (int todo, Crop* cropCall) {
             }
     }
 
-    RAWParams rp = params.raw;
-    if( !highDetailNeeded ){
-        // if below 100% magnification, take a fast path
-        if(rp.bayersensor.method != RAWParams::BayerSensor::methodstring[RAWParams::BayerSensor::none] && rp.bayersensor.method != RAWParams::BayerSensor::methodstring[RAWParams::BayerSensor::mono])
-            rp.bayersensor.method = RAWParams::BayerSensor::methodstring[RAWParams::BayerSensor::fast];
-        //bayerrp.all_enhance = false;
-
-        if(rp.xtranssensor.method != RAWParams::XTransSensor::methodstring[RAWParams::XTransSensor::none] && rp.xtranssensor.method != RAWParams::XTransSensor::methodstring[RAWParams::XTransSensor::mono])
-            rp.xtranssensor.method = RAWParams::XTransSensor::methodstring[RAWParams::XTransSensor::fast];
-
-        rp.bayersensor.ccSteps = 0;
-        rp.xtranssensor.ccSteps = 0;
-        //rp.deadPixelFilter = rp.hotPixelFilter = false;
-    }
+    RAWParams rp = previewRawParams (params.raw, highDetailNeeded);
 
     progress ("Applying white balance, color correction & sRGB conversion...",100*readyphase/numofphases);
     // raw auto CA is bypassed if no high detail is needed, so we have to compute it when high detail is needed
     if ( (todo & M_PREPROC) || (!highDetailPreprocessComputed && highDetailNeeded)) {
         imgsrc->preprocess( rp, params.lensProf, params.coarse );
         imgsrc->getRAWHistogram( histRedRaw, histGreenRaw, histBlueRaw );
+        MyMutex::MyLock initLock(minit);
+        freePyramid ();
         if (highDetailNeeded)
             highDetailPreprocessComputed = true;
         else
@@ -202,6 +239,10 @@ void ImProcCoordinator::updatePreviewImage (int todo, Crop* cropCall) {
         imgsrc->isRAW();
 
         imgsrc->demosaic( rp );
+        {
+            MyMutex::MyLock initLock(minit);
+            freePyramid ();
+        }
 
         if (highDetailNeeded) {
             highDetailRawComputed = true;
@@ -230,6 +271,8 @@ void ImProcCoordinator::updatePreviewImage (int todo, Crop* cropCall) {
     if (todo & (M_INIT|M_LINDENOISE)) {
         MyMutex::MyLock initLock(minit);  // Also used in crop window
 
+        freePyramid ();
+
         imgsrc->HLRecovery_Global( params.toneCurve ); // this handles Color HLRecovery
         if (settings->verbose) printf ("Applying white balance, color correction & sRBG conversion...\n");
         currWB = ColorTemp (params.wb.temperature, params.wb.green, params.wb.equal, params.wb.method);
@@ -269,60 +312,85 @@ void ImProcCoordinator::updatePreviewImage (int todo, Crop* cropCall) {
         // Will (re)allocate the preview's buffers
         setScale (scale);
 
-        imgsrc->getImage (currWB, tr, orig_prev, pp, params.toneCurve, params.icm, params.raw);
-        //ColorTemp::CAT02 (orig_prev, &params)	;
-
-		Imagefloat *calclum = NULL ;
-		DirPyrDenoiseParams denoiseParams = params.dirpyrDenoise;
-
-		denoiseParams.getCurves(noiseLCurve,noiseCCurve);
-		int nbw=6;//nb tile W
-		int nbh=4;//
-		
-		float *ch_M = new float [nbw*nbh];//allocate memory
-		float *max_r = new float [nbw*nbh];//allocate memory
-		float *max_b = new float [nbw*nbh];//allocate memory
-		
-		if(denoiseParams.Lmethod == "CUR") {
-			if(noiseLCurve)
-				denoiseParams.luma = 0.5f;
-			else
-				denoiseParams.luma = 0.0f;
-		} else if(denoiseParams.Lmethod == "SLI")
-			noiseLCurve.Reset();
-		
-
-		if((noiseLCurve || noiseCCurve) &&  denoiseParams.enabled && (scale==1)){//only allocate memory if enabled and scale=1	
-			// we only need image reduced to 1/4 here
-			calclum = new Imagefloat ((pW+1)/2, (pH+1)/2);//for luminance denoise curve
-			for(int ii=0;ii<pH;ii+=2){
-				for(int jj=0;jj<pW;jj+=2){
-					calclum->r(ii>>1,jj>>1) = orig_prev->r(ii,jj);
-					calclum->g(ii>>1,jj>>1) = orig_prev->g(ii,jj);
-					calclum->b(ii>>1,jj>>1) = orig_prev->b(ii,jj);
+        // the stage may have been computed already with the same parameters (history navigation, undo, before/after)
+        Glib::ustring ppText = params.toString ();
+        unsigned int seed = scale | (highDetailPreprocessComputed ? 1<<8 : 0) | (highDetailRawComputed ? 1<<9 : 0) | ((todo & M_LINDENOISE) ? 1<<10 : 0);
+        initKey = stageKey (ppText, initGroups, true, seed);
+
+        std::vector<float> initValues;
+        Imagefloat* cachedInit = initCache.get (initKey, initValues);
+        if (cachedInit && cachedInit->width == pW && cachedInit->height == pH) {
+            cachedInit->copyData (orig_prev);
+            chaut = initValues[0]; redaut = initValues[1]; blueaut = initValues[2];
+            maxredaut = initValues[3]; maxblueaut = initValues[4]; nresi = initValues[5]; highresi = initValues[6];
+        }
+        else {
+            imgsrc->getImage (currWB, tr, orig_prev, pp, params.toneCurve, params.icm, params.raw);
+            //ColorTemp::CAT02 (orig_prev, &params)	;
+
+			Imagefloat *calclum = NULL ;
+			DirPyrDenoiseParams denoiseParams = params.dirpyrDenoise;
+
+			denoiseParams.getCurves(noiseLCurve,noiseCCurve);
+			int nbw=6;//nb tile W
+			int nbh=4;//
+			
+			float *ch_M = new float [nbw*nbh];//allocate memory
+			float *max_r = new float [nbw*nbh];//allocate memory
+			float *max_b = new float [nbw*nbh];//allocate memory
+			
+			if(denoiseParams.Lmethod == "CUR") {
+				if(noiseLCurve)
+					denoiseParams.luma = 0.5f;
+				else
+					denoiseParams.luma = 0.0f;
+			} else if(denoiseParams.Lmethod == "SLI")
+				noiseLCurve.Reset();
+			
+
+			if((noiseLCurve || noiseCCurve) &&  denoiseParams.enabled && (scale==1)){//only allocate memory if enabled and scale=1	
+				// we only need image reduced to 1/4 here
+				calclum = new Imagefloat ((pW+1)/2, (pH+1)/2);//for luminance denoise curve
+				for(int ii=0;ii<pH;ii+=2){
+					for(int jj=0;jj<pW;jj+=2){
+						calclum->r(ii>>1,jj>>1) = orig_prev->r(ii,jj);
+						calclum->g(ii>>1,jj>>1) = orig_prev->g(ii,jj);
+						calclum->b(ii>>1,jj>>1) = orig_prev->b(ii,jj);
+					}
 				}
+				imgsrc->convertColorSpace(calclum, params.icm, currWB, params.raw);//claculate values after colorspace conversion
 			}
-			imgsrc->convertColorSpace(calclum, params.icm, currWB, params.raw);//claculate values after colorspace conversion
-		}
-		//always enabled to calculated auto Chroma
-        if (todo & M_LINDENOISE) {
-			if (denoiseParams.enabled && (scale==1)) {
-			printf("IMPROC\n");
-			int kall=1;
-			ipf.RGB_denoise(kall, orig_prev, orig_prev, calclum, ch_M, max_r, max_b, imgsrc->isRAW(), denoiseParams, imgsrc->getDirPyrDenoiseExpComp(), noiseLCurve, noiseCCurve, chaut, redaut, blueaut, maxredaut, maxblueaut, nresi, highresi);
-		}
-		}
-	//	delete calclum;
-	delete [] ch_M;
-	delete [] max_r;
-	delete [] max_b;
-	
-        imgsrc->convertColorSpace(orig_prev, params.icm, currWB, params.raw);
+			//always enabled to calculated auto Chroma
+            if (todo & M_LINDENOISE) {
+				if (denoiseParams.enabled && (scale==1)) {
+				printf("IMPROC\n");
+				int kall=1;
+				ipf.RGB_denoise(kall, orig_prev, orig_prev, calclum, ch_M, max_r, max_b, imgsrc->isRAW(), denoiseParams, imgsrc->getDirPyrDenoiseExpComp(), noiseLCurve, noiseCCurve, chaut, redaut, blueaut, maxredaut, maxblueaut, nresi, highresi, &obsolete);
+			}
+			}
+		//	delete calclum;
+		delete [] ch_M;
+		delete [] max_r;
+		delete [] max_b;
+		
+            imgsrc->convertColorSpace(orig_prev, params.icm, currWB, params.raw);
+
+            initValues.resize (7);
+            initValues[0] = chaut; initValues[1] = redaut; initValues[2] = blueaut;
+            initValues[3] = maxredaut; initValues[4] = maxblueaut; initValues[5] = nresi; initValues[6] = highresi;
+            if (options.previewCacheSize > 0 && !obsolete)
+                initCache.put (initKey, orig_prev->copy (), initValues, options.previewCacheSize);
+        }
 
         ipf.firstAnalysis (orig_prev, &params, vhist16, imgsrc->getGamma());
     }
     readyphase++;
 
+    if (obsolete) {
+        cancelUpdate (todo, M_PREPROC|M_RAW);
+        return;
+    }
+
     progress ("Rotate / Distortion...",100*readyphase/numofphases);
     // Remove transformation if unneeded
     bool needstransform = ipf.needsTransform();
@@ -349,6 +417,11 @@ void ImProcCoordinator::updatePreviewImage (int todo, Crop* cropCall) {
     }
     readyphase++;
 
+    if (obsolete) {
+        cancelUpdate (todo, M_PREPROC|M_RAW|M_INIT|M_LINDENOISE|M_TRANSFORM|M_BLURMAP);
+        return;
+    }
+
     if (todo & M_AUTOEXP) {
         if (params.toneCurve.autoexp) {
             LUTu aehist; int aehistcompr;
@@ -400,6 +473,9 @@ void ImProcCoordinator::updatePreviewImage (int todo, Crop* cropCall) {
 
         CurveFactory::curveBW (params.blackwhite.beforeCurve,params.blackwhite.afterCurve, vhist16bw, histToneCurveBW, beforeToneCurveBW, afterToneCurveBW,scale==1 ? 1 : 1);
 
+        if (settings->verbose)
+            curveCache.printStats ();
+
 
         float satLimit = float(params.colorToning.satProtectionThreshold)/100.f*0.7f+0.3f;
         float satLimitOpacity = 1.f-(float(params.colorToning.saturatedOpacity)/100.f);
@@ -445,8 +521,28 @@ void ImProcCoordinator::updatePreviewImage (int todo, Crop* cropCall) {
 			double rrm=33.;
 			double ggm=33.;
 			double bbm=33.;
-            ipf.rgbProc (oprevi, oprevl, NULL, hltonecurve, shtonecurve, tonecurve, shmap, params.toneCurve.saturation,
-                         rCurve, gCurve, bCurve, satLimit ,satLimitOpacity, ctColorCurve, ctOpacityCurve, opautili, clToningcurve, cl2Toningcurve, customToneCurve1, customToneCurve2,beforeToneCurveBW, afterToneCurveBW, rrm, ggm, bbm, bwAutoR, bwAutoG, bwAutoB, params.toneCurve.expcomp, params.toneCurve.hlcompr, params.toneCurve.hlcomprthresh);
+
+            // the key is computed after the auto exposure, which may have changed the tone curve parameters
+            StageKey rgbKey = stageKey (params.toString (), labGroups, false, 0, &initKey);
+            std::vector<float> rgbValues;
+            LabImage* cachedRGB = rgbCache.get (rgbKey, rgbValues);
+            if (cachedRGB && cachedRGB->W == pW && cachedRGB->H == pH) {
+                oprevl->CopyFrom (cachedRGB);
+                rrm = rgbValues[0]; ggm = rgbValues[1]; bbm = rgbValues[2];
+                bwAutoR = rgbValues[3]; bwAutoG = rgbValues[4]; bwAutoB = rgbValues[5];
+            }
+            else {
+                ipf.rgbProc (oprevi, oprevl, NULL, hltonecurve, shtonecurve, tonecurve, shmap, params.toneCurve.saturation,
+                             rCurve, gCurve, bCurve, satLimit ,satLimitOpacity, ctColorCurve, ctOpacityCurve, opautili, clToningcurve, cl2Toningcurve, customToneCurve1, customToneCurve2,beforeToneCurveBW, afterToneCurveBW, rrm, ggm, bbm, bwAutoR, bwAutoG, bwAutoB, params.toneCurve.expcomp, params.toneCurve.hlcompr, params.toneCurve.hlcomprthresh);
+                if (options.previewCacheSize > 0) {
+                    rgbValues.resize (6);
+                    rgbValues[0] = rrm; rgbValues[1] = ggm; rgbValues[2] = bbm;
+                    rgbValues[3] = bwAutoR; rgbValues[4] = bwAutoG; rgbValues[5] = bwAutoB;
+                    LabImage* copy = new LabImage (pW, pH);
+                    copy->CopyFrom (oprevl);
+                    rgbCache.put (rgbKey, copy, rgbValues, options.previewCacheSize);
+                }
+            }
             if(params.blackwhite.enabled && params.blackwhite.autoc && abwListener) {
                 if (settings->verbose)
                     printf("ImProcCoordinator / Auto B&W coefs:   R=%.2f   G=%.2f   B=%.2f\n", bwAutoR, bwAutoG, bwAutoB);
@@ -581,9 +677,14 @@ void ImProcCoordinator::updatePreviewImage (int todo, Crop* cropCall) {
 		
 			int kall=0;
 			progress ("Wavelet...",100*readyphase/numofphases);
-			ipf.ip_wavelet(nprevl, nprevl, kall, WaveParams, wavCLVCurve, waOpacityCurveRG, waOpacityCurveBY, scale);		
+			ipf.ip_wavelet(nprevl, nprevl, kall, WaveParams, wavCLVCurve, waOpacityCurveRG, waOpacityCurveBY, scale, &obsolete);		
 		}
 
+        if (obsolete) {
+            cancelUpdate (todo, todo & ~(M_LUMINANCE|M_COLOR));
+            return;
+        }
+
         
         if(params.colorappearance.enabled){
 			//L histo  and Chroma histo for ciecam
@@ -667,6 +768,11 @@ void ImProcCoordinator::updatePreviewImage (int todo, Crop* cropCall) {
             if (CAMBrightCurveQ) CAMBrightCurveQ.reset();
         }
     }
+    if (obsolete) {
+        cancelUpdate (todo, todo);
+        return;
+    }
+
     // process crop, if needed
     for (size_t i=0; i<crops.size(); i++)
         if (crops[i]->hasListener () && cropCall != crops[i] )
@@ -717,6 +823,158 @@ void ImProcCoordinator::updatePreviewImage (int todo, Crop* cropCall) {
 }
 
 
+/** @brief Called when new parameters arrived while updatePreviewImage was running
+  *
+  * The stages of this update that have not been completed are scheduled again, so the next update
+  * doesn't rely on their incomplete output. The crops have not been updated at all, they redo the whole update.
+  * @param todo the stages requested by the cancelled update
+  * @param done the stages that have been completed
+  */
+void ImProcCoordinator::cancelUpdate (int todo, int done) {
+
+    if (settings->verbose)
+        printf ("ImProcCoordinator: update cancelled, new parameters pending\n");
+
+    paramsUpdateMutex.lock ();
+    changeSinceLast |= todo & ~done;
+    paramsUpdateMutex.unlock ();
+
+    for (size_t i=0; i<crops.size(); i++)
+        crops[i]->postponeUpdate (todo);
+
+    CAMBrightCurveJ.dirty = true;
+    CAMBrightCurveQ.dirty = true;
+}
+
+/** @brief Copies a part of the color converted image, subsampled by skip, from the pyramid
+  *
+  * Each level of the pyramid is the whole image rendered at a skip factor, so panning and zooming in the crops
+  * don't need to render the image source again. The preview image is used as the level of its own scale.
+  * A missing level is queued to be built in the background, the crop renders its region itself meanwhile.
+  * Levels are freed when the white balance, the raw processing or the color management changes.
+  * The caller must hold minit.
+  * @param dst image receiving the region, its size is the size of the region
+  * @param tran coarse transformation of the region
+  * @param pp region, as passed to ImageSource::getImage to render it
+  * @return true if dst has been filled, false if the caller has to render the region itself
+  */
+bool ImProcCoordinator::getPyramidRegion (Imagefloat* dst, int tran, PreviewProps pp) {
+
+    const int skip = pp.skip;
+    if (skip < 2)
+        return false;
+
+    MyMutex::MyLock lock(pyramidMutex);
+
+    if (tran != pyramidTr) {
+        lock.release ();
+        freePyramid ();
+        lock.acquire ();
+        pyramidTr = tran;
+    }
+
+    Imagefloat* level = NULL;
+    if (skip == scale && orig_prev && tran == tr)
+        level = orig_prev;
+    else {
+        std::map<int, Imagefloat*>::iterator it = pyramid.find (skip);
+        if (it != pyramid.end())
+            level = it->second;
+        else {
+            if (pyramidQueued.insert (skip).second)
+                pyramidTasks->run (sigc::bind (sigc::mem_fun (*this, &ImProcCoordinator::buildPyramidLevel),
+                                               skip, tran, currWB, params.toneCurve, params.icm, params.raw));
+            return false;
+        }
+    }
+
+    // the pixels of the region are found in the level from the position of their samples in the image source,
+    // the regions being sampled from their own origin, which isn't necessarily on the grid of the level
+    const int W = dst->width;
+    const int H = dst->height;
+    PreviewProps lpp (0, 0, fw, fh, skip);
+    int lx, ly, lxj, lyj, lxi, lyi, rx, ry, rxj, ryj, rxi, ryi;
+    if (W < 2 || H < 2
+            || !imgsrc->getSamplePosition (tran, lpp, level->width, level->height, 0, 0, lx, ly)
+            || !imgsrc->getSamplePosition (tran, lpp, level->width, level->height, 0, 1, lxj, lyj)
+            || !imgsrc->getSamplePosition (tran, lpp, level->width, level->height, 1, 0, lxi, lyi)
+            || !imgsrc->getSamplePosition (tran, pp, W, H, 0, 0, rx, ry)
+            || !imgsrc->getSamplePosition (tran, pp, W, H, 0, 1, rxj, ryj)
+            || !imgsrc->getSamplePosition (tran, pp, W, H, 1, 0, rxi, ryi))
+        return false;
+
+    // the same transformation gives the same directions to the rows and columns of the level and of the region
+    const int djx = lxj - lx, djy = lyj - ly;
+    const int dix = lxi - lx, diy = lyi - ly;
+    if (rxj - rx != djx || ryj - ry != djy || rxi - rx != dix || ryi - ry != diy)
+        return false;
+    const int dx = rx - lx, dy = ry - ly;
+    const int j0 = (dx * djx + dy * djy) / (skip * skip);
+    const int i0 = (dx * dix + dy * diy) / (skip * skip);
+    if (i0 * dix + j0 * djx != dx || i0 * diy + j0 * djy != dy)
+        return false;   // not on the grid of the level
+
+#ifdef _OPENMP
+#pragma omp parallel for
+#endif
+    for (int i=0; i<H; i++) {
+        int li = LIM(i0+i, 0, level->height-1);
+        for (int j=0; j<W; j++) {
+            int lj = LIM(j0+j, 0, level->width-1);
+            dst->r(i,j) = level->r(li,lj);
+            dst->g(i,j) = level->g(li,lj);
+            dst->b(i,j) = level->b(li,lj);
+        }
+    }
+    return true;
+}
+
+/** @brief Renders a level of the pyramid, run by pyramidTasks
+  *
+  * updatePreviewImage waits for it before changing the image source, the parameters are the ones of the request.
+  * The image source isn't reentrant, so it is rendered under minit like the crops and the preview. */
+void ImProcCoordinator::buildPyramidLevel (int skip, int tran, ColorTemp wb, ToneCurveParams hrp, ColorManagementParams cmp, RAWParams raw) {
+
+    Imagefloat* level;
+    {
+        MyMutex::MyLock initLock(minit);
+        {
+            MyMutex::MyLock lock(pyramidMutex);
+            if (!pyramidQueued.count (skip) || tran != pyramidTr)
+                return;     // freed while waiting for minit
+        }
+
+        int w, h;
+        PreviewProps pp (0, 0, fw, fh, skip);
+        imgsrc->getSize (tran, pp, w, h);
+        level = new Imagefloat (w, h);
+        imgsrc->getImage (wb, tran, level, pp, hrp, cmp, raw);
+        imgsrc->convertColorSpace (level, cmp, wb, raw);
+    }
+
+    MyMutex::MyLock lock(pyramidMutex);
+    if (!pyramidQueued.erase (skip) || tran != pyramidTr) {
+        // freed meanwhile
+        delete level;
+        return;
+    }
+    // the levels with a small skip factor are the largest ones, they are dropped first
+    while (pyramid.size() >= 2) {
+        delete pyramid.begin()->second;
+        pyramid.erase (pyramid.begin());
+    }
+    pyramid[skip] = level;
+}
+
+void ImProcCoordinator::freePyramid () {
+
+    MyMutex::MyLock lock(pyramidMutex);
+    for (std::map<int, Imagefloat*>::iterator it = pyramid.begin(); it != pyramid.end(); ++it)
+        delete it->second;
+    pyramid.clear ();
+    pyramidQueued.clear ();
+}
+
 void ImProcCoordinator::freeAll () {
 
     if (settings->verbose) printf ("freeall starts %d\n", (int)allocated);
@@ -808,45 +1066,80 @@ void ImProcCoordinator::updateLRGBHistograms () {
     int x1, y1, x2, y2;
     params.crop.mapToResized(pW, pH, scale, x1, x2, y1, y2); 
 
-#pragma omp parallel sections
-{
-#pragma omp section
+    // only the shape of the histograms is displayed, they are counted on a subsampled preview when it's large
+    const int step = ParallelHistogram::subsampling (x2-x1, y2-y1, 1<<20);
+
+    ParallelHistogram chroma (histChroma.getSize(), 4), luma (histLuma.getSize(), 4);
+    ParallelHistogram red (histRed.getSize()), green (histGreen.getSize()), blue (histBlue.getSize());
+    const int chromaMax = chroma.getSize()-1, lumaMax = luma.getSize()-1;
+
+#ifdef _OPENMP
+#pragma omp parallel
+#endif
 {
-    histChroma.clear();
-    for (int i=y1; i<y2; i++)
-        for (int j=x1; j<x2; j++) {
-            histChroma[(int)(sqrtf(SQR(nprevl->a[i][j]) + SQR(nprevl->b[i][j]))/188.f)]++;//188 = 48000/256
+    unsigned int* chromaBins = chroma.threadBins();
+    unsigned int* lumaBins = luma.threadBins();
+    unsigned int* redBins = red.threadBins();
+    unsigned int* greenBins = green.threadBins();
+    unsigned int* blueBins = blue.threadBins();
+#ifdef __SSE2__
+    const vfloat chromaScalev = F2V(1.f/188.f), lumaScalev = F2V(1.f/128.f);
+    const vfloat chromaMaxv = F2V(chromaMax), lumaMaxv = F2V(lumaMax), zerov = ZEROV;
+    const int chromaCopy = chroma.getSize(), lumaCopy = luma.getSize();
+    int chromaIdx[4], lumaIdx[4];
+#endif
+
+#ifdef _OPENMP
+#pragma omp for schedule(dynamic,16) nowait
+#endif
+    for (int i=y1; i<y2; i+=step) {
+        int j=x1;
+#ifdef __SSE2__
+        if (step == 1) {
+            // each lane of the vectors counts in its own copy of the bins
+            for (; j<x2-3; j+=4) {
+                vfloat av = LVFU(nprevl->a[i][j]);
+                vfloat bv = LVFU(nprevl->b[i][j]);
+                vfloat cv = vmulf(vsqrtf(vaddf(vmulf(av,av), vmulf(bv,bv))), chromaScalev);//188 = 48000/256
+                _mm_storeu_si128 ((__m128i*)chromaIdx, _mm_cvttps_epi32(vminf(vmaxf(cv, zerov), chromaMaxv)));
+                chromaBins[chromaIdx[0]]++;
+                chromaBins[chromaCopy+chromaIdx[1]]++;
+                chromaBins[2*chromaCopy+chromaIdx[2]]++;
+                chromaBins[3*chromaCopy+chromaIdx[3]]++;
+                vfloat lv = vmulf(LVFU(nprevl->L[i][j]), lumaScalev);
+                _mm_storeu_si128 ((__m128i*)lumaIdx, _mm_cvttps_epi32(vminf(vmaxf(lv, zerov), lumaMaxv)));
+                lumaBins[lumaIdx[0]]++;
+                lumaBins[lumaCopy+lumaIdx[1]]++;
+                lumaBins[2*lumaCopy+lumaIdx[2]]++;
+                lumaBins[3*lumaCopy+lumaIdx[3]]++;
+            }
         }
-}
-#pragma omp section
-{
-    histLuma.clear();
-    for (int i=y1; i<y2; i++)
-        for (int j=x1; j<x2; j++) {
-            histLuma[(int)(nprevl->L[i][j]/128.f)]++;
+#endif
+        for (; j<x2; j+=step) {
+            chromaBins[LIM((int)(sqrtf(SQR(nprevl->a[i][j]) + SQR(nprevl->b[i][j]))/188.f), 0, chromaMax)]++;//188 = 48000/256
+            lumaBins[LIM((int)(nprevl->L[i][j]/128.f), 0, lumaMax)]++;
         }
-}
-#pragma omp section
-{
-    histRed.clear();
-    histGreen.clear();
-    histBlue.clear();
-
-    for (int i=y1; i<y2; i++) {
-        int ofs = (i*pW + x1)*3;
-        for (int j=x1; j<x2; j++) {
-            int r=workimg->data[ofs++];
-            int g=workimg->data[ofs++];
-            int b=workimg->data[ofs++];
 
-            histRed[r]++;
-            histGreen[g]++;
-            histBlue[b]++;
+        const unsigned char* data = workimg->data + (i*pW + x1)*3;
+        for (j=x1; j<x2; j+=step, data+=3*step) {
+            redBins[data[0]]++;
+            greenBins[data[1]]++;
+            blueBins[data[2]]++;
         }
     }
 }
-}
 
+    const unsigned int weight = step*step;
+    histChroma.clear();
+    chroma.addTo (histChroma, weight);
+    histLuma.clear();
+    luma.addTo (histLuma, weight);
+    histRed.clear();
+    red.addTo (histRed, weight);
+    histGreen.clear();
+    green.addTo (histGreen, weight);
+    histBlue.clear();
+    blue.addTo (histBlue, weight);
 }
 
 void ImProcCoordinator::progress (Glib::ustring str, int pr) {
@@ -1048,6 +1341,8 @@ void ImProcCoordinator::startProcessing () {
 void ImProcCoordinator::startProcessing(int changeCode) {
     paramsUpdateMutex.lock();
     changeSinceLast |= changeCode;
+    if (changeCode & (M_VOID-1))
+        obsolete = true;
     paramsUpdateMutex.unlock();
 
     startProcessing ();
@@ -1063,6 +1358,7 @@ void ImProcCoordinator::process () {
         params = nextParams;
         int change = changeSinceLast;
         changeSinceLast = 0;
+        obsolete = false;
         paramsUpdateMutex.unlock ();
 
         // M_VOID means no update, and is a bit higher that the rest
@@ -1088,6 +1384,9 @@ void ImProcCoordinator::endUpdateParams (ProcEvent change) {
 
 void ImProcCoordinator::endUpdateParams (int changeFlags) {
     changeSinceLast |= changeFlags;
+    // the running update, if any, is now obsolete
+    if (changeFlags & (M_VOID-1))
+        obsolete = true;
 
     paramsUpdateMutex.unlock ();
     startProcessing ();
@@ -27,6 +27,10 @@
 #include "procevents.h"
 #include "dcrop.h"
 #include "LUT.h"
+#include "stagecache.h"
+#include "taskscheduler.h"
+#include <map>
+#include <set>
 #include "../rtgui/threadutils.h"
 
 namespace rtengine {
@@ -77,6 +81,21 @@ class ImProcCoordinator : public StagedImageProcessor {
 
         void freeAll ();
 
+        // Results of the previous updates, keyed by the parameters they depend on
+        StageCache<Imagefloat> initCache;   // orig_prev
+        StageCache<LabImage> rgbCache;      // oprevl
+        StageKey initKey;                   // key of the current orig_prev
+
+        // Color converted whole image at the skip factors requested by the crops, built in the background on first use
+        std::map<int, Imagefloat*> pyramid;
+        std::set<int> pyramidQueued;        // skip factors of the levels being built
+        int pyramidTr;
+        MyMutex pyramidMutex;               // protects the members above, taken after minit when both are needed
+        TaskGroup* pyramidTasks;
+        bool getPyramidRegion (Imagefloat* dst, int tran, PreviewProps pp);
+        void buildPyramidLevel (int skip, int tran, ColorTemp wb, ToneCurveParams hrp, ColorManagementParams cmp, RAWParams raw);
+        void freePyramid ();
+
         // Precomputed values used by DetailedCrop ----------------------------------------------
 
         float bwAutoR, bwAutoG, bwAutoB;
@@ -162,6 +181,7 @@ class ImProcCoordinator : public StagedImageProcessor {
         void updateLRGBHistograms ();
         void setScale (int prevscale);
         void updatePreviewImage (int todo, Crop* cropCall= NULL);
+        void cancelUpdate (int todo, int done);
 
         MyMutex mProcessing;
         ProcParams params;
@@ -172,6 +192,7 @@ class ImProcCoordinator : public StagedImageProcessor {
         MyMutex paramsUpdateMutex;
         int  changeSinceLast;
         bool updaterRunning;
+        volatile bool obsolete; // set when new parameters arrive, the running update stops at its next check
         ProcParams nextParams;
         bool destroying;
         bool utili;
@@ -191,6 +212,11 @@ class ImProcCoordinator : public StagedImageProcessor {
         ~ImProcCoordinator ();
         void assign     (ImageSource* imgsrc);
 
+        // raw parameters the preview is preprocessed and demosaiced with, the fast methods being used if the full detail isn't needed
+        static RAWParams previewRawParams (const RAWParams& raw, bool highDetailNeeded);
+        // true if the preview is always demosaiced with the method of the parameters
+        static bool previewNeedsHighDetail ();
+
         void        getParams (procparams::ProcParams* dst) { *dst = params; }
 
         void        startProcessing(int changeCode);
@@ -39,6 +39,7 @@
 #include "EdgePreservingDecomposition.h"
 #include "improccoordinator.h"
 #include "clutstore.h"
+#include "histogram.h"
 
 #ifdef _OPENMP
 #include <omp.h>
@@ -195,17 +196,7 @@ void ImProcFunctions::firstAnalysis (Imagefloat* original, const ProcParams* par
 #endif
 	// calculate histogram of the y channel needed for contrast curve calculation in exposure adjustments
 
-	int T = 1;
-#ifdef _OPENMP
-	if(multiThread)
-		T = omp_get_max_threads();
-#endif
-
-    unsigned int** hist = new unsigned int* [T];
-    for (int i=0; i<T; i++) {
-		hist[i] = new unsigned int[65536];
-		memset (hist[i], 0, 65536*sizeof(int));
-    }
+	ParallelHistogram hist (65536);
 
 #ifdef _OPENMP
 	#pragma omp parallel if (multiThread)
@@ -216,22 +207,16 @@ void ImProcFunctions::firstAnalysis (Imagefloat* original, const ProcParams* par
 		int blk = H/nthreads;
 
 		if (tid<nthreads-1)
-			firstAnalysisThread (original, wprofile, hist[tid], tid*blk, (tid+1)*blk);
+			firstAnalysisThread (original, wprofile, hist.threadBins(), tid*blk, (tid+1)*blk);
 		else
-			firstAnalysisThread (original, wprofile, hist[tid], tid*blk, H);
+			firstAnalysisThread (original, wprofile, hist.threadBins(), tid*blk, H);
     }
 #else
-    firstAnalysisThread (original, wprofile, hist[0], 0, original->height);
+    firstAnalysisThread (original, wprofile, hist.threadBins(), 0, original->height);
 #endif
 
 	histogram.clear();
-	for (int j=0; j<T; j++)
-		for (int i=0; i<65536; i++)
-			histogram[i] += hist[j][i];
-
-    for (int i=0; i<T; i++)
-    	delete [] hist[i];
-    delete [] hist;
+	hist.addTo (histogram);
 }
 
 // Copyright (c) 2012 Jacques Desmis <jdesmis@gmail.com>
@@ -1136,7 +1121,7 @@ if((params->colorappearance.tonecie || (params->colorappearance.tonecie && param
 
 
 // Copyright (c) 2012 Jacques Desmis <jdesmis@gmail.com>
-void ImProcFunctions::ciecam_02float (CieImage* ncie, float adap, int begh, int endh, int pW, int pwb, LabImage* lab, const ProcParams* params,
+SSEFUNCTION void ImProcFunctions::ciecam_02float (CieImage* ncie, float adap, int begh, int endh, int pW, int pwb, LabImage* lab, const ProcParams* params,
 								const ColorAppearance & customColCurve1, const ColorAppearance & customColCurve2,const ColorAppearance & customColCurve3,
 								LUTu & histLCAM, LUTu & histCCAM, LUTf & CAMBrightCurveJ, LUTf & CAMBrightCurveQ, float &mean, int Iterates, int scale, bool execsharp, float &d, int scalecd, int rtt)
 {
@@ -1310,18 +1295,13 @@ if(params->colorappearance.enabled) {
 			hist16Q (65536);
 			hist16Q.clear();
 		}
+		// each thread counts in its own bins
+		ParallelHistogram hist16Jpar (needJ ? 65536 : 1);
+		ParallelHistogram hist16Qpar (needQ ? 65536 : 1);
 #pragma omp parallel
 {
-		LUTu hist16Jthr;
-		LUTu hist16Qthr;
-		if (needJ) {
-			hist16Jthr (65536);
-			hist16Jthr.clear();
-		}
-		if (needQ) {
-			hist16Qthr(65536);
-			hist16Qthr.clear();
-		}
+		unsigned int* hist16Jthr = hist16Jpar.threadBins();
+		unsigned int* hist16Qthr = hist16Qpar.threadBins();
 
 #pragma omp for reduction(+:sum)
 		for (int i=0; i<height; i++)
@@ -1346,17 +1326,11 @@ if(params->colorappearance.enabled) {
 					hist16Qthr[CLIP((int) (sqrtf((koef*(lab->L[i][j]))*32768.f)))]++;	//for brightness Q : approximation for Q=wh*sqrt(J/100)  J not equal L
 				sum+=koef*lab->L[i][j];//evaluate mean J to calculate Yb
 		}
-#pragma omp critical
-{
-	if(needJ)
-		for(int i=0;i<65536;i++)
-			hist16J[i] += hist16Jthr[i];
-	if(needQ)
-		for(int i=0;i<65536;i++)
-			hist16Q[i] += hist16Qthr[i];
-		
-}
 }
+		if(needJ)
+			hist16Jpar.addTo (hist16J);
+		if(needQ)
+			hist16Qpar.addTo (hist16Q);
 
 
 		//mean=(sum/((endh-begh)*width))/327.68f;//for Yb  for all image...if one day "pipette" we can adapt Yb for each zone
@@ -1438,38 +1412,78 @@ if(settings->viewinggreySc==1) yb=18.0f;//fixed
 	};
 	
 	
+#ifdef __SSE2__
+	const vfloat awv = F2V(aw), flv = F2V(fl), whv = F2V(wh), pflv = F2V(pfl);
+	const vfloat xw1v = F2V(xw1), yw1v = F2V(yw1), zw1v = F2V(zw1);
+	const vfloat cv = F2V(c), ncv = F2V(nc), pow1v = F2V(pow1), nbbv = F2V(nbb), ncbv = F2V(ncb), czv = F2V(cz), dv = F2V(d);
+	const vfloat xw2v = F2V(xw2), yw2v = F2V(yw2), zw2v = F2V(zw2);
+	const vfloat c2v = F2V(c2), nc2v = F2V(nc2), pow1nv = F2V(pow1n), nbbjv = F2V(nbbj), ncbjv = F2V(ncbj), fljv = F2V(flj), czjv = F2V(czj), djv = F2V(dj), awjv = F2V(awj);
+#endif
+	const bool labOutput = LabPassOne && (!params->colorappearance.tonecie  || !settings->autocielab || !epdEnabled);
+
+	// each thread fills its own histograms, they are merged at the end
+	ParallelHistogram hist16JCAMpar (ciedata && pW!=1 ? 65536 : 1);
+	ParallelHistogram hist16_CCAMpar (ciedata && pW!=1 ? 65536 : 1);
 #ifndef _DEBUG	
 #pragma omp parallel
 #endif
 {	
 	float minQThr = 10000.f;
 	float maxQThr = -1000.f;
+	unsigned int* hist16JCAMThr = hist16JCAMpar.threadBins();
+	unsigned int* hist16_CCAMThr = hist16_CCAMpar.threadBins();
+	// the forward and inverse models are applied on whole rows
+	const int bufferWidth = (width+3) & ~3;
+	AlignedBuffer<float> rowBuffer(6*bufferWidth);
+	float *Jbuffer = rowBuffer.data;
+	float *Cbuffer = Jbuffer + bufferWidth;
+	float *hbuffer = Cbuffer + bufferWidth;
+	float *Qbuffer = hbuffer + bufferWidth;
+	float *Mbuffer = Qbuffer + bufferWidth;
+	float *sbuffer = Mbuffer + bufferWidth;
 #ifndef _DEBUG
 #pragma omp for schedule(dynamic, 10)
 #endif
-	for (int i=0; i<height; i++)
+	for (int i=0; i<height; i++) {
+		//convert Lab => XYZ
 		for (int j=0; j<width; j++) {
-
-			float L=lab->L[i][j];
-			float a=lab->a[i][j];
-			float b=lab->b[i][j];
 			float x1,y1,z1;
-			float x,y,z;
-			//convert Lab => XYZ
-			Color::Lab2XYZ(L, a, b, x1, y1, z1);
-			float J, C, h, Q, M, s;
-			float Jpro,Cpro, hpro, Qpro, Mpro, spro;
-
-			x=(float)x1/655.35f;
-			y=(float)y1/655.35f;
-			z=(float)z1/655.35f;
-			//process source==> normal
-			ColorTemp::xyz2jchqms_ciecam02float( J, C,  h,
-                           Q,  M,  s, aw, fl, wh,
-                           x,  y,  z,
+			Color::Lab2XYZ(lab->L[i][j], lab->a[i][j], lab->b[i][j], x1, y1, z1);
+			Jbuffer[j]=x1/655.35f;
+			Cbuffer[j]=y1/655.35f;
+			hbuffer[j]=z1/655.35f;
+		}
+		//process source==> normal
+		int k=0;
+#ifdef __SSE2__
+		for (; k<width-3; k+=4) {
+			vfloat J, C, h, Q, M, s;
+			ColorTemp::xyz2jchqms_ciecam02float( J, C, h,
+                           Q, M, s, awv, flv, whv,
+                           LVF(Jbuffer[k]), LVF(Cbuffer[k]), LVF(hbuffer[k]),
+                           xw1v, yw1v, zw1v,
+                           cv, ncv, pow1v, nbbv, ncbv, pflv, czv, dv);
+			STVF(Jbuffer[k], J);
+			STVF(Cbuffer[k], C);
+			STVF(hbuffer[k], h);
+			STVF(Qbuffer[k], Q);
+			STVF(Mbuffer[k], M);
+			STVF(sbuffer[k], s);
+		}
+#endif
+		for (; k<width; k++) {
+			ColorTemp::xyz2jchqms_ciecam02float( Jbuffer[k], Cbuffer[k], hbuffer[k],
+                           Qbuffer[k], Mbuffer[k], sbuffer[k], aw, fl, wh,
+                           Jbuffer[k], Cbuffer[k], hbuffer[k],
                            xw1, yw1,  zw1,
                            yb,  la,
                            f, c,  nc,  pilot, gamu, pow1, nbb, ncb, pfl, cz, d);
+		}
+
+		for (int j=0; j<width; j++) {
+			float J=Jbuffer[j], C=Cbuffer[j], h=hbuffer[j], Q=Qbuffer[j], M=Mbuffer[j], s=sbuffer[j];
+			float Jpro,Cpro, hpro, Qpro, Mpro, spro;
+
 			Jpro=J;
 			Cpro=C;
 			hpro=h;
@@ -1765,38 +1779,60 @@ if(settings->viewinggreySc==1) yb=18.0f;//fixed
                 if(pW!=1){//only with improccoordinator
 				if(libr==1) posl=CLIP((int)(Q*brli));//40.0 to 100.0 approximative factor for Q  - 327 for J
 				else if(libr==0) posl=CLIP((int)(J*brli));//327 for J
-				hist16JCAM[posl]++;
+				hist16JCAMThr[posl]++;
 				}
 				chropC=true;
                 if(pW!=1){//only with improccoordinator
 				if(colch==0) posc=CLIP((int)(C*chsacol));//450.0 approximative factor for s    320 for M
 				else if(colch==1) posc=CLIP((int)(s*chsacol));
 				else if(colch==2) posc=CLIP((int)(M*chsacol));
-				hist16_CCAM[posc]++;
+				hist16_CCAMThr[posc]++;
 				}
 			}
-if(LabPassOne){
-			float xx,yy,zz;
-			//process normal==> viewing
+			}
+			Jbuffer[j]=J;
+			Cbuffer[j]=C;
+			hbuffer[j]=h;
+		}
 
-			ColorTemp::jch2xyz_ciecam02float( xx, yy, zz,
-			                             J,  C, h,
-			                             xw2, yw2,  zw2,
-			                             yb2, la2,
-			                             f2,  c2, nc2, gamu, pow1n, nbbj, ncbj, flj, czj, dj, awj);
-			x=(float)xx*655.35f;
-			y=(float)yy*655.35f;
-			z=(float)zz*655.35f;
+		if(labOutput) {
+			//process normal==> viewing, XYZ is stored in the Q, M and s buffers
+			int k=0;
+#ifdef __SSE2__
+			for (; k<width-3; k+=4) {
+				vfloat xx, yy, zz;
+				ColorTemp::jch2xyz_ciecam02float( xx, yy, zz,
+				                             LVF(Jbuffer[k]), LVF(Cbuffer[k]), LVF(hbuffer[k]),
+				                             xw2v, yw2v, zw2v,
+				                             c2v, nc2v, pow1nv, nbbjv, ncbjv, fljv, czjv, djv, awjv);
+				STVF(Qbuffer[k], xx);
+				STVF(Mbuffer[k], yy);
+				STVF(sbuffer[k], zz);
+			}
+#endif
+			for (; k<width; k++) {
+				ColorTemp::jch2xyz_ciecam02float( Qbuffer[k], Mbuffer[k], sbuffer[k],
+				                             Jbuffer[k], Cbuffer[k], hbuffer[k],
+				                             xw2, yw2,  zw2,
+				                             yb2, la2,
+				                             f2,  c2, nc2, gamu, pow1n, nbbj, ncbj, flj, czj, dj, awj);
+			}
+
+			for (int j=0; j<width; j++) {
+			float xx=Qbuffer[j], yy=Mbuffer[j], zz=sbuffer[j];
+			float x=(float)xx*655.35f;
+			float y=(float)yy*655.35f;
+			float z=(float)zz*655.35f;
 			float Ll,aa,bb;
 			//convert xyz=>lab
 			Color::XYZ2Lab(x,  y,  z, Ll, aa, bb);
 #ifdef _DEBUG
-			if(Ll > 70000.f && J < 1.f) {
+			if(Ll > 70000.f && Jbuffer[j] < 1.f) {
 #pragma omp critical
 {
 				printf("Why is Ll so big when J is so small?\n");
-				printf("J : %f, Ll : %f, xx : %f, yy : %f, zz : %f\n",J,Ll,xx,yy,zz);
-				printf("J : %f, C : %f, h : %f\n",J,C,h);
+				printf("J : %f, Ll : %f, xx : %f, yy : %f, zz : %f\n",Jbuffer[j],Ll,xx,yy,zz);
+				printf("J : %f, C : %f, h : %f\n",Jbuffer[j],Cbuffer[j],hbuffer[j]);
 }
 			}
 #endif
@@ -1836,9 +1872,9 @@ if(LabPassOne){
 			lab->a[i][j]=aa;
 			lab->b[i][j]=bb;
 		}
+			}
 		}
-		}
-		}
+	}
 #pragma omp critical
 {
 	if(minQThr < minQ)
@@ -1848,6 +1884,10 @@ if(LabPassOne){
 }
 	}
 	// End of parallelization
+	if(ciedata && pW!=1) {
+		hist16JCAMpar.addTo (hist16JCAM);
+		hist16_CCAMpar.addTo (hist16_CCAM);
+	}
 if(!params->colorappearance.tonecie   || !settings->autocielab){//normal
 
 	if(ciedata) {
@@ -1998,19 +2038,26 @@ if((params->colorappearance.tonecie && (epdEnabled)) || (params->sharpening.enab
 		{float(wiprofa[2][0]),float(wiprofa[2][1]),float(wiprofa[2][2])}
 	};
 
+	ParallelHistogram hist16JCAMpar (ciedata && pW!=1 ? 65536 : 1);
+	ParallelHistogram hist16_CCAMpar (ciedata && pW!=1 ? 65536 : 1);
 #ifndef _DEBUG
 #pragma omp parallel
 #endif
 {
-
+	unsigned int* hist16JCAMThr = hist16JCAMpar.threadBins();
+	unsigned int* hist16_CCAMThr = hist16_CCAMpar.threadBins();
+	const int bufferWidth = (width+3) & ~3;
+	AlignedBuffer<float> rowBuffer(4*bufferWidth);
+	float *Cbuffer = rowBuffer.data;
+	float *xbuffer = Cbuffer + bufferWidth;
+	float *ybuffer = xbuffer + bufferWidth;
+	float *zbuffer = ybuffer + bufferWidth;
 
 #ifndef _DEBUG
 		#pragma omp for schedule(dynamic, 10)
 #endif
-		for (int i=0; i<height; i++) // update CIECAM with new values after tone-mapping
+		for (int i=0; i<height; i++) { // update CIECAM with new values after tone-mapping
 			for (int j=0; j<width; j++) {
-				float xx,yy,zz;
-				float x,y,z;
 			//	if(epdEnabled) ncie->J_p[i][j]=(100.0f* ncie->Q_p[i][j]*ncie->Q_p[i][j])/(w_h*w_h);
 				if(epdEnabled) ncie->J_p[i][j]=(100.0f* ncie->Q_p[i][j]*ncie->Q_p[i][j])/SQR((4.f/c)*(aw+4.f));
 
@@ -2033,26 +2080,45 @@ if((params->colorappearance.tonecie && (epdEnabled)) || (params->sharpening.enab
 					if(pW!=1){//only with improccoordinator
 						if(libr==1) posl=CLIP((int)(ncie->Q_p[i][j]*brli));//40.0 to 100.0 approximative factor for Q  - 327 for J
 						else if(libr==0) posl=CLIP((int)(ncie->J_p[i][j]*brli));//327 for J
-						hist16JCAM[posl]++;
+						hist16JCAMThr[posl]++;
 					}
 					chropC=true;
 					if(pW!=1){//only with improccoordinator
 						if(colch==0) posc=CLIP((int)(ncie_C_p*chsacol));//450.0 approximative factor for s    320 for M
 						else if(colch==1) {sa_t=100.f*sqrtf(ncie_C_p/ncie->Q_p[i][j]); posc=CLIP((int)(sa_t*chsacol));}//Q_p always > 0
 						else if(colch==2) posc=CLIP((int)(ncie->M_p[i][j]*chsacol));
-						hist16_CCAM[posc]++;
+						hist16_CCAMThr[posc]++;
 					}
 				}
 				//end histograms
+				Cbuffer[j] = ncie_C_p;
+			}
 
+			int k=0;
+#ifdef __SSE2__
+			for (; k<width-3; k+=4) {
+				vfloat xx, yy, zz;
 				ColorTemp::jch2xyz_ciecam02float( xx, yy, zz,
-											 ncie->J_p[i][j],  ncie_C_p, ncie->h_p[i][j],
+											 LVFU(ncie->J_p[i][k]), LVF(Cbuffer[k]), LVFU(ncie->h_p[i][k]),
+											 xw2v, yw2v, zw2v,
+											 c2v, nc2v, pow1nv, nbbjv, ncbjv, fljv, czjv, djv, awjv);
+				STVF(xbuffer[k], xx);
+				STVF(ybuffer[k], yy);
+				STVF(zbuffer[k], zz);
+			}
+#endif
+			for (; k<width; k++) {
+				ColorTemp::jch2xyz_ciecam02float( xbuffer[k], ybuffer[k], zbuffer[k],
+											 ncie->J_p[i][k],  Cbuffer[k], ncie->h_p[i][k],
 											 xw2, yw2,  zw2,
 											 yb2, la2,
 											 f2,  c2, nc2, gamu, pow1n, nbbj, ncbj, flj, czj, dj, awj);
-				x=(float)xx*655.35f;
-				y=(float)yy*655.35f;
-				z=(float)zz*655.35f;
+			}
+
+			for (int j=0; j<width; j++) {
+				float x=xbuffer[j]*655.35f;
+				float y=ybuffer[j]*655.35f;
+				float z=zbuffer[j]*655.35f;
 				float Ll,aa,bb;
 				//convert xyz=>lab
 				Color::XYZ2Lab(x,  y,  z, Ll, aa, bb);
@@ -2089,8 +2155,12 @@ if((params->colorappearance.tonecie && (epdEnabled)) || (params->sharpening.enab
 					lab->b[i][j]=bb;
 				}
 			}
-
+		}
 } //end parallelization
+	if(ciedata && pW!=1) {
+		hist16JCAMpar.addTo (hist16JCAM);
+		hist16_CCAMpar.addTo (hist16_CCAM);
+	}
 
 	//show CIECAM histograms
 	if(ciedata) {
@@ -2297,7 +2367,8 @@ void ImProcFunctions::rgbProc (Imagefloat* working, LabImage* lab, EditBuffer *e
 
     ClutPtr colorLUT;
     bool clutAndWorkingProfilesAreSame = false;
-    TMatrix work2xyz, xyz2clut, clut2xyz, xyz2work;
+    // working <-> clut profile conversions, the xyz step is folded into a single matrix
+    float work2clut[3][3], clut2work[3][3];
     if ( params->filmSimulation.enabled && !params->filmSimulation.clutFilename.empty() )
     {
         colorLUT.set( clutStore.getClut( params->filmSimulation.clutFilename ) );
@@ -2306,16 +2377,24 @@ void ImProcFunctions::rgbProc (Imagefloat* working, LabImage* lab, EditBuffer *e
             clutAndWorkingProfilesAreSame = colorLUT->profile() == params->icm.working;
             if ( !clutAndWorkingProfilesAreSame )
             {
-                work2xyz = iccStore->workingSpaceMatrix( params->icm.working );
-                xyz2clut = iccStore->workingSpaceInverseMatrix( colorLUT->profile() );
-                xyz2work = iccStore->workingSpaceInverseMatrix( params->icm.working );
-                clut2xyz = iccStore->workingSpaceMatrix( colorLUT->profile() );	
+                TMatrix work2xyz = iccStore->workingSpaceMatrix( params->icm.working );
+                TMatrix xyz2clut = iccStore->workingSpaceInverseMatrix( colorLUT->profile() );
+                TMatrix xyz2work = iccStore->workingSpaceInverseMatrix( params->icm.working );
+                TMatrix clut2xyz = iccStore->workingSpaceMatrix( colorLUT->profile() );
+                for (int i=0; i<3; i++)
+                    for (int j=0; j<3; j++) {
+                        work2clut[i][j] = clut2work[i][j] = 0.f;
+                        for (int k=0; k<3; k++) {
+                            work2clut[i][j] += xyz2clut[i][k] * work2xyz[k][j];
+                            clut2work[i][j] += xyz2work[i][k] * clut2xyz[k][j];
+                        }
+                    }
             }
         }
     }
 
-    double filmSimCorrectedStrength = double(params->filmSimulation.strength)/100.;
-    double filmSimSourceStrength = double(100-params->filmSimulation.strength)/100.;
+    const float filmSimCorrectedStrength = float(params->filmSimulation.strength)/100.f;
+    const float filmSimSourceStrength = float(100-params->filmSimulation.strength)/100.f;
 
 	const float exp_scale = pow (2.0, expcomp);
 	const float comp = (max(0.0, expcomp) + 1.0)*hlcompr/100.0;
@@ -3108,41 +3187,46 @@ void ImProcFunctions::rgbProc (Imagefloat* working, LabImage* lab, EditBuffer *e
             //Film Simulations
             if ( colorLUT )
             {
+                float clutR[TS], clutG[TS], clutB[TS];
                 for (int i=istart,ti=0; i<tH; i++,ti++) {
-                    for (int j=jstart,tj=0; j<tW; j++,tj++) {
-                        float &sourceR =rtemp[ti*TS+tj];
-                        float &sourceG =gtemp[ti*TS+tj];
-                        float &sourceB = btemp[ti*TS+tj];
+                    float *rowR = &rtemp[ti*TS];
+                    float *rowG = &gtemp[ti*TS];
+                    float *rowB = &btemp[ti*TS];
+                    const int n = tW-jstart;
 
+                    for (int tj=0; tj<n; tj++) {
 						if (!clutAndWorkingProfilesAreSame) {
 							//convert from working to clut profile
-							float x, y, z;
-							Color::rgbxyz( sourceR, sourceG, sourceB, x, y, z, work2xyz );
-							Color::xyz2rgb( x, y, z, sourceR, sourceG, sourceB, xyz2clut );
+							float r = rowR[tj], g = rowG[tj], b = rowB[tj];
+							Color::rgbxyz( r, g, b, rowR[tj], rowG[tj], rowB[tj], work2clut );
 						}
 						//appply gamma sRGB (default RT)
-						sourceR = CLIP<float>( Color::gamma_srgb( sourceR ) );
-						sourceG = CLIP<float>( Color::gamma_srgb( sourceG ) );
-						sourceB = CLIP<float>( Color::gamma_srgb( sourceB ) );
+						rowR[tj] = CLIP<float>( Color::gamma_srgb( rowR[tj] ) );
+						rowG[tj] = CLIP<float>( Color::gamma_srgb( rowG[tj] ) );
+						rowB[tj] = CLIP<float>( Color::gamma_srgb( rowB[tj] ) );
+                    }
 
-                        float r, g, b;
-                        colorLUT->getRGB( sourceR, sourceG, sourceB, r, g, b );
+                    // the whole row goes through the CLUT at once
+                    colorLUT->getRGB( rowR, rowG, rowB, clutR, clutG, clutB, n );
+
+                    for (int tj=0; tj<n; tj++) {
                         // apply strength
-                        sourceR = r * filmSimCorrectedStrength + sourceR * filmSimSourceStrength; 
-                        sourceG = g * filmSimCorrectedStrength + sourceG * filmSimSourceStrength; 
-                        sourceB = b * filmSimCorrectedStrength + sourceB * filmSimSourceStrength; 
+                        float sourceR = clutR[tj] * filmSimCorrectedStrength + rowR[tj] * filmSimSourceStrength;
+                        float sourceG = clutG[tj] * filmSimCorrectedStrength + rowG[tj] * filmSimSourceStrength;
+                        float sourceB = clutB[tj] * filmSimCorrectedStrength + rowB[tj] * filmSimSourceStrength;
 						// apply inverse gamma sRGB
 						sourceR = Color::igamma_srgb( sourceR );
 						sourceG = Color::igamma_srgb( sourceG );
 						sourceB = Color::igamma_srgb( sourceB );
-						
+
 						if (!clutAndWorkingProfilesAreSame) {
 							//convert from clut to working profile
-							float x, y, z;
-							Color::rgbxyz( sourceR, sourceG, sourceB, x, y, z, clut2xyz );
-							Color::xyz2rgb( x, y, z, sourceR, sourceG, sourceB, xyz2work );
+							Color::rgbxyz( sourceR, sourceG, sourceB, rowR[tj], rowG[tj], rowB[tj], clut2work );
+						} else {
+							rowR[tj] = sourceR;
+							rowG[tj] = sourceG;
+							rowB[tj] = sourceB;
 						}
-							
                     }
                 }
             }
@@ -61,6 +61,7 @@ class ImProcFunctions {
 		const ProcParams* params;
 		double scale;
 		bool multiThread;
+		size_t memoryBudget;
 
         void calcVignettingParams(int oW, int oH, const VignettingParams& vignetting, double &w2, double &h2, double& maxRadius, double &v, double &b, double &mul);
 
@@ -72,6 +73,7 @@ class ImProcFunctions {
 		void sharpenHaloCtrlcam (CieImage* ncie, float** blurmap, float** base, int W, int H);
 		void firstAnalysisThread(Imagefloat* original, Glib::ustring wprofile, unsigned int* histogram, int row_from, int row_to);
 		void dcdamping          (float** aI, float** aO, float damping, int W, int H);
+		void deconvolve         (float** src, float** tmpI, float** tmp, int W, int H); // Richardson-Lucy estimate of src in tmpI, tmp is a W*H scratch buffer
 
 		bool needsCA            ();
 		bool needsDistortion    ();
@@ -210,10 +212,12 @@ class ImProcFunctions {
 		static void cleanupCache ();
 		
 		ImProcFunctions       (const ProcParams* iparams, bool imultiThread=true)
-			: monitorTransform(NULL), params(iparams), scale(1), multiThread(imultiThread), iGamma(true), g(0.0) {}
+			: monitorTransform(NULL), params(iparams), scale(1), multiThread(imultiThread), memoryBudget(0), iGamma(true), g(0.0) {}
 		~ImProcFunctions      ();
 		
 		void setScale         (double iscale);
+		// Memory available to the tiled stages (denoise, wavelet) in bytes, 0 = tileMemoryBudget()
+		void setMemoryBudget  (size_t budget) { memoryBudget = budget; }
 
 		bool needsTransform   ();
 		bool needsPCVignetting ();
@@ -258,6 +262,7 @@ class ImProcFunctions {
 		void deconvsharpeningcam (CieImage* ncie, float** buffer);
 		void MLsharpen (LabImage* lab);// Manuel's clarity / sharpening
 		void MLmicrocontrast(LabImage* lab ); //Manuel's microcontrast
+		void MLmicrocontrast(float** luminance, int W, int H);
 		void MLmicrocontrastcam(CieImage* ncie ); //Manuel's microcontrast
 
 		void impulsedenoise   (LabImage* lab);//Emil's impulse denoise
@@ -284,8 +289,9 @@ class ImProcFunctions {
 		//void RGB_InputTransf(Imagefloat * src, LabImage * dst, const procparams::DirPyrDenoiseParams & dnparams, const procparams::DefringeParams & defringe);
 		//void RGB_OutputTransf(LabImage * src, Imagefloat * dst, const procparams::DirPyrDenoiseParams & dnparams);
 		//void output_tile_row (float *Lbloxrow, float ** Lhipassdn, float ** tilemask, int height, int width, int top, int blkrad );
-		void Tile_calc (int tilesize, int overlap, int kall, int imwidth, int imheight, int &numtiles_W, int &numtiles_H, int &tilewidth, int &tileheight, int &tileWskip, int &tileHskip);
-		void ip_wavelet(LabImage * lab, LabImage * dst, int kall, const procparams::WaveletParams & waparams, const WavCurve & wavCLVCcurve, const WavOpacityCurveRG & waOpacityCurveRG, const WavOpacityCurveBY & waOpacityCurveBY, int skip);
+		static void Tile_calc (int tilesize, int overlap, int kall, int imwidth, int imheight, int &numtiles_W, int &numtiles_H, int &tilewidth, int &tileheight, int &tileWskip, int &tileHskip);
+		// the tiles left are skipped once *cancelFlag gets set, the output being incomplete then
+		void ip_wavelet(LabImage * lab, LabImage * dst, int kall, const procparams::WaveletParams & waparams, const WavCurve & wavCLVCcurve, const WavOpacityCurveRG & waOpacityCurveRG, const WavOpacityCurveBY & waOpacityCurveBY, int skip, const volatile bool* cancelFlag = NULL);
 		void WaveletcontAllL(LabImage * lab, float **varhue, float **varchrom, wavelet_decomposition &WaveletCoeffs_L, 
 											struct cont_params cp, int skip);
 		void WaveletcontAllAB(LabImage * lab, float **varhue, float **varchrom, wavelet_decomposition &WaveletCoeffs_a,
@@ -306,7 +312,8 @@ class ImProcFunctions {
 
 		enum mediantype {MED_3X3SOFT, MED_3X3STRONG, MED_5X5SOFT, MED_5X5STRONG, MED_7X7, MED_9X9};
 		void Median_Denoise( float **src, float **dst, int width, int height, mediantype medianType, int iterations, int numThreads, float **buffer = NULL);
-		void RGB_denoise(int kall, Imagefloat * src, Imagefloat * dst, Imagefloat * calclum, float * ch_M, float *max_r, float *max_b, bool isRAW, const procparams::DirPyrDenoiseParams & dnparams, const double expcomp,const NoiseCurve & ctNoisCurve , const NoiseCurve & ctNoisCCcurve , float &chaut, float &redaut, float &blueaut, float &maxredaut, float & maxblueaut, float &nresi, float &highresi);
+		// the tiles left are skipped once *cancelFlag gets set, the output being incomplete then
+		void RGB_denoise(int kall, Imagefloat * src, Imagefloat * dst, Imagefloat * calclum, float * ch_M, float *max_r, float *max_b, bool isRAW, const procparams::DirPyrDenoiseParams & dnparams, const double expcomp,const NoiseCurve & ctNoisCurve , const NoiseCurve & ctNoisCCcurve , float &chaut, float &redaut, float &blueaut, float &maxredaut, float & maxblueaut, float &nresi, float &highresi, const volatile bool* cancelFlag = NULL);
 		void RGB_denoise_infoGamCurve(const procparams::DirPyrDenoiseParams & dnparams, const bool isRAW, LUTf &gamcurve, float &gam, float &gamthresh, float &gamslope);
 		void RGB_denoise_info(Imagefloat * src, Imagefloat * calclum, bool isRAW, LUTf &gamcurve, float gam, float gamthresh, float gamslope, const procparams::DirPyrDenoiseParams & dnparams, const double expcomp, float &chaut, int &Nb, float &redaut, float &blueaut, float &maxredaut, float & maxblueaut, float &minredaut, float & minblueaut,float &nresi, float &highresi, float &chromina, float &sigma, float &lumema, float &sigma_L, float &redyel,float &skinc, float &nsknc, bool multiThread = false);
 		void RGBtile_denoise (float * fLblox, int hblproc, float noisevar_L, float * nbrwt, float * blurbuffer );	//for DCT
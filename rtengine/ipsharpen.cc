@@ -21,10 +21,9 @@
 #include "gauss.h"
 #include "bilateral2.h"
 #include "rt_math.h"
+#include <cstring>
 #include "sleef.c"
-#ifdef __SSE2__
-#include "sleefsseavx.c"
-#endif
+#include "opthelper.h"
 #ifdef _OPENMP
 #include <omp.h>
 #endif
@@ -114,34 +113,115 @@ void ImProcFunctions::dcdamping (float** aI, float** aO, float damping, int W, i
 #endif
 }
 
-void ImProcFunctions::deconvsharpening (LabImage* lab, float** b2) {
-	if (params->sharpening.enabled==false || params->sharpening.deconvamount<1)
-		return;
+void ImProcFunctions::deconvolve (float** src, float** tmpI, float** tmp, int W, int H) {
 
-	int W = lab->W, H = lab->H;
+	const double sigma = params->sharpening.deconvradius / scale;
+	const int iterations = params->sharpening.deconviter;
+	const float damping = params->sharpening.deconvdamping / 5.0;
+	const bool needdamp = params->sharpening.deconvdamping > 0;
 
-	float** tmpI = new float*[H];
-	for (int i=0; i<H; i++) {
-		tmpI[i] = new float[W];
-		for (int j=0; j<W; j++)
-			tmpI[i][j] = (float)lab->L[i][j];
-	}
+	// The recursive gaussian treats the tile borders as image borders, so the result near a border differs from the
+	// untiled one and the difference fades towards the core. With a halo of 20*sigma (at least 32 pixels) the core
+	// differs by less than 1 (of 32768) from the untiled result, for radius 0.5..2.5 and up to 100 iterations.
+	// A core of 256 keeps a tile's buffers below about 1 MB.
+	const int halo = max(32, (int)ceil(20.0 * sigma));
+	const int tileCore = 256;
+	const int tileSize = tileCore + 2 * halo;
+
+	if (2 * tileSize <= max(W, H)) {
+		// All the iterations run on a tile before going to the next one, so the working set (the estimate and the blurred
+		// tile) stays in cache instead of streaming the whole image through memory four times per iteration
+		const int tilesX = (W + tileCore - 1) / tileCore;
+		const int tilesY = (H + tileCore - 1) / tileCore;
+
+#ifdef _OPENMP
+#pragma omp parallel
+#endif
+		{
+		float* estimateBuffer = new float[tileSize * tileSize];
+		float* blurBuffer = new float[tileSize * tileSize];
+		float** estimate = new float*[tileSize];
+		float** blur = new float*[tileSize];
+		float** observed = new float*[tileSize];
+		AlignedBufferMP<double> buffer(tileSize);
 
-	float** tmp = (float**)b2;
+#ifdef _OPENMP
+#pragma omp for schedule(dynamic)
+#endif
+		for (int tile = 0; tile < tilesX * tilesY; tile++) {
+			const int coreTop = (tile / tilesX) * tileCore;
+			const int coreLeft = (tile % tilesX) * tileCore;
+			const int coreBottom = min(coreTop + tileCore, H);
+			const int coreRight = min(coreLeft + tileCore, W);
+			const int top = max(coreTop - halo, 0);
+			const int left = max(coreLeft - halo, 0);
+			const int tw = min(coreRight + halo, W) - left;
+			const int th = min(coreBottom + halo, H) - top;
+
+			for (int i = 0; i < th; i++) {
+				observed[i] = src[top + i] + left;
+				estimate[i] = estimateBuffer + i * tw;
+				blur[i] = blurBuffer + i * tw;
+				memcpy (estimate[i], observed[i], tw * sizeof(float));
+			}
+
+			// a team of one thread, so the work sharing loops of the gaussian blur and of dcdamping stay on this tile
+#ifdef _OPENMP
+#pragma omp parallel num_threads(1)
+#endif
+			for (int k = 0; k < iterations; k++) {
+				gaussHorizontal<float> (estimate, blur, buffer, tw, th, sigma);
+				gaussVertical<float>   (blur, blur, buffer, tw, th, sigma);
+
+				if (!needdamp) {
+					for (int i = 0; i < th; i++)
+						for (int j = 0; j < tw; j++)
+							if (blur[i][j] > 0)
+								blur[i][j] = observed[i][j] / blur[i][j];
+				}
+				else
+					dcdamping (blur, observed, damping, tw, th);
+
+				gaussHorizontal<float> (blur, blur, buffer, tw, th, sigma);
+				gaussVertical<float>   (blur, blur, buffer, tw, th, sigma);
+
+				for (int i = 0; i < th; i++)
+					for (int j = 0; j < tw; j++)
+						estimate[i][j] *= blur[i][j];
+			}
+
+			for (int i = coreTop; i < coreBottom; i++)
+				memcpy (tmpI[i] + coreLeft, estimate[i - top] + coreLeft - left, (coreRight - coreLeft) * sizeof(float));
+		}
+
+		delete [] observed;
+		delete [] blur;
+		delete [] estimate;
+		delete [] blurBuffer;
+		delete [] estimateBuffer;
+		}
+		return;
+	}
 
+	// full image iterations: small images (previews, detail windows) or neighbourhoods too large for tiling
 #ifdef _OPENMP
 #pragma omp parallel
 #endif
 	{
-    AlignedBufferMP<double> buffer(max(W,H));
+	AlignedBufferMP<double> buffer(max(W,H));
 
-	float damping = params->sharpening.deconvdamping / 5.0;
-	bool needdamp = params->sharpening.deconvdamping > 0;
-	for (int k=0; k<params->sharpening.deconviter; k++) {
+#ifdef _OPENMP
+#pragma omp for
+#endif
+	for (int i=0; i<H; i++)
+		for (int j=0; j<W; j++)
+			tmpI[i][j] = src[i][j];
+
+	for (int k=0; k<iterations; k++) {
 
 		// apply blur function (gaussian blur)
-        gaussHorizontal<float> (tmpI, tmp, buffer, W, H, params->sharpening.deconvradius / scale);
-        gaussVertical<float>   (tmp, tmp, buffer, W, H, params->sharpening.deconvradius / scale);
+        gaussHorizontal<float> (tmpI, tmp, buffer, W, H, sigma);
+        gaussVertical<float>   (tmp, tmp, buffer, W, H, sigma);
 
 		if (!needdamp) {
 #ifdef _OPENMP
@@ -150,13 +230,13 @@ void ImProcFunctions::deconvsharpening (LabImage* lab, float** b2) {
 			for (int i=0; i<H; i++)
 				for (int j=0; j<W; j++)
 					if (tmp[i][j]>0)
-						tmp[i][j] = (float)lab->L[i][j] / tmp[i][j];
+						tmp[i][j] = src[i][j] / tmp[i][j];
 		}
 		else
-			dcdamping (tmp, lab->L, damping, W, H);
+			dcdamping (tmp, src, damping, W, H);
 
-        gaussHorizontal<float> (tmp, tmp, buffer, W, H, params->sharpening.deconvradius / scale);
-        gaussVertical<float>   (tmp, tmp, buffer, W, H, params->sharpening.deconvradius / scale);
+        gaussHorizontal<float> (tmp, tmp, buffer, W, H, sigma);
+        gaussVertical<float>   (tmp, tmp, buffer, W, H, sigma);
 
 #ifdef _OPENMP
 #pragma omp for
@@ -165,19 +245,31 @@ void ImProcFunctions::deconvsharpening (LabImage* lab, float** b2) {
 			for (int j=0; j<W; j++)
 				tmpI[i][j] = tmpI[i][j] * tmp[i][j];
 	} // end for
+	} // end parallel
+}
+
+void ImProcFunctions::deconvsharpening (LabImage* lab, float** b2) {
+	if (params->sharpening.enabled==false || params->sharpening.deconvamount<1)
+		return;
+
+	int W = lab->W, H = lab->H;
+
+	float** tmpI = new float*[H];
+	for (int i=0; i<H; i++)
+		tmpI[i] = new float[W];
+
+	deconvolve (lab->L, tmpI, b2, W, H);
 
 	float p2 = params->sharpening.deconvamount / 100.0;
 	float p1 = 1.0 - p2;
 
 #ifdef _OPENMP
-#pragma omp for
+#pragma omp parallel for
 #endif
 	for (int i=0; i<H; i++)
 		for (int j=0; j<W; j++)
 			lab->L[i][j] = lab->L[i][j]*p1 + max(tmpI[i][j],0.0f)*p2;
 
-	} // end parallel
-
 	for (int i=0; i<H; i++)
 		delete [] tmpI[i];
 	delete [] tmpI;
@@ -319,12 +411,155 @@ void ImProcFunctions::sharpenHaloCtrl (LabImage* lab, float** blurmap, float** b
 	}
 }
 
+// Temporary copies of the channels of MLsharpen and MLmicrocontrast, kept from one call to the next. Only buffers up to
+// 4 Mpixels (16 MB) are kept, enough for the preview and the detail windows; a full size buffer is freed after use.
+static AlignedBufferPool<float> sharpenBuffers (1, 64, 4<<20);
+
+// Value of the pixel at L interpolated along the direction of step d, p being the step across it; v is kept where the
+// pixel isn't between its two neighbours along d. squareMinus raises the difference to the neighbour at -d to the
+// 4th power instead of the square, as the anti-diagonal always did.
+static inline float MLsharpenDirection (const float* L, int d, int p, float v, float contrast, bool squareMinus) {
+
+	const float epsil=0.01f;//prevent divide by zero
+	if (!((L[0]<L[-d] && L[0]>L[d]) || (L[0]>L[-d] && L[0]<L[d])))
+		return v;
+
+	float f1 = fabs(L[-2*d]-L[-d]);
+	float f2 = fabs(L[-d]-L[0]);
+	if (squareMinus)
+		f2 *= f2;
+	float f3 = fabs(L[-d]-L[-p])*fabs(L[-d]-L[p]);
+	float f4 = sqrt(fabs(L[-d]-L[-2*p])*fabs(L[-d]-L[2*p]));
+	const float difMinus = f1*f2*f2*f3*f3*f4;
+	f1 = fabs(L[2*d]-L[d]);
+	f2 = fabs(L[d]-L[0]);
+	f3 = fabs(L[d]-L[-p])*fabs(L[d]-L[p]);
+	f4 = sqrt(fabs(L[d]-L[-2*p])*fabs(L[d]-L[2*p]));
+	const float difPlus = f1*f2*f2*f3*f3*f4;
+
+	if (difMinus>epsil && difPlus>epsil) {
+		const float lum = (L[-d]*difPlus+L[d]*difMinus)/(difMinus+difPlus);
+		return v*(1.f-contrast)+lum*contrast;
+	}
+	return v;
+}
+
+// New value of the pixel at L, a copy of the channel in 0..100; original is returned where the pixel isn't changed
+static inline float MLsharpenPixel (const float* L, int width, float amount, float chmax, bool luminance, float original) {
+
+	const float eps2=0.001f;//prevent divide by zero
+	const float v = L[0];
+
+	// weight functions
+	const float wH = eps2 + fabs(L[1]-L[-1]);
+	const float wV = eps2 + fabs(L[width]-L[-width]);
+	float s = 1.0f+fabs(wH-wV)/2.0f;
+	float wD1 = eps2 + fabs(L[width+1]-L[-width-1])/s;
+	float wD2 = eps2 + fabs(L[width-1]-L[-width+1])/s;
+	wD1 /= wD2;
+	wD2 /= wD1;
+
+	// contrast detection
+	float contrast = sqrt(SQR(L[1]-L[-1])+SQR(L[width]-L[-width]))/chmax;
+	if (contrast>1.0f)
+		contrast=1.0f;
+
+	// new possible values
+	const float lumH  = MLsharpenDirection (L, 1,       width,   v, contrast, false);
+	const float lumV  = MLsharpenDirection (L, width,   1,       v, contrast, false);
+	const float lumD1 = MLsharpenDirection (L, width+1, width-1, v, contrast, false);
+	const float lumD2 = MLsharpenDirection (L, width-1, width+1, v, contrast, true);
+
+	// avoid sharpening diagonals too much
+	s = amount;
+	if (((wH/wV<0.45f)&&(wH/wV>0.05f))||((wV/wH<0.45f)&&(wV/wH>0.05f)))
+		s = amount/3.0f;
+
+	// final mix
+	if (wH==0.0f || wV==0.0f || wD1==0.0f || wD2==0.0f || (luminance && v>=92.f))
+		return original;
+	const float templab = v*(1.f-s)+(lumH*wH+lumV*wV+lumD1*wD1+lumD2*wD2)/(wH+wV+wD1+wD2)*s;
+	return luminance ? fabs(327.68f*templab) : 327.68f*templab; // fabs because lab->L always >0
+}
+
+#ifdef __SSE2__
+// Same as MLsharpenDirection for the 4 pixels from L on, the selection being done without branches
+static INLINE vfloat MLsharpenDirection (const float* L, int d, int p, vfloat v, vfloat contrast, bool squareMinus) {
+
+	const vfloat epsilv = F2V(0.01f);
+	const vfloat L0 = LVFU(L[0]);
+	const vfloat Lm = LVFU(L[-d]);
+	const vfloat Lp = LVFU(L[d]);
+	const vmask between = vorm(vandm(vmaskf_lt(L0, Lm), vmaskf_gt(L0, Lp)), vandm(vmaskf_gt(L0, Lm), vmaskf_lt(L0, Lp)));
+
+	vfloat f1 = vabsf(LVFU(L[-2*d])-Lm);
+	vfloat f2 = vabsf(Lm-L0);
+	if (squareMinus)
+		f2 *= f2;
+	vfloat f3 = vabsf(Lm-LVFU(L[-p]))*vabsf(Lm-LVFU(L[p]));
+	vfloat f4 = vsqrtf(vabsf(Lm-LVFU(L[-2*p]))*vabsf(Lm-LVFU(L[2*p])));
+	const vfloat difMinus = f1*f2*f2*f3*f3*f4;
+	f1 = vabsf(LVFU(L[2*d])-Lp);
+	f2 = vabsf(Lp-L0);
+	f3 = vabsf(Lp-LVFU(L[-p]))*vabsf(Lp-LVFU(L[p]));
+	f4 = vsqrtf(vabsf(Lp-LVFU(L[-2*p]))*vabsf(Lp-LVFU(L[2*p])));
+	const vfloat difPlus = f1*f2*f2*f3*f3*f4;
+
+	// the lanes dividing by 0 aren't selected
+	const vfloat lum = (Lm*difPlus+Lp*difMinus)/(difMinus+difPlus);
+	const vmask interpolate = vandm(between, vandm(vmaskf_gt(difMinus, epsilv), vmaskf_gt(difPlus, epsilv)));
+	return vself(interpolate, v*(F2V(1.f)-contrast)+lum*contrast, v);
+}
+
+// Same as MLsharpenPixel for the 4 pixels from L on
+static INLINE vfloat MLsharpenPixels (const float* L, int width, float amount, float chmax, bool luminance, vfloat original) {
+
+	const vfloat eps2v = F2V(0.001f);
+	const vfloat onev = F2V(1.f);
+	const vfloat v = LVFU(L[0]);
+
+	// weight functions
+	const vfloat wH = eps2v + vabsf(LVFU(L[1])-LVFU(L[-1]));
+	const vfloat wV = eps2v + vabsf(LVFU(L[width])-LVFU(L[-width]));
+	const vfloat sv = onev+vabsf(wH-wV)/F2V(2.0f);
+	vfloat wD1 = eps2v + vabsf(LVFU(L[width+1])-LVFU(L[-width-1]))/sv;
+	vfloat wD2 = eps2v + vabsf(LVFU(L[width-1])-LVFU(L[-width+1]))/sv;
+	wD1 /= wD2;
+	wD2 /= wD1;
+
+	// contrast detection
+	const vfloat contrast = vminf(vsqrtf(SQRV(LVFU(L[1])-LVFU(L[-1]))+SQRV(LVFU(L[width])-LVFU(L[-width])))/F2V(chmax), onev);
+
+	// new possible values
+	const vfloat lumH  = MLsharpenDirection (L, 1,       width,   v, contrast, false);
+	const vfloat lumV  = MLsharpenDirection (L, width,   1,       v, contrast, false);
+	const vfloat lumD1 = MLsharpenDirection (L, width+1, width-1, v, contrast, false);
+	const vfloat lumD2 = MLsharpenDirection (L, width-1, width+1, v, contrast, true);
+
+	// avoid sharpening diagonals too much
+	const vfloat rHV = wH/wV, rVH = wV/wH;
+	const vmask diagonal = vorm(vandm(vmaskf_lt(rHV, F2V(0.45f)), vmaskf_gt(rHV, F2V(0.05f))),
+	                            vandm(vmaskf_lt(rVH, F2V(0.45f)), vmaskf_gt(rVH, F2V(0.05f))));
+	const vfloat s = vself(diagonal, F2V(amount/3.0f), F2V(amount));
+
+	// final mix
+	vmask change = vandm(vandm(vmaskf_neq(wH, ZEROV), vmaskf_neq(wV, ZEROV)), vandm(vmaskf_neq(wD1, ZEROV), vmaskf_neq(wD2, ZEROV)));
+	if (luminance)
+		change = vandnotm(vmaskf_ge(v, F2V(92.f)), change);
+	const vfloat templab = v*(onev-s)+(lumH*wH+lumV*wV+lumD1*wD1+lumD2*wD2)/(wH+wV+wD1+wD2)*s;
+	vfloat newv = F2V(327.68f)*templab;
+	if (luminance)
+		newv = vabsf(newv); // lab->L always >0
+	return vself(change, newv, original);
+}
+#endif
+
 // To the extent possible under law, Manuel Llorens <manuelllorens@gmail.com>
 // has waived all copyright and related or neighboring rights to this work.
 // This work is published from: Spain.
 
 // Thanks to Manuel for this excellent job (Jacques Desmis JDC or frej83)
-void ImProcFunctions::MLsharpen (LabImage* lab) {
+SSEFUNCTION void ImProcFunctions::MLsharpen (LabImage* lab) {
 	// JD: this algorithm maximize clarity of images; it does not play on accutance. It can remove (partialy) the effects of the AA filter)
 	// I think we can use this algorithm alone in most cases, or first to clarify image and if you want a very little USM (unsharp mask sharpening) after...
 	if (params->sharpenEdge.enabled==false)
@@ -332,29 +567,15 @@ void ImProcFunctions::MLsharpen (LabImage* lab) {
 	MyTime t1e,t2e;
 	t1e.set();
 
-	int offset,c,i,j,p,width2;
-	int width = lab->W, height = lab->H;
-	float *L,lumH,lumV,lumD1,lumD2,v,contrast,s;
-	float difL,difR,difT,difB,difLT,difRB,difLB,difRT,wH,wV,wD1,wD2,chmax[3];
-	float f1,f2,f3,f4;
-	float templab;
-	int iii,kkk;
-	width2 = 2*width;
-	const float epsil=0.01f;//prevent divide by zero
-	const float eps2=0.001f;//prevent divide by zero
-	float amount;
-	amount = params->sharpenEdge.amount / 100.0f;
+	const int width = lab->W, height = lab->H;
+	const float amount = params->sharpenEdge.amount / 100.0f;
 	if (amount < 0.00001f)
 		return;
 
 	if (settings->verbose)
 		printf ("SharpenEdge amount %f\n", amount);
 
-	L = new float[width*height];
-
-	chmax[0] = 8.0f;
-	chmax[1] = 3.0f;
-	chmax[2] = 3.0f;
+	const float chmax[3] = {8.0f, 3.0f, 3.0f};
 
 	int channels;
 	if (params->sharpenEdge.threechannels) channels=0; else channels=2;
@@ -365,342 +586,185 @@ void ImProcFunctions::MLsharpen (LabImage* lab) {
 	if (settings->verbose)
 		printf ("SharpenEdge passes %d\n", passes);
 
-	for (p=0; p<passes; p++)
-		for (c=0; c<=channels; c++) {// c=0 Luminance only
+	AlignedBuffer<float>* buffer = sharpenBuffers.acquire (width*height);
+	float* L = buffer->data;
+	if (!L) {
+		sharpenBuffers.release (buffer);
+		return;
+	}
 
-#pragma omp parallel for private(offset) shared(L)
-			for (offset=0; offset<width*height; offset++) {
-				int ii = offset/width;
-				int kk = offset-ii*width;
-				if      (c==0) L[offset] = lab->L[ii][kk]/327.68f; // adjust to RT and to 0..100
-				else if (c==1) L[offset] = lab->a[ii][kk]/327.68f;
-				else if (c==2) L[offset] = lab->b[ii][kk]/327.68f;
-			}
-#pragma omp parallel for private(j,i,iii,kkk, templab,offset,wH,wV,wD1,wD2,s,lumH,lumV,lumD1,lumD2,v,contrast,f1,f2,f3,f4,difT,difB,difL,difR,difLT,difLB,difRT,difRB) shared(lab,L,amount)
-			for(j=2; j<height-2; j++)
-				for(i=2,offset=j*width+i; i<width-2; i++,offset++) {
-					// weight functions
-					wH = eps2 + fabs(L[offset+1]-L[offset-1]);
-					wV = eps2 + fabs(L[offset+width]-L[offset-width]);
-
-					s = 1.0f+fabs(wH-wV)/2.0f;
-					wD1 = eps2 + fabs(L[offset+width+1]-L[offset-width-1])/s;
-					wD2 = eps2 + fabs(L[offset+width-1]-L[offset-width+1])/s;
-					s = wD1;
-					wD1 /= wD2;
-					wD2 /= wD1;
-
-					// initial values
-					int ii = offset/width;
-					int kk = offset-ii*width;
-					if      (c==0) lumH=lumV=lumD1=lumD2=v=lab->L[ii][kk]/327.68f;
-					else if (c==1) lumH=lumV=lumD1=lumD2=v=lab->a[ii][kk]/327.68f;
-					else if (c==2) lumH=lumV=lumD1=lumD2=v=lab->b[ii][kk]/327.68f;
-
-
-					// contrast detection
-					contrast = sqrt(fabs(L[offset+1]-L[offset-1])*fabs(L[offset+1]-L[offset-1])+fabs(L[offset+width]-L[offset-width])*fabs(L[offset+width]-L[offset-width]))/chmax[c];
-					if (contrast>1.0f)
-						contrast=1.0f;
-
-					// new possible values
-					if (((L[offset]<L[offset-1])&&(L[offset]>L[offset+1])) || ((L[offset]>L[offset-1])&&(L[offset]<L[offset+1]))){
-						f1 = fabs(L[offset-2]-L[offset-1]);
-						f2 = fabs(L[offset-1]-L[offset]);
-						f3 = fabs(L[offset-1]-L[offset-width])*fabs(L[offset-1]-L[offset+width]);
-						f4 = sqrt(fabs(L[offset-1]-L[offset-width2])*fabs(L[offset-1]-L[offset+width2]));
-						difL = f1*f2*f2*f3*f3*f4;
-						f1 = fabs(L[offset+2]-L[offset+1]);
-						f2 = fabs(L[offset+1]-L[offset]);
-						f3 = fabs(L[offset+1]-L[offset-width])*fabs(L[offset+1]-L[offset+width]);
-						f4 = sqrt(fabs(L[offset+1]-L[offset-width2])*fabs(L[offset+1]-L[offset+width2]));
-						difR = f1*f2*f2*f3*f3*f4;
-						if ((difR>epsil)&&(difL>epsil)){
-							lumH = (L[offset-1]*difR+L[offset+1]*difL)/(difL+difR);
-							lumH = v*(1.f-contrast)+lumH*contrast;
-						}
-					}
-
-					if (((L[offset]<L[offset-width])&&(L[offset]>L[offset+width])) || ((L[offset]>L[offset-width])&&(L[offset]<L[offset+width]))) {
-						f1 = fabs(L[offset-width2]-L[offset-width]);
-						f2 = fabs(L[offset-width]-L[offset]);
-						f3 = fabs(L[offset-width]-L[offset-1])*fabs(L[offset-width]-L[offset+1]);
-						f4 = sqrt(fabs(L[offset-width]-L[offset-2])*fabs(L[offset-width]-L[offset+2]));
-						difT = f1*f2*f2*f3*f3*f4;
-						f1 = fabs(L[offset+width2]-L[offset+width]);
-						f2 = fabs(L[offset+width]-L[offset]);
-						f3 = fabs(L[offset+width]-L[offset-1])*fabs(L[offset+width]-L[offset+1]);
-						f4 = sqrt(fabs(L[offset+width]-L[offset-2])*fabs(L[offset+width]-L[offset+2]));
-						difB = f1*f2*f2*f3*f3*f4;
-						if ((difB>epsil)&&(difT>epsil)){
-							lumV = (L[offset-width]*difB+L[offset+width]*difT)/(difT+difB);
-							lumV = v*(1.f-contrast)+lumV*contrast;
-						}
-					}
-
-					if (((L[offset]<L[offset-1-width])&&(L[offset]>L[offset+1+width])) || ((L[offset]>L[offset-1-width])&&(L[offset]<L[offset+1+width]))) {
-						f1 = fabs(L[offset-2-width2]-L[offset-1-width]);
-						f2 = fabs(L[offset-1-width]-L[offset]);
-						f3 = fabs(L[offset-1-width]-L[offset-width+1])*fabs(L[offset-1-width]-L[offset+width-1]);
-						f4 = sqrt(fabs(L[offset-1-width]-L[offset-width2+2])*fabs(L[offset-1-width]-L[offset+width2-2]));
-						difLT = f1*f2*f2*f3*f3*f4;
-						f1 = fabs(L[offset+2+width2]-L[offset+1+width]);
-						f2 = fabs(L[offset+1+width]-L[offset]);
-						f3 = fabs(L[offset+1+width]-L[offset-width+1])*fabs(L[offset+1+width]-L[offset+width-1]);
-						f4 = sqrt(fabs(L[offset+1+width]-L[offset-width2+2])*fabs(L[offset+1+width]-L[offset+width2-2]));
-						difRB = f1*f2*f2*f3*f3*f4;
-						if ((difLT>epsil)&&(difRB>epsil)) {
-							lumD1 = (L[offset-1-width]*difRB+L[offset+1+width]*difLT)/(difLT+difRB);
-							lumD1 = v*(1.f-contrast)+lumD1*contrast;
-						}
-					}
-
-					if (((L[offset]<L[offset+1-width])&&(L[offset]>L[offset-1+width])) || ((L[offset]>L[offset+1-width])&&(L[offset]<L[offset-1+width]))) {
-						f1 = fabs(L[offset-2+width2]-L[offset-1+width]);
-						f2 = fabs(L[offset-1+width]-L[offset]);
-						f3 = fabs(L[offset-1+width]-L[offset-width-1])*fabs(L[offset-1+width]-L[offset+width+1]);
-						f4 = sqrt(fabs(L[offset-1+width]-L[offset-width2-2])*fabs(L[offset-1+width]-L[offset+width2+2]));
-						difLB = f1*f2*f2*f3*f3*f4;
-						f1 = fabs(L[offset+2-width2]-L[offset+1-width]);
-						f2 = fabs(L[offset+1-width]-L[offset])*fabs(L[offset+1-width]-L[offset]);
-						f3 = fabs(L[offset+1-width]-L[offset+width+1])*fabs(L[offset+1-width]-L[offset-width-1]);
-						f4 = sqrt(fabs(L[offset+1-width]-L[offset+width2+2])*fabs(L[offset+1-width]-L[offset-width2-2]));
-						difRT = f1*f2*f2*f3*f3*f4;
-						if ((difLB>epsil)&&(difRT>epsil)) {
-							lumD2 = (L[offset+1-width]*difLB+L[offset-1+width]*difRT)/(difLB+difRT);
-							lumD2 = v*(1.f-contrast)+lumD2*contrast;
-						}
-					}
-
-					s = amount;
-
-					// avoid sharpening diagonals too much
-					if (((fabs(wH/wV)<0.45f)&&(fabs(wH/wV)>0.05f))||((fabs(wV/wH)<0.45f)&&(fabs(wV/wH)>0.05f)))
-						s = amount/3.0f;
-
-					// final mix
-					if ((wH!=0.0f)&&(wV!=0.0f)&&(wD1!=0.0f)&&(wD2!=0.0f)) {
-						iii = offset/width;
-						kkk = offset-iii*width;
-						float provL=lab->L[iii][kkk]/327.68f;
-						if(c==0){ if(provL < 92.f) templab = v*(1.f-s)+(lumH*wH+lumV*wV+lumD1*wD1+lumD2*wD2)/(wH+wV+wD1+wD2)*s; else templab=provL;}
-						else templab = v*(1.f-s)+(lumH*wH+lumV*wV+lumD1*wD1+lumD2*wD2)/(wH+wV+wD1+wD2)*s;
-						if      (c==0) lab->L[iii][kkk] = fabs(327.68f*templab); // fabs because lab->L always >0
-						else if (c==1) lab->a[iii][kkk] =      327.68f*templab ;
-						else if (c==2) lab->b[iii][kkk] =      327.68f*templab ;
-					}
+	for (int p=0; p<passes; p++)
+		for (int c=0; c<=channels; c++) {// c=0 Luminance only
+			float** channel = c==0 ? lab->L : (c==1 ? lab->a : lab->b);
+			const bool luminance = c==0;
 
-				}
+#ifdef _OPENMP
+#pragma omp parallel
+#endif
+{
+#ifdef _OPENMP
+#pragma omp for
+#endif
+			for (int j=0; j<height; j++)
+				for (int i=0; i<width; i++)
+					L[j*width+i] = channel[j][i]/327.68f; // adjust to RT and to 0..100
+
+#ifdef _OPENMP
+#pragma omp for
+#endif
+			for (int j=2; j<height-2; j++) {
+				int i=2;
+#ifdef __SSE2__
+				for (; i<width-5; i+=4)
+					_mm_storeu_ps (&channel[j][i], MLsharpenPixels (&L[j*width+i], width, amount, chmax[c], luminance, LVFU(channel[j][i])));
+#endif
+				for (; i<width-2; i++)
+					channel[j][i] = MLsharpenPixel (&L[j*width+i], width, amount, chmax[c], luminance, channel[j][i]);
+			}
+}
 		}
 
-	delete [] L;
+	sharpenBuffers.release (buffer);
 
 	t2e.set();
 	if (settings->verbose)
 		printf("SharpenEdge gradient  %d usec\n", t2e.etime(t1e));
 }
 
-// To the extent possible under law, Manuel Llorens <manuelllorens@gmail.com>
-// has waived all copyright and related or neighboring rights to this work.
-// This code is licensed under CC0 v1.0, see license information at
-// http://creativecommons.org/publicdomain/zero/1.0/
+// Thresholds and coefficients of MLmicrocontrast for one uniformity
+struct MicrocontrastTables {
+	int numOffsets;
+	int offsets[24];        // neighbours added to the pixel, in the order of the sum
+	float weights[24];      // weight of each neighbour, amount included
+	int numNeighbours;
+	int neighbours[24];     // neighbours blended with the pixel, in raster order
+	float contBase;         // contrast modulation between 40 and 60
+	float contCoef[5];      // contrast modulation beyond contHigh or below contLow
+	float hiCoef[20];       // modulation of the highlights beyond hiThr
+	float loCoef[20];       // modulation of the shadows below loThr
+};
+
+static const float contHigh[5] = {60.0f, 70.0f, 80.0f, 90.0f, 95.0f};
+static const float contLow[5]  = {40.0f, 30.0f, 20.0f, 10.0f,  5.0f};
+static const float hiThr[20] = {5.0f, 10.0f, 13.0f, 17.0f, 20.0f, 25.0f, 30.0f, 37.0f, 42.0f, 58.0f,
+                                63.0f, 70.0f, 75.0f, 80.0f, 83.0f, 87.0f, 90.0f, 92.0f, 95.0f, 98.0f};
+static const float loThr[20] = {95.0f, 90.0f, 87.0f, 83.0f, 80.0f, 75.0f, 70.0f, 63.0f, 58.0f, 42.0f,
+                                37.0f, 30.0f, 25.0f, 20.0f, 17.0f, 13.0f, 10.0f, 8.0f, 5.0f, 2.0f};
+
+// New value of the pixel at LM, a copy of the luminance in 0..100; original is returned where the pixel isn't changed
+static inline float MLmicrocontrastPixel (const float* LM, int width, int k, float chmax, const MicrocontrastTables& t, float original) {
+
+	const float v0 = LM[0];
+	float contrast;
+	if (k==1) contrast = sqrt(SQR(LM[1]-LM[-1])+SQR(LM[width]-LM[-width]))/chmax; //for 3x3
+	else      contrast = sqrt(SQR(LM[1]-LM[-1])+SQR(LM[width]-LM[-width])+SQR(LM[2]-LM[-2])+SQR(LM[2*width]-LM[-2*width]))/(2*chmax); //for 5x5
+	if (contrast>1.0f)
+		contrast=1.0f;
+
+	float temp = v0;
+	for (int n=0; n<t.numOffsets; n++)
+		temp += CLIREF(v0-LM[t.offsets[n]])*t.weights[n];
+	if (temp<0.0f)
+		temp = 0.0f;
+	const float v = temp;
+
+	// the last neighbour on the other side of the pixel than before wins
+	for (int n=0; n<t.numNeighbours; n++) {
+		const float Ln = LM[t.neighbours[n]];
+		if ((v<Ln && v0>Ln) || (v>Ln && v0<Ln))
+			temp = v*0.75f+Ln*0.25f;
+	}
+
+	// JD : luminance pyramid to adjust contrast by evaluation of LM
+	float cont = t.contBase;
+	for (int n=0; n<5; n++)
+		if (v0>contHigh[n] || v0<contLow[n])
+			cont = t.contCoef[n];
+	contrast *= cont;
+	if (contrast>1.0f)
+		contrast=1.0f;
+
+	// JD: modulation of microcontrast in function of original Luminance and modulation of luminance
+	const float tempL = 327.68f*(temp*(1.0f-contrast)+v0*contrast);
+	float result = original;
+	float temp2 = tempL/(327.68f*v0);//for highlights
+	if (temp2>1.0f && v0>0.0f) {
+		if (temp2>1.70f) temp2=1.70f;//limit action
+		float coef = 0.0f;
+		for (int n=0; n<20; n++)
+			if (v0>hiThr[n])
+				coef = t.hiCoef[n];
+		result = (coef*(temp2-1.0f)+1.0f)*v0*327.68f;
+	}
+	float temp4 = (327.68f*v0)/tempL;
+	if (temp4>1.0f && v0<100.0f) {
+		if (temp4>1.7f) temp4=1.7f;//limit action
+		float coef = 0.0f;
+		for (int n=0; n<20; n++)
+			if (v0<loThr[n])
+				coef = t.loCoef[n];
+		result = (v0*327.68f)/(coef*(temp4-1.0f)+1.0f);
+	}
+	return result;
+}
+
+#ifdef __SSE2__
+// Same as MLmicrocontrastPixel for the 4 pixels from LM on, the thresholds being selected without branches
+static INLINE vfloat MLmicrocontrastPixels (const float* LM, int width, int k, float chmax, const MicrocontrastTables& t, vfloat original) {
+
+	const vfloat onev = F2V(1.0f);
+	const vfloat v0 = LVFU(LM[0]);
+	vfloat contrast;
+	if (k==1) contrast = vsqrtf(SQRV(LVFU(LM[1])-LVFU(LM[-1]))+SQRV(LVFU(LM[width])-LVFU(LM[-width])))/F2V(chmax);
+	else      contrast = vsqrtf(SQRV(LVFU(LM[1])-LVFU(LM[-1]))+SQRV(LVFU(LM[width])-LVFU(LM[-width]))
+	                           +SQRV(LVFU(LM[2])-LVFU(LM[-2]))+SQRV(LVFU(LM[2*width])-LVFU(LM[-2*width])))/F2V(2*chmax);
+	contrast = vminf(contrast, onev);
+
+	const vfloat limv = F2V(200000.0f);
+	vfloat temp = v0;
+	for (int n=0; n<t.numOffsets; n++)
+		temp += LIMV(v0-LVFU(LM[t.offsets[n]]), -limv, limv)*F2V(t.weights[n]);
+	temp = vmaxf(temp, ZEROV);
+	const vfloat v = temp;
+
+	for (int n=0; n<t.numNeighbours; n++) {
+		const vfloat Ln = LVFU(LM[t.neighbours[n]]);
+		const vmask across = vorm(vandm(vmaskf_lt(v, Ln), vmaskf_gt(v0, Ln)), vandm(vmaskf_gt(v, Ln), vmaskf_lt(v0, Ln)));
+		temp = vself(across, v*F2V(0.75f)+Ln*F2V(0.25f), temp);
+	}
+
+	vfloat cont = F2V(t.contBase);
+	for (int n=0; n<5; n++)
+		cont = vself(vorm(vmaskf_gt(v0, F2V(contHigh[n])), vmaskf_lt(v0, F2V(contLow[n]))), F2V(t.contCoef[n]), cont);
+	contrast = vminf(contrast*cont, onev);
+
+	const vfloat scalev = F2V(327.68f);
+	const vfloat tempL = scalev*(temp*(onev-contrast)+v0*contrast);
+	vfloat result = original;
+
+	const vfloat limitv = F2V(1.70f);
+	const vfloat temp2 = tempL/(scalev*v0);
+	vfloat coef = ZEROV;
+	for (int n=0; n<20; n++)
+		coef = vself(vmaskf_gt(v0, F2V(hiThr[n])), F2V(t.hiCoef[n]), coef);
+	result = vself(vandm(vmaskf_gt(temp2, onev), vmaskf_gt(v0, ZEROV)), (coef*(vminf(temp2, limitv)-onev)+onev)*v0*scalev, result);
+
+	const vfloat temp4 = (scalev*v0)/tempL;
+	coef = ZEROV;
+	for (int n=0; n<20; n++)
+		coef = vself(vmaskf_lt(v0, F2V(loThr[n])), F2V(t.loCoef[n]), coef);
+	result = vself(vandm(vmaskf_gt(temp4, onev), vmaskf_lt(v0, F2V(100.0f))), (v0*scalev)/(coef*(vminf(temp4, limitv)-onev)+onev), result);
+
+	return result;
+}
+#endif
 
 //! MicroContrast is a sharpening method developed by Manuel Llorens and documented here: http://www.rawness.es/sharpening/?lang=en
 //! <BR>The purpose is maximize clarity of the image without creating halo's.
 //! <BR>Addition from JD : pyramid  + pondered contrast with matrix 5x5
 //! \param lab LabImage Image in the CIELab colour space
 void ImProcFunctions::MLmicrocontrast(LabImage* lab) {
-	if (params->sharpenMicro.enabled==false)
-		return;
-	MyTime t1e,t2e;
-	t1e.set();
-	int k;
-	if (params->sharpenMicro.matrix == false) k=2; else k=1;
-	// k=2 matrix 5x5  k=1 matrix 3x3
-	int offset,offset2,i,j,col,row,n;
-	float temp,temp2,temp3,temp4,tempL;
-	float *LM,v,s,contrast;
-	int signs[25];
-	int width = lab->W, height = lab->H;
-	float uniform = params->sharpenMicro.uniformity;//between 0 to 100
-	int unif;
-	unif = (int)(uniform/10.0f); //put unif between 0 to 10
-	float amount = params->sharpenMicro.amount/1500.0f; //amount 2000.0 quasi no artefacts ==> 1500 = maximum, after artefacts
-	if (amount < 0.000001f)
-		return;
-	if (k==1)
-		amount *= 2.7f;  //25/9 if 3x3
-	if (settings->verbose)
-		printf ("Micro-contrast amount %f\n", amount);
-	if (settings->verbose)
-		printf ("Micro-contrast uniformity %i\n",unif);
-	//modulation uniformity in function of luminance
-	float L98[11] = {0.001f,0.0015f,0.002f,0.004f,0.006f,0.008f,0.01f,0.03f,0.05f,0.1f,0.1f};
-	float L95[11] = {0.0012f,0.002f,0.005f,0.01f,0.02f,0.05f,0.1f,0.12f,0.15f,0.2f,0.25f};
-	float L92[11] = {0.01f,0.015f,0.02f,0.06f,0.10f,0.13f,0.17f,0.25f,0.3f,0.32f,0.35f};
-	float L90[11] = {0.015f,0.02f,0.04f,0.08f,0.12f,0.15f,0.2f,0.3f,0.4f,0.5f,0.6f};
-	float L87[11] = {0.025f,0.03f,0.05f,0.1f,0.15f,0.25f,0.3f,0.4f,0.5f,0.63f,0.75f};
-	float L83[11] = {0.055f,0.08f,0.1f,0.15f,0.2f,0.3f,0.4f,0.5f,0.6f,0.75f,0.85f};
-	float L80[11] = {0.15f,0.2f,0.25f,0.3f,0.35f,0.4f,0.5f,0.6f,0.7f,0.8f,0.9f};
-	float L75[11] = {0.22f,0.25f,0.3f,0.4f,0.5f,0.6f,0.7f,0.8f,0.85f,0.9f,0.95f};
-	float L70[11] = {0.35f,0.4f,0.5f,0.6f,0.7f,0.8f,0.97f,1.0f,1.0f,1.0f,1.0f};
-	float L63[11] = {0.55f,0.6f,0.7f,0.8f,0.85f,0.9f,1.0f,1.0f,1.0f,1.0f,1.0f};
-	float L58[11] = {0.75f,0.77f,0.8f,0.9f,1.0f,1.0f,1.0f,1.0f,1.0f,1.0f,1.0f};
-	//default 5
-	//modulation contrast
-	float Cont0[11] = {0.05f,0.1f,0.2f,0.25f,0.3f,0.4f,0.5f,0.6f,0.7f,0.8f,0.9f};
-	float Cont1[11] = {0.1f,0.2f,0.3f,0.4f,0.5f,0.6f,0.7f,0.8f,0.9f,0.95f,1.0f};
-	float Cont2[11] = {0.2f,0.40f,0.6f,0.7f,0.8f,0.85f,0.90f,0.95f,1.0f,1.05f,1.10f};
-	float Cont3[11] = {0.5f,0.6f,0.7f,0.8f,0.85f,0.9f,1.0f,1.0f,1.05f,1.10f,1.20f};
-	float Cont4[11] = {0.8f,0.85f,0.9f,0.95f,1.0f,1.05f,1.10f,1.150f,1.2f,1.25f,1.40f};
-	float Cont5[11] = {1.0f,1.1f,1.2f,1.25f,1.3f,1.4f,1.45f,1.50f,1.6f,1.65f,1.80f};
-
-	float chmax=8.0f;
-	LM = new float[width*height];//allocation for Luminance
-#pragma omp parallel for private(offset, i,j) shared(LM)
-	for(j=0; j<height; j++)
-		for(i=0,offset=j*width+i; i<width; i++,offset++) {
-			LM[offset] = lab->L[j][i]/327.68f;// adjust to 0.100 and to RT variables
-		}
-
-#pragma omp parallel for private(j,i,offset,s,signs,v,n,row,col,offset2,contrast,temp,temp2,temp3,tempL,temp4) shared(lab,LM,amount,chmax,unif,k,L98,L95,L92,L90,L87,L83,L80,L75,L70,L63,L58,Cont0,Cont1,Cont2,Cont3,Cont4,Cont5)
-	for(j=k; j<height-k; j++)
-		for(i=k,offset=j*width+i; i<width-k; i++,offset++) {
-			s=amount;
-			v=LM[offset];
-			n=0;
-			for(row=j-k; row<=j+k; row++)
-				for(col=i-k,offset2=row*width+col; col<=i+k; col++,offset2++) {
-					signs[n]=0;
-					if (v<LM[offset2]) signs[n]=-1;
-					if (v>LM[offset2]) signs[n]=1;
-					n++;
-				}
-			if      (k==1) contrast = sqrt(fabs(LM[offset+1]-LM[offset-1])*fabs(LM[offset+1]-LM[offset-1])+fabs(LM[offset+width]-LM[offset-width])*fabs(LM[offset+width]-LM[offset-width]))/chmax; //for 3x3
-			else if (k==2) contrast = sqrt(fabs(LM[offset+1]-LM[offset-1])*fabs(LM[offset+1]-LM[offset-1])+fabs(LM[offset+width]-LM[offset-width])*fabs(LM[offset+width]-LM[offset-width])
-									      +fabs(LM[offset+2]-LM[offset-2])*fabs(LM[offset+2]-LM[offset-2])+fabs(LM[offset+2*width]-LM[offset-2*width])*fabs(LM[offset+2*width]-LM[offset-2*width]))/(2*chmax);  //for 5x5
-
-			if (contrast>1.0f)
-				contrast=1.0f;
-			//matrix 5x5
-			temp=lab->L[j][i]/327.68f;  //begin 3x3
-			temp += CLIREF(v-LM[offset-width-1])*sqrtf(2.0f)*s;
-			temp += CLIREF(v-LM[offset-width])*s;
-			temp += CLIREF(v-LM[offset-width+1])*sqrtf(2.0f)*s;
-			temp += CLIREF(v-LM[offset-1])*s;
-			temp += CLIREF(v-LM[offset+1])*s;
-			temp += CLIREF(v-LM[offset+width-1])*sqrtf(2.0f)*s;
-			temp += CLIREF(v-LM[offset+width])*s;
-			temp += CLIREF(v-LM[offset+width+1])*sqrtf(2.0f)*s;//end 3x3
-
-			// add JD continue 5x5
-			if (k==2) {
-				temp += 2.0f*CLIREF(v-LM[offset+2*width])*s;
-				temp += 2.0f*CLIREF(v-LM[offset-2*width])*s;
-				temp += 2.0f*CLIREF(v-LM[offset-2      ])*s;
-				temp += 2.0f*CLIREF(v-LM[offset+2      ])*s;
-
-				temp += 2.0f*CLIREF(v-LM[offset+2*width-1])*s*sqrtf(1.25f);// 1.25  = 1*1 + 0.5*0.5
-				temp += 2.0f*CLIREF(v-LM[offset+2*width-2])*s*sqrtf(2.00f);
-				temp += 2.0f*CLIREF(v-LM[offset+2*width+1])*s*sqrtf(1.25f);
-				temp += 2.0f*CLIREF(v-LM[offset+2*width+2])*s*sqrtf(2.00f);
-				temp += 2.0f*CLIREF(v-LM[offset+  width+2])*s*sqrtf(1.25f);
-				temp += 2.0f*CLIREF(v-LM[offset+  width-2])*s*sqrtf(1.25f);
-				temp += 2.0f*CLIREF(v-LM[offset-2*width-1])*s*sqrtf(1.25f);
-				temp += 2.0f*CLIREF(v-LM[offset-2*width-2])*s*sqrtf(2.00f);
-				temp += 2.0f*CLIREF(v-LM[offset-2*width+1])*s*sqrtf(1.25f);
-				temp += 2.0f*CLIREF(v-LM[offset-2*width+2])*s*sqrtf(2.00f);
-				temp += 2.0f*CLIREF(v-LM[offset-  width+2])*s*sqrtf(1.25f);
-				temp += 2.0f*CLIREF(v-LM[offset-  width-2])*s*sqrtf(1.25f);
-			}
-			if (temp <0.0f) temp = 0.0f;
-			v=temp;
-
-			n=0;
-
-			for(row=j-k; row<=j+k; row++){
-				for(col=i-k,offset2=row*width+col; col<=i+k; col++,offset2++){
-					if (((v<LM[offset2])&&(signs[n]>0))||((v>LM[offset2])&&(signs[n]<0))) {
-						temp = v*0.75f+LM[offset2]*0.25f;// 0.75 0.25
-					}
-                    n++;
-				}
-            }
-			if (LM[offset]>95.0f || LM[offset]<5.0f)
-				contrast *= Cont0[unif]; //+ JD : luminance  pyramid to adjust contrast by evaluation of LM[offset]
-			else if (LM[offset]>90.0f || LM[offset]<10.0f)
-				contrast *= Cont1[unif];
-			else if (LM[offset]>80.0f || LM[offset]<20.0f)
-				contrast *= Cont2[unif];
-			else if (LM[offset]>70.0f || LM[offset]<30.0f)
-				contrast *= Cont3[unif];
-			else if (LM[offset]>60.0f || LM[offset]<40.0f)
-				contrast *= Cont4[unif];
-			else
-				contrast *= Cont5[unif];//(2.0f/k)*Cont5[unif];
-
-			if (contrast>1.0f)
-				contrast=1.0f;
-			tempL = 327.68f*(temp*(1.0f-contrast)+LM[offset]*contrast);
-			// JD: modulation of microcontrast in function of original Luminance and modulation of luminance
-			temp2 = tempL/(327.68f*LM[offset]);//for highlights
-			if (temp2>1.0f) {
-				if (temp2>1.70f) temp2=1.70f;//limit action
-				if      (LM[offset]>98.0f) { lab->L[j][i]=LM[offset]*327.68f; }
-				else if (LM[offset]>95.0f) { temp3=temp2-1.0f; temp=(L95[unif]*temp3)+1.0f; lab->L[j][i]=temp*LM[offset]*327.68f; }
-				else if (LM[offset]>92.0f) { temp3=temp2-1.0f; temp=(L92[unif]*temp3)+1.0f; lab->L[j][i]=temp*LM[offset]*327.68f; }
-				else if (LM[offset]>90.0f) { temp3=temp2-1.0f; temp=(L90[unif]*temp3)+1.0f; lab->L[j][i]=temp*LM[offset]*327.68f; }
-				else if (LM[offset]>87.0f) { temp3=temp2-1.0f; temp=(L87[unif]*temp3)+1.0f; lab->L[j][i]=temp*LM[offset]*327.68f; }
-				else if (LM[offset]>83.0f) { temp3=temp2-1.0f; temp=(L83[unif]*temp3)+1.0f; lab->L[j][i]=temp*LM[offset]*327.68f; }
-				else if (LM[offset]>80.0f) { temp3=temp2-1.0f; temp=(L80[unif]*temp3)+1.0f; lab->L[j][i]=temp*LM[offset]*327.68f; }
-				else if (LM[offset]>75.0f) { temp3=temp2-1.0f; temp=(L75[unif]*temp3)+1.0f; lab->L[j][i]=temp*LM[offset]*327.68f; }
-				else if (LM[offset]>70.0f) { temp3=temp2-1.0f; temp=(L70[unif]*temp3)+1.0f; lab->L[j][i]=temp*LM[offset]*327.68f; }
-				else if (LM[offset]>63.0f) { temp3=temp2-1.0f; temp=(L63[unif]*temp3)+1.0f; lab->L[j][i]=temp*LM[offset]*327.68f; }
-				else if (LM[offset]>58.0f) { temp3=temp2-1.0f; temp=(L58[unif]*temp3)+1.0f; lab->L[j][i]=temp*LM[offset]*327.68f; }
-				else if (LM[offset]>42.0f) { temp3=temp2-1.0f; temp=(L58[unif]*temp3)+1.0f; lab->L[j][i]=temp*LM[offset]*327.68f; }
-				else if (LM[offset]>37.0f) { temp3=temp2-1.0f; temp=(L63[unif]*temp3)+1.0f; lab->L[j][i]=temp*LM[offset]*327.68f; }
-				else if (LM[offset]>30.0f) { temp3=temp2-1.0f; temp=(L70[unif]*temp3)+1.0f; lab->L[j][i]=temp*LM[offset]*327.68f; }
-				else if (LM[offset]>25.0f) { temp3=temp2-1.0f; temp=(L75[unif]*temp3)+1.0f; lab->L[j][i]=temp*LM[offset]*327.68f; }
-				else if (LM[offset]>20.0f) { temp3=temp2-1.0f; temp=(L80[unif]*temp3)+1.0f; lab->L[j][i]=temp*LM[offset]*327.68f; }
-				else if (LM[offset]>17.0f) { temp3=temp2-1.0f; temp=(L83[unif]*temp3)+1.0f; lab->L[j][i]=temp*LM[offset]*327.68f; }
-				else if (LM[offset]>13.0f) { temp3=temp2-1.0f; temp=(L87[unif]*temp3)+1.0f; lab->L[j][i]=temp*LM[offset]*327.68f; }
-				else if (LM[offset]>10.0f) { temp3=temp2-1.0f; temp=(L90[unif]*temp3)+1.0f; lab->L[j][i]=temp*LM[offset]*327.68f; }
-				else if (LM[offset]> 5.0f) { temp3=temp2-1.0f; temp=(L95[unif]*temp3)+1.0f; lab->L[j][i]=temp*LM[offset]*327.68f; }
-				else if (LM[offset]> 0.0f) { lab->L[j][i]=LM[offset]*327.68f;}
-			}
-			temp4 = (327.68f*LM[offset])/tempL;//
-			if (temp4>1.0f) {
-				if (temp4>1.7f)
-					temp4 = 1.7f;//limit action
-				if      (LM[offset]< 2.0f) { temp3=temp4-1.0f; temp=(L98[unif]*temp3)+1.0f; lab->L[j][i]=(LM[offset]*327.68f)/temp; }
-				else if (LM[offset]< 5.0f) { temp3=temp4-1.0f; temp=(L95[unif]*temp3)+1.0f; lab->L[j][i]=(LM[offset]*327.68f)/temp; }
-				else if (LM[offset]< 8.0f) { temp3=temp4-1.0f; temp=(L92[unif]*temp3)+1.0f; lab->L[j][i]=(LM[offset]*327.68f)/temp; }
-				else if (LM[offset]<10.0f) { temp3=temp4-1.0f; temp=(L90[unif]*temp3)+1.0f; lab->L[j][i]=(LM[offset]*327.68f)/temp; }
-				else if (LM[offset]<13.0f) { temp3=temp4-1.0f; temp=(L87[unif]*temp3)+1.0f; lab->L[j][i]=(LM[offset]*327.68f)/temp; }
-				else if (LM[offset]<17.0f) { temp3=temp4-1.0f; temp=(L83[unif]*temp3)+1.0f; lab->L[j][i]=(LM[offset]*327.68f)/temp; }
-				else if (LM[offset]<20.0f) { temp3=temp4-1.0f; temp=(L80[unif]*temp3)+1.0f; lab->L[j][i]=(LM[offset]*327.68f)/temp; }
-				else if (LM[offset]<25.0f) { temp3=temp4-1.0f; temp=(L75[unif]*temp3)+1.0f; lab->L[j][i]=(LM[offset]*327.68f)/temp; }
-				else if (LM[offset]<30.0f) { temp3=temp4-1.0f; temp=(L70[unif]*temp3)+1.0f; lab->L[j][i]=(LM[offset]*327.68f)/temp; }
-				else if (LM[offset]<37.0f) { temp3=temp4-1.0f; temp=(L63[unif]*temp3)+1.0f; lab->L[j][i]=(LM[offset]*327.68f)/temp; }
-				else if (LM[offset]<42.0f) { temp3=temp4-1.0f; temp=(L58[unif]*temp3)+1.0f; lab->L[j][i]=(LM[offset]*327.68f)/temp; }
-				else if (LM[offset]<58.0f) { temp3=temp4-1.0f; temp=(L58[unif]*temp3)+1.0f; lab->L[j][i]=(LM[offset]*327.68f)/temp; }
-				else if (LM[offset]<63.0f) { temp3=temp4-1.0f; temp=(L63[unif]*temp3)+1.0f; lab->L[j][i]=(LM[offset]*327.68f)/temp; }
-				else if (LM[offset]<70.0f) { temp3=temp4-1.0f; temp=(L70[unif]*temp3)+1.0f; lab->L[j][i]=(LM[offset]*327.68f)/temp; }
-				else if (LM[offset]<75.0f) { temp3=temp4-1.0f; temp=(L75[unif]*temp3)+1.0f; lab->L[j][i]=(LM[offset]*327.68f)/temp; }
-				else if (LM[offset]<80.0f) { temp3=temp4-1.0f; temp=(L80[unif]*temp3)+1.0f; lab->L[j][i]=(LM[offset]*327.68f)/temp; }
-				else if (LM[offset]<83.0f) { temp3=temp4-1.0f; temp=(L83[unif]*temp3)+1.0f; lab->L[j][i]=(LM[offset]*327.68f)/temp; }
-				else if (LM[offset]<87.0f) { temp3=temp4-1.0f; temp=(L87[unif]*temp3)+1.0f; lab->L[j][i]=(LM[offset]*327.68f)/temp; }
-				else if (LM[offset]<90.0f) { temp3=temp4-1.0f; temp=(L90[unif]*temp3)+1.0f; lab->L[j][i]=(LM[offset]*327.68f)/temp; }
-				else if (LM[offset]<95.0f) { temp3=temp4-1.0f; temp=(L95[unif]*temp3)+1.0f; lab->L[j][i]=(LM[offset]*327.68f)/temp; }
-				else if (LM[offset]<100.0f) { lab->L[j][i]=LM[offset]*327.68f; }
-			}
-
-		}
-	delete [] LM;
-	t2e.set();
-	if (settings->verbose)
-		printf("Micro-contrast  %d usec\n", t2e.etime(t1e));
-
+	MLmicrocontrast (lab->L, lab->W, lab->H);
 }
 
 //! MicroContrast is a sharpening method developed by Manuel Llorens and documented here: http://www.rawness.es/sharpening/?lang=en
@@ -708,6 +772,16 @@ void ImProcFunctions::MLmicrocontrast(LabImage* lab) {
 //! <BR>Addition from JD : pyramid  + pondered contrast with matrix 5x5
 //! \param ncie CieImage Image in the CIECAM02 colour space
 void ImProcFunctions::MLmicrocontrastcam(CieImage* ncie) {
+	MLmicrocontrast (ncie->sh_p, ncie->W, ncie->H);
+}
+
+// To the extent possible under law, Manuel Llorens <manuelllorens@gmail.com>
+// has waived all copyright and related or neighboring rights to this work.
+// This code is licensed under CC0 v1.0, see license information at
+// http://creativecommons.org/publicdomain/zero/1.0/
+
+//! \param luminance luminance plane, 0..32768
+SSEFUNCTION void ImProcFunctions::MLmicrocontrast(float** luminance, int W, int H) {
 	if (params->sharpenMicro.enabled==false)
 		return;
 	MyTime t1e,t2e;
@@ -715,11 +789,7 @@ void ImProcFunctions::MLmicrocontrastcam(CieImage* ncie) {
 	int k;
 	if (params->sharpenMicro.matrix == false) k=2; else k=1;
 	// k=2 matrix 5x5  k=1 matrix 3x3
-	int offset,offset2,i,j,col,row,n;
-	float temp,temp2,temp3,temp4,tempL;
-	float *LM,v,s,contrast;
-	int signs[25];
-	int width = ncie->W, height = ncie->H;
+	const int width = W, height = H;
 	float uniform = params->sharpenMicro.uniformity;//between 0 to 100
 	int unif;
 	unif = (int)(uniform/10.0f); //put unif between 0 to 10
@@ -753,148 +823,77 @@ void ImProcFunctions::MLmicrocontrastcam(CieImage* ncie) {
 	float Cont4[11] = {0.8f,0.85f,0.9f,0.95f,1.0f,1.05f,1.10f,1.150f,1.2f,1.25f,1.40f};
 	float Cont5[11] = {1.0f,1.1f,1.2f,1.25f,1.3f,1.4f,1.45f,1.50f,1.6f,1.65f,1.80f};
 
-	float chmax=8.0f;
-	LM = new float[width*height];//allocation for Luminance
-#pragma omp parallel for private(offset, i,j) shared(LM)
-	for(j=0; j<height; j++)
-		for(i=0,offset=j*width+i; i<width; i++,offset++) {
-			LM[offset] = ncie->sh_p[j][i]/327.68f;// adjust to 0.100 and to RT variables
+	// the cascades of thresholds, in the order they are selected
+	MicrocontrastTables t;
+	t.contBase = Cont5[unif];
+	const float contCoef[5] = {Cont4[unif], Cont3[unif], Cont2[unif], Cont1[unif], Cont0[unif]};
+	const float hiCoef[20] = {L95[unif], L90[unif], L87[unif], L83[unif], L80[unif], L75[unif], L70[unif], L63[unif], L58[unif], L58[unif],
+	                          L63[unif], L70[unif], L75[unif], L80[unif], L83[unif], L87[unif], L90[unif], L92[unif], L95[unif], 0.0f};
+	const float loCoef[20] = {L95[unif], L90[unif], L87[unif], L83[unif], L80[unif], L75[unif], L70[unif], L63[unif], L58[unif], L58[unif],
+	                          L63[unif], L70[unif], L75[unif], L80[unif], L83[unif], L87[unif], L90[unif], L92[unif], L95[unif], L98[unif]};
+	memcpy (t.contCoef, contCoef, sizeof(contCoef));
+	memcpy (t.hiCoef, hiCoef, sizeof(hiCoef));
+	memcpy (t.loCoef, loCoef, sizeof(loCoef));
+
+	//matrix 3x3, then JD continue 5x5
+	const float s = amount;
+	const int offsets3[8] = {-width-1, -width, -width+1, -1, 1, width-1, width, width+1};
+	const float weights3[8] = {sqrtf(2.0f)*s, s, sqrtf(2.0f)*s, s, s, sqrtf(2.0f)*s, s, sqrtf(2.0f)*s};
+	const int offsets5[16] = {2*width, -2*width, -2, 2,
+	                          2*width-1, 2*width-2, 2*width+1, 2*width+2, width+2, width-2,
+	                          -2*width-1, -2*width-2, -2*width+1, -2*width+2, -width+2, -width-2};
+	const float weights5[16] = {2.0f*s, 2.0f*s, 2.0f*s, 2.0f*s,
+	                            2.0f*s*sqrtf(1.25f), 2.0f*s*sqrtf(2.00f), 2.0f*s*sqrtf(1.25f), 2.0f*s*sqrtf(2.00f), 2.0f*s*sqrtf(1.25f), 2.0f*s*sqrtf(1.25f),
+	                            2.0f*s*sqrtf(1.25f), 2.0f*s*sqrtf(2.00f), 2.0f*s*sqrtf(1.25f), 2.0f*s*sqrtf(2.00f), 2.0f*s*sqrtf(1.25f), 2.0f*s*sqrtf(1.25f)};
+	t.numOffsets = 0;
+	for (int n=0; n<8; n++, t.numOffsets++) {
+		t.offsets[t.numOffsets] = offsets3[n];
+		t.weights[t.numOffsets] = weights3[n];
+	}
+	if (k==2)
+		for (int n=0; n<16; n++, t.numOffsets++) {
+			t.offsets[t.numOffsets] = offsets5[n];
+			t.weights[t.numOffsets] = weights5[n];
 		}
+	t.numNeighbours = 0;
+	for (int row=-k; row<=k; row++)
+		for (int col=-k; col<=k; col++)
+			if (row || col)
+				t.neighbours[t.numNeighbours++] = row*width+col;
 
-#pragma omp parallel for private(j,i,offset,s,signs,v,n,row,col,offset2,contrast,temp,temp2,temp3,tempL,temp4) shared(ncie,LM,amount,chmax,unif,k,L98,L95,L92,L90,L87,L83,L80,L75,L70,L63,L58,Cont0,Cont1,Cont2,Cont3,Cont4,Cont5)
-	for(j=k; j<height-k; j++)
-		for(i=k,offset=j*width+i; i<width-k; i++,offset++) {
-			s=amount;
-			v=LM[offset];
-			n=0;
-			for(row=j-k; row<=j+k; row++)
-				for(col=i-k,offset2=row*width+col; col<=i+k; col++,offset2++) {
-					signs[n]=0;
-					if (v<LM[offset2]) signs[n]=-1;
-					if (v>LM[offset2]) signs[n]=1;
-					n++;
-				}
-			if      (k==1) contrast = sqrt(fabs(LM[offset+1]-LM[offset-1])*fabs(LM[offset+1]-LM[offset-1])+fabs(LM[offset+width]-LM[offset-width])*fabs(LM[offset+width]-LM[offset-width]))/chmax; //for 3x3
-			else if (k==2) contrast = sqrt(fabs(LM[offset+1]-LM[offset-1])*fabs(LM[offset+1]-LM[offset-1])+fabs(LM[offset+width]-LM[offset-width])*fabs(LM[offset+width]-LM[offset-width])
-									      +fabs(LM[offset+2]-LM[offset-2])*fabs(LM[offset+2]-LM[offset-2])+fabs(LM[offset+2*width]-LM[offset-2*width])*fabs(LM[offset+2*width]-LM[offset-2*width]))/(2*chmax);  //for 5x5
-
-			if (contrast>1.0f)
-				contrast=1.0f;
-			//matrix 5x5
-			temp=ncie->sh_p[j][i]/327.68f;  //begin 3x3
-			temp += CLIREF(v-LM[offset-width-1])*sqrtf(2.0f)*s;
-			temp += CLIREF(v-LM[offset-width])*s;
-			temp += CLIREF(v-LM[offset-width+1])*sqrtf(2.0f)*s;
-			temp += CLIREF(v-LM[offset-1])*s;
-			temp += CLIREF(v-LM[offset+1])*s;
-			temp += CLIREF(v-LM[offset+width-1])*sqrtf(2.0f)*s;
-			temp += CLIREF(v-LM[offset+width])*s;
-			temp += CLIREF(v-LM[offset+width+1])*sqrtf(2.0f)*s;//end 3x3
-
-			// add JD continue 5x5
-			if (k==2) {
-				temp += 2.0f*CLIREF(v-LM[offset+2*width])*s;
-				temp += 2.0f*CLIREF(v-LM[offset-2*width])*s;
-				temp += 2.0f*CLIREF(v-LM[offset-2      ])*s;
-				temp += 2.0f*CLIREF(v-LM[offset+2      ])*s;
-
-				temp += 2.0f*CLIREF(v-LM[offset+2*width-1])*s*sqrtf(1.25f);// 1.25  = 1*1 + 0.5*0.5
-				temp += 2.0f*CLIREF(v-LM[offset+2*width-2])*s*sqrtf(2.00f);
-				temp += 2.0f*CLIREF(v-LM[offset+2*width+1])*s*sqrtf(1.25f);
-				temp += 2.0f*CLIREF(v-LM[offset+2*width+2])*s*sqrtf(2.00f);
-				temp += 2.0f*CLIREF(v-LM[offset+  width+2])*s*sqrtf(1.25f);
-				temp += 2.0f*CLIREF(v-LM[offset+  width-2])*s*sqrtf(1.25f);
-				temp += 2.0f*CLIREF(v-LM[offset-2*width-1])*s*sqrtf(1.25f);
-				temp += 2.0f*CLIREF(v-LM[offset-2*width-2])*s*sqrtf(2.00f);
-				temp += 2.0f*CLIREF(v-LM[offset-2*width+1])*s*sqrtf(1.25f);
-				temp += 2.0f*CLIREF(v-LM[offset-2*width+2])*s*sqrtf(2.00f);
-				temp += 2.0f*CLIREF(v-LM[offset-  width+2])*s*sqrtf(1.25f);
-				temp += 2.0f*CLIREF(v-LM[offset-  width-2])*s*sqrtf(1.25f);
-			}
-			if (temp <0.0f) temp = 0.0f;
-			v=temp;
-
-			n=0;
+	float chmax=8.0f;
+	AlignedBuffer<float>* buffer = sharpenBuffers.acquire (width*height);
+	float* LM = buffer->data;//allocation for Luminance
+	if (!LM) {
+		sharpenBuffers.release (buffer);
+		return;
+	}
 
-			for(row=j-k; row<=j+k; row++){
-				for(col=i-k,offset2=row*width+col; col<=i+k; col++,offset2++){
-					if (((v<LM[offset2])&&(signs[n]>0))||((v>LM[offset2])&&(signs[n]<0))) {
-						temp = v*0.75f+LM[offset2]*0.25f;// 0.75 0.25
-					}
-                    n++;
-				}
-            }
-			if (LM[offset]>95.0f || LM[offset]<5.0f)
-				contrast *= Cont0[unif]; //+ JD : luminance  pyramid to adjust contrast by evaluation of LM[offset]
-			else if (LM[offset]>90.0f || LM[offset]<10.0f)
-				contrast *= Cont1[unif];
-			else if (LM[offset]>80.0f || LM[offset]<20.0f)
-				contrast *= Cont2[unif];
-			else if (LM[offset]>70.0f || LM[offset]<30.0f)
-				contrast *= Cont3[unif];
-			else if (LM[offset]>60.0f || LM[offset]<40.0f)
-				contrast *= Cont4[unif];
-			else
-				contrast *= Cont5[unif];//(2.0f/k)*Cont5[unif];
-
-			if (contrast>1.0f)
-				contrast=1.0f;
-			tempL = 327.68f*(temp*(1.0f-contrast)+LM[offset]*contrast);
-			// JD: modulation of microcontrast in function of original Luminance and modulation of luminance
-			temp2 = tempL/(327.68f*LM[offset]);//for highlights
-			if (temp2>1.0f) {
-				if (temp2>1.70f) temp2=1.70f;//limit action
-				if      (LM[offset]>98.0f) { ncie->sh_p[j][i]=LM[offset]*327.68f; }
-				else if (LM[offset]>95.0f) { temp3=temp2-1.0f; temp=(L95[unif]*temp3)+1.0f; ncie->sh_p[j][i]=temp*LM[offset]*327.68f; }
-				else if (LM[offset]>92.0f) { temp3=temp2-1.0f; temp=(L92[unif]*temp3)+1.0f; ncie->sh_p[j][i]=temp*LM[offset]*327.68f; }
-				else if (LM[offset]>90.0f) { temp3=temp2-1.0f; temp=(L90[unif]*temp3)+1.0f; ncie->sh_p[j][i]=temp*LM[offset]*327.68f; }
-				else if (LM[offset]>87.0f) { temp3=temp2-1.0f; temp=(L87[unif]*temp3)+1.0f; ncie->sh_p[j][i]=temp*LM[offset]*327.68f; }
-				else if (LM[offset]>83.0f) { temp3=temp2-1.0f; temp=(L83[unif]*temp3)+1.0f; ncie->sh_p[j][i]=temp*LM[offset]*327.68f; }
-				else if (LM[offset]>80.0f) { temp3=temp2-1.0f; temp=(L80[unif]*temp3)+1.0f; ncie->sh_p[j][i]=temp*LM[offset]*327.68f; }
-				else if (LM[offset]>75.0f) { temp3=temp2-1.0f; temp=(L75[unif]*temp3)+1.0f; ncie->sh_p[j][i]=temp*LM[offset]*327.68f; }
-				else if (LM[offset]>70.0f) { temp3=temp2-1.0f; temp=(L70[unif]*temp3)+1.0f; ncie->sh_p[j][i]=temp*LM[offset]*327.68f; }
-				else if (LM[offset]>63.0f) { temp3=temp2-1.0f; temp=(L63[unif]*temp3)+1.0f; ncie->sh_p[j][i]=temp*LM[offset]*327.68f; }
-				else if (LM[offset]>58.0f) { temp3=temp2-1.0f; temp=(L58[unif]*temp3)+1.0f; ncie->sh_p[j][i]=temp*LM[offset]*327.68f; }
-				else if (LM[offset]>42.0f) { temp3=temp2-1.0f; temp=(L58[unif]*temp3)+1.0f; ncie->sh_p[j][i]=temp*LM[offset]*327.68f; }
-				else if (LM[offset]>37.0f) { temp3=temp2-1.0f; temp=(L63[unif]*temp3)+1.0f; ncie->sh_p[j][i]=temp*LM[offset]*327.68f; }
-				else if (LM[offset]>30.0f) { temp3=temp2-1.0f; temp=(L70[unif]*temp3)+1.0f; ncie->sh_p[j][i]=temp*LM[offset]*327.68f; }
-				else if (LM[offset]>25.0f) { temp3=temp2-1.0f; temp=(L75[unif]*temp3)+1.0f; ncie->sh_p[j][i]=temp*LM[offset]*327.68f; }
-				else if (LM[offset]>20.0f) { temp3=temp2-1.0f; temp=(L80[unif]*temp3)+1.0f; ncie->sh_p[j][i]=temp*LM[offset]*327.68f; }
-				else if (LM[offset]>17.0f) { temp3=temp2-1.0f; temp=(L83[unif]*temp3)+1.0f; ncie->sh_p[j][i]=temp*LM[offset]*327.68f; }
-				else if (LM[offset]>13.0f) { temp3=temp2-1.0f; temp=(L87[unif]*temp3)+1.0f; ncie->sh_p[j][i]=temp*LM[offset]*327.68f; }
-				else if (LM[offset]>10.0f) { temp3=temp2-1.0f; temp=(L90[unif]*temp3)+1.0f; ncie->sh_p[j][i]=temp*LM[offset]*327.68f; }
-				else if (LM[offset]> 5.0f) { temp3=temp2-1.0f; temp=(L95[unif]*temp3)+1.0f; ncie->sh_p[j][i]=temp*LM[offset]*327.68f; }
-				else if (LM[offset]> 0.0f) { ncie->sh_p[j][i]=LM[offset]*327.68f;}
-			}
-			temp4 = (327.68f*LM[offset])/tempL;//
-			if (temp4>1.0f) {
-				if (temp4>1.7f)
-					temp4 = 1.7f;//limit action
-				if      (LM[offset]< 2.0f) { temp3=temp4-1.0f; temp=(L98[unif]*temp3)+1.0f;	ncie->sh_p[j][i]=(LM[offset]*327.68f)/temp; }
-				else if (LM[offset]< 5.0f) { temp3=temp4-1.0f; temp=(L95[unif]*temp3)+1.0f; ncie->sh_p[j][i]=(LM[offset]*327.68f)/temp; }
-				else if (LM[offset]< 8.0f) { temp3=temp4-1.0f; temp=(L92[unif]*temp3)+1.0f; ncie->sh_p[j][i]=(LM[offset]*327.68f)/temp; }
-				else if (LM[offset]<10.0f) { temp3=temp4-1.0f; temp=(L90[unif]*temp3)+1.0f;	ncie->sh_p[j][i]=(LM[offset]*327.68f)/temp; }
-				else if (LM[offset]<13.0f) { temp3=temp4-1.0f; temp=(L87[unif]*temp3)+1.0f; ncie->sh_p[j][i]=(LM[offset]*327.68f)/temp; }
-				else if (LM[offset]<17.0f) { temp3=temp4-1.0f; temp=(L83[unif]*temp3)+1.0f;	ncie->sh_p[j][i]=(LM[offset]*327.68f)/temp; }
-				else if (LM[offset]<20.0f) { temp3=temp4-1.0f; temp=(L80[unif]*temp3)+1.0f; ncie->sh_p[j][i]=(LM[offset]*327.68f)/temp; }
-				else if (LM[offset]<25.0f) { temp3=temp4-1.0f; temp=(L75[unif]*temp3)+1.0f; ncie->sh_p[j][i]=(LM[offset]*327.68f)/temp; }
-				else if (LM[offset]<30.0f) { temp3=temp4-1.0f; temp=(L70[unif]*temp3)+1.0f; ncie->sh_p[j][i]=(LM[offset]*327.68f)/temp; }
-				else if (LM[offset]<37.0f) { temp3=temp4-1.0f; temp=(L63[unif]*temp3)+1.0f; ncie->sh_p[j][i]=(LM[offset]*327.68f)/temp; }
-				else if (LM[offset]<42.0f) { temp3=temp4-1.0f; temp=(L58[unif]*temp3)+1.0f; ncie->sh_p[j][i]=(LM[offset]*327.68f)/temp; }
-				else if (LM[offset]<58.0f) { temp3=temp4-1.0f; temp=(L58[unif]*temp3)+1.0f; ncie->sh_p[j][i]=(LM[offset]*327.68f)/temp; }
-				else if (LM[offset]<63.0f) { temp3=temp4-1.0f; temp=(L63[unif]*temp3)+1.0f; ncie->sh_p[j][i]=(LM[offset]*327.68f)/temp; }
-				else if (LM[offset]<70.0f) { temp3=temp4-1.0f; temp=(L70[unif]*temp3)+1.0f;	ncie->sh_p[j][i]=(LM[offset]*327.68f)/temp; }
-				else if (LM[offset]<75.0f) { temp3=temp4-1.0f; temp=(L75[unif]*temp3)+1.0f; ncie->sh_p[j][i]=(LM[offset]*327.68f)/temp; }
-				else if (LM[offset]<80.0f) { temp3=temp4-1.0f; temp=(L80[unif]*temp3)+1.0f; ncie->sh_p[j][i]=(LM[offset]*327.68f)/temp; }
-				else if (LM[offset]<83.0f) { temp3=temp4-1.0f; temp=(L83[unif]*temp3)+1.0f; ncie->sh_p[j][i]=(LM[offset]*327.68f)/temp; }
-				else if (LM[offset]<87.0f) { temp3=temp4-1.0f; temp=(L87[unif]*temp3)+1.0f; ncie->sh_p[j][i]=(LM[offset]*327.68f)/temp; }
-				else if (LM[offset]<90.0f) { temp3=temp4-1.0f; temp=(L90[unif]*temp3)+1.0f; ncie->sh_p[j][i]=(LM[offset]*327.68f)/temp; }
-				else if (LM[offset]<95.0f) { temp3=temp4-1.0f; temp=(L95[unif]*temp3)+1.0f; ncie->sh_p[j][i]=(LM[offset]*327.68f)/temp; }
-				else if (LM[offset]<100.0f) { ncie->sh_p[j][i]=LM[offset]*327.68f; }
-			}
+#ifdef _OPENMP
+#pragma omp parallel
+#endif
+{
+#ifdef _OPENMP
+#pragma omp for
+#endif
+	for(int j=0; j<height; j++)
+		for(int i=0; i<width; i++)
+			LM[j*width+i] = luminance[j][i]/327.68f;// adjust to 0.100 and to RT variables
 
-		}
-	delete [] LM;
+#ifdef _OPENMP
+#pragma omp for
+#endif
+	for(int j=k; j<height-k; j++) {
+		int i=k;
+#ifdef __SSE2__
+		for (; i<width-k-3; i+=4)
+			_mm_storeu_ps (&luminance[j][i], MLmicrocontrastPixels (&LM[j*width+i], width, k, chmax, t, LVFU(luminance[j][i])));
+#endif
+		for (; i<width-k; i++)
+			luminance[j][i] = MLmicrocontrastPixel (&LM[j*width+i], width, k, chmax, t, luminance[j][i]);
+	}
+}
+	sharpenBuffers.release (buffer);
 	t2e.set();
 	if (settings->verbose)
 		printf("Micro-contrast  %d usec\n", t2e.etime(t1e));
@@ -912,66 +911,21 @@ void ImProcFunctions::deconvsharpeningcam (CieImage* ncie, float** b2) {
 	int W = ncie->W, H = ncie->H;
 
 	float** tmpI = new float*[H];
-	for (int i=0; i<H; i++) {
+	for (int i=0; i<H; i++)
 		tmpI[i] = new float[W];
-		for (int j=0; j<W; j++)
-			tmpI[i][j] = (float)ncie->sh_p[i][j];
-	}
 
-	float** tmp = (float**)b2;
+	deconvolve (ncie->sh_p, tmpI, b2, W, H);
 
-#ifdef _OPENMP
-#pragma omp parallel
-#endif
-	{
-    AlignedBufferMP<double> buffer(max(W,H));
-
-
-	float damping = params->sharpening.deconvdamping / 5.0;
-	bool needdamp = params->sharpening.deconvdamping > 0;
-	for (int k=0; k<params->sharpening.deconviter; k++) {
-
-		// apply blur function (gaussian blur)
-        gaussHorizontal<float> (tmpI, tmp, buffer, W, H, params->sharpening.deconvradius / scale);
-        gaussVertical<float>   (tmp, tmp, buffer, W, H, params->sharpening.deconvradius / scale);
-
-		if (!needdamp) {
-#ifdef _OPENMP
-#pragma omp for
-#endif
-			for (int i=0; i<H; i++)
-				for (int j=0; j<W; j++)
-					if (tmp[i][j]>0)
-						tmp[i][j] = (float)ncie->sh_p[i][j] / tmp[i][j];
-		}
-		else
-			dcdamping (tmp, ncie->sh_p, damping, W, H);
-
-        gaussHorizontal<float> (tmp, tmp, buffer, W, H, params->sharpening.deconvradius / scale);
-        gaussVertical<float>   (tmp, tmp, buffer, W, H, params->sharpening.deconvradius / scale);
-
-
-#ifdef _OPENMP
-#pragma omp for
-#endif
-		for (int i=0; i<H; i++)
-			for (int j=0; j<W; j++)
-				tmpI[i][j] = tmpI[i][j] * tmp[i][j];
-	} // end for
-
-//	float p2 = params->sharpening.deconvamount / 100.0;
 	float p2 = params->sharpening.deconvamount / 100.0;
 	float p1 = 1.0 - p2;
 
 #ifdef _OPENMP
-#pragma omp for
+#pragma omp parallel for
 #endif
 	for (int i=0; i<H; i++)
 		for (int j=0; j<W; j++)
 			if(ncie->J_p[i][j] > 8.0f && ncie->J_p[i][j] < 92.0f) ncie->sh_p[i][j] = ncie->sh_p[i][j]*p1 + max(tmpI[i][j],0.0f)*p2;
 
-	} // end parallel
-
 	for (int i=0; i<H; i++)
 		delete [] tmpI[i];
 	delete [] tmpI;
@@ -30,6 +30,7 @@
 
 #include "rtengine.h"
 #include "improcfun.h"
+#include "tileplan.h"
 #include "LUT.h"
 #include "array2D.h"
 #include "boxblur.h"
@@ -105,7 +106,7 @@ struct cont_params {
 
 int wavNestedLevels = 1;
 
-SSEFUNCTION void ImProcFunctions::ip_wavelet(LabImage * lab, LabImage * dst, int kall, const procparams::WaveletParams & waparams, const WavCurve & wavCLVCcurve, const WavOpacityCurveRG & waOpacityCurveRG, const WavOpacityCurveBY & waOpacityCurveBY, int skip)
+SSEFUNCTION void ImProcFunctions::ip_wavelet(LabImage * lab, LabImage * dst, int kall, const procparams::WaveletParams & waparams, const WavCurve & wavCLVCcurve, const WavOpacityCurveRG & waOpacityCurveRG, const WavOpacityCurveBY & waOpacityCurveBY, int skip, const volatile bool* cancelFlag)
 {
     MyTime t1e,t2e;
     t1e.set();
@@ -293,22 +294,18 @@ SSEFUNCTION void ImProcFunctions::ip_wavelet(LabImage * lab, LabImage * dst, int
 		// begin tile processing of image
 
 		//output buffer
-		int realtile;
+		int realtile = 22;
 		if(params->wavelet.Tilesmethod=="big") realtile=22;
 		if(params->wavelet.Tilesmethod=="lit") realtile=12;
-		
-		int tilesize;
-		int overlap;
-		tilesize = 1024;
-		overlap = 128;
-		//tilesize=128*params->wavelet.tiles;
-		tilesize=128*realtile;
-		//overlap=(int) tilesize*params->wavelet.overl;
-		overlap=(int) tilesize*0.125f;
-		//	printf("overl=%d\n",overlap);
-		int numtiles_W, numtiles_H, tilewidth, tileheight, tileWskip, tileHskip;
 		if(params->wavelet.Tilesmethod=="full") kall=0;
-		Tile_calc (tilesize, overlap, kall, imwidth, imheight, numtiles_W, numtiles_H, tilewidth, tileheight, tileWskip, tileHskip);
+
+		// the tile size chosen by the user is the largest one allowed, tiles never get smaller than the "lit" ones to keep the levels
+		// about 80 bytes per pixel of a tile: labco, Lold, varhue, varchro, tmL and the decompositions of L, a and b
+		TilePlan plan = planTiles ("Ip Wavelet", imwidth, imheight, 80, 128*12, 128*realtile, 0.125f, kall==0,
+		                           options.rgbDenoiseThreadLimit > 0 ? max(options.rgbDenoiseThreadLimit / 2, 1) : 0, memoryBudget);
+		int numtiles_W = plan.numtiles_W, numtiles_H = plan.numtiles_H;
+		int tilewidth = plan.tilewidth, tileheight = plan.tileheight;
+		int tileWskip = plan.tileWskip, tileHskip = plan.tileHskip;
 
 		const int numtiles = numtiles_W*numtiles_H;
 		LabImage * dsttmp;
@@ -331,42 +328,13 @@ SSEFUNCTION void ImProcFunctions::ip_wavelet(LabImage * lab, LabImage * dst, int
 		//printf("levwav = %d\n",levwav);
 
 		int numthreads = 1;
-		int maxnumberofthreadsforwavelet =0;
-		//reduce memory for big tile size
-		if(kall!=0) {
-			if(realtile <= 22) maxnumberofthreadsforwavelet=2;
-			if(realtile <= 20) maxnumberofthreadsforwavelet=3;
-			if(realtile <= 18) maxnumberofthreadsforwavelet=4;
-			if(realtile <= 16) maxnumberofthreadsforwavelet=6;
-			if(realtile <= 14) maxnumberofthreadsforwavelet=8;
-			//printf("maxNRT=%d\n",maxnumberofthreadsforwavelet);
-			if((maxnumberofthreadsforwavelet==6 || maxnumberofthreadsforwavelet==8)  && levwav==10) maxnumberofthreadsforwavelet-=2;
-			if(levwav <=7 && maxnumberofthreadsforwavelet ==8) maxnumberofthreadsforwavelet=0;
-		}
-		//printf("maxthre=%d\n",maxnumberofthreadsforwavelet);
-
 #ifdef _OPENMP
-	// Calculate number of tiles. If less than omp_get_max_threads(), then limit num_threads to number of tiles
-		if( options.rgbDenoiseThreadLimit>0)
-			maxnumberofthreadsforwavelet = min(max(options.rgbDenoiseThreadLimit / 2, 1), maxnumberofthreadsforwavelet);	
-	
-		numthreads = MIN(numtiles,omp_get_max_threads());
-		if(maxnumberofthreadsforwavelet > 0)
-			numthreads = MIN(numthreads,maxnumberofthreadsforwavelet);
-		wavNestedLevels = omp_get_max_threads() / numthreads;
+		numthreads = plan.numthreads;
+		wavNestedLevels = plan.nestedLevels;
 		bool oldNested = omp_get_nested();
-		if(wavNestedLevels < 2)
-			wavNestedLevels = 1;
-		else
+		if(wavNestedLevels > 1)
 			omp_set_nested(true);
-		if(maxnumberofthreadsforwavelet > 0)
-			while(wavNestedLevels*numthreads > maxnumberofthreadsforwavelet)
-				wavNestedLevels--;
-		if(settings->verbose)
-			printf("Ip Wavelet uses %d main thread(s) and up to %d nested thread(s) for each main thread\n",numthreads,wavNestedLevels);
-
-
-#endif			
+#endif
 
 #ifdef _OPENMP
 #pragma omp parallel num_threads(numthreads)
@@ -389,6 +357,8 @@ SSEFUNCTION void ImProcFunctions::ip_wavelet(LabImage * lab, LabImage * dst, int
 #endif	
 		for (int tiletop=0; tiletop<imheight; tiletop+=tileHskip) {
 			for (int tileleft=0; tileleft<imwidth ; tileleft+=tileWskip) {
+				if (cancelFlag && *cancelFlag)
+					continue;   // the result is obsolete, skip the remaining tiles
 				int tileright = MIN(imwidth,tileleft+tilewidth);
 				int tilebottom = MIN(imheight,tiletop+tileheight);
 				int width  = tileright-tileleft;
@@ -511,8 +481,6 @@ SSEFUNCTION void ImProcFunctions::ip_wavelet(LabImage * lab, LabImage * dst, int
 					}
 				}
 
-				int datalen = labco->W * labco->H;
-
 				int levwavL = levwav;
 				//printf("LevwavL before: %d\n",levwavL);
 				if(cp.contrast == 0 && cp.conres == 0.f && cp.conresH == 0.f && cp.val ==0 && params->wavelet.CLmethod=="all") { // no processing of residual L  or edge=> we probably can reduce the number of levels
@@ -521,10 +489,10 @@ SSEFUNCTION void ImProcFunctions::ip_wavelet(LabImage * lab, LabImage * dst, int
 				}
 				//printf("LevwavL after: %d\n",levwavL);
 				if(levwavL > 0) {
-					wavelet_decomposition* Ldecomp = new wavelet_decomposition (labco->data, labco->W, labco->H, levwavL, 1, skip, max(1,wavNestedLevels), DaubLen );
+					wavelet_decomposition* Ldecomp = new wavelet_decomposition (labco->L[0], labco->W, labco->H, levwavL, 1, skip, max(1,wavNestedLevels), DaubLen );
 					if(!Ldecomp->memoryAllocationFailed) {
 						WaveletcontAllL(labco, varhue, varchro, *Ldecomp, cp, skip);
-						Ldecomp->reconstruct(labco->data, cp.strength);
+						Ldecomp->reconstruct(labco->L[0], cp.strength);
 					}
 					delete Ldecomp;
 				}
@@ -537,10 +505,10 @@ SSEFUNCTION void ImProcFunctions::ip_wavelet(LabImage * lab, LabImage * dst, int
 				}
 				//printf("Levwava after: %d\n",levwava);
 				if(levwava > 0) {
-					wavelet_decomposition* adecomp = new wavelet_decomposition (labco->data+datalen, labco->W, labco->H,levwava, 1, skip, max(1,wavNestedLevels), DaubLen );
+					wavelet_decomposition* adecomp = new wavelet_decomposition (labco->a[0], labco->W, labco->H,levwava, 1, skip, max(1,wavNestedLevels), DaubLen );
 					if(!adecomp->memoryAllocationFailed) {
 						WaveletcontAllAB(labco, varhue, varchro, *adecomp, cp, true);
-						adecomp->reconstruct(labco->data+datalen, cp.strength);
+						adecomp->reconstruct(labco->a[0], cp.strength);
 					}
 					delete adecomp;
 				}
@@ -553,10 +521,10 @@ SSEFUNCTION void ImProcFunctions::ip_wavelet(LabImage * lab, LabImage * dst, int
 				}
 				//printf("Levwavb after: %d\n",levwavb);
 				if(levwavb > 0) {
-					wavelet_decomposition* bdecomp = new wavelet_decomposition (labco->data+2*datalen, labco->W, labco->H, levwavb, 1, skip, max(1,wavNestedLevels), DaubLen );
+					wavelet_decomposition* bdecomp = new wavelet_decomposition (labco->b[0], labco->W, labco->H, levwavb, 1, skip, max(1,wavNestedLevels), DaubLen );
 					if(!bdecomp->memoryAllocationFailed) {
 						WaveletcontAllAB(labco, varhue, varchro, *bdecomp, cp, false);
-						bdecomp->reconstruct(labco->data+2*datalen, cp.strength);
+						bdecomp->reconstruct(labco->b[0], cp.strength);
 					}
 					delete bdecomp;
 				}
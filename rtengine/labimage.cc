@@ -11,7 +11,9 @@ LabImage::~LabImage () {
 }
 
 void LabImage::CopyFrom(LabImage *Img){
-    memcpy(data, Img->data, W*H*3*sizeof(float));
+    memcpy(L[0], Img->L[0], W*H*sizeof(float));
+    memcpy(a[0], Img->a[0], W*H*sizeof(float));
+    memcpy(b[0], Img->b[0], W*H*sizeof(float));
 }
 
 void LabImage::getPipetteData (float &v1, float &v2, float &v3, int posX, int posY, int squareSize) {
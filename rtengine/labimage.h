@@ -19,6 +19,8 @@
 #ifndef _LABIMAGE_H_
 #define _LABIMAGE_H_
 
+#include "planaralloc.h"
+
 namespace rtengine {
 
 class LabImage {
@@ -29,14 +31,17 @@ private:
 		a = new float*[H];
 		b = new float*[H];
 
-		data = new float [W*H*3];
+		// The planes are aligned and staggered, but their rows are contiguous because many algorithms
+		// (the wavelet decompositions among others) process a plane as a single buffer
+		const size_t planestride = planeStride (W*H*sizeof(float)) / sizeof(float);
+		data = (float*) allocPlanes (3*planestride*sizeof(float));
 		float * index = data;
 		for (int i=0; i<H; i++)
 			L[i] = index + i*W;
-		index+=W*H;
+		index+=planestride;
 		for (int i=0; i<H; i++)
 			a[i] = index + i*W;
-		index+=W*H;
+		index+=planestride;
 
 		for (int i=0; i<H; i++)
 			b[i] = index + i*W;
@@ -59,7 +64,7 @@ public:
 			delete [] L;
 			delete [] a;
 			delete [] b;
-			delete [] data;
+			freePlanes (data);
 		}
 	}
 	void reallocLab( ) { allocLab(W,H); };
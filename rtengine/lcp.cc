@@ -211,8 +211,36 @@ float LCPMapper::calcVignetteFac(int x, int y) const {
     // No need for swapXY, since vignette is in RAW and always before rotation
     double xd=((double)x-mc.x0)/mc.fx, yd=((double)y-mc.y0)/mc.fy;
 
+    return vignetteFac(xd*xd+yd*yd);
+}
+
+void LCPMapper::calcVignetteTable(int width, int height, LUTf &table, float *xSqr, float *ySqr) const {
+    // the factor only depends on the squared radius, which is the largest in a corner
+    double rsqrMax = 0.;
+    for (int i=0; i<4; i++) {
+        double xd=((i&1 ? width-1 : 0)-mc.x0)/mc.fx, yd=((i&2 ? height-1 : 0)-mc.y0)/mc.fy;
+        rsqrMax = std::max(rsqrMax, xd*xd+yd*yd);
+    }
+
+    const int tableSize = 16384;
+    double scale = rsqrMax > 0. ? (tableSize-1)/rsqrMax : 0.;
+
+    for (int x=0; x<width; x++) {
+        double xd=((double)x-mc.x0)/mc.fx;
+        xSqr[x] = xd*xd*scale;
+    }
+    for (int y=0; y<height; y++) {
+        double yd=((double)y-mc.y0)/mc.fy;
+        ySqr[y] = yd*yd*scale;
+    }
+
+    table(tableSize, LUT_CLIP_BELOW|LUT_CLIP_ABOVE);
+    for (int i=0; i<tableSize; i++)
+        table[i] = vignetteFac(scale > 0. ? i/scale : 0.);
+}
+
+float LCPMapper::vignetteFac(double rsqr) const {
     const float* aVig= mc.param;
-    double rsqr      = xd*xd+yd*yd;
     double param0Sqr = aVig[0]*aVig[0];
 
     return 1. + rsqr * (-aVig[0] + rsqr * ((param0Sqr - aVig[1])
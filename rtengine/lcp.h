@@ -127,6 +127,13 @@ namespace rtengine {
         void  correctDistortion(double& x, double& y) const;  // MUST be the first stage
         void  correctCA(double& x, double& y, int channel) const;
         float calcVignetteFac  (int x, int y) const;  // MUST be in RAW
+
+        // precalculates the vignetting factors of a width x height RAW image: the factor of pixel (x,y) is
+        // table[xSqr[x] + ySqr[y]], xSqr and ySqr having width and height elements
+        void  calcVignetteTable(int width, int height, LUTf &table, float *xSqr, float *ySqr) const;
+
+    private:
+        float vignetteFac(double rsqr) const;
     };
 }
 #endif
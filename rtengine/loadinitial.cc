@@ -19,6 +19,7 @@
 #include "rtengine.h"
 #include "stdimagesource.h"
 #include "rawimagesource.h"
+#include "improccoordinator.h"
 
 namespace rtengine {
 
@@ -43,5 +44,30 @@ InitialImage* InitialImage::load (const Glib::ustring& fname, bool isRaw, int* e
     }
     return isrc;
 }
+
+InitialImage* InitialImage::prefetch (const Glib::ustring& fname, bool isRaw, const procparams::ProcParams& params, int* errorCode, volatile bool* cancel) {
+
+    ImageSource* isrc;
+
+    if (!isRaw)
+        isrc = new StdImageSource ();
+    else
+        isrc = new RawImageSource ();
+
+    *errorCode = isrc->load (fname);
+    if (*errorCode || (cancel && *cancel)) {
+        delete isrc;
+        return NULL;
+    }
+
+    // same raw parameters as the first update of the ImProcCoordinator
+    RAWParams rp = ImProcCoordinator::previewRawParams (params.raw, ImProcCoordinator::previewNeedsHighDetail ());
+    isrc->prepare (rp, params.lensProf, params.coarse, cancel);
+    if (cancel && *cancel) {
+        delete isrc;
+        return NULL;
+    }
+    return isrc;
+}
 }
 
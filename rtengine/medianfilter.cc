@@ -0,0 +1,392 @@
+/*
+ *  This file is part of RawTherapee.
+ *
+ *  RawTherapee is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  RawTherapee is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with RawTherapee.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "medianfilter.h"
+#include "rt_math.h"
+#include "opthelper.h"
+#include <vector>
+#include <algorithm>
+#include <cstring>
+#include <cfloat>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+namespace rtengine {
+
+namespace {
+
+// comparison of a selection network: slot a gets the minimum and slot b the maximum,
+// the one not used by the following comparisons isn't computed
+struct Comparator {
+    short a, b;
+    bool needMin, needMax;
+};
+
+// Batcher's odd-even merge sort of n values, reduced to the comparisons the median depends on
+void buildMedianNetwork (int n, std::vector<Comparator> &network, int &medianSlot) {
+
+    int N = 1;
+    while (N < n)
+        N <<= 1;
+
+    // the wires n..N-1 hold +infinity: comparing with them just moves the values around
+    std::vector<int> slot(N);
+    std::vector<bool> infinite(N);
+    for (int i = 0; i < N; i++) {
+        slot[i] = i;
+        infinite[i] = i >= n;
+    }
+
+    std::vector<Comparator> sorter;
+    for (int p = 1; p < N; p <<= 1)
+        for (int k = p; k >= 1; k >>= 1)
+            for (int j = k % p; j + k < N; j += 2*k)
+                for (int i = 0; i < k && i + j + k < N; i++)
+                    if ((i + j) / (2*p) == (i + j + k) / (2*p)) {
+                        const int x = i + j, y = i + j + k;
+                        if (infinite[y])
+                            continue;
+                        if (infinite[x]) {
+                            slot[x] = slot[y];
+                            infinite[x] = false;
+                            infinite[y] = true;
+                            continue;
+                        }
+                        Comparator c = {(short)slot[x], (short)slot[y], true, true};
+                        sorter.push_back (c);
+                    }
+    medianSlot = slot[n/2];
+
+    // going backwards from the median, keep the comparisons whose results are used
+    std::vector<bool> needed(n, false);
+    needed[medianSlot] = true;
+    network.clear ();
+    for (int k = (int)sorter.size() - 1; k >= 0; k--) {
+        Comparator c = sorter[k];
+        c.needMin = needed[c.a];
+        c.needMax = needed[c.b];
+        if (c.needMin || c.needMax) {
+            network.push_back (c);
+            needed[c.a] = needed[c.b] = true;
+        }
+    }
+    std::reverse (network.begin(), network.end());
+}
+
+void copyBorders (float **src, float **dst, int width, int height, int radius) {
+
+    for (int i = 0; i < height; i++) {
+        if (i < radius || i >= height - radius) {
+            for (int j = 0; j < width; j++)
+                dst[i][j] = src[i][j];
+        } else {
+            for (int j = 0; j < min(radius, width); j++)
+                dst[i][j] = src[i][j];
+            for (int j = max(width - radius, 0); j < width; j++)
+                dst[i][j] = src[i][j];
+        }
+    }
+}
+
+SSEFUNCTION void medianNetwork (float **src, float **dst, int width, int height, int radius, int numThreads) {
+
+    const int diameter = 2*radius + 1;
+    const int n = diameter*diameter;
+    std::vector<Comparator> network;
+    int medianSlot;
+    buildMedianNetwork (n, network, medianSlot);
+    const int numComparators = network.size();
+
+#ifdef _OPENMP
+#pragma omp parallel num_threads(numThreads) if(numThreads>1)
+#endif
+{
+    float v[81];
+#ifdef __SSE2__
+    vfloat vv[81];
+#endif
+#ifdef _OPENMP
+#pragma omp for
+#endif
+    for (int i = radius; i < height - radius; i++) {
+        int j = radius;
+#ifdef __SSE2__
+        for (; j < width - radius - 3; j += 4) {
+            for (int k = 0, ii = -radius; ii <= radius; ii++)
+                for (int jj = -radius; jj <= radius; jj++, k++)
+                    vv[k] = LVFU(src[i+ii][j+jj]);
+            for (int k = 0; k < numComparators; k++) {
+                const Comparator &c = network[k];
+                if (c.needMin) {
+                    const vfloat lo = vminf(vv[c.a], vv[c.b]);
+                    if (c.needMax)
+                        vv[c.b] = vmaxf(vv[c.a], vv[c.b]);
+                    vv[c.a] = lo;
+                } else
+                    vv[c.b] = vmaxf(vv[c.a], vv[c.b]);
+            }
+            _mm_storeu_ps(&dst[i][j], vv[medianSlot]);
+        }
+#endif
+        for (; j < width - radius; j++) {
+            for (int k = 0, ii = -radius; ii <= radius; ii++)
+                for (int jj = -radius; jj <= radius; jj++, k++)
+                    v[k] = src[i+ii][j+jj];
+            for (int k = 0; k < numComparators; k++) {
+                const Comparator &c = network[k];
+                if (c.needMin) {
+                    const float lo = min(v[c.a], v[c.b]);
+                    if (c.needMax)
+                        v[c.b] = max(v[c.a], v[c.b]);
+                    v[c.a] = lo;
+                } else
+                    v[c.b] = max(v[c.a], v[c.b]);
+            }
+            dst[i][j] = v[medianSlot];
+        }
+    }
+}
+}
+
+void medianSelect (float **src, float **dst, int width, int height, int radius, int numThreads) {
+
+    const int diameter = 2*radius + 1;
+    const int n = diameter*diameter;
+#ifdef _OPENMP
+#pragma omp parallel num_threads(numThreads) if(numThreads>1)
+#endif
+{
+    std::vector<float> v(n);
+#ifdef _OPENMP
+#pragma omp for
+#endif
+    for (int i = radius; i < height - radius; i++)
+        for (int j = radius; j < width - radius; j++) {
+            for (int k = 0, ii = -radius; ii <= radius; ii++)
+                for (int jj = -radius; jj <= radius; jj++, k++)
+                    v[k] = src[i+ii][j+jj];
+            std::nth_element (v.begin(), v.begin() + n/2, v.end());
+            dst[i][j] = v[n/2];
+        }
+}
+}
+
+// dst += add - sub, for 256 bins
+SSEFUNCTION inline void updateHistogram (unsigned short * RESTRICT dst, const unsigned short * RESTRICT add, const unsigned short * RESTRICT sub) {
+#ifdef __SSE2__
+    for (int k = 0; k < 256; k += 8) {
+        __m128i d = _mm_loadu_si128 ((__m128i*)&dst[k]);
+        d = _mm_add_epi16 (d, _mm_loadu_si128 ((const __m128i*)&add[k]));
+        d = _mm_sub_epi16 (d, _mm_loadu_si128 ((const __m128i*)&sub[k]));
+        _mm_storeu_si128 ((__m128i*)&dst[k], d);
+    }
+#else
+    for (int k = 0; k < 256; k++)
+        dst[k] += add[k] - sub[k];
+#endif
+}
+
+// dst += add, for 256 bins
+SSEFUNCTION inline void addHistogram (unsigned short * RESTRICT dst, const unsigned short * RESTRICT add) {
+#ifdef __SSE2__
+    for (int k = 0; k < 256; k += 8)
+        _mm_storeu_si128 ((__m128i*)&dst[k], _mm_add_epi16 (_mm_loadu_si128 ((__m128i*)&dst[k]), _mm_loadu_si128 ((const __m128i*)&add[k])));
+#else
+    for (int k = 0; k < 256; k++)
+        dst[k] += add[k];
+#endif
+}
+
+// index of the bin holding the value of the given rank, count receives the number of values in the previous bins
+SSEFUNCTION inline int findBin (const unsigned short * RESTRICT hist, int rank, int &count) {
+
+    int b = 0;
+#ifdef __SSE2__
+    // skip the blocks of 16 bins below the rank; the counts go up to 255*255, they are summed as 32 bits integers
+    const __m128i zero = _mm_setzero_si128();
+    for (; b < 256 - 16; b += 16) {
+        const __m128i lo = _mm_loadu_si128 ((const __m128i*)&hist[b]);
+        const __m128i hi = _mm_loadu_si128 ((const __m128i*)&hist[b+8]);
+        __m128i sum = _mm_add_epi32 (_mm_add_epi32 (_mm_unpacklo_epi16 (lo, zero), _mm_unpackhi_epi16 (lo, zero)),
+                                     _mm_add_epi32 (_mm_unpacklo_epi16 (hi, zero), _mm_unpackhi_epi16 (hi, zero)));
+        sum = _mm_add_epi32 (sum, _mm_shuffle_epi32 (sum, _MM_SHUFFLE(1,0,3,2)));
+        sum = _mm_add_epi32 (sum, _mm_shuffle_epi32 (sum, _MM_SHUFFLE(2,3,0,1)));
+        const int blockCount = _mm_cvtsi128_si32 (sum);
+        if (count + blockCount > rank)
+            break;
+        count += blockCount;
+    }
+#endif
+    while (count + hist[b] <= rank)
+        count += hist[b++];
+    return b;
+}
+
+/* Perreault and Hebert, "Median Filtering in Constant Time", 2007
+ * The 16 bits values are counted in 256 coarse bins (high byte) of 256 fine bins (low byte).
+ * Each column of a strip keeps the histogram of its pixels in the window rows, updated with 2 pixels when going down.
+ * The window histogram is updated with 2 columns when going right. Only its coarse bins are kept up to date,
+ * the fine bins of a coarse bin are updated from the columns when the median falls in it.
+ */
+void medianHistogram (float **src, float **dst, int width, int height, int radius, int numThreads) {
+
+    float minVal = FLT_MAX, maxVal = -FLT_MAX;
+#ifdef _OPENMP
+#pragma omp parallel num_threads(numThreads) if(numThreads>1)
+#endif
+{
+    float minThr = FLT_MAX, maxThr = -FLT_MAX;
+#ifdef _OPENMP
+#pragma omp for nowait
+#endif
+    for (int i = 0; i < height; i++)
+        for (int j = 0; j < width; j++) {
+            minThr = min(minThr, src[i][j]);
+            maxThr = max(maxThr, src[i][j]);
+        }
+#ifdef _OPENMP
+#pragma omp critical
+#endif
+{
+    minVal = min(minVal, minThr);
+    maxVal = max(maxVal, maxThr);
+}
+}
+
+    if (!(maxVal > minVal)) {
+        // flat plane
+        for (int i = radius; i < height - radius; i++)
+            for (int j = radius; j < width - radius; j++)
+                dst[i][j] = src[i][j];
+        return;
+    }
+
+    const float scale = 65535.f / (maxVal - minVal);
+    const float invScale = (maxVal - minVal) / 65535.f;
+    unsigned short *q = new unsigned short[width*height];
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(numThreads) if(numThreads>1)
+#endif
+    for (int i = 0; i < height; i++)
+        for (int j = 0; j < width; j++)
+            q[i*width+j] = (src[i][j] - minVal) * scale + 0.5f;
+
+    const int diameter = 2*radius + 1;
+    const int rank = diameter*diameter/2;   // number of values below the median
+    const int strip = 32;                   // columns of output per strip
+    const int cols = strip + 2*radius;
+
+    // the fine histograms of the columns take 128 kB per column and thread, 37 MB at radius 127:
+    // fewer threads are used when they wouldn't fit in maxHistogramMemory together
+    const size_t maxHistogramMemory = 256 << 20;
+    const int histThreads = LIM((int)(maxHistogramMemory / ((size_t)256*cols*256*sizeof(unsigned short))), 1, max(numThreads, 1));
+
+#ifdef _OPENMP
+#pragma omp parallel num_threads(histThreads) if(histThreads>1)
+#endif
+{
+    unsigned short *colCoarse = new unsigned short[cols*256];         // [column][coarse bin]
+    unsigned short *colFine = new unsigned short[256*cols*256];       // [coarse bin][column][fine bin]
+    unsigned short coarse[256];
+    unsigned short *fine = new unsigned short[256*256];               // [coarse bin][fine bin]
+    int fineColumn[256];                                              // column the fine bins have been computed for
+
+#ifdef _OPENMP
+#pragma omp for schedule(dynamic)
+#endif
+    for (int x0 = radius; x0 < width - radius; x0 += strip) {
+        const int x1 = min(x0 + strip, width - radius);
+        const int c0 = x0 - radius;             // image column of the first histogram
+        const int ncols = x1 - x0 + 2*radius;
+
+        memset (colCoarse, 0, ncols*256*sizeof(unsigned short));
+        for (int b = 0; b < 256; b++)
+            memset (colFine + b*cols*256, 0, ncols*256*sizeof(unsigned short));
+        for (int i = 0; i < diameter; i++)
+            for (int c = 0; c < ncols; c++) {
+                const unsigned short v = q[i*width+c0+c];
+                colCoarse[c*256 + (v>>8)]++;
+                colFine[((v>>8)*cols + c)*256 + (v&255)]++;
+            }
+
+        for (int i = radius; i < height - radius; i++) {
+            if (i > radius)
+                for (int c = 0; c < ncols; c++) {
+                    const unsigned short out = q[(i-radius-1)*width+c0+c];
+                    const unsigned short in = q[(i+radius)*width+c0+c];
+                    colCoarse[c*256 + (out>>8)]--;
+                    colFine[((out>>8)*cols + c)*256 + (out&255)]--;
+                    colCoarse[c*256 + (in>>8)]++;
+                    colFine[((in>>8)*cols + c)*256 + (in&255)]++;
+                }
+
+            memset (coarse, 0, sizeof(coarse));
+            for (int c = 0; c < diameter; c++)
+                addHistogram (coarse, colCoarse + c*256);
+            for (int b = 0; b < 256; b++)
+                fineColumn[b] = -cols;
+
+            for (int j = x0; j < x1; j++) {
+                const int c = j - c0;           // histogram column of the window centre
+                if (j > x0)
+                    updateHistogram (coarse, colCoarse + (c+radius)*256, colCoarse + (c-radius-1)*256);
+
+                int count = 0;
+                const int b = findBin (coarse, rank, count);
+
+                unsigned short *f = fine + b*256;
+                const unsigned short *cf = colFine + b*cols*256;
+                if (2*(c - fineColumn[b]) > diameter) {
+                    memset (f, 0, 256*sizeof(unsigned short));
+                    for (int k = c - radius; k <= c + radius; k++)
+                        addHistogram (f, cf + k*256);
+                } else
+                    for (int k = fineColumn[b] + 1; k <= c; k++)
+                        updateHistogram (f, cf + (k+radius)*256, cf + (k-radius-1)*256);
+                fineColumn[b] = c;
+
+                const int fb = findBin (f, rank, count);
+                dst[i][j] = minVal + (b*256 + fb) * invScale;
+            }
+        }
+    }
+
+    delete [] fine;
+    delete [] colFine;
+    delete [] colCoarse;
+}
+    delete [] q;
+}
+
+}
+
+void medianFilter (float **src, float **dst, int width, int height, int radius, bool quantise, int numThreads) {
+
+    if (radius < 1) {
+        copyBorders (src, dst, width, height, max(width, height));
+        return;
+    }
+    copyBorders (src, dst, width, height, radius);
+    if (radius <= 4)
+        medianNetwork (src, dst, width, height, radius, numThreads);
+    else if (quantise)
+        medianHistogram (src, dst, width, height, radius, numThreads);
+    else
+        medianSelect (src, dst, width, height, radius, numThreads);
+}
+
+}
@@ -0,0 +1,40 @@
+/*
+ *  This file is part of RawTherapee.
+ *
+ *  RawTherapee is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  RawTherapee is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with RawTherapee.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef _MEDIANFILTER_H_
+#define _MEDIANFILTER_H_
+
+namespace rtengine {
+
+/** @brief Median of the (2*radius+1)x(2*radius+1) window around each pixel of a float plane
+  *
+  * The windows up to 9x9 use sorting networks pruned to the comparisons the median depends on, on 4 pixels at once.
+  * The larger windows use the constant time algorithm of Perreault and Hebert on the values quantised to 16 bits
+  * between the minimum and the maximum of the plane, or a selection per pixel if the quantisation isn't allowed.
+  * Their histograms take 128 kB per thread and column of the window plus 32: 37 MB per thread at radius 127,
+  * the number of threads is reduced to keep the total under 256 MB.
+  * The pixels closer than radius to a border are copied from the source.
+  * @param src source plane
+  * @param dst destination plane, must be different from src
+  * @param width width of the planes
+  * @param height height of the planes
+  * @param radius radius of the window, at most 127
+  * @param quantise if true, the windows larger than 9x9 may use the values quantised to 16 bits
+  * @param numThreads number of threads */
+void medianFilter (float **src, float **dst, int width, int height, int radius, bool quantise, int numThreads);
+
+}
+#endif
@@ -0,0 +1,75 @@
+/*
+ *  This file is part of RawTherapee.
+ *
+ *  RawTherapee is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  RawTherapee is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with RawTherapee.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "planaralloc.h"
+#include "settings.h"
+#include <cstdlib>
+#ifdef WIN32
+#include <malloc.h>
+#else
+#include <sys/mman.h>
+#endif
+
+namespace rtengine {
+
+extern const Settings* settings;
+
+static const size_t hugePageSize = 2 << 20;
+
+size_t planeRowStride (size_t rowBytes) {
+
+    size_t stride = (rowBytes + planeAlignment - 1) / planeAlignment * planeAlignment;
+    if (stride && stride % 4096 == 0)
+        stride += planeAlignment;
+    return stride;
+}
+
+size_t planeStride (size_t planeBytes) {
+
+    // the successive planes start 256 bytes further modulo 4 KB
+    return (planeBytes + 4095) / 4096 * 4096 + 256;
+}
+
+void* allocPlanes (size_t size) {
+
+    if (!size)
+        return NULL;
+
+    void* ptr = NULL;
+#ifdef WIN32
+    ptr = _aligned_malloc (size, planeAlignment);
+#else
+    const bool huge = settings && settings->hugePages && size >= hugePageSize;
+    if (posix_memalign (&ptr, huge ? hugePageSize : planeAlignment, size))
+        return NULL;
+#ifdef MADV_HUGEPAGE
+    if (huge)
+        madvise (ptr, size / hugePageSize * hugePageSize, MADV_HUGEPAGE);
+#endif
+#endif
+    return ptr;
+}
+
+void freePlanes (void* ptr) {
+
+#ifdef WIN32
+    _aligned_free (ptr);
+#else
+    free (ptr);
+#endif
+}
+
+}
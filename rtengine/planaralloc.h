@@ -0,0 +1,51 @@
+/*
+ *  This file is part of RawTherapee.
+ *
+ *  RawTherapee is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  RawTherapee is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with RawTherapee.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef _PLANARALLOC_H_
+#define _PLANARALLOC_H_
+
+#include <cstddef>
+
+namespace rtengine {
+
+/** @brief Alignment of the image planes and of their padded rows, in bytes: a cache line, and enough for SSE and AVX */
+const size_t planeAlignment = 64;
+
+/** @brief Length in bytes of the rows of a plane, padding included
+  *
+  * Rows are padded to a multiple of planeAlignment, plus one cache line when the length is a multiple of 4 KB,
+  * where the pixels of a column would all map to the same cache sets.
+  * @param rowBytes length of the pixels of a row, in bytes */
+size_t planeRowStride (size_t rowBytes);
+
+/** @brief Distance in bytes between the planes of a planar image
+  *
+  * The planes are staggered by a few cache lines modulo 4 KB, so that the same pixel of the different planes doesn't
+  * alias in the caches and in the store buffer.
+  * @param planeBytes size of a plane, in bytes */
+size_t planeStride (size_t planeBytes);
+
+/** @brief Allocates memory for image planes, aligned on planeAlignment
+  *
+  * Large blocks are backed by huge pages where the system supports it and Settings::hugePages is set.
+  * @return the block, or NULL if the allocation failed */
+void* allocPlanes (size_t size);
+
+/** @brief Frees a block allocated by allocPlanes; NULL is ignored */
+void freePlanes (void* ptr);
+
+}
+#endif
@@ -588,12 +588,25 @@ void LensProfParams::setDefaults() {
     useCA=false;
 }
 
+bool LensProfParams::operator== (const LensProfParams& other) const {
+    return lcpFile == other.lcpFile
+        && useDist == other.useDist
+        && useVign == other.useVign
+        && useCA == other.useCA;
+}
+
 void CoarseTransformParams::setDefaults() {
     rotate = 0;
     hflip = false;
     vflip = false;
 }
 
+bool CoarseTransformParams::operator== (const CoarseTransformParams& other) const {
+    return rotate == other.rotate
+        && hflip == other.hflip
+        && vflip == other.vflip;
+}
+
 void RAWParams::setDefaults() {
     bayersensor.method = RAWParams::BayerSensor::methodstring[RAWParams::BayerSensor::amaze];
     bayersensor.ccSteps = 0;
@@ -631,6 +644,42 @@ void RAWParams::setDefaults() {
     hotdeadpix_thresh = 40;
 }
 
+bool RAWParams::operator== (const RAWParams& other) const {
+    return bayersensor.method == other.bayersensor.method
+        && bayersensor.ccSteps == other.bayersensor.ccSteps
+        && bayersensor.black0 == other.bayersensor.black0
+        && bayersensor.black1 == other.bayersensor.black1
+        && bayersensor.black2 == other.bayersensor.black2
+        && bayersensor.black3 == other.bayersensor.black3
+        && bayersensor.twogreen == other.bayersensor.twogreen
+        && bayersensor.greenthresh == other.bayersensor.greenthresh
+        && bayersensor.linenoise == other.bayersensor.linenoise
+        && bayersensor.dcb_enhance == other.bayersensor.dcb_enhance
+        && bayersensor.dcb_iterations == other.bayersensor.dcb_iterations
+        && bayersensor.lmmse_iterations == other.bayersensor.lmmse_iterations
+        && xtranssensor.method == other.xtranssensor.method
+        && xtranssensor.ccSteps == other.xtranssensor.ccSteps
+        && xtranssensor.blackred == other.xtranssensor.blackred
+        && xtranssensor.blackgreen == other.xtranssensor.blackgreen
+        && xtranssensor.blackblue == other.xtranssensor.blackblue
+        && dark_frame == other.dark_frame
+        && df_autoselect == other.df_autoselect
+        && ff_file == other.ff_file
+        && ff_AutoSelect == other.ff_AutoSelect
+        && ff_BlurRadius == other.ff_BlurRadius
+        && ff_BlurType == other.ff_BlurType
+        && ff_AutoClipControl == other.ff_AutoClipControl
+        && ff_clipControl == other.ff_clipControl
+        && expos == other.expos
+        && preser == other.preser
+        && ca_autocorrect == other.ca_autocorrect
+        && cared == other.cared
+        && cablue == other.cablue
+        && hotPixelFilter == other.hotPixelFilter
+        && deadPixelFilter == other.deadPixelFilter
+        && hotdeadpix_thresh == other.hotdeadpix_thresh;
+}
+
 void ColorManagementParams::setDefaults() {
     input   = "(cameraICC)";
     blendCMSMatrix = false;
@@ -1000,6 +1049,22 @@ int ProcParams::save (Glib::ustring fname, Glib::ustring fname2, bool fnameAbsol
     if (!fname.length() && !fname2.length())
         return 0;
 
+    Glib::ustring sPParams = toString (fname, fnameAbsolute, pedited);
+
+    int error1, error2;
+    error1 = write (fname , sPParams);
+    if (fname2.length()) {
+
+        error2 = write (fname2, sPParams);
+        // If at least one file has been saved, it's a success
+        return error1 & error2;
+    }
+    else
+        return error1;
+}
+
+Glib::ustring ProcParams::toString (Glib::ustring fname, bool fnameAbsolute, ParamsEdited* pedited) {
+
     SafeKeyFile keyFile;
 
     keyFile.set_string  ("Version", "AppVersion", APPVERSION);
@@ -1743,19 +1808,8 @@ int ProcParams::save (Glib::ustring fname, Glib::ustring fname2, bool fnameAbsol
             keyFile.set_string_list ("IPTC", i->first, values);
         }
     }
-    
-    Glib::ustring sPParams = keyFile.to_data();
 
-    int error1, error2;
-    error1 = write (fname , sPParams);
-    if (fname2.length()) {
-
-        error2 = write (fname2, sPParams);
-        // If at least one file has been saved, it's a success
-        return error1 & error2;
-    }
-    else
-        return error1;
+    return keyFile.to_data();
 }
 
 int ProcParams::write (Glib::ustring &fname, Glib::ustring &content) const {
@@ -2794,16 +2848,11 @@ bool ProcParams::operator== (const ProcParams& other) {
 		&& crop.ratio == other.crop.ratio
 		&& crop.orientation == other.crop.orientation
 		&& crop.guide == other.crop.guide
-		&& coarse.rotate == other.coarse.rotate
-		&& coarse.hflip == other.coarse.hflip
-		&& coarse.vflip == other.coarse.vflip
+		&& coarse == other.coarse
 		&& rotate.degree == other.rotate.degree
 		&& commonTrans.autofill == other.commonTrans.autofill
 		&& distortion.amount == other.distortion.amount
-		&& lensProf.lcpFile == other.lensProf.lcpFile
-		&& lensProf.useDist == other.lensProf.useDist
-		&& lensProf.useVign == other.lensProf.useVign
-		&& lensProf.useCA == other.lensProf.useCA
+		&& lensProf == other.lensProf
 		&& perspective.horizontal == other.perspective.horizontal
 		&& perspective.vertical == other.perspective.vertical
 		&& gradient.enabled == other.gradient.enabled
@@ -2853,38 +2902,7 @@ bool ProcParams::operator== (const ProcParams& other) {
 		&& resize.dataspec == other.resize.dataspec
 		&& resize.width == other.resize.width
 		&& resize.height == other.resize.height
-		&& raw.bayersensor.method == other.raw.bayersensor.method
-		&& raw.bayersensor.ccSteps == other.raw.bayersensor.ccSteps
-		&& raw.bayersensor.black0==other.raw.bayersensor.black0
-		&& raw.bayersensor.black1==other.raw.bayersensor.black1
-		&& raw.bayersensor.black2==other.raw.bayersensor.black2
-		&& raw.bayersensor.black3==other.raw.bayersensor.black3
-		&& raw.bayersensor.twogreen==other.raw.bayersensor.twogreen
-		&& raw.bayersensor.greenthresh == other.raw.bayersensor.greenthresh
-		&& raw.bayersensor.linenoise == other.raw.bayersensor.linenoise
-		&& raw.bayersensor.dcb_enhance == other.raw.bayersensor.dcb_enhance
-		&& raw.bayersensor.dcb_iterations == other.raw.bayersensor.dcb_iterations
-		&& raw.xtranssensor.method == other.raw.xtranssensor.method
-		&& raw.xtranssensor.ccSteps == other.raw.xtranssensor.ccSteps
-		&& raw.xtranssensor.blackred==other.raw.xtranssensor.blackred
-		&& raw.xtranssensor.blackgreen==other.raw.xtranssensor.blackgreen
-		&& raw.xtranssensor.blackblue==other.raw.xtranssensor.blackblue
-		&& raw.dark_frame == other.raw.dark_frame
-		&& raw.df_autoselect == other.raw.df_autoselect
-		&& raw.ff_file == other.raw.ff_file
-		&& raw.ff_AutoSelect == other.raw.ff_AutoSelect
-		&& raw.ff_BlurRadius == other.raw.ff_BlurRadius
-		&& raw.ff_BlurType == other.raw.ff_BlurType
-		&& raw.ff_AutoClipControl == other.raw.ff_AutoClipControl
-		&& raw.ff_clipControl == other.raw.ff_clipControl
-		&& raw.expos==other.raw.expos
-		&& raw.preser==other.raw.preser
-		&& raw.ca_autocorrect == other.raw.ca_autocorrect
-		&& raw.cared == other.raw.cared
-		&& raw.cablue == other.raw.cablue
-		&& raw.hotPixelFilter == other.raw.hotPixelFilter
-		&& raw.deadPixelFilter == other.raw.deadPixelFilter
-		&& raw.hotdeadpix_thresh == other.raw.hotdeadpix_thresh
+		&& raw == other.raw
 		&& icm.input == other.icm.input
 		&& icm.toneCurve == other.icm.toneCurve
 		&& icm.blendCMSMatrix == other.icm.blendCMSMatrix
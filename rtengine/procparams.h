@@ -643,6 +643,8 @@ class CoarseTransformParams {
            setDefaults();
         }
         void setDefaults();
+        bool operator== (const CoarseTransformParams& other) const;
+        bool operator!= (const CoarseTransformParams& other) const { return !(*this == other); }
 };
 
 /**
@@ -683,6 +685,8 @@ public:
         setDefaults();
     }
     void setDefaults();
+    bool operator== (const LensProfParams& other) const;
+    bool operator!= (const LensProfParams& other) const { return !(*this == other); }
 };
 
 /**
@@ -1036,6 +1040,8 @@ class RAWParams {
             setDefaults();
         }
         void setDefaults();
+        bool operator== (const RAWParams& other) const;
+        bool operator!= (const RAWParams& other) const { return !(*this == other); }
 };
 
 /**
@@ -1111,6 +1117,14 @@ class ProcParams {
         * @return Error code (=0 if all supplied filenames where created correctly)
         */
         int     save        (Glib::ustring fname, Glib::ustring fname2 = "", bool fnameAbsolute = true, ParamsEdited* pedited=NULL);
+      /**
+        * Returns the parameters in the pp3 format, as save() would write them.
+        * @param fname the name of the file the text is meant for, used to store embedded filenames as relative (optional)
+        * @param fnameAbsolute set to false if embedded filenames should be stored as relative to fname's directory
+        * @param pedited pointer to a ParamsEdited object (optional) to store which values has to be saved
+        * @return the content of the pp3 file
+        */
+        Glib::ustring toString (Glib::ustring fname = "", bool fnameAbsolute = true, ParamsEdited* pedited=NULL);
       /**
         * Loads the parameters from a file.
         * @param fname the name of the file
@@ -148,6 +148,8 @@ public:
   int get_profileLen() const {return profile_length;}
   char* get_profile() const { return profile_data;}
   IMFILE *get_file() { return ifp; }
+  // hand over the file left open by loadRaw(..., closeFile=false), the caller has to close it
+  IMFILE *releaseFile() { IMFILE *f = ifp; ifp = NULL; return f; }
   bool is_supportedThumb() const ;
   int get_thumbOffset(){ return int(thumb_offset);}
   int get_thumbWidth(){ return int(thumb_width);}
@@ -18,6 +18,7 @@
  */
 #include <cmath>
 #include <iostream>
+#include <cstring>
 
 #include "rtengine.h"
 #include "rawimagesource.h"
@@ -36,6 +37,7 @@
 #include "dcp.h"
 #include "rt_math.h"
 #include "improcfun.h"
+#include "histogram.h"
 #ifdef _OPENMP
 #include <omp.h>
 #endif
@@ -79,6 +81,9 @@ RawImageSource::RawImageSource ()
 ,green(0,0)
 ,red(0,0)
 ,blue(0,0)
+,proxyData(0,0)
+,proxyStep(1)
+,proxyCell(1)
 {
     hrmap[0] = NULL;
     hrmap[1] = NULL;
@@ -88,6 +93,7 @@ RawImageSource::RawImageSource ()
 	camProfile = NULL;
 	embProfile = NULL;
 	rgbSourceModified = false;
+	preprocessPrepared = demosaicPrepared = false;
 	hlmax[0] = hlmax[1] = hlmax[2] = hlmax[3] = 0.f;
 }
 	
@@ -782,6 +788,193 @@ int RawImageSource::findHotDeadPixels( PixelsMap &bpMap, float thresh, bool find
 	return counter;
 }
 
+// dark frame subtraction, black level, white balance and vignetting of one row of the CFA; the channel maxima are
+// updated before the vignetting, like scaleColors does, if rowchmax isn't NULL
+void RawImageSource::preprocessRow (int row, float *dst, RawImage *riDark, const float *vignX, float vignY, const LUTf &vignTable, float *rowchmax)
+{
+	const float *src = ri->data[row];
+	const float *dark = riDark ? riDark->data[row] : NULL;
+	const bool isXtrans = ri->getSensorType()==ST_FUJI_XTRANS;
+	unsigned short black[4]={ri->get_cblack(0),ri->get_cblack(1),ri->get_cblack(2),ri->get_cblack(3)};
+
+	for (int col = 0; col < W; col++) {
+		float val = src[col];
+		int c  = FC(row, col);
+		int c4 = ( c == 1 && !(row&1) ) ? 3 : c;
+		if (dark)
+			val = max(val+black[c4] - dark[col], 0.0f);
+		if (isXtrans)
+			c = c4 = ri->XTRANSFC(row, col);
+		val-=cblacksom[c4];
+		val*=scale_mul[c4];
+		if (rowchmax)
+			rowchmax[c] = max(rowchmax[c],val);
+		if (vignX && val>0)
+			val *= vignTable[vignX[col]+vignY];
+		dst[col] = val;
+	}
+}
+
+/* Does in a single sweep over the CFA what copyOriginalPixels (without flat field), scaleColors, the vignetting correction,
+ * the zero-is-bad scan and findHotDeadPixels do one after the other. Each thread processes a band of rows from top to
+ * bottom, the hot/dead pixel detection running 4 rows behind on the rows still in cache; the 4 rows of the neighbouring
+ * bands it needs are computed again in a private buffer. The averages of the greens of the even and odd rows, used by
+ * the Olympus/Panasonic pre-compensation, are computed too if greenAvg isn't NULL. */
+void RawImageSource::preprocessSweep (const RAWParams &raw, RawImage *riDark, const LCPMapper *vignMap, PixelsMap &bitmapBads,
+                                      int &zeroPixels, int &hotDeadPixels, double *greenAvg)
+{
+	if (!rawData)
+		rawData(W,H);
+
+	chmax[0]=chmax[1]=chmax[2]=chmax[3]=0;//channel maxima
+	prepareScaleColors(raw);
+
+	if (!(riDark && W == riDark->get_width() && H == riDark->get_height()))
+		riDark = NULL;
+
+	LUTf vignTable;
+	float *vignX = NULL, *vignY = NULL;
+	if (vignMap) {
+		vignX = new float[W];
+		vignY = new float[H];
+		vignMap->calcVignetteTable(W, H, vignTable, vignX, vignY);
+	}
+
+	const bool zeroIsBad = ri->zeroIsBad();
+	const bool isBayer = ri->getSensorType()==ST_BAYER;
+	const bool findHotPixels = isBayer && raw.hotPixelFilter, findDeadPixels = isBayer && raw.deadPixelFilter;
+	const bool hotDead = findHotPixels || findDeadPixels;
+	const float varthresh = (20.0*(raw.hotdeadpix_thresh/100.0) + 1.0 );
+	const int halo = hotDead ? 4 : 0;
+
+	int zeros=0, hotdead=0, ng1=0, ng2=0;
+	double avgg1=0., avgg2=0.;
+
+#pragma omp parallel reduction(+: zeros, hotdead, ng1, ng2, avgg1, avgg2)
+{
+#ifdef _OPENMP
+	const int tid = omp_get_thread_num(), nthreads = omp_get_num_threads();
+#else
+	const int tid = 0, nthreads = 1;
+#endif
+	const int r0 = (int)((long long)H*tid/nthreads), r1 = (int)((long long)H*(tid+1)/nthreads);
+	const int lo = max(r0-halo,0), hi = min(r1+halo,H);
+
+	float tmpchmax[3];
+	tmpchmax[0] = tmpchmax[1] = tmpchmax[2] = 0.0f;
+
+	// the rows lo..hi-1: the band in rawData, the halo rows in haloBuf
+	float **rows = new float*[hi-lo+1];
+	float *haloBuf = hotDead ? new float[2*halo*W] : NULL;
+	float *cfablur = hotDead ? new float[5*W] : NULL;     // ring of the last 5 rows of the high pass
+	float **row = rows - lo;
+	for (int i=lo; i<hi; i++)
+		row[i] = (i<r0) ? haloBuf + (i-lo)*W : (i<r1) ? rawData[i] : haloBuf + (halo+i-r1)*W;
+
+	for (int t=lo; t < (hotDead ? r1+4 : r1); t++) {
+		if (t<hi) {
+			const bool inBand = t>=r0 && t<r1;
+			preprocessRow(t, row[t], riDark, vignX, vignY ? vignY[t] : 0.f, vignTable, inBand ? tmpchmax : NULL);
+			if (inBand) {
+				if (zeroIsBad) {
+					// pixels with value zero are bad pixels; dcraw sets this flag only for some cameras (mainly Panasonic and Leica)
+					for (int j=0; j<W; j++)
+						if (ri->data[t][j] == 0.f) {
+							bitmapBads.set(j,t);
+							zeros++;
+						}
+				}
+				if (greenAvg && t>=border && t<H-border) {
+					for (int j=border; j<W-border; j++)
+						if (ri->ISGREEN(t,j)) {
+							if (t&1) {
+								avgg2 += row[t][j];
+								ng2++;
+							}
+							else {
+								avgg1 += row[t][j];
+								ng1++;
+							}
+						}
+				}
+			}
+		}
+
+		if (!hotDead)
+			continue;
+
+		// high pass of the row 2 rows above, see findHotDeadPixels
+		int i = t-2;
+		if (i>=max(r0-2,0) && i<min(r1+2,H)) {
+			int iprev,inext,jprev,jnext;
+			float p[9],temp;
+			if (i<2) {iprev=i+2;} else {iprev=i-2;}
+			if (i>H-3) {inext=i-2;} else {inext=i+2;}
+			float *blur = cfablur + (i%5)*W;
+			for (int j=0; j<W; j++) {
+				if (j<2) {jprev=j+2;} else {jprev=j-2;}
+				if (j>W-3) {jnext=j-2;} else {jnext=j+2;}
+				med3x3(row[iprev][jprev],row[iprev][j],row[iprev][jnext],
+					   row[i][jprev],row[i][j],row[i][jnext],
+					   row[inext][jprev],row[inext][j],row[inext][jnext],temp);
+				blur[j] = row[i][j]-temp;
+			}
+		}
+
+		// heat/death evaluation of the row 4 rows above
+		int rr = t-4;
+		if (rr>=r0 && rr<r1) {
+			int top=max(0,rr-2);
+			int bottom=min(H-1,rr+2);
+			const float *blur = cfablur + (rr%5)*W;
+			for (int cc=0; cc < W; cc++) {
+				//evaluate pixel for heat/death
+				float pixdev = blur[cc];
+				if((!findDeadPixels) && pixdev <= 0)
+					continue;
+				if((!findHotPixels) && pixdev >= 0)
+					continue;
+				pixdev = fabsf(pixdev);
+				float hfnbrave = -pixdev;
+				int left=max(0,cc-2);
+				int right=min(W-1,cc+2);
+				for (int mm=top; mm<=bottom; mm++) {
+					const float *nbr = cfablur + (mm%5)*W;
+					for (int nn=left; nn<=right; nn++) {
+						hfnbrave += fabsf(nbr[nn]);
+					}
+				}
+				if (pixdev * ((bottom-top+1)*(right-left+1)-1) > varthresh*hfnbrave) {
+					// mark the pixel as "bad"
+					bitmapBads.set(cc,rr);
+					hotdead++;
+				}
+			}//end of pixel evaluation
+		}
+	}
+
+	delete [] rows;
+	delete [] haloBuf;
+	delete [] cfablur;
+
+#pragma omp critical
+{
+	chmax[0] = max(tmpchmax[0],chmax[0]);
+	chmax[1] = max(tmpchmax[1],chmax[1]);
+	chmax[2] = max(tmpchmax[2],chmax[2]);
+}
+}
+	delete [] vignX;
+	delete [] vignY;
+
+	zeroPixels = zeros;
+	hotDeadPixels = hotdead;
+	if (greenAvg) {
+		greenAvg[0] = avgg1/ng1;
+		greenAvg[1] = avgg2/ng2;
+	}
+}
+
 void RawImageSource::rotateLine (float* line, PlanarPtr<float> &channel, int tran, int i, int w, int h) {
 
     if ((tran & TR_ROT) == TR_R180) 
@@ -1044,6 +1237,58 @@ void RawImageSource::getFullSize (int& w, int& h, int tr) {
 	
 //%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
  
+bool RawImageSource::getSamplePosition (int tran, PreviewProps pp, int width, int height, int i, int j, int& sx, int& sy) {
+
+    // the fuji and d1x images are interpolated from the samples
+    if (fuji || d1x)
+        return false;
+
+    // same geometry as getImage
+    tran = defTransform (tran);
+    int sx1, sy1, imwidth, imheight, fw;
+    transformRect (pp, tran, sx1, sy1, imwidth, imheight, fw);
+    if ((tran & TR_ROT) == TR_R90 || (tran & TR_ROT) == TR_R270) {
+        imwidth = min(imwidth, height);
+        imheight = min(imheight, width);
+    }
+    else {
+        imwidth = min(imwidth, width);
+        imheight = min(imheight, height);
+    }
+
+    // undo the flips, then the rotation of rotateLine
+    if (tran & TR_HFLIP)
+        j = width - 1 - j;
+    if (tran & TR_VFLIP)
+        i = height - 1 - i;
+    int ix, jx;
+    if ((tran & TR_ROT) == TR_R180) {
+        ix = imheight - 1 - i;
+        jx = imwidth - 1 - j;
+    }
+    else if ((tran & TR_ROT) == TR_R90) {
+        ix = imheight - 1 - j;
+        jx = i;
+    }
+    else if ((tran & TR_ROT) == TR_R270) {
+        ix = j;
+        jx = imwidth - 1 - i;
+    }
+    else {
+        ix = i;
+        jx = j;
+    }
+
+    const int skip = pp.skip;
+    sy = sy1 + skip*ix;
+    if (sy >= H - skip)
+        sy = H - skip - 1;
+    sx = sx1 + skip*jx;
+    if (sx >= W - skip)
+        sx = W - skip - 1;
+    return true;
+}
+
 void RawImageSource::getSize (int tran, PreviewProps pp, int& w, int& h) {
 
     tran = defTransform (tran);
@@ -1087,7 +1332,7 @@ int RawImageSource::load (Glib::ustring fname, bool batch) {
     }
 
     ri = new RawImage(fname);
-    int errCode = ri->loadRaw (true, true, plistener, 0.8);
+    int errCode = ri->loadRaw (true, false, plistener, 0.8);  // the file is kept open for ImageData
     if (errCode) return errCode;
 
     ri->compress_image();
@@ -1199,7 +1444,7 @@ int RawImageSource::load (Glib::ustring fname, bool batch) {
     rml.exifBase = ri->get_exifBase();
     rml.ciffBase = ri->get_ciffBase();
     rml.ciffLength = ri->get_ciffLen();
-    idata = new ImageData (fname, &rml);
+    idata = new ImageData (fname, &rml, ri->releaseFile());
 
     green(W,H);
     red(W,H);
@@ -1221,6 +1466,16 @@ int RawImageSource::load (Glib::ustring fname, bool batch) {
 
 void RawImageSource::preprocess  (const RAWParams &raw, const LensProfParams &lensProf, const CoarseTransformParams& coarse)
 {
+	if (preprocessPrepared) {
+		preprocessPrepared = false;
+		if (raw == preparedRaw && lensProf == preparedLensProf && coarse == preparedCoarse) {
+			if (settings->verbose)
+				printf ("Preprocessing done ahead of time\n");
+			return;
+		}
+	}
+	demosaicPrepared = false;
+
 	MyTime t1,t2;
 	t1.set();
 
@@ -1239,20 +1494,6 @@ void RawImageSource::preprocess  (const RAWParams &raw, const LensProfParams &le
 	PixelsMap bitmapBads(W,H);
 	int totBP=0; // Hold count of bad pixels to correct
 
-	if(ri->zeroIsBad()) { // mark all pixels with value zero as bad, has to be called before FF and DF. dcraw sets this flag only for some cameras (mainly Panasonic and Leica)
-#pragma omp parallel for reduction(+:totBP)
-		for(int i=0;i<H;i++)
-			for(int j=0;j<W;j++) {
-				if(ri->data[i][j] == 0.f) {
-					bitmapBads.set(j,i);
-					totBP++;
-				}
-			}
-		if( settings->verbose) {
-			printf( "%d pixels with value zero marked as bad pixels\n",totBP);
-		}
-	}
-
 	//FLATFIELD start
 	Glib::ustring newFF = raw.ff_file;
 	RawImage *rif=NULL;
@@ -1269,9 +1510,68 @@ void RawImageSource::preprocess  (const RAWParams &raw, const LensProfParams &le
 		printf( "Flat Field Correction:%s\n",rif->get_filename().c_str());
 	}
 
-	copyOriginalPixels(raw, ri, rid, rif);
-	//FLATFIELD end
-	
+    // vignetting of lens profile
+    LCPMapper *vignMap = NULL;
+    if (!hasFlatField && lensProf.useVign) {
+        LCPProfile *pLCPProf=lcpStore->getProfile(lensProf.lcpFile);
+        if (pLCPProf && idata->getFocalLen() > 0.f)
+            vignMap = new LCPMapper(pLCPProf, idata->getFocalLen(), idata->getFocalLen35mm(), idata->getFocusDist(), idata->getFNumber(), true, false, W, H, coarse, -1);
+    }
+
+	const bool hotDeadFilter = ri->getSensorType()==ST_BAYER && (raw.hotPixelFilter>0 || raw.deadPixelFilter>0);
+
+    // check if it is an olympus E camera, if yes, compute G channel pre-compensation factors
+    const bool greenPrecomp = ri->getSensorType()==ST_BAYER && (raw.bayersensor.greenthresh || (((idata->getMake().size()>=7 && idata->getMake().substr(0,7)=="OLYMPUS" && idata->getModel()[0]=='E') || (idata->getMake().size()>=9 && idata->getMake().substr(0,9)=="Panasonic")) && raw.bayersensor.method != RAWParams::BayerSensor::methodstring[ RAWParams::BayerSensor::vng4]));
+    double greenAvg[2];
+
+	// the CFA without flat field is done in a single sweep, the flat field needing the whole dark subtracted frame
+	const bool sweep = ri->getSensorType()!=ST_NONE && !hasFlatField;
+
+	if (sweep) {
+		if (hotDeadFilter && plistener) {
+			plistener->setProgressStr ("Hot/Dead Pixel Filter...");
+			plistener->setProgress (0.0);
+		}
+		int nZero, nFound;
+		preprocessSweep(raw, rid, vignMap, bitmapBads, nZero, nFound, greenPrecomp ? greenAvg : NULL);
+		totBP += nZero + nFound;
+		if( settings->verbose && ri->zeroIsBad()) {
+			printf( "%d pixels with value zero marked as bad pixels\n",nZero);
+		}
+		if( settings->verbose && nFound>0){
+			printf( "Correcting %d hot/dead pixels found inside image\n",nFound );
+		}
+	} else {
+		if(ri->zeroIsBad()) { // mark all pixels with value zero as bad, has to be called before FF and DF. dcraw sets this flag only for some cameras (mainly Panasonic and Leica)
+#pragma omp parallel for reduction(+:totBP)
+			for(int i=0;i<H;i++)
+				for(int j=0;j<W;j++) {
+					if(ri->data[i][j] == 0.f) {
+						bitmapBads.set(j,i);
+						totBP++;
+					}
+				}
+			if( settings->verbose) {
+				printf( "%d pixels with value zero marked as bad pixels\n",totBP);
+			}
+		}
+
+		copyOriginalPixels(raw, ri, rid, rif);
+		//FLATFIELD end
+
+		scaleColors( 0,0, W, H, raw);//+ + raw parameters for black level(raw.blackxx)
+
+		// Correct vignetting of lens profile
+		if (vignMap) {
+			#pragma omp parallel for
+			for (int y=0; y<H; y++) {
+				for (int x=0; x<W; x++) {
+					if (rawData[y][x]>0) rawData[y][x] *= vignMap->calcVignetteFac(x,y);
+				}
+			}
+		}
+	}
+	delete vignMap;
 
 	// Always correct camera badpixels from .badpixels file
 	std::vector<badPix> *bp = dfm.getBadPixels( ri->get_maker(), ri->get_model(), idata->getSerialNumber() );
@@ -1295,27 +1595,9 @@ void RawImageSource::preprocess  (const RAWParams &raw, const LensProfParams &le
 		}
 	}
 
-
-    scaleColors( 0,0, W, H, raw);//+ + raw parameters for black level(raw.blackxx)
-
-    // Correct vignetting of lens profile
-    if (!hasFlatField && lensProf.useVign) {
-        LCPProfile *pLCPProf=lcpStore->getProfile(lensProf.lcpFile);
-        if (pLCPProf && idata->getFocalLen() > 0.f) {
-            LCPMapper map(pLCPProf, idata->getFocalLen(), idata->getFocalLen35mm(), idata->getFocusDist(), idata->getFNumber(), true, false, W, H, coarse, -1);
-        
-            #pragma omp parallel for
-            for (int y=0; y<H; y++) {
-                for (int x=0; x<W; x++) {
-                    if (rawData[y][x]>0) rawData[y][x] *= map.calcVignetteFac(x,y);
-                }
-            }
-        }
-    }
-
     defGain = 0.0;//log(initialGain) / log(2.0);
 
-	if ( ri->getSensorType()==ST_BAYER && (raw.hotPixelFilter>0 || raw.deadPixelFilter>0)) {
+	if ( !sweep && hotDeadFilter) {
 		if (plistener) {
 			plistener->setProgressStr ("Hot/Dead Pixel Filter...");
 			plistener->setProgress (0.0);
@@ -1327,27 +1609,30 @@ void RawImageSource::preprocess  (const RAWParams &raw, const LensProfParams &le
 		}
 	}
 
-    // check if it is an olympus E camera, if yes, compute G channel pre-compensation factors
-    if ( ri->getSensorType()==ST_BAYER && (raw.bayersensor.greenthresh || (((idata->getMake().size()>=7 && idata->getMake().substr(0,7)=="OLYMPUS" && idata->getModel()[0]=='E') || (idata->getMake().size()>=9 && idata->getMake().substr(0,9)=="Panasonic")) && raw.bayersensor.method != RAWParams::BayerSensor::methodstring[ RAWParams::BayerSensor::vng4])) ) {
+    if ( greenPrecomp ) {
         // global correction
-        int ng1=0, ng2=0, i=0;
-        double avgg1=0., avgg2=0.;
+        if (!sweep) {
+            int ng1=0, ng2=0, i=0;
+            double avgg1=0., avgg2=0.;
 
 #pragma omp parallel for default(shared) private(i) reduction(+: ng1, ng2, avgg1, avgg2)
-        for (i=border; i<H-border; i++)
-            for (int j=border; j<W-border; j++)
-                if (ri->ISGREEN(i,j)) {
-                    if (i&1) {
-						avgg2 += rawData[i][j];
-                        ng2++;
-                    }
-                    else {
-                        avgg1 += rawData[i][j];
-                        ng1++;
+            for (i=border; i<H-border; i++)
+                for (int j=border; j<W-border; j++)
+                    if (ri->ISGREEN(i,j)) {
+                        if (i&1) {
+                            avgg2 += rawData[i][j];
+                            ng2++;
+                        }
+                        else {
+                            avgg1 += rawData[i][j];
+                            ng1++;
+                        }
                     }
-                }
-        double corrg1 = ((double)avgg1/ng1 + (double)avgg2/ng2) / 2.0 / ((double)avgg1/ng1);
-        double corrg2 = ((double)avgg1/ng1 + (double)avgg2/ng2) / 2.0 / ((double)avgg2/ng2);
+            greenAvg[0] = avgg1/ng1;
+            greenAvg[1] = avgg2/ng2;
+        }
+        double corrg1 = (greenAvg[0] + greenAvg[1]) / 2.0 / greenAvg[0];
+        double corrg2 = (greenAvg[0] + greenAvg[1]) / 2.0 / greenAvg[1];
 
 #pragma omp parallel for default(shared)
         for (int i=border; i<H-border; i++)
@@ -1393,6 +1678,8 @@ void RawImageSource::preprocess  (const RAWParams &raw, const LensProfParams &le
 	}
 	
 	if ( raw.expos !=1 ) processRawWhitepoint(raw.expos, raw.preser);
+
+	buildAnalysisProxy ();
 	
 	if(dirpyrdenoiseExpComp == INFINITY) {
         LUTu aehist; int aehistcompr;
@@ -1412,6 +1699,15 @@ void RawImageSource::preprocess  (const RAWParams &raw, const LensProfParams &le
 	
 void RawImageSource::demosaic(const RAWParams &raw)
 {
+	if (demosaicPrepared) {
+		demosaicPrepared = false;
+		if (raw == preparedRaw && !rgbSourceModified) {
+			if (settings->verbose)
+				printf ("Demosaicing done ahead of time\n");
+			return;
+		}
+	}
+
 	MyTime t1,t2;
 	t1.set();
 
@@ -1468,7 +1764,25 @@ void RawImageSource::demosaic(const RAWParams &raw)
 
 }
 
+void RawImageSource::prepare (const RAWParams &raw, const LensProfParams &lensProf, const CoarseTransformParams& coarse, volatile bool* cancel)
+{
+	preprocessPrepared = demosaicPrepared = false;
+
+	preprocess (raw, lensProf, coarse);
+	if (cancel && *cancel)
+		return;
+	demosaic (raw);
+	if (cancel && *cancel)
+		return;
+
+	preparedRaw = raw;
+	preparedLensProf = lensProf;
+	preparedCoarse = coarse;
+	preprocessPrepared = demosaicPrepared = true;
+}
+
 void RawImageSource::flushRawData() {
+    preprocessPrepared = demosaicPrepared = false;
     if(cache) {
         delete [] cache;
         cache = 0;
@@ -1479,6 +1793,7 @@ void RawImageSource::flushRawData() {
 }
 
 void RawImageSource::flushRGB() {
+    demosaicPrepared = false;
     if (green) {
         green(0,0);
     }
@@ -1939,9 +2254,8 @@ SSEFUNCTION void RawImageSource::cfaboxblur(RawImage *riFlatFile, float* cfablur
 	
 
 // Scale original pixels into the range 0 65535 using black offsets and multipliers 
-void RawImageSource::scaleColors(int winx,int winy,int winw,int winh, const RAWParams &raw)
+void RawImageSource::prepareScaleColors(const RAWParams &raw)
 {
-	chmax[0]=chmax[1]=chmax[2]=chmax[3]=0;//channel maxima
 	float black_lev[4];//black level
 
 	//adjust black level  (eg Canon)
@@ -1968,7 +2282,14 @@ void RawImageSource::scaleColors(int winx,int winy,int winw,int winh, const RAWP
 	for(int i=0; i<4 ;i++) cblacksom[i] = max( c_black[i]+black_lev[i], 0.0f ); // adjust black level
         initialGain = calculate_scale_mul(scale_mul, ref_pre_mul, c_white, cblacksom, isMono, ri->get_colors()); // recalculate scale colors with adjusted levels
         //fprintf(stderr, "recalc: %f [%f %f %f %f]\n", initialGain, scale_mul[0], scale_mul[1], scale_mul[2], scale_mul[3]);
-        
+}
+
+void RawImageSource::scaleColors(int winx,int winy,int winw,int winh, const RAWParams &raw)
+{
+	chmax[0]=chmax[1]=chmax[2]=chmax[3]=0;//channel maxima
+
+	prepareScaleColors(raw);
+
 	// this seems strange, but it works
 
 		// scale image colors
@@ -2977,45 +3298,52 @@ void RawImageSource::getAutoExpHistogram (LUTu & histogram, int& histcompr) {
     histogram(65536>>histcompr);
     histogram.clear();
 
+    // (k,l) runs over the proxy, (i,j) is the same pixel in rawData
+    float** data = analysisData ();
+    const int rowStart = rawToProxy (border);
+    const int rowEnd = rawToProxy (H-border);
+
+    ParallelHistogram histPar (65536>>histcompr);
 #pragma omp parallel
 {
-	LUTu tmphistogram(65536>>histcompr);
-	tmphistogram.clear();
+	unsigned int* tmphistogram = histPar.threadBins();
 #pragma omp for nowait
-    for (int i=border; i<H-border; i++) {
+    for (int k=rowStart; k<rowEnd; k++) {
+        const int i = proxyToRaw (k);
         int start, end;
         getRowStartEnd (i, start, end);
+        start = rawToProxy (start);
+        end = rawToProxy (end);
 
         if (ri->getSensorType()==ST_BAYER) {
-            for (int j=start; j<end; j++) {
-				if (ri->ISGREEN(i,j))     tmphistogram[CLIP((int)(refwb_green*rawData[i][j]))>>histcompr]+=4;
-				else if (ri->ISRED(i,j))  tmphistogram[CLIP((int)(refwb_red*  rawData[i][j]))>>histcompr]+=4;
-				else if (ri->ISBLUE(i,j)) tmphistogram[CLIP((int)(refwb_blue* rawData[i][j]))>>histcompr]+=4;
+            for (int l=start; l<end; l++) {
+				const int j = proxyToRaw (l);
+				if (ri->ISGREEN(i,j))     tmphistogram[CLIP((int)(refwb_green*data[k][l]))>>histcompr]+=4;
+				else if (ri->ISRED(i,j))  tmphistogram[CLIP((int)(refwb_red*  data[k][l]))>>histcompr]+=4;
+				else if (ri->ISBLUE(i,j)) tmphistogram[CLIP((int)(refwb_blue* data[k][l]))>>histcompr]+=4;
 			} 
         } else if (ri->getSensorType()==ST_FUJI_XTRANS) {
-            for (int j=start; j<end; j++) {
-				if (ri->ISXTRANSGREEN(i,j))     tmphistogram[CLIP((int)(refwb_green*rawData[i][j]))>>histcompr]+=4;
-				else if (ri->ISXTRANSRED(i,j))  tmphistogram[CLIP((int)(refwb_red*  rawData[i][j]))>>histcompr]+=4;
-				else if (ri->ISXTRANSBLUE(i,j)) tmphistogram[CLIP((int)(refwb_blue* rawData[i][j]))>>histcompr]+=4;
+            for (int l=start; l<end; l++) {
+				const int j = proxyToRaw (l);
+				if (ri->ISXTRANSGREEN(i,j))     tmphistogram[CLIP((int)(refwb_green*data[k][l]))>>histcompr]+=4;
+				else if (ri->ISXTRANSRED(i,j))  tmphistogram[CLIP((int)(refwb_red*  data[k][l]))>>histcompr]+=4;
+				else if (ri->ISXTRANSBLUE(i,j)) tmphistogram[CLIP((int)(refwb_blue* data[k][l]))>>histcompr]+=4;
 			} 
 		} else if (ri->get_colors() == 1) {
-			for (int j=start; j<end; j++) {
-				tmphistogram[CLIP((int)(refwb_red*  rawData[i][j]))>>histcompr]++;
+			for (int l=start; l<end; l++) {
+				tmphistogram[CLIP((int)(refwb_red*  data[k][l]))>>histcompr]++;
 			}
 		} else {
-			for (int j=start; j<end; j++) {
-				tmphistogram[CLIP((int)(refwb_red*  rawData[i][3*j+0]))>>histcompr]++;
-				tmphistogram[CLIP((int)(refwb_green*rawData[i][3*j+1]))>>histcompr]+=2;
-				tmphistogram[CLIP((int)(refwb_blue* rawData[i][3*j+2]))>>histcompr]++;
+			for (int l=start; l<end; l++) {
+				tmphistogram[CLIP((int)(refwb_red*  data[k][3*l+0]))>>histcompr]++;
+				tmphistogram[CLIP((int)(refwb_green*data[k][3*l+1]))>>histcompr]+=2;
+				tmphistogram[CLIP((int)(refwb_blue* data[k][3*l+2]))>>histcompr]++;
 			}
 		}
     }
-#pragma omp critical
-{
-	for(int i=0; i<(65536>>histcompr);i++)
-		histogram[i] += tmphistogram[i];
-}
 }
+    // each pixel of the proxy stands for proxyStep x proxyStep pixels
+    histPar.addTo (histogram, proxyStep*proxyStep);
 }
 		
 // Histogram MUST be 256 in size; gamma is applied, blackpoint and gain also
@@ -3024,21 +3352,15 @@ void RawImageSource::getRAWHistogram (LUTu & histRedRaw, LUTu & histGreenRaw, LU
 	histRedRaw.clear(); histGreenRaw.clear(); histBlueRaw.clear();
 	const float mult[4] = { 65535.0 / ri->get_white(0), 65535.0 / ri->get_white(1), 65535.0 / ri->get_white(2), 65535.0 / ri->get_white(3) };
 	
+	// one histogram of the raw values per color, the gamma is applied once they are merged
+	ParallelHistogram histPar (4*65536);
 #ifdef _OPENMP
-	int numThreads;
-	// reduce the number of threads under certain conditions to avoid overhaed of too many critical regions
-	numThreads = sqrt((((H-2*border)*(W-2*border))/262144.f));
-	numThreads = std::min(std::max(numThreads,1), omp_get_max_threads());
-
-#pragma omp parallel num_threads(numThreads)
+#pragma omp parallel
 #endif
 {
 	// we need one LUT per color and thread, which corresponds to 1 MB per thread
-	LUTu tmphist[4];
-	tmphist[0](65536);tmphist[0].clear();
-	tmphist[1](65536);tmphist[1].clear();
-	tmphist[2](65536);tmphist[2].clear();
-	tmphist[3](65536);tmphist[3].clear();
+	unsigned int* bins = histPar.threadBins();
+	unsigned int* tmphist[4] = { bins, bins + 65536, bins + 2*65536, bins + 3*65536 };
 	
 #ifdef _OPENMP	
 #pragma omp for nowait
@@ -3054,48 +3376,47 @@ void RawImageSource::getRAWHistogram (LUTu & histRedRaw, LUTu & histGreenRaw, LU
 			int c2 = FC(i,start+1);
 			c2 = ( c2 == 1 && !(i&1) ) ? 3 : c2;
 			for (j=start; j<end-1; j+=2) {
-				tmphist[c1][(int)ri->data[i][j]]++;
-				tmphist[c2][(int)ri->data[i][j+1]]++;
+				tmphist[c1][CLIP((int)ri->data[i][j])]++;
+				tmphist[c2][CLIP((int)ri->data[i][j+1])]++;
 			}
 			if(j<end) { // last pixel of row if width is odd
-				tmphist[c1][(int)ri->data[i][j]]++;
+				tmphist[c1][CLIP((int)ri->data[i][j])]++;
 			}
 		} else if (ri->get_colors() == 1) {
 			for (int j=start; j<end; j++) {
 				for (int c=0; c<3; c++){
-					tmphist[c][(int)ri->data[i][j]]++;
+					tmphist[c][CLIP((int)ri->data[i][j])]++;
 				}
 			}
 		} else if(ri->getSensorType()==ST_FUJI_XTRANS) {
 			for (int j=start; j<end-1; j+=2) {
 				int c = ri->XTRANSFC(i,j);
-				tmphist[c][(int)ri->data[i][j]]++;
+				tmphist[c][CLIP((int)ri->data[i][j])]++;
 			}
 		} else {
 			for (int j=start; j<end; j++) {
 				for (int c=0; c<3; c++){
-					tmphist[c][(int)ri->data[i][3*j+c]]++;
+					tmphist[c][CLIP((int)ri->data[i][3*j+c])]++;
 				}
 			}
 		}
 	}
-#ifdef _OPENMP
-#pragma omp critical
-#endif
-{
+} // end of parallel region
+
+	LUTu tmphist(4*65536);
+	tmphist.clear();
+	histPar.addTo (tmphist);
 	for(int i=0;i<65536;i++){
 		int idx;
 		idx = CLIP((int)Color::gamma(mult[0]*(i-(cblacksom[0]/*+black_lev[0]*/))));
-		histRedRaw[idx>>8] += tmphist[0][i];
+		histRedRaw[idx>>8] += tmphist[i];
 		idx = CLIP((int)Color::gamma(mult[1]*(i-(cblacksom[1]/*+black_lev[1]*/))));
-		histGreenRaw[idx>>8] += tmphist[1][i];
+		histGreenRaw[idx>>8] += tmphist[65536+i];
 		idx = CLIP((int)Color::gamma(mult[3]*(i-(cblacksom[3]/*+black_lev[3]*/))));
-		histGreenRaw[idx>>8] += tmphist[3][i];
+		histGreenRaw[idx>>8] += tmphist[3*65536+i];
 		idx = CLIP((int)Color::gamma(mult[2]*(i-(cblacksom[2]/*+black_lev[2]*/))));
-		histBlueRaw[idx>>8] += tmphist[2][i];
+		histBlueRaw[idx>>8] += tmphist[2*65536+i];
 	}
-} // end of critical region
-} // end of parallel region
 
     
     if (ri->getSensorType()==ST_BAYER)		// since there are twice as many greens, correct for it
@@ -3121,6 +3442,46 @@ void RawImageSource::getRowStartEnd (int x, int &start, int &end) {
         end = W-border;
     }
 }
+
+/* The automatic levels and white balance don't need every pixel: they read a proxy keeping whole CFA cells, one out of
+ * settings->rawAnalysisSubsampling in both directions, so that the colors of its pixels are still given by the CFA at
+ * the same position in rawData. It is built once per preprocessing and then reused by the analyses of all the updates. */
+void RawImageSource::buildAnalysisProxy () {
+
+	proxyCell = ri->getSensorType()==ST_BAYER ? 2 : ri->getSensorType()==ST_FUJI_XTRANS ? 6 : 1;
+	proxyStep = max(settings->rawAnalysisSubsampling, 1);
+	if (proxyStep == 1 || !rawData) {
+		proxyStep = 1;
+		proxyData(0,0);
+		return;
+	}
+
+	const int channels = (ri->getSensorType()==ST_BAYER || ri->getSensorType()==ST_FUJI_XTRANS || ri->get_colors() == 1) ? 1 : 3;
+	const int rows = rawToProxy (H);
+	const int cols = rawToProxy (W);
+	proxyData (cols*channels, rows);
+
+#ifdef _OPENMP
+#pragma omp parallel for
+#endif
+	for (int k=0; k<rows; k++) {
+		const float* src = rawData[proxyToRaw(k)];
+		float* dst = proxyData[k];
+		for (int l=0; l<cols; l+=proxyCell) {
+			const int cell = min(proxyCell, cols-l);
+			memcpy (dst + l*channels, src + proxyToRaw(l)*channels, cell*channels*sizeof(float));
+		}
+	}
+}
+
+int RawImageSource::rawToProxy (int x) const {
+
+	if (x <= 0)
+		return 0;
+	const int cell = x / (proxyCell*proxyStep);
+	const int offset = x % (proxyCell*proxyStep);
+	return offset < proxyCell ? cell*proxyCell + offset : (cell+1)*proxyCell;
+}
 	
 //%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
 	void RawImageSource::getAutoWBMultipliers (double &rm, double &gm, double &bm) {
@@ -3147,17 +3508,23 @@ void RawImageSource::getRowStartEnd (int x, int &start, int &end) {
 		double avg_g = 0;
 		double avg_b = 0;
 		int rn = 0, gn = 0, bn = 0;
+
+		// (k,l) runs over the proxy, (i,j) is the same pixel in rawData
+		float** data = analysisData ();
+		const int rowStart = rawToProxy (32);
+		const int rowEnd = rawToProxy (H-32);
 		
 		if (fuji) {
-			for (int i=32; i<H-32; i++) {
+			for (int k=rowStart; k<rowEnd; k++) {
+				const int i = proxyToRaw (k);
 				int fw = ri->get_FujiWidth();
-				int start = ABS(fw-i) + 32;
-				int end = min(H+W-fw-i, fw+i) - 32;
-				for (int j=start; j<end; j++) {
+				int start = rawToProxy (ABS(fw-i) + 32);
+				int end = rawToProxy (min(H+W-fw-i, fw+i) - 32);
+				for (int l=start; l<end; l++) {
 					if (ri->getSensorType()!=ST_BAYER) {
-						double dr = CLIP(initialGain*(rawData[i][3*j]  ));
-						double dg = CLIP(initialGain*(rawData[i][3*j+1]));
-						double db = CLIP(initialGain*(rawData[i][3*j+2]));
+						double dr = CLIP(initialGain*(data[k][3*l]  ));
+						double dg = CLIP(initialGain*(data[k][3*l+1]));
+						double db = CLIP(initialGain*(data[k][3*l+2]));
 						if (dr>64000. || dg>64000. || db>64000.) continue;
 						avg_r += dr;
 						avg_g += dg;
@@ -3165,8 +3532,8 @@ void RawImageSource::getRowStartEnd (int x, int &start, int &end) {
 						rn = gn = ++bn;
 					}
 					else {
-						int c = FC( i, j);
-						double d = CLIP(initialGain*(rawData[i][j]));
+						int c = FC( i, proxyToRaw (l));
+						double d = CLIP(initialGain*(data[k][l]));
 						if (d>64000.)
 							continue;
 						// Let's test green first, because they are more numerous
@@ -3187,27 +3554,31 @@ void RawImageSource::getRowStartEnd (int x, int &start, int &end) {
 			}
 		}
 		else {
+			const int colStart = rawToProxy (32);
+			const int colEnd = rawToProxy (W-32);
 			if (ri->getSensorType()!=ST_BAYER) {
 				if(ri->getSensorType()==ST_FUJI_XTRANS) {
-					for (int i=32; i<H-32; i++)
-						for (int j=32; j<W-32; j++) {
+					for (int k=rowStart; k<rowEnd; k++)
+						for (int l=colStart; l<colEnd; l++) {
+							const int i = proxyToRaw (k);
+							const int j = proxyToRaw (l);
 							// each loop read 1 rgb triplet value
 							if(ri->ISXTRANSRED(i,j)) {
-								float dr = CLIP(initialGain*(rawData[i][j]));
+								float dr = CLIP(initialGain*(data[k][l]));
 								if (dr>64000.f)
 									continue;
 								avg_r += dr;
 								rn ++;
 							}
 							if(ri->ISXTRANSGREEN(i,j)) {
-								float dg = CLIP(initialGain*(rawData[i][j]));
+								float dg = CLIP(initialGain*(data[k][l]));
 								if (dg>64000.f)
 									continue;
 								avg_g += dg;
 								gn ++;
 							}
 							if(ri->ISXTRANSBLUE(i,j)) {
-								float db = CLIP(initialGain*(rawData[i][j]));
+								float db = CLIP(initialGain*(data[k][l]));
 								if (db>64000.f)
 									continue;
 								avg_b += db;
@@ -3215,13 +3586,13 @@ void RawImageSource::getRowStartEnd (int x, int &start, int &end) {
 							}
 						}
 				} else {
-					for (int i=32; i<H-32; i++)
-						for (int j=32; j<W-32; j++) {
+					for (int k=rowStart; k<rowEnd; k++)
+						for (int l=colStart; l<colEnd; l++) {
 							// each loop read 1 rgb triplet value
 
-							double dr = CLIP(initialGain*(rawData[i][3*j]  ));
-							double dg = CLIP(initialGain*(rawData[i][3*j+1]));
-							double db = CLIP(initialGain*(rawData[i][3*j+2]));
+							double dr = CLIP(initialGain*(data[k][3*l]  ));
+							double dg = CLIP(initialGain*(data[k][3*l+1]));
+							double db = CLIP(initialGain*(data[k][3*l+2]));
 							if (dr>64000. || dg>64000. || db>64000.) continue;
 							avg_r += dr; rn++;
 							avg_g += dg; 
@@ -3237,14 +3608,15 @@ void RawImageSource::getRowStartEnd (int x, int &start, int &end) {
 				} else {//first pixel is R or B
 					if (ri->ISRED(0,0)) {ey=0; ex=0;} else {ey=1; ex=1;}
 				}
+				// the quartets start on even rows and columns of rawData, as the cells of the proxy
 				double d[2][2];
-				for (int i=32; i<H-32; i+=2)
-					for (int j=32; j<W-32; j+=2) {
+				for (int k=rowStart; k<rowEnd; k+=2)
+					for (int l=colStart; l<colEnd; l+=2) {
 						//average each Bayer quartet component individually if non-clipped
-						d[0][0] = CLIP(initialGain*(rawData[i][j]    ));
-						d[0][1] = CLIP(initialGain*(rawData[i][j+1]  ));
-						d[1][0] = CLIP(initialGain*(rawData[i+1][j]  ));
-						d[1][1] = CLIP(initialGain*(rawData[i+1][j+1]));
+						d[0][0] = CLIP(initialGain*(data[k][l]    ));
+						d[0][1] = CLIP(initialGain*(data[k][l+1]  ));
+						d[1][0] = CLIP(initialGain*(data[k+1][l]  ));
+						d[1][1] = CLIP(initialGain*(data[k+1][l+1]));
 						if (d[ey][ex] <= 64000.) {
 							avg_r += d[ey][ex];
 							rn++;
@@ -34,6 +34,8 @@
 
 namespace rtengine {
 
+class LCPMapper;
+
 // these two functions "simulate" and jagged array, but just use two allocs
 template<class T> T** allocArray (int W, int H, bool initZero=false) {
 
@@ -104,6 +106,12 @@ class RawImageSource : public ImageSource {
         cmsHPROFILE embProfile;
         bool rgbSourceModified;
 
+        // parameters of the preprocessing and demosaicing done by prepare, still valid if the flags are set
+        bool preprocessPrepared, demosaicPrepared;
+        RAWParams preparedRaw;
+        LensProfParams preparedLensProf;
+        CoarseTransformParams preparedCoarse;
+
         RawImage* ri;  // Copy of raw pixels, NOT corrected for initial gain, blackpoint etc.
 
         // to accelerate CIELAB conversion:
@@ -120,6 +128,12 @@ class RawImageSource : public ImageSource {
         // the interpolated blue plane:
         array2D<float> blue;
 
+        // whole CFA cells of rawData, one cell out of proxyStep x proxyStep, on which the automatic levels and white
+        // balance are computed; built at the end of the preprocessing, empty if they read rawData
+        array2D<float> proxyData;
+        int proxyStep;  // 1 if the analyses read rawData
+        int proxyCell;  // size of the CFA cell: 2 for Bayer, 6 for X-Trans, 1 otherwise
+
 
         void hphd_vertical       (float** hpmap, int col_from, int col_to);
         void hphd_horizontal     (float** hpmap, int row_from, int row_to);
@@ -135,6 +149,12 @@ class RawImageSource : public ImageSource {
         void HLRecovery_ColorPropagation (float* red, float* green, float* blue, int i, int sx1, int width, int skip);
         unsigned FC(int row, int col){ return ri->FC(row,col); }
         inline void getRowStartEnd (int x, int &start, int &end);
+        void buildAnalysisProxy  ();
+        float** analysisData     () { return proxyStep > 1 ? (float**)proxyData : (float**)rawData; }
+        // row (column) of rawData of the row (column) k of the proxy
+        int  proxyToRaw          (int k) const { return (k / proxyCell) * proxyCell * proxyStep + k % proxyCell; }
+        // first row (column) of the proxy at or after the row (column) x of rawData
+        int  rawToProxy          (int x) const;
         static void getProfilePreprocParams(cmsHPROFILE in, float& gammafac, float& lineFac, float& lineSum);
 
 
@@ -145,6 +165,7 @@ class RawImageSource : public ImageSource {
         int         load        (Glib::ustring fname, bool batch = false);
         void        preprocess  (const RAWParams &raw, const LensProfParams &lensProf, const CoarseTransformParams& coarse);
         void        demosaic    (const RAWParams &raw);
+        void        prepare     (const RAWParams &raw, const LensProfParams &lensProf, const CoarseTransformParams& coarse, volatile bool* cancel = NULL);
         void        flushRawData      ();
         void        flushRGB          ();
         void        HLRecovery_Global (ToneCurveParams hrp);
@@ -157,6 +178,10 @@ class RawImageSource : public ImageSource {
         void        copyOriginalPixels(const RAWParams &raw, RawImage *ri, RawImage *riDark, RawImage *riFlatFile  );
         void        cfaboxblur  (RawImage *riFlatFile, float* cfablur, int boxH, int boxW );
         void        scaleColors (int winx,int winy,int winw,int winh, const RAWParams &raw);// raw for cblack
+        void        prepareScaleColors (const RAWParams &raw);
+        void        preprocessRow (int row, float *dst, RawImage *riDark, const float *vignX, float vignY, const LUTf &vignTable, float *rowchmax);
+        void        preprocessSweep (const RAWParams &raw, RawImage *riDark, const LCPMapper *vignMap, PixelsMap &bitmapBads,
+                                     int &zeroPixels, int &hotDeadPixels, double *greenAvg);
 
         void        getImage    (ColorTemp ctemp, int tran, Imagefloat* image, PreviewProps pp, ToneCurveParams hrp, ColorManagementParams cmp, RAWParams raw);
         eSensorType getSensorType () { return ri!=NULL ? ri->getSensorType() : ST_NONE; }
@@ -172,6 +197,7 @@ class RawImageSource : public ImageSource {
         void        getFullSize (int& w, int& h, int tr = TR_NONE);
         void        getSize     (int tran, PreviewProps pp, int& w, int& h);
         int         getRotateDegree() const { return ri->get_rotateDegree(); }
+        bool        getSamplePosition (int tran, PreviewProps pp, int width, int height, int i, int j, int& sx, int& sy);
 
         ImageData*  getImageData () { return idata; }
         ImageMatrices* getImageMatrices () { return &imatrices; }
@@ -214,7 +240,6 @@ class RawImageSource : public ImageSource {
 
         int  LinEqSolve( int nDim, double* pfMatr, double* pfVect, double* pfSolution);//Emil's CA auto correction
         void CA_correct_RT	(double cared, double cablue);
-        void ddct8x8s(int isgn, float a[8][8]);
         void processRawWhitepoint (float expos, float preser);  // exposure before interpolation
 
         int  interpolateBadPixelsBayer( PixelsMap &bitmapBads );
@@ -170,6 +170,15 @@ namespace rtengine {
             * @param pl is a pointer pointing to an object implementing a progress listener. It can be NULL, in this case progress is not reported.
             * @return an object representing the loaded and pre-processed image */
           static InitialImage* load (const Glib::ustring& fname, bool isRaw, int* errorCode, ProgressListener* pl = NULL);
+          /** Loads an image into the memory ahead of its opening in an editor, and preprocesses and demosaics it the way
+            * the first preview will need it. A StagedImageProcessor created on it with the same raw parameters skips this work.
+            * @param fname the name of the file
+            * @param isRaw shall be true if it is a raw file
+            * @param params the processing parameters the image is expected to be opened with
+            * @param errorCode is a pointer to a variable that is set to nonzero if an error happened (output)
+            * @param cancel if not NULL, the work stops and NULL is returned when the pointed value becomes true
+            * @return an object representing the loaded and pre-processed image */
+          static InitialImage* prefetch (const Glib::ustring& fname, bool isRaw, const procparams::ProcParams& params, int* errorCode, volatile bool* cancel = NULL);
     };
 
     /** When the preview image is ready for display during staged processing (thus the changes have been updated),
@@ -456,6 +465,11 @@ namespace rtengine {
                         * @return the next ProcessingJob to process */  
             virtual ProcessingJob* imageReady (IImage16* img) =0;
             virtual void error(Glib::ustring message) =0;
+         /** This function is called before each job and between its processing steps, so that several batch processings running at the same
+                        * time can share the threads and the memory as they start and end.
+                        * @param numThreads is set to the number of threads the next steps may use, 0 = all the available ones
+                        * @param memoryBudget is set to the memory the tiled stages (denoise, wavelet) may use in bytes, 0 = the whole budget */
+            virtual void getResources (int& numThreads, size_t& memoryBudget) { numThreads = 0; memoryBudget = 0; }
     };
 /** This function performs all the image processinf steps corresponding to the given ProcessingJob. It runs in the background, thus it returns immediately,
    * When it finishes, it calls the BatchProcessingListener with the resulting image and asks for the next job. It the listener gives a new job, it goes on 
@@ -463,8 +477,18 @@ namespace rtengine {
    * The ProcessingJob passed becomes invalid, you can not use it any more.
    * @param job the ProcessingJob to cancel. 
    * @param bpl is the BatchProcessingListener that is called when the image is ready or the next job is needed. It also acts as a ProgressListener.
-   * @param tunnelMetaData tunnels IPTC and XMP to output without change */  
-    void startBatchProcessing (ProcessingJob* job, BatchProcessingListener* bpl, bool tunnelMetaData);
+   * @param tunnelMetaData tunnels IPTC and XMP to output without change
+   * @param numThreads is the number of threads used by the processing of the jobs, 0 = all the available ones. Several batch processings can run
+   * at the same time, each with its own listener. */  
+    void startBatchProcessing (ProcessingJob* job, BatchProcessingListener* bpl, bool tunnelMetaData, int numThreads = 0);
+
+/** Estimates the memory used by the processing of an image, in bytes. It is a rough upper bound depending on the size of the image and on the
+   * enabled tools, used to choose how many images can be processed at the same time.
+   * @param fullWidth is the width of the image
+   * @param fullHeight is the height of the image
+   * @param isRaw shall be true if it is a raw file
+   * @param params are the processing parameters of the image */
+    size_t estimateProcessingMemory (int fullWidth, int fullHeight, bool isRaw, const procparams::ProcParams& params);
 
 
     extern MyMutex* lcmsMutex;
@@ -176,6 +176,15 @@ Thumbnail* Thumbnail::loadQuickFromRaw (const Glib::ustring& fname, RawMetaDataL
 
     int err = 1;
 
+    // the embedded JPEG can be decoded at a fraction of its size if it's still larger than the thumbnail
+    int minWidth = 0, minHeight = 0;
+    if (!inspectorMode) {
+        if (fixwh==1)
+            minHeight = h;
+        else
+            minWidth = w;
+    }
+
     // see if it is something we support
     if ( ri->is_supportedThumb() )
     {
@@ -188,9 +197,9 @@ Thumbnail* Thumbnail::loadQuickFromRaw (const Glib::ustring& fname, RawMetaDataL
         	std::string suffix = fname.length() > 4 ? fname.substr(fname.length()-3) : "";
         	for (int i = 0; i < suffix.length(); i++) suffix[i] = std::tolower(suffix[i]);
 			if(suffix != "mrw" || (unsigned char)data[0] == 0xff)
-				err = img->loadJPEGFromMemory(data,ri->get_thumbLength());
+				err = img->loadJPEGFromMemory(data,ri->get_thumbLength(),minWidth,minHeight);
 #else
-            err = img->loadJPEGFromMemory(data,ri->get_thumbLength());
+            err = img->loadJPEGFromMemory(data,ri->get_thumbLength(),minWidth,minHeight);
 #endif
         }
         else
@@ -225,11 +234,11 @@ Thumbnail* Thumbnail::loadQuickFromRaw (const Glib::ustring& fname, RawMetaDataL
     else {
         if (fixwh==1) {
             w = h * img->width / img->height;
-            tpp->scale = (double)img->height / h;
+            tpp->scale = (double)img->height / img->getLoadedScale() / h;
         }
         else {
             h = w * img->height / img->width;
-            tpp->scale = (double)img->width / w;
+            tpp->scale = (double)img->width / img->getLoadedScale() / w;
         }
     }
 
@@ -34,6 +34,12 @@ namespace rtengine {
 			int				leveldnaut; 			// level of auto denoise
 			int				leveldnliss; 			// level of auto multi zone
 			int				leveldnautsimpl; 			// STD or EXPERT
+			int				tileMemoryBudget; 			// memory budget of the tiled stages (denoise, wavelet) in MB, 0 = half of the physical memory
+			int				curveCacheSize; 			// memory used by the cache of the curve LUTs in MB
+			bool			reuseCAFit; 			// auto CA correction reuses the fit of the previous images shot with the same lens and settings
+			bool			hugePages;				// large image buffers are backed by huge pages where the system supports it
+			int				rawAnalysisSubsampling;	// auto levels and auto WB read one CFA cell of the raw data out of n x n, 1 = full resolution
+			int				schedulerThreads;		// worker threads of the task scheduler, 0 = one per core
  
 			Glib::ustring   monitorProfile;         ///< ICC profile of the monitor (full path recommended)
 			bool            autoMonitorProfile;     ///< Try to auto-determine the correct monitor color profile
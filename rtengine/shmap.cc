@@ -23,6 +23,7 @@
 #include "rawimagesource.h"
 #undef THREAD_PRIORITY_NORMAL
 #include "opthelper.h"
+#include "dirpyrfilter.h"
 
 namespace rtengine {
 
@@ -195,195 +196,10 @@ void SHMap::forceStat (float max_, float min_, float avg_) {
     avg = avg_;
 }
 
-SSEFUNCTION void SHMap::dirpyr_shmap(float ** data_fine, float ** data_coarse, int width, int height, LUTf & rangefn, int level, int scale)
+void SHMap::dirpyr_shmap(float ** data_fine, float ** data_coarse, int width, int height, LUTf & rangefn, int level, int scale)
 {
 	//scale is spacing of directional averaging weights
-
-	//%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
-	// calculate weights, compute directionally weighted average
-
-	int scalewin, halfwin;
-
-	if(level < 2) {
-		halfwin = 1;
-		scalewin = halfwin*scale;
-
-#ifdef _OPENMP
-#pragma omp parallel
-#endif
-{
-#if defined( __SSE2__ ) && defined( __x86_64__ )
-	__m128 dirwtv, valv, normv, dftemp1v, dftemp2v;
-#endif // __SSE2__
-	int j;
-#ifdef _OPENMP
-#pragma omp for
-#endif
-	for(int i = 0; i < height; i++) {
-		float dirwt;
-		for(j = 0; j < scalewin; j++) {
-			float val=0.f;
-			float norm=0.f;
-			for(int inbr=max(i-scalewin,i%scale); inbr<=min(i+scalewin, height-1); inbr+=scale) {
-				for (int jnbr=j%scale; jnbr<=j+scalewin; jnbr+=scale) {
-					dirwt = ( rangefn[abs(data_fine[inbr][jnbr]-data_fine[i][j])] );
-					val += dirwt*data_fine[inbr][jnbr];
-					norm += dirwt;
-				}
-			}
-			data_coarse[i][j] = val/norm; // low pass filter
-		}
-#if defined( __SSE2__ ) && defined( __x86_64__ )
-		int inbrMin = max(i-scalewin,i%scale);
-		for(; j < (width-scalewin)-3; j+=4) {
-			valv= _mm_setzero_ps();
-			normv= _mm_setzero_ps();
-			dftemp1v = LVFU(data_fine[i][j]);
-			for(int inbr=inbrMin; inbr<=min(i+scalewin, height-1); inbr+=scale) {
-				for (int jnbr=j-scalewin; jnbr<=j+scalewin; jnbr+=scale) {
-					dftemp2v = LVFU(data_fine[inbr][jnbr]);
-					dirwtv = ( rangefn[_mm_cvttps_epi32(vabsf(dftemp2v-dftemp1v))] );
-					valv += dirwtv*dftemp2v;
-					normv += dirwtv;
-				}
-			}
-			_mm_storeu_ps( &data_coarse[i][j], valv/normv);
-		}
-		for(; j < width-scalewin; j++) {
-			float val=0.f;
-			float norm=0.f;
-			for(int inbr=inbrMin; inbr<=min(i+scalewin, height-1); inbr+=scale) {
-				for (int jnbr=j-scalewin; jnbr<=j+scalewin; jnbr+=scale) {
-					dirwt = ( rangefn[abs(data_fine[inbr][jnbr]-data_fine[i][j])] );
-					val += dirwt*data_fine[inbr][jnbr];
-					norm += dirwt;
-				}
-			}
-			data_coarse[i][j] = val/norm; // low pass filter
-		}
-
-#else
-		for(; j < width-scalewin; j++) {
-			float val=0.f;
-			float norm=0.f;
-			for(int inbr=max(i-scalewin,i%scale); inbr<=min(i+scalewin, height-1); inbr+=scale) {
-				for (int jnbr=j-scalewin; jnbr<=j+scalewin; jnbr+=scale) {
-					dirwt = ( rangefn[abs(data_fine[inbr][jnbr]-data_fine[i][j])] );
-					val += dirwt*data_fine[inbr][jnbr];
-					norm += dirwt;
-				}
-			}
-			data_coarse[i][j] = val/norm; // low pass filter
-		}
-#endif
-		for(; j < width; j++) {
-			float val=0.f;
-			float norm=0.f;
-			for(int inbr=max(i-scalewin,i%scale); inbr<=min(i+scalewin, height-1); inbr+=scale) {
-				for (int jnbr=j-scalewin; jnbr<width; jnbr+=scale) {
-					dirwt = ( rangefn[abs(data_fine[inbr][jnbr]-data_fine[i][j])] );
-					val += dirwt*data_fine[inbr][jnbr];
-					norm += dirwt;
-				}
-			}
-			data_coarse[i][j] = val/norm; // low pass filter
-		}
-	}
-}
-}
-else {
-	halfwin=2;
-	scalewin = halfwin*scale;
-	int domker[5][5] = {{1,1,1,1,1},{1,2,2,2,1},{1,2,2,2,1},{1,2,2,2,1},{1,1,1,1,1}};
-	//generate domain kernel
-
-#ifdef _OPENMP
-#pragma omp parallel
-#endif
-{
-#if defined( __SSE2__ ) && defined( __x86_64__ )
-	__m128 dirwtv, valv, normv, dftemp1v, dftemp2v;
-	float domkerv[5][5][4] __attribute__ ((aligned (16))) = {{{1,1,1,1},{1,1,1,1},{1,1,1,1},{1,1,1,1},{1,1,1,1}},{{1,1,1,1},{2,2,2,2},{2,2,2,2},{2,2,2,2},{1,1,1,1}},{{1,1,1,1},{2,2,2,2},{2,2,2,2},{2,2,2,2},{1,1,1,1}},{{1,1,1,1},{2,2,2,2},{2,2,2,2},{2,2,2,2},{1,1,1,1}},{{1,1,1,1},{1,1,1,1},{1,1,1,1},{1,1,1,1},{1,1,1,1}}};
-
-#endif // __SSE2__
-	int j;
-#ifdef _OPENMP
-#pragma omp for schedule(dynamic,16)
-#endif
-	for(int i = 0; i < height; i++) {
-		float dirwt;
-		for(j = 0; j < scalewin; j++) {
-			float val=0.f;
-			float norm=0.f;
-			for(int inbr=max(i-scalewin,i%scale); inbr<=min(i+scalewin, height-1); inbr+=scale) {
-				for (int jnbr=j%scale; jnbr<=j+scalewin; jnbr+=scale) {
-					dirwt = ( domker[(inbr-i)/scale+halfwin][(jnbr-j)/scale+halfwin] * rangefn[abs(data_fine[inbr][jnbr]-data_fine[i][j])] );
-					val += dirwt*data_fine[inbr][jnbr];
-					norm += dirwt;
-				}
-			}
-			data_coarse[i][j] = val/norm; // low pass filter
-		}
-#if defined( __SSE2__ ) && defined( __x86_64__ )
-		for(; j < width-scalewin-3; j+=4) {
-			valv = _mm_setzero_ps();
-			normv = _mm_setzero_ps();
-			dftemp1v = LVFU(data_fine[i][j]);
-			for(int inbr=max(i-scalewin,i%scale); inbr<=MIN(i+scalewin, height-1); inbr+=scale) {
-				int indexihlp = (inbr-i)/scale+halfwin;
-				for (int jnbr=j-scalewin,indexjhlp = 0; jnbr<=j+scalewin; jnbr+=scale,indexjhlp++) {
-					dftemp2v = LVFU(data_fine[inbr][jnbr]);
-					dirwtv = ( _mm_load_ps((float*)&domkerv[indexihlp][indexjhlp]) * rangefn[_mm_cvttps_epi32(vabsf(dftemp2v-dftemp1v))] );
-					valv += dirwtv*dftemp2v;
-					normv += dirwtv;
-				}
-			}
-			_mm_storeu_ps( &data_coarse[i][j], valv/normv);
-		}
-		for(; j < width-scalewin; j++) {
-			float val=0;
-			float norm=0;
-			for(int inbr=max(i-scalewin,i%scale); inbr<=min(i+scalewin, height-1); inbr+=scale) {
-				for (int jnbr=j-scalewin; jnbr<=j+scalewin; jnbr+=scale) {
-					dirwt = ( domker[(inbr-i)/scale+halfwin][(jnbr-j)/scale+halfwin] * rangefn[abs(data_fine[inbr][jnbr]-data_fine[i][j])] );
-					val += dirwt*data_fine[inbr][jnbr];
-					norm += dirwt;
-				}
-			}
-			data_coarse[i][j] = val/norm; // low pass filter
-		}
-
-#else
-		for(; j < width-scalewin; j++) {
-			float val=0;
-			float norm=0;
-			for(int inbr=max(i-scalewin,i%scale); inbr<=min(i+scalewin, height-1); inbr+=scale) {
-				for (int jnbr=j-scalewin; jnbr<=j+scalewin; jnbr+=scale) {
-					dirwt = ( domker[(inbr-i)/scale+halfwin][(jnbr-j)/scale+halfwin] * rangefn[abs(data_fine[inbr][jnbr]-data_fine[i][j])] );
-					val += dirwt*data_fine[inbr][jnbr];
-					norm += dirwt;
-				}
-			}
-			data_coarse[i][j] = val/norm; // low pass filter
-		}
-#endif
-		for(; j < width; j++) {
-			float val=0;
-			float norm=0;
-			for(int inbr=max(i-scalewin,i%scale); inbr<=min(i+scalewin, height-1); inbr+=scale) {
-				for (int jnbr=j-scalewin; jnbr<width; jnbr+=scale) {
-					dirwt = ( domker[(inbr-i)/scale+halfwin][(jnbr-j)/scale+halfwin] * rangefn[abs(data_fine[inbr][jnbr]-data_fine[i][j])] );
-					val += dirwt*data_fine[inbr][jnbr];
-					norm += dirwt;
-				}
-			}
-			data_coarse[i][j] = val/norm; // low pass filter
-		}
-	}
-}
-
-}
-
+	dirpyrFilter (data_fine, data_coarse, width, height, level, scale, true, DirpyrTableRange(rangefn));
 }
 
 }//end of SHMap
@@ -31,6 +31,7 @@
 #include "../rtgui/ppversion.h"
 #include "../rtgui/multilangmgr.h"
 #include "mytime.h"
+#include "histogram.h"
 #undef THREAD_PRIORITY_NORMAL
 #ifdef _OPENMP
 #include <omp.h>
@@ -39,7 +40,23 @@
 namespace rtengine {
 extern const Settings* settings;
 
-IImage16* processImage (ProcessingJob* pjob, int& errorCode, ProgressListener* pl, bool tunnelMetaData, bool flush) {
+// Takes the threads and the memory the batch queue gives to the job at this point, they change as other jobs start or end
+static void updateResources (BatchProcessingListener* bpl, ImProcFunctions& ipf) {
+
+    if (!bpl)
+        return;
+
+    int numThreads;
+    size_t memoryBudget;
+    bpl->getResources (numThreads, memoryBudget);
+#ifdef _OPENMP
+    if (numThreads > 0)
+        omp_set_num_threads (numThreads);
+#endif
+    ipf.setMemoryBudget (memoryBudget);
+}
+
+static IImage16* processJob (ProcessingJob* pjob, int& errorCode, ProgressListener* pl, BatchProcessingListener* bpl, bool tunnelMetaData, bool flush) {
 
     errorCode = 0;
 
@@ -97,6 +114,7 @@ IImage16* processImage (ProcessingJob* pjob, int& errorCode, ProgressListener* p
 //    t1.set();
 
     ImProcFunctions ipf (&params, true);
+    updateResources (bpl, ipf);
 
     PreviewProps pp (0, 0, fw, fh, 1);
     imgsrc->preprocess( params.raw, params.lensProf, params.coarse);
@@ -488,6 +506,7 @@ IImage16* processImage (ProcessingJob* pjob, int& errorCode, ProgressListener* p
     Imagefloat* baseImg = new Imagefloat (fw, fh);
     imgsrc->getImage (currWB, tr, baseImg, pp, params.toneCurve, params.icm, params.raw);
     if (pl) pl->setProgress (0.45);
+    updateResources (bpl, ipf);
 
 //	LUTf Noisecurve (65536,0);
 //!!!// auto exposure!!!
@@ -698,6 +717,7 @@ IImage16* processImage (ProcessingJob* pjob, int& errorCode, ProgressListener* p
 
     if (pl) 
         pl->setProgress (0.5);
+    updateResources (bpl, ipf);
 
 	//%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
 	//%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
@@ -706,12 +726,12 @@ IImage16* processImage (ProcessingJob* pjob, int& errorCode, ProgressListener* p
     hist16.clear();  hist16C.clear();
 	if(params.labCurve.contrast !=0) {//only use hist16 for contrast
 	
+    ParallelHistogram hist16par (65536);
 #ifdef _OPENMP
-#pragma omp parallel shared(hist16,labView, fh, fw)
+#pragma omp parallel shared(labView, fh, fw)
 #endif
 {
-    LUTu hist16thr (65536);  // one temporary lookup table per thread
-    hist16thr.clear();
+    unsigned int* hist16thr = hist16par.threadBins();  // one temporary lookup table per thread
 #ifdef _OPENMP
 #pragma omp for schedule(static) nowait
 #endif
@@ -719,13 +739,8 @@ IImage16* processImage (ProcessingJob* pjob, int& errorCode, ProgressListener* p
         for (int j=0; j<fw; j++){
             hist16thr[CLIP((int)((labView->L[i][j])))]++;
         }
-
-#pragma omp critical
-{
-    for(int i=0;i<65536;i++)
-        hist16[i] += hist16thr[i];
-}
 }
+    hist16par.addTo (hist16);
 	
 	
 	}
@@ -1171,13 +1186,50 @@ IImage16* processImage (ProcessingJob* pjob, int& errorCode, ProgressListener* p
     return readyImg;
 }
 
-void batchProcessingThread (ProcessingJob* job, BatchProcessingListener* bpl, bool tunnelMetaData) {
+size_t estimateProcessingMemory (int fullWidth, int fullHeight, bool isRaw, const procparams::ProcParams& params) {
+
+    // bytes per pixel of the buffers living through the whole processing: the raw data and the demosaiced planes of a
+    // raw file or the source image, then the working image, the Lab image and the output image
+    size_t bytesPerPixel = isRaw ? 56 : 40;
+
+    // the tools run one after the other, the most demanding one adding its buffers to the above
+    size_t tool = 0;
+    if (params.dirpyrDenoise.enabled)
+        tool = max(tool, (size_t)36);
+    if (params.wavelet.enabled)
+        tool = max(tool, (size_t)40);
+    if (params.colorappearance.enabled)
+        tool = max(tool, (size_t)32);
+    if (params.dirpyrequalizer.enabled)
+        tool = max(tool, (size_t)24);
+    if (params.epd.enabled)
+        tool = max(tool, (size_t)16);
+    if (params.defringe.enabled || params.impulseDenoise.enabled)
+        tool = max(tool, (size_t)12);
+    if (params.sharpening.enabled || params.sharpenMicro.enabled || params.sh.enabled)
+        tool = max(tool, (size_t)8);
+
+    return (size_t)fullWidth * fullHeight * (bytesPerPixel + tool);
+}
+
+IImage16* processImage (ProcessingJob* pjob, int& errorCode, ProgressListener* pl, bool tunnelMetaData, bool flush) {
+
+    return processJob (pjob, errorCode, pl, NULL, tunnelMetaData, flush);
+}
+
+void batchProcessingThread (ProcessingJob* job, BatchProcessingListener* bpl, bool tunnelMetaData, int numThreads) {
+
+#ifdef _OPENMP
+    // the OpenMP settings are per thread: the parallel regions started by this job use numThreads threads
+    if (numThreads > 0)
+        omp_set_num_threads (numThreads);
+#endif
 
     ProcessingJob* currentJob = job;
     
     while (currentJob) {
         int errorCode;
-        IImage16* img = processImage (currentJob, errorCode, bpl, tunnelMetaData, true);
+        IImage16* img = processJob (currentJob, errorCode, bpl, bpl, tunnelMetaData, true);
         if (errorCode) {
             bpl->error (M("MAIN_MSG_CANNOTLOAD"));
             currentJob = NULL;
@@ -1192,14 +1244,14 @@ void batchProcessingThread (ProcessingJob* job, BatchProcessingListener* bpl, bo
     }
 }
 
-void startBatchProcessing (ProcessingJob* job, BatchProcessingListener* bpl, bool tunnelMetaData) {
+void startBatchProcessing (ProcessingJob* job, BatchProcessingListener* bpl, bool tunnelMetaData, int numThreads) {
 
     if (bpl)
 #if __GNUC__ == 4 && __GNUC_MINOR__ == 8 && defined( WIN32 ) && defined(__x86_64__)
 		// See Issue 2384 "Very bad response time on win7/64 using gcc 4.8 when queue is running"
-        Glib::Thread::create(sigc::bind(sigc::ptr_fun(batchProcessingThread), job, bpl, tunnelMetaData), 0, true, true, Glib::THREAD_PRIORITY_NORMAL);
+        Glib::Thread::create(sigc::bind(sigc::ptr_fun(batchProcessingThread), job, bpl, tunnelMetaData, numThreads), 0, true, true, Glib::THREAD_PRIORITY_NORMAL);
 #else
-        Glib::Thread::create(sigc::bind(sigc::ptr_fun(batchProcessingThread), job, bpl, tunnelMetaData), 0, true, true, Glib::THREAD_PRIORITY_LOW);
+        Glib::Thread::create(sigc::bind(sigc::ptr_fun(batchProcessingThread), job, bpl, tunnelMetaData, numThreads), 0, true, true, Glib::THREAD_PRIORITY_LOW);
 #endif
     
 }
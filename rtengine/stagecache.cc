@@ -0,0 +1,68 @@
+/*
+ *  This file is part of RawTherapee.
+ *
+ *  RawTherapee is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  RawTherapee is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with RawTherapee.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "stagecache.h"
+#include <cstdio>
+
+namespace rtengine {
+
+StageKey stageKey (const Glib::ustring& ppText, const char* const* groups, bool include, unsigned int seed, const StageKey* previous) {
+
+    StageKey key;
+    if (previous)
+        key.text = previous->text;
+    char seedText[16];
+    sprintf (seedText, "%u\n", seed);
+    key.text += seedText;
+
+    const std::string& text = ppText.raw();
+    bool selected = false;
+
+    size_t pos = 0;
+    while (pos < text.size()) {
+        size_t end = text.find ('\n', pos);
+        if (end == std::string::npos)
+            end = text.size();
+
+        if (text[pos] == '[') {
+            // group header: [Group Name]
+            size_t close = text.find (']', pos);
+            std::string group = text.substr (pos + 1, (close < end ? close : end) - pos - 1);
+            bool listed = false;
+            for (int i = 0; groups[i]; i++)
+                if (group == groups[i]) {
+                    listed = true;
+                    break;
+                }
+            selected = (listed == include);
+        }
+
+        if (selected)
+            key.text.append (text, pos, (end < text.size() ? end + 1 : end) - pos);
+
+        pos = end + 1;
+    }
+
+    // 64 bits FNV-1a hash of the kept text
+    key.hash = 14695981039346656037ull;
+    for (size_t i = 0; i < key.text.size(); i++) {
+        key.hash ^= (unsigned char)key.text[i];
+        key.hash *= 1099511628211ull;
+    }
+    return key;
+}
+
+}
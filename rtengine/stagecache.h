@@ -0,0 +1,116 @@
+/*
+ *  This file is part of RawTherapee.
+ *
+ *  RawTherapee is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  RawTherapee is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with RawTherapee.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef _STAGECACHE_H_
+#define _STAGECACHE_H_
+
+#include <glibmm.h>
+#include <list>
+#include <vector>
+#include <string>
+
+namespace rtengine {
+
+/** @brief Key of a stage of the processing pipeline
+  *
+  * The hash only speeds up the lookups: the text it is computed from is compared as well, so that two different
+  * parameter sets with the same hash can't share a result. */
+struct StageKey {
+    unsigned long long hash;
+    std::string text;
+
+    StageKey () : hash(0) {}
+    bool operator== (const StageKey& k) const { return hash == k.hash && text == k.text; }
+};
+
+/** @brief Computes the key of a stage of the processing pipeline
+  *
+  * The key holds the pp3 groups the stage depends on, as returned by ProcParams::toString, and their 64 bits hash.
+  * @param ppText the processing parameters in the pp3 format
+  * @param groups NULL terminated list of group names
+  * @param include if true, only the listed groups are kept, otherwise all groups but the listed ones are kept
+  * @param seed any other input of the stage that is not part of the parameters
+  * @param previous key of the previous stage, or NULL
+  * @return the key of the stage */
+StageKey stageKey (const Glib::ustring& ppText, const char* const* groups, bool include, unsigned int seed, const StageKey* previous = NULL);
+
+/** @brief Keeps the last results of a stage of the preview pipeline
+  *
+  * The results are stored with the key of the parameters they have been computed with, so going back in the history,
+  * undoing or toggling a tool finds the result already computed instead of running the stage again. Besides the image,
+  * an entry stores the scalar values computed by the stage (e.g. the auto denoise or auto B&W values) so they can be restored too.
+  * The cache keeps at most maxSize entries, the least recently used one is dropped first.
+  */
+template<class T>
+class StageCache {
+
+    private:
+        struct Entry {
+            StageKey key;
+            T* image;
+            std::vector<float> values;
+        };
+        std::list<Entry> entries;   // most recently used first
+
+    public:
+        ~StageCache () { clear (); }
+
+        /** @brief Looks for the result of the given key
+          * @param key key of the stage
+          * @param values receives the scalar values stored with the image
+          * @return the cached image, which remains owned by the cache, or NULL */
+        T* get (const StageKey& key, std::vector<float>& values) {
+            for (typename std::list<Entry>::iterator i = entries.begin(); i != entries.end(); ++i)
+                if (i->key == key) {
+                    entries.splice (entries.begin(), entries, i);
+                    values = i->values;
+                    return i->image;
+                }
+            return NULL;
+        }
+
+        /** @brief Stores a result, the cache takes ownership of the image
+          * @param key key of the stage
+          * @param image copy of the result of the stage
+          * @param values scalar values computed by the stage
+          * @param maxSize maximum number of entries; if 0, the image is deleted and the cache emptied */
+        void put (const StageKey& key, T* image, const std::vector<float>& values, int maxSize) {
+            for (typename std::list<Entry>::iterator i = entries.begin(); i != entries.end(); ++i)
+                if (i->key == key) {
+                    delete i->image;
+                    entries.erase (i);
+                    break;
+                }
+            Entry e;
+            e.key = key;
+            e.image = image;
+            e.values = values;
+            entries.push_front (e);
+            while (!entries.empty() && (int)entries.size() > maxSize) {
+                delete entries.back().image;
+                entries.pop_back ();
+            }
+        }
+
+        void clear () {
+            for (typename std::list<Entry>::iterator i = entries.begin(); i != entries.end(); ++i)
+                delete i->image;
+            entries.clear ();
+        }
+};
+
+}
+#endif
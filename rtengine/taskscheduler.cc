@@ -0,0 +1,257 @@
+/*
+ *  This file is part of RawTherapee.
+ *
+ *  RawTherapee is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  RawTherapee is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with RawTherapee.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "taskscheduler.h"
+#include "settings.h"
+#include "rt_math.h"
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+namespace rtengine {
+
+extern const Settings* settings;
+
+TaskGroup::TaskGroup (TaskPriority priority, int maxConcurrency)
+    : priority(priority), maxConcurrency(max(maxConcurrency, 0)), running(0), pending(0) {
+}
+
+TaskGroup::~TaskGroup () {
+
+    wait ();
+}
+
+void TaskGroup::run (const sigc::slot<void>& task) {
+
+    TaskScheduler& scheduler = TaskScheduler::getInstance ();
+    TaskScheduler::Task t;
+    t.group = this;
+    t.slot = task;
+
+    MyMutex::MyLock lock(scheduler.mutex);
+    scheduler.queues[priority].push_back (t);
+    pending++;
+    scheduler.changed.broadcast ();
+}
+
+void TaskGroup::wait () {
+
+    TaskScheduler& scheduler = TaskScheduler::getInstance ();
+
+    MyMutex::MyLock lock(scheduler.mutex);
+    while (pending > 0) {
+        TaskScheduler::Task task;
+        if (scheduler.takeTask (task, this, false))
+            scheduler.execute (task, lock);
+        else
+            scheduler.changed.wait (lock);
+    }
+}
+
+int TaskGroup::cancel () {
+
+    TaskScheduler& scheduler = TaskScheduler::getInstance ();
+    int removed = 0;
+
+    MyMutex::MyLock lock(scheduler.mutex);
+    std::deque<TaskScheduler::Task>& queue = scheduler.queues[priority];
+    for (std::deque<TaskScheduler::Task>::iterator it = queue.begin(); it != queue.end();)
+        if (it->group == this) {
+            it = queue.erase (it);
+            removed++;
+        }
+        else
+            it++;
+    pending -= removed;
+    scheduler.changed.broadcast ();
+
+    return removed;
+}
+
+void TaskGroup::setPriority (TaskPriority newPriority) {
+
+    TaskScheduler& scheduler = TaskScheduler::getInstance ();
+
+    MyMutex::MyLock lock(scheduler.mutex);
+    if (newPriority == priority)
+        return;
+    // the queued tasks move to the queue of the new priority, in their order
+    std::deque<TaskScheduler::Task>& from = scheduler.queues[priority];
+    std::deque<TaskScheduler::Task>& to = scheduler.queues[newPriority];
+    for (std::deque<TaskScheduler::Task>::iterator it = from.begin(); it != from.end();)
+        if (it->group == this) {
+            to.push_back (*it);
+            it = from.erase (it);
+        }
+        else
+            it++;
+    priority = newPriority;
+    scheduler.changed.broadcast ();
+}
+
+int TaskGroup::getPending () {
+
+    TaskScheduler& scheduler = TaskScheduler::getInstance ();
+
+    MyMutex::MyLock lock(scheduler.mutex);
+    return pending;
+}
+
+TaskScheduler::TaskScheduler ()
+    : busyWorkers(0), busyBackground(0), tasksRun(0), busyTime(0) {
+
+    numWorkers = settings ? settings->schedulerThreads : 0;
+    if (numWorkers <= 0) {
+#ifdef _OPENMP
+        numWorkers = omp_get_num_procs ();
+#else
+        numWorkers = 2;
+#endif
+    }
+    for (int i = 0; i < TASK_PRIORITIES; i++)
+        ungrouped[i] = new TaskGroup ((TaskPriority)i);
+
+    startTime = g_get_monotonic_time ();
+    for (int i = 0; i < numWorkers; i++)
+        Glib::Thread::create (sigc::mem_fun(*this, &TaskScheduler::workerThread), false);
+}
+
+TaskScheduler& TaskScheduler::getInstance () {
+
+    // never deleted, the workers run until the end of the process
+    static TaskScheduler* instance = new TaskScheduler ();
+    return *instance;
+}
+
+bool TaskScheduler::takeTask (Task& task, const TaskGroup* group, bool worker) {
+
+    for (int p = 0; p < TASK_PRIORITIES; p++) {
+        if (group && group->priority != p)
+            continue;
+        // the last free worker waits for the interactive and normal tasks
+        if (worker && p == TASK_BACKGROUND && numWorkers > 1 && busyBackground >= numWorkers - 1)
+            continue;
+        for (std::deque<Task>::iterator it = queues[p].begin(); it != queues[p].end(); it++) {
+            const TaskGroup* g = it->group;
+            if ((group && g != group) || (g->maxConcurrency && g->running >= g->maxConcurrency))
+                continue;
+            task = *it;
+            queues[p].erase (it);
+            return true;
+        }
+    }
+    return false;
+}
+
+void TaskScheduler::execute (Task& task, MyMutex::MyLock& lock) {
+
+    TaskGroup* group = task.group;
+    group->running++;
+    lock.release ();
+
+    task.slot ();
+
+    lock.acquire ();
+    group->running--;
+    group->pending--;   // the group may be deleted by its owner from here on
+    tasksRun++;
+    changed.broadcast ();
+}
+
+void TaskScheduler::workerThread () {
+
+    MyMutex::MyLock lock(mutex);
+    while (true) {
+        Task task;
+        if (!takeTask (task, NULL, true)) {
+            changed.wait (lock);
+            continue;
+        }
+        const bool background = task.group->priority == TASK_BACKGROUND;
+        busyWorkers++;
+        if (background)
+            busyBackground++;
+        const gint64 start = g_get_monotonic_time ();
+
+        execute (task, lock);
+
+        busyTime += g_get_monotonic_time () - start;
+        busyWorkers--;
+        if (background)
+            busyBackground--;
+    }
+}
+
+void TaskScheduler::run (const sigc::slot<void>& task, TaskPriority priority) {
+
+    ungrouped[priority]->run (task);
+}
+
+struct ParallelForRange {
+    volatile gint next;
+    int end;
+    int grain;
+    const sigc::slot<void, int, int>* body;
+};
+
+static void parallelForTask (ParallelForRange* range) {
+
+    while (true) {
+        const int first = g_atomic_int_add (&range->next, range->grain);
+        if (first >= range->end)
+            return;
+        (*range->body) (first, min(first + range->grain, range->end));
+    }
+}
+
+void TaskScheduler::parallelFor (int begin, int end, int grain, const sigc::slot<void, int, int>& body, TaskPriority priority) {
+
+    if (end <= begin)
+        return;
+    grain = max(grain, 1);
+
+    ParallelForRange range;
+    range.next = begin;
+    range.end = end;
+    range.grain = grain;
+    range.body = &body;
+
+    // the calling thread takes ranges too, the tasks of the workers that didn't start in time find none left
+    const int ranges = (end - begin - 1) / grain + 1;
+    TaskGroup group (priority);
+    for (int i = 1; i < min(ranges, numWorkers + 1); i++)
+        group.run (sigc::bind(sigc::ptr_fun(&parallelForTask), &range));
+    parallelForTask (&range);
+    group.wait ();
+}
+
+TaskSchedulerMetrics TaskScheduler::getMetrics () {
+
+    TaskSchedulerMetrics metrics;
+
+    MyMutex::MyLock lock(mutex);
+    metrics.workers = numWorkers;
+    metrics.busyWorkers = busyWorkers;
+    for (int p = 0; p < TASK_PRIORITIES; p++)
+        metrics.queued[p] = queues[p].size();
+    metrics.tasksRun = tasksRun;
+    const gint64 lifetime = (g_get_monotonic_time () - startTime) * numWorkers;
+    metrics.utilisation = lifetime > 0 ? (double)busyTime / lifetime : 0.;
+
+    return metrics;
+}
+
+}
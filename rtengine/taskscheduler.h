@@ -0,0 +1,132 @@
+/*
+ *  This file is part of RawTherapee.
+ *
+ *  RawTherapee is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  RawTherapee is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with RawTherapee.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef _TASKSCHEDULER_H_
+#define _TASKSCHEDULER_H_
+
+#include <glibmm.h>
+#include <deque>
+#include "../rtgui/threadutils.h"
+
+namespace rtengine {
+
+/** @brief Priority of the tasks, a free worker takes the queued task of the highest priority first */
+enum TaskPriority {
+    TASK_INTERACTIVE,   // what the user is waiting for: the preview and the detail windows
+    TASK_NORMAL,
+    TASK_BACKGROUND,    // the thumbnails, never given the last free worker
+    TASK_PRIORITIES
+};
+
+/** @brief Tasks of one kind, sharing a priority and a limit of concurrency
+  *
+  * wait() doesn't sleep while tasks of the group are still queued: the calling thread runs them itself, so that a
+  * group waited for from a task completes even when all the workers are busy. */
+class TaskGroup {
+
+    friend class TaskScheduler;
+
+    TaskPriority priority;
+    int maxConcurrency; // 0 = no limit but the number of workers
+    int running;        // tasks of the group being run
+    int pending;        // tasks of the group queued or being run
+
+    TaskGroup (const TaskGroup&);
+    TaskGroup& operator= (const TaskGroup&);
+
+  public:
+    /** @param maxConcurrency maximum number of tasks of the group run at the same time, 0 for no limit */
+    explicit TaskGroup (TaskPriority priority = TASK_NORMAL, int maxConcurrency = 0);
+    /** @brief Waits for the end of the tasks of the group */
+    ~TaskGroup ();
+
+    /** @brief Queues task, to be run by a worker */
+    void run (const sigc::slot<void>& task);
+
+    /** @brief Returns once all the tasks queued have been run */
+    void wait ();
+
+    /** @brief Removes the tasks not started yet
+      * @return number of tasks removed */
+    int cancel ();
+
+    /** @brief Changes the priority of the group, its tasks already queued included */
+    void setPriority (TaskPriority priority);
+
+    /** @brief Number of tasks queued or being run */
+    int getPending ();
+};
+
+/** @brief Activity of the task scheduler */
+struct TaskSchedulerMetrics {
+    int workers;
+    int busyWorkers;                    // workers running a task now
+    int queued[TASK_PRIORITIES];        // tasks waiting for a worker, per priority
+    unsigned long long tasksRun;        // tasks run since the start, by the workers and by the threads waiting for them
+    double utilisation;                 // time spent by the workers running tasks / their lifetime, 0..1
+};
+
+/** @brief Worker threads shared by the engine and the GUI
+  *
+  * The tasks of the whole process are queued here instead of each component starting its own threads, so that the
+  * cores aren't oversubscribed and the interactive work goes first. There are Settings::schedulerThreads workers, one
+  * per core by default. The scheduler is created on first use and lives until the end of the process. */
+class TaskScheduler {
+
+    friend class TaskGroup;
+
+    struct Task {
+        TaskGroup* group;
+        sigc::slot<void> slot;
+    };
+
+    std::deque<Task> queues[TASK_PRIORITIES];
+    TaskGroup* ungrouped[TASK_PRIORITIES];  // groups of the tasks queued by run
+    int numWorkers;
+    int busyWorkers;
+    int busyBackground;     // workers running a background task
+    unsigned long long tasksRun;
+    gint64 busyTime;        // time spent by the workers running tasks, in microseconds
+    gint64 startTime;
+    MyMutex mutex;          // protects the members above and the members of the groups
+    MyCond  changed;        // broadcast when a task is queued or finished
+
+    TaskScheduler ();
+    void workerThread ();
+    // the mutex is locked when these are called, execute releases it while the task runs
+    bool takeTask (Task& task, const TaskGroup* group, bool worker);
+    void execute (Task& task, MyMutex::MyLock& lock);
+
+  public:
+    static TaskScheduler& getInstance ();
+
+    /** @brief Queues task out of any group */
+    void run (const sigc::slot<void>& task, TaskPriority priority = TASK_NORMAL);
+
+    /** @brief Calls body(first, last) on consecutive ranges of at most grain indices covering [begin, end)
+      *
+      * The ranges are taken one after the other by the free workers and the calling thread, which returns when all
+      * of them are done. It replaces "#pragma omp parallel for schedule(dynamic,grain)" in the loops moved to the
+      * scheduler. */
+    void parallelFor (int begin, int end, int grain, const sigc::slot<void, int, int>& body, TaskPriority priority = TASK_INTERACTIVE);
+
+    int getNumWorkers () const { return numWorkers; }
+
+    TaskSchedulerMetrics getMetrics ();
+};
+
+}
+#endif
@@ -0,0 +1,129 @@
+/*
+ *  This file is part of RawTherapee.
+ *
+ *  RawTherapee is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  RawTherapee is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with RawTherapee.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "tileplan.h"
+#include "improcfun.h"
+#include "settings.h"
+#include "rt_math.h"
+#include <cstdio>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+#ifdef WIN32
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
+
+namespace rtengine {
+
+extern const Settings* settings;
+
+size_t tileMemoryBudget () {
+
+    if (settings->tileMemoryBudget > 0)
+        return (size_t)settings->tileMemoryBudget << 20;
+
+    unsigned long long physical = 0;
+#ifdef WIN32
+    MEMORYSTATUSEX status;
+    status.dwLength = sizeof (status);
+    if (GlobalMemoryStatusEx (&status))
+        physical = status.ullTotalPhys;
+#else
+    long pages = sysconf (_SC_PHYS_PAGES);
+    long pageSize = sysconf (_SC_PAGE_SIZE);
+    if (pages > 0 && pageSize > 0)
+        physical = (unsigned long long)pages * pageSize;
+#endif
+    if (physical == 0)
+        physical = 4096ull << 20;   // unknown, assume 4 GB
+
+    unsigned long long budget = physical / 2;
+    // a 32 bits process can't address much more anyway
+    if (sizeof(size_t) < 8 && budget > (1024ull << 20))
+        budget = 1024ull << 20;
+    return (size_t)budget;
+}
+
+TilePlan planTiles (const char* name, int imwidth, int imheight, size_t bytesPerPixel, int minTilesize, int maxTilesize,
+                    float overlapRatio, bool fullImage, int maxThreads, size_t budget) {
+
+#ifdef _OPENMP
+    int threads = omp_get_max_threads();
+#else
+    int threads = 1;
+#endif
+    if (maxThreads > 0 && maxThreads < threads)
+        threads = maxThreads;
+    if (minTilesize > maxTilesize)
+        minTilesize = maxTilesize;
+
+    if (budget == 0)
+        budget = tileMemoryBudget ();
+    TilePlan plan;
+    bool found = false;
+
+    if (fullImage && bytesPerPixel * imwidth * imheight <= budget) {
+        plan.tilesize = max(imwidth, imheight);
+        plan.overlap = (int)(maxTilesize * overlapRatio);
+        ImProcFunctions::Tile_calc (plan.tilesize, plan.overlap, 0, imwidth, imheight, plan.numtiles_W, plan.numtiles_H,
+                                    plan.tilewidth, plan.tileheight, plan.tileWskip, plan.tileHskip);
+        plan.numthreads = 1;
+        found = true;
+    } else {
+        double bestCost = 0.0;
+        bool fits = false;
+        for (int tilesize = maxTilesize; tilesize >= minTilesize && !fits; tilesize -= 128) {
+            TilePlan p;
+            p.tilesize = tilesize;
+            p.overlap = (int)(tilesize * overlapRatio);
+            ImProcFunctions::Tile_calc (p.tilesize, p.overlap, 2, imwidth, imheight, p.numtiles_W, p.numtiles_H,
+                                        p.tilewidth, p.tileheight, p.tileWskip, p.tileHskip);
+            const int numtiles = p.numtiles_W * p.numtiles_H;
+            const size_t tileBytes = bytesPerPixel * p.tilewidth * p.tileheight;
+
+            // the largest size running on all the threads within the budget is kept: smaller tiles wouldn't save memory,
+            // they would only make the result depend on the number of threads
+            int concurrent = min(numtiles, threads);
+            if (tileBytes > 0 && (size_t)concurrent * tileBytes > budget)
+                concurrent = max((int)(budget / tileBytes), 1);
+            else
+                fits = true;
+
+            // the tiles are processed in passes of 'concurrent' tiles, each pass taking the time of one tile
+            const int passes = (numtiles + concurrent - 1) / concurrent;
+            const double cost = (double)passes * p.tilewidth * p.tileheight;
+            if (!found || fits || cost < bestCost) {
+                p.numthreads = concurrent;
+                plan = p;
+                bestCost = cost;
+                found = true;
+            }
+        }
+    }
+
+    plan.nestedLevels = max(threads / plan.numthreads, 1);
+
+    if (settings->verbose)
+        printf ("%s: %d x %d tile(s) of %d x %d, %d tile(s) at a time with %d thread(s) each, %d MB per tile out of a %d MB budget\n",
+                name, plan.numtiles_W, plan.numtiles_H, plan.tilewidth, plan.tileheight, plan.numthreads, plan.nestedLevels,
+                (int)((bytesPerPixel * plan.tilewidth * plan.tileheight) >> 20), (int)(budget >> 20));
+
+    return plan;
+}
+
+}
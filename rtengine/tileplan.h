@@ -0,0 +1,62 @@
+/*
+ *  This file is part of RawTherapee.
+ *
+ *  RawTherapee is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  RawTherapee is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with RawTherapee.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef _TILEPLAN_H_
+#define _TILEPLAN_H_
+
+#include <cstddef>
+
+namespace rtengine {
+
+/** @brief Tile layout and threads of a tiled processing stage (denoise, wavelet) */
+struct TilePlan {
+    int tilesize;
+    int overlap;
+    int numtiles_W, numtiles_H;
+    int tilewidth, tileheight;
+    int tileWskip, tileHskip;
+    int numthreads;     ///< number of tiles processed at the same time
+    int nestedLevels;   ///< number of threads working on each of these tiles
+};
+
+/** @brief Memory available to the tiled stages, in bytes
+  *
+  * Given by Settings::tileMemoryBudget, or half of the physical memory if it is 0. */
+size_t tileMemoryBudget ();
+
+/** @brief Chooses the tile size and the number of threads of a tiled stage
+  *
+  * maxTilesize is used as long as min(tiles, threads) tile working sets fit in the memory budget. Otherwise the smaller
+  * sizes down to minTilesize are tried by steps of 128 pixels: the first one fitting in the budget this way is kept, or
+  * if none does, the one needing the least passes over the fewest pixels (overlaps included), the number of tiles
+  * processed at the same time being limited by the budget. The threads not used by the tiles are given to each tile as
+  * nested threads.
+  * @param name name of the stage, used in the verbose output
+  * @param imwidth width of the image
+  * @param imheight height of the image
+  * @param bytesPerPixel estimation of the memory used to process one pixel of a tile
+  * @param minTilesize smallest tile size allowed
+  * @param maxTilesize largest tile size allowed
+  * @param overlapRatio overlap between two tiles, relative to the tile size
+  * @param fullImage if true and if its working set fits in the budget, the image is processed as a single tile
+  * @param maxThreads maximum number of threads used, 0 = no limit
+  * @param budget memory available to the stage in bytes, 0 = tileMemoryBudget()
+  * @return the plan of the stage */
+TilePlan planTiles (const char* name, int imwidth, int imheight, size_t bytesPerPixel, int minTilesize, int maxTilesize,
+                    float overlapRatio, bool fullImage, int maxThreads, size_t budget = 0);
+
+}
+#endif
@@ -28,6 +28,7 @@
 #include "../rtgui/cacheimagedata.h"
 #include "rtexif.h"
 #include "../rtengine/safegtk.h"
+#include "../rtengine/myfile.h"
 #include "../rtgui/version.h"
 #include "../rtgui/ppversion.h"
 
@@ -44,13 +45,13 @@ Interpreter stdInterpreter;
 #define TAG_SUBFILETYPE 0x00fe
 
 TagDirectory::TagDirectory () 
-  : attribs(ifdAttribs), order(HOSTORDER), parent(NULL) {}
+  : attribs(ifdAttribs), order(HOSTORDER), parent(NULL), makerNoteSource(NULL), pendingMakerNotes(0) {}
 
 TagDirectory::TagDirectory (TagDirectory* p, const TagAttrib* ta, ByteOrder border) 
-    : attribs(ta), order(border), parent(p) {}
+    : attribs(ta), order(border), parent(p), makerNoteSource(NULL), pendingMakerNotes(0) {}
 
-TagDirectory::TagDirectory (TagDirectory* p, FILE* f, int base, const TagAttrib* ta, ByteOrder border, bool skipIgnored)
-  : attribs(ta), order(border), parent(p)
+TagDirectory::TagDirectory (TagDirectory* p, IMFILE* f, int base, const TagAttrib* ta, ByteOrder border, bool skipIgnored, bool deferMakerNotes)
+  : attribs(ta), order(border), parent(p), makerNoteSource(deferMakerNotes && !p ? f : NULL), pendingMakerNotes(0)
 {
 
   int numOfTags = get2 (f, order);
@@ -83,6 +84,8 @@ TagDirectory::TagDirectory (TagDirectory* p, FILE* f, int base, const TagAttrib*
         addTag (newTag);
     } else addTag (newTag);
   }  
+  if (!parent && !pendingMakerNotes)
+    makerNoteSource = NULL;  // no makernote to decode later, the file isn't needed anymore
 }
  
 TagDirectory::~TagDirectory () {
@@ -112,6 +115,18 @@ TagDirectory*  TagDirectory::getRoot()
     else return this;
 }
 
+void TagDirectory::parseDeferredMakerNotes () {
+
+    // a deferred makernote is not a directory yet: getDirectory decodes it, then its content is walked as well
+    for (size_t i=0; i<tags.size(); i++) {
+        if (tags[i]->hasDeferredMakerNote())
+            tags[i]->getDirectory ();
+        if (tags[i]->isDirectory())
+            for (int j=0; tags[i]->getDirectory(j); j++)
+                tags[i]->getDirectory(j)->parseDeferredMakerNotes ();
+    }
+}
+
 const TagAttrib* TagDirectory::getAttrib (int id) {
 
     if (attribs)
@@ -579,7 +594,7 @@ TagDirectoryTable::TagDirectoryTable (TagDirectory* p, unsigned char *v,int mems
     }
 }
 
-TagDirectoryTable::TagDirectoryTable (TagDirectory* p, FILE* f, int memsize,int offs, TagType type, const TagAttrib* ta, ByteOrder border)
+TagDirectoryTable::TagDirectoryTable (TagDirectory* p, IMFILE* f, int memsize,int offs, TagType type, const TagAttrib* ta, ByteOrder border)
 :TagDirectory(p,ta,border),zeroOffset(offs),valuesSize(memsize),defaultType( type )
 {
     values = new unsigned char[valuesSize];
@@ -621,8 +636,21 @@ int TagDirectoryTable::write (int start, unsigned char* buffer) {
 // this class represents a tag stored in the directory
 //-----------------------------------------------------------------------------
 
-Tag::Tag (TagDirectory* p, FILE* f, int base) 
-  : type(INVALID), count(0), value(NULL), allocOwnMemory(true), attrib(NULL), parent(p), directory(NULL) {
+// has to be kept in sync with the brands handled by Tag::parseMakerNote
+static bool hasMakerNoteParser (const std::string &make, const std::string &model)
+{
+    return make.find( "NIKON" ) != std::string::npos
+        || make.find( "Canon" ) != std::string::npos
+        || make.find( "PENTAX" ) != std::string::npos
+        || (make.find( "RICOH" ) != std::string::npos && model.find("PENTAX") != std::string::npos)
+        || make.find( "FUJIFILM" ) != std::string::npos
+        || make.find( "KONICA MINOLTA" ) != std::string::npos || make.find( "Minolta" ) != std::string::npos
+        || make.find( "SONY" ) != std::string::npos
+        || make.find( "OLYMPUS" ) != std::string::npos;
+}
+
+Tag::Tag (TagDirectory* p, IMFILE* f, int base) 
+  : type(INVALID), count(0), value(NULL), allocOwnMemory(true), attrib(NULL), parent(p), directory(NULL), makerNoteDeferred(false) {
 
     ByteOrder order = getOrder();
 
@@ -695,7 +723,22 @@ Tag::Tag (TagDirectory* p, FILE* f, int base)
     }
     // if this tag is the makernote, it needs special treatment (brand specific parsing)
     if (tag==0x927C && attrib && !strcmp (attrib->name, "MakerNote") ) {
-        if( !parseMakerNote(f,base,order )){
+        if (parent->getRoot()->getMakerNoteSource()) {
+            // only remember where the makernote is, it will be decoded on first access
+            Tag* tmake = parent->getRoot()->findTag("Make");
+            Tag* tmodel = parent->getRoot()->findTag("Model");
+            if (!hasMakerNoteParser (tmake ? tmake->valueToString() : "", tmodel ? tmodel->valueToString() : "")) {
+                type = INVALID;
+                fseek (f, save, SEEK_SET);
+                return;
+            }
+            makerNoteDeferred = true;
+            parent->getRoot()->addPendingMakerNote ();
+            makerNoteBase = base;
+            makerNotePos = ftell (f);
+            makerNoteOrder = order;
+        }
+        else if( !parseMakerNote(f,base,order )){
             type = INVALID;
             fseek (f, save, SEEK_SET);
             return;
@@ -910,7 +953,21 @@ defsubdirs:
 
 }
 
-bool Tag::parseMakerNote(FILE* f, int base, ByteOrder bom )
+void Tag::parseDeferredMakerNote ()
+{
+    makerNoteDeferred = false;
+    TagDirectory* root = parent->getRoot();
+    IMFILE* f = root->getMakerNoteSource();
+    if (!f)
+        return;
+    int save = ftell (f);
+    fseek (f, makerNotePos, SEEK_SET);
+    parseMakerNote (f, makerNoteBase, makerNoteOrder);
+    fseek (f, save, SEEK_SET);
+    root->pendingMakerNoteDecoded ();  // resets the source of the tree after the last one
+}
+
+bool Tag::parseMakerNote(IMFILE* f, int base, ByteOrder bom )
 {
     value = NULL;
     Tag* tmake = parent->getRoot()->findTag("Make");
@@ -1018,6 +1075,9 @@ bool Tag::parseMakerNote(FILE* f, int base, ByteOrder bom )
 
 Tag* Tag::clone (TagDirectory* parent) {
 
+    if (makerNoteDeferred)
+        parseDeferredMakerNote ();
+
     Tag* t = new Tag (parent, attrib);
     
     t->tag = tag;
@@ -1176,6 +1236,9 @@ void Tag::toRational (int& num, int& denom, int ofs) {
 
 void Tag::toString (char* buffer, int ofs) {
 
+  if (makerNoteDeferred)
+      parseDeferredMakerNote ();
+
   if (type==UNDEFINED && !directory) {
       bool isstring = true;
       int i=0;
@@ -1256,6 +1319,9 @@ void Tag::valueFromString (const std::string& value) {
 
 int Tag::calculateSize () {
     int size = 0;
+
+    if (makerNoteDeferred)
+        parseDeferredMakerNote ();
     
     if (directory) {
         int j;
@@ -1282,6 +1348,9 @@ int Tag::write (int offs, int dataOffs, unsigned char* buffer) {
   if ((int)type==0 || offs>65500)
     return dataOffs;
 
+  if (makerNoteDeferred)
+    parseDeferredMakerNote ();
+
   sset2 (tag, buffer+offs, parent->getOrder());
   offs += 2;
   unsigned short typ = type;
@@ -1348,23 +1417,23 @@ int Tag::write (int offs, int dataOffs, unsigned char* buffer) {
 }
 
 Tag::Tag (TagDirectory* p, const TagAttrib* attr)
- : tag(attr ? attr->ID : -1), type(INVALID), count(0), value(NULL), valuesize(0), keep(true), allocOwnMemory(true), attrib(attr), parent(p), directory(NULL), makerNoteKind (NOMK) {
+ : tag(attr ? attr->ID : -1), type(INVALID), count(0), value(NULL), valuesize(0), keep(true), allocOwnMemory(true), attrib(attr), parent(p), directory(NULL), makerNoteKind (NOMK), makerNoteDeferred(false) {
 }
 
 Tag::Tag (TagDirectory* p, const TagAttrib* attr, int data, TagType t) 
- : tag(attr ? attr->ID : -1), type(t), count(1), value(NULL), valuesize(0), keep(true), allocOwnMemory(true), attrib(attr), parent(p), directory(NULL), makerNoteKind (NOMK) {
+ : tag(attr ? attr->ID : -1), type(t), count(1), value(NULL), valuesize(0), keep(true), allocOwnMemory(true), attrib(attr), parent(p), directory(NULL), makerNoteKind (NOMK), makerNoteDeferred(false) {
 
     initInt (data, t);
 }
 
 Tag::Tag (TagDirectory* p, const TagAttrib* attr, unsigned char *data, TagType t)
- : tag(attr ? attr->ID : -1), type(t), count(1), value(NULL), valuesize(0), keep(true), allocOwnMemory(false), attrib(attr), parent(p), directory(NULL), makerNoteKind (NOMK) {
+ : tag(attr ? attr->ID : -1), type(t), count(1), value(NULL), valuesize(0), keep(true), allocOwnMemory(false), attrib(attr), parent(p), directory(NULL), makerNoteKind (NOMK), makerNoteDeferred(false) {
 
     initType (data, t);
 }
 
 Tag::Tag (TagDirectory* p, const TagAttrib* attr, const char* text) 
- : tag(attr ? attr->ID : -1), type(ASCII), count(1), value(NULL), valuesize(0), keep(true), allocOwnMemory(true), attrib(attr), parent(p), directory(NULL), makerNoteKind (NOMK) {
+ : tag(attr ? attr->ID : -1), type(ASCII), count(1), value(NULL), valuesize(0), keep(true), allocOwnMemory(true), attrib(attr), parent(p), directory(NULL), makerNoteKind (NOMK), makerNoteDeferred(false) {
 
     initString (text);
 }
@@ -1478,7 +1547,7 @@ const TagAttrib* lookupAttrib (const TagAttrib* dir, const char* field) {
 }
 
 
-TagDirectory* ExifManager::parseCIFF (FILE* f, int base, int length) {
+TagDirectory* ExifManager::parseCIFF (IMFILE* f, int base, int length) {
 
     TagDirectory* root = new TagDirectory (NULL, ifdAttribs, INTEL);
     Tag* exif = new Tag (root, lookupAttrib(ifdAttribs,"Exif"));
@@ -1492,7 +1561,7 @@ TagDirectory* ExifManager::parseCIFF (FILE* f, int base, int length) {
     return root;
 }
 
-Tag* ExifManager::saveCIFFMNTag (FILE* f, TagDirectory* root, int len, const char* name) {
+Tag* ExifManager::saveCIFFMNTag (IMFILE* f, TagDirectory* root, int len, const char* name) {
     int s = ftell (f);
     char* data = new char [len];
     fread (data, len, 1, f);
@@ -1504,7 +1573,7 @@ Tag* ExifManager::saveCIFFMNTag (FILE* f, TagDirectory* root, int len, const cha
     return cs;
 }
 
-void ExifManager::parseCIFF (FILE* f, int base, int length, TagDirectory* root) {
+void ExifManager::parseCIFF (IMFILE* f, int base, int length, TagDirectory* root) {
 
   char buffer[1024];
   Tag* t;
@@ -1955,7 +2024,7 @@ parse_leafdata(TagDirectory* root, ByteOrder order) {
     }
 }
 
-TagDirectory* ExifManager::parse (FILE* f, int base, bool skipIgnored) {
+TagDirectory* ExifManager::parse (IMFILE* f, int base, bool skipIgnored, bool deferMakerNotes) {
   setlocale(LC_NUMERIC, "C"); // to set decimal point in sscanf
   // read tiff header
   fseek (f, base, SEEK_SET);
@@ -1969,7 +2038,7 @@ TagDirectory* ExifManager::parse (FILE* f, int base, bool skipIgnored) {
   fseek (f, base+firstifd, SEEK_SET);
 
   // first read the IFD directory
-  TagDirectory* root =  new TagDirectory (NULL, f, base, ifdAttribs, order, skipIgnored);
+  TagDirectory* root =  new TagDirectory (NULL, f, base, ifdAttribs, order, skipIgnored, deferMakerNotes);
 
   // fix ISO issue with nikon and panasonic cameras
   Tag* make = root->getTag ("Make");
@@ -2149,7 +2218,7 @@ TagDirectory* ExifManager::parse (FILE* f, int base, bool skipIgnored) {
   return root;
 }
 
-TagDirectory* ExifManager::parseJPEG (FILE* f) {
+TagDirectory* ExifManager::parseJPEG (IMFILE* f, bool deferMakerNotes) {
 
   fseek (f, 0, SEEK_SET);
   unsigned char markerl = 0xff;
@@ -2165,16 +2234,16 @@ TagDirectory* ExifManager::parseJPEG (FILE* f) {
         return NULL;
       if (!memcmp(idbuff+2, exifid, 6)) {     // Exif info found
         tiffbase = ftell (f);        
-        return parse (f, tiffbase);
+        return parse (f, tiffbase, true, deferMakerNotes);
       }
     }
   }
   return NULL;
 }
 
-TagDirectory* ExifManager::parseTIFF (FILE* f, bool skipIgnored) {
+TagDirectory* ExifManager::parseTIFF (IMFILE* f, bool skipIgnored, bool deferMakerNotes) {
 
-  return parse (f, 0, skipIgnored);
+  return parse (f, 0, skipIgnored, deferMakerNotes);
 }
 
 std::vector<Tag*> ExifManager::defTags; 
@@ -2330,14 +2399,14 @@ int sget4 (unsigned char *s, rtexif::ByteOrder order) {
   else                  return s[0] << 24 | s[1] << 16 | s[2] << 8 | s[3];
 }
 
-inline unsigned short get2 (FILE* f, rtexif::ByteOrder order) {
+inline unsigned short get2 (IMFILE* f, rtexif::ByteOrder order) {
 
   unsigned char str[2] = { 0xff,0xff };
   fread (str, 1, 2, f);
   return rtexif::sget2 (str, order);
 }
 
-int get4 (FILE* f, rtexif::ByteOrder order) {
+int get4 (IMFILE* f, rtexif::ByteOrder order) {
 
   unsigned char str[4] = { 0xff,0xff,0xff,0xff };
   fread (str, 1, 4, f);
@@ -31,6 +31,7 @@
 #include "../rtengine/safekeyfile.h"
 
 class CacheImageData;
+struct IMFILE;
 
 namespace rtexif {
 
@@ -55,8 +56,8 @@ bool extractLensInfo(std::string &fullname,double &minFocal, double &maxFocal, d
 
 unsigned short sget2 (unsigned char *s, ByteOrder order);
 int sget4 (unsigned char *s, ByteOrder order);
-inline unsigned short get2 (FILE* f, ByteOrder order);
-inline int get4 (FILE* f, ByteOrder order);
+inline unsigned short get2 (IMFILE* f, ByteOrder order);
+inline int get4 (IMFILE* f, ByteOrder order);
 inline void sset2 (unsigned short v, unsigned char *s, ByteOrder order);
 inline void sset4 (int v, unsigned char *s, ByteOrder order);
 inline float int_to_float (int i);
@@ -99,17 +100,23 @@ class TagDirectory {
     const TagAttrib*  attribs;  // descriptor table to decode the tags
     ByteOrder         order;    // byte order
     TagDirectory*     parent;   // parent directory (NULL if root)
+    IMFILE*           makerNoteSource; // file the deferred makernotes are read from (root only, NULL once none is pending)
+    int               pendingMakerNotes; // number of makernotes of the tree not decoded yet (root only)
     static Glib::ustring getDumpKey (int tagID, const Glib::ustring tagName);
 
   public:
     TagDirectory ();
-    TagDirectory (TagDirectory* p, FILE* f, int base, const TagAttrib* ta, ByteOrder border, bool skipIgnored=true);
+    TagDirectory (TagDirectory* p, IMFILE* f, int base, const TagAttrib* ta, ByteOrder border, bool skipIgnored=true, bool deferMakerNotes=false);
     TagDirectory (TagDirectory* p, const TagAttrib* ta, ByteOrder border);
     virtual ~TagDirectory ();
    
     inline ByteOrder getOrder      () const { return order; }   
     TagDirectory*    getParent     () { return parent; }
     TagDirectory*    getRoot       ();
+    IMFILE*          getMakerNoteSource () { return makerNoteSource; }
+    void             parseDeferredMakerNotes ();  // decode all the deferred makernotes of the tree; the source file can be closed afterward
+    void             addPendingMakerNote ()     { pendingMakerNotes++; }
+    void             pendingMakerNoteDecoded () { if (--pendingMakerNotes<=0) makerNoteSource = NULL; }
     inline int       getCount      () const { return tags.size (); }
     const TagAttrib* getAttrib     (int id);
     const TagAttrib* getAttrib     (const char* name);  // Find a Tag by scanning the whole tag tree and stopping at the first occurrence
@@ -149,7 +156,7 @@ class TagDirectoryTable: public TagDirectory {
    public:
 	TagDirectoryTable();
 	TagDirectoryTable (TagDirectory* p, unsigned char *v,int memsize,int offs, TagType type, const TagAttrib* ta, ByteOrder border);
-	TagDirectoryTable (TagDirectory* p, FILE* f, int memsize,int offset, TagType type, const TagAttrib* ta, ByteOrder border);
+	TagDirectoryTable (TagDirectory* p, IMFILE* f, int memsize,int offset, TagType type, const TagAttrib* ta, ByteOrder border);
 	virtual ~TagDirectoryTable();
 	virtual int calculateSize ();
 	virtual int write (int start, unsigned char* buffer);
@@ -172,10 +179,15 @@ class Tag {
     TagDirectory*    parent;
     TagDirectory**   directory;
     MNKind           makerNoteKind;
-    bool             parseMakerNote(FILE* f, int base, ByteOrder bom );
+    bool             makerNoteDeferred;  // true if the makernote has not been decoded yet
+    int              makerNoteBase;      // base and file position of the deferred makernote
+    int              makerNotePos;
+    ByteOrder        makerNoteOrder;
+    bool             parseMakerNote(IMFILE* f, int base, ByteOrder bom );
+    void             parseDeferredMakerNote ();
 
   public:
-    Tag (TagDirectory* parent, FILE* f, int base);                          // parse next tag from the file
+    Tag (TagDirectory* parent, IMFILE* f, int base);                        // parse next tag from the file
     Tag (TagDirectory* parent, const TagAttrib* attr);
     Tag (TagDirectory* parent, const TagAttrib* attr, unsigned char *data, TagType t);
     Tag (TagDirectory* parent, const TagAttrib* attr, int data, TagType t);  // create a new tag from array (used
@@ -229,23 +241,29 @@ class Tag {
     void setKeep (bool k) { keep = k; }   
    
     // get subdirectory (there can be several, the last is NULL)
+    // a deferred makernote is not a directory until getDirectory has decoded it, so that walking the tree doesn't read it
     bool           isDirectory  ()        { return directory!=NULL; }
-    TagDirectory*  getDirectory (int i=0) { return (directory) ? directory[i] : 0; }
+    TagDirectory*  getDirectory (int i=0) { if (makerNoteDeferred) parseDeferredMakerNote (); return (directory) ? directory[i] : 0; }
+    bool           hasDeferredMakerNote () const { return makerNoteDeferred; }
 
-    MNKind getMakerNoteFormat () { return makerNoteKind; }
+    MNKind getMakerNoteFormat () { if (makerNoteDeferred) parseDeferredMakerNote (); return makerNoteKind; }
  };
 
 class ExifManager {
 
     static std::vector<Tag*> defTags;
   
-    static Tag* saveCIFFMNTag (FILE* f, TagDirectory* root, int len, const char* name);
+    static Tag* saveCIFFMNTag (IMFILE* f, TagDirectory* root, int len, const char* name);
   public:
-    static TagDirectory* parse (FILE*f, int base, bool skipIgnored=true);
-    static TagDirectory* parseJPEG (FILE*f);
-    static TagDirectory* parseTIFF (FILE*f, bool skipIgnored=true);
-    static TagDirectory* parseCIFF (FILE* f, int base, int length);
-    static void          parseCIFF (FILE* f, int base, int length, TagDirectory* root);
+    /** Parse the Exif structure starting at "base". If deferMakerNotes is true, the makernote is only decoded when
+      * its directory is explicitly requested with Tag::getDirectory; lookups like findTag don't enter it before.
+      * "f" then has to stay open until getMakerNoteSource() of the returned tree is NULL or the tree has been deleted.
+      * The decoding reads "f": the caller has to serialize it with any other use of the file. */
+    static TagDirectory* parse (IMFILE*f, int base, bool skipIgnored=true, bool deferMakerNotes=false);
+    static TagDirectory* parseJPEG (IMFILE*f, bool deferMakerNotes=false);
+    static TagDirectory* parseTIFF (IMFILE*f, bool skipIgnored=true, bool deferMakerNotes=false);
+    static TagDirectory* parseCIFF (IMFILE* f, int base, int length);
+    static void          parseCIFF (IMFILE* f, int base, int length, TagDirectory* root);
     
     static const std::vector<Tag*>& getDefaultTIFFTags (TagDirectory* forthis);
     static int    createJPEGMarker (const TagDirectory* root, const rtengine::procparams::ExifPairs& changeList, int W, int H, unsigned char* buffer);
@@ -32,12 +32,41 @@
 #include "batchqueuebuttonset.h"
 #include "guiutils.h"
 #include "../rtengine/safegtk.h"
+#include "../rtengine/tileplan.h"
 #include "rtimage.h"
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 
 using namespace std;
 using namespace rtengine;
 
-BatchQueue::BatchQueue (FileCatalog* aFileCatalog) : processing(NULL), fileCatalog(aFileCatalog), sequence(0), listener(NULL)  {
+rtengine::ProcessingJob* BatchQueueWorker::imageReady (rtengine::IImage16* img) {
+
+    rtengine::ProcessingJob* job = queue->imageReady (this, img);
+    if (!job)
+        delete this;    // the thread ends, the engine won't call its listener anymore
+    return job;
+}
+
+void BatchQueueWorker::error (Glib::ustring msg) {
+
+    queue->error (this, msg);
+    delete this;        // the thread ends after an error
+}
+
+void BatchQueueWorker::setProgress (double p) {
+
+    queue->setProgress (this, p);
+}
+
+void BatchQueueWorker::getResources (int& numThreads, size_t& memoryBudget) {
+
+    queue->getResources (this, numThreads, memoryBudget);
+}
+
+BatchQueue::BatchQueue (FileCatalog* aFileCatalog) : fileCatalog(aFileCatalog), sequence(0), memoryInUse(0),
+                                                     staleLines(0), listener(NULL)  {
 
     location = THLOC_BATCHQUEUE;
 
@@ -203,15 +232,41 @@ void BatchQueue::addEntries ( std::vector<BatchQueueEntry*> &entries, bool head,
 	}
 	}
 
-	if (save)
-		saveBatchQueue( );
+	if (save) {
+		// entries added at the head change the order of the saved queue
+		if (head)
+			saveBatchQueue( );
+		else
+			appendToBatchQueue (entries);
+	}
 
     redraw();
     notifyListener (false);
 }
 
+static void writeBatchQueueHeader (FILE* f)
+{
+    // The column's header is mandatory (the first line will be skipped when loaded)
+    fprintf(f,"input image full path|param file full path|output image full path|file format|jpeg quality|jpeg subsampling|"
+              "png bit depth|png compression|tiff bit depth|uncompressed tiff|save output params|force format options|<end of line>\n");
+}
+
+static void writeBatchQueueEntry (FILE* f, BatchQueueEntry* bqe)
+{
+    // Warning: for code's simplicity in loadBatchQueue, each field must end by the '|' character, safer than ';' or ',' since it can't be used in paths
+    fprintf(f,"%s|%s|%s|%s|%d|%d|%d|%d|%d|%d|%d|%d|\n",
+        bqe->filename.c_str(),bqe->savedParamsFile.c_str(), bqe->outFileName.c_str(), bqe->saveFormat.format.c_str(),
+        bqe->saveFormat.jpegQuality, bqe->saveFormat.jpegSubSamp,
+        bqe->saveFormat.pngBits, bqe->saveFormat.pngCompression,
+        bqe->saveFormat.tiffBits, bqe->saveFormat.tiffUncompressed,
+        bqe->saveFormat.saveParams, bqe->forceFormatOpts
+    );
+}
+
 bool BatchQueue::saveBatchQueue( )
 {
+    MyMutex::MyLock fileLock(queueFileMutex);
+
     Glib::ustring savedQueueFile;
     savedQueueFile = options.rtdir+"/batch/queue.csv";
     FILE *f = safe_g_fopen (savedQueueFile, "wt");
@@ -226,36 +281,69 @@ bool BatchQueue::saveBatchQueue( )
     #endif
 
     if (fd.size())
-        // The column's header is mandatory (the first line will be skipped when loaded)
-        fprintf(f,"input image full path|param file full path|output image full path|file format|jpeg quality|jpeg subsampling|"
-                  "png bit depth|png compression|tiff bit depth|uncompressed tiff|save output params|force format options|<end of line>\n");
+        writeBatchQueueHeader (f);
 
     // method is already running with entryLock, so no need to lock again
-    for (std::vector<ThumbBrowserEntryBase*>::iterator pos=fd.begin(); pos!=fd.end(); pos++){
-        BatchQueueEntry* bqe = reinterpret_cast<BatchQueueEntry*>(*pos);
-        // Warning: for code's simplicity in loadBatchQueue, each field must end by the '|' character, safer than ';' or ',' since it can't be used in paths
-        fprintf(f,"%s|%s|%s|%s|%d|%d|%d|%d|%d|%d|%d|%d|\n",
-            bqe->filename.c_str(),bqe->savedParamsFile.c_str(), bqe->outFileName.c_str(), bqe->saveFormat.format.c_str(),
-            bqe->saveFormat.jpegQuality, bqe->saveFormat.jpegSubSamp,
-            bqe->saveFormat.pngBits, bqe->saveFormat.pngCompression,
-            bqe->saveFormat.tiffBits, bqe->saveFormat.tiffUncompressed,
-            bqe->saveFormat.saveParams, bqe->forceFormatOpts
-        );
-    }
+    for (std::vector<ThumbBrowserEntryBase*>::iterator pos=fd.begin(); pos!=fd.end(); pos++)
+        writeBatchQueueEntry (f, static_cast<BatchQueueEntry*>(*pos));
     }
     fclose (f);
+    staleLines = 0;
     return true;
 }
 
+// Adds the entries at the end of the saved queue, without rewriting it
+bool BatchQueue::appendToBatchQueue (const std::vector<BatchQueueEntry*> &entries)
+{
+    MyMutex::MyLock fileLock(queueFileMutex);
+
+    Glib::ustring savedQueueFile;
+    savedQueueFile = options.rtdir+"/batch/queue.csv";
+    FILE *f = safe_g_fopen (savedQueueFile, "at");
+
+    if (f==NULL)
+        return false;
+
+    fseek (f, 0, SEEK_END);
+    if (ftell (f) == 0)
+        writeBatchQueueHeader (f);
+    for (size_t i=0; i<entries.size(); i++)
+        writeBatchQueueEntry (f, entries[i]);
+    fclose (f);
+    return true;
+}
+
+// The saved queue keeps the lines of the entries processed or cancelled, their parameter file being removed; it is
+// rewritten once they outnumber the entries left
+void BatchQueue::entriesLeftQueue (int count)
+{
+    size_t queueSize;
+    {
+        #if PROTECT_VECTORS
+        MYREADERLOCK(l, entryRW);
+        #endif
+        queueSize = fd.size();
+    }
+
+    bool rewrite;
+    {
+        MyMutex::MyLock fileLock(queueFileMutex);
+        staleLines += count;
+        rewrite = staleLines > 100 && (size_t)staleLines > queueSize;
+    }
+    if (rewrite)
+        saveBatchQueue( );
+}
+
 bool BatchQueue::loadBatchQueue( )
 {
     Glib::ustring savedQueueFile;
     savedQueueFile = options.rtdir+"/batch/queue.csv";
     FILE *f = safe_g_fopen (savedQueueFile, "rt");
+    unsigned numLines=0, numLoaded=0;
 
     if (f!=NULL) {
         char *buffer = new char[1024];
-        unsigned numLoaded=0;
         // skipping the first line
         bool firstLine=true;
 
@@ -274,6 +362,7 @@ bool BatchQueue::loadBatchQueue( )
                 firstLine=false;
                 continue;
             }
+            numLines++;
 
             size_t pos;
             Glib::ustring source;
@@ -419,6 +508,12 @@ bool BatchQueue::loadBatchQueue( )
         fclose(f);
     }
 
+    {
+        // the entries processed or cancelled are still in the file, see entriesLeftQueue
+        MyMutex::MyLock fileLock(queueFileMutex);
+        staleLines = numLines - numLoaded;
+    }
+
     redraw();
     notifyListener(false);
 
@@ -450,6 +545,7 @@ int cancelItemUI (void* data)
 }
 
 void BatchQueue::cancelItems (std::vector<ThumbBrowserEntryBase*>* items) {
+    int cancelled = 0;
     {
         // TODO: Check for Linux
         #if PROTECT_VECTORS
@@ -467,6 +563,7 @@ void BatchQueue::cancelItems (std::vector<ThumbBrowserEntryBase*>* items) {
                 if (entry->thumbnail)
                     entry->thumbnail->imageRemovedFromQueue ();
                 g_idle_add (cancelItemUI, entry);
+                cancelled++;
             }
         }
         for (size_t i=0; i<fd.size(); i++)
@@ -475,7 +572,7 @@ void BatchQueue::cancelItems (std::vector<ThumbBrowserEntryBase*>* items) {
         selected.clear ();
     }
 
-    saveBatchQueue( );
+    entriesLeftQueue (cancelled);
 
     redraw ();
     notifyListener (false);
@@ -573,45 +670,163 @@ void BatchQueue::openItemInEditor(ThumbBrowserEntryBase* item) {
 }
 
 
-void BatchQueue::startProcessing () {
+int BatchQueue::maxJobs () {
+
+    if (options.batchQueueJobs > 0)
+        return options.batchQueueJobs;
+
+#ifdef _OPENMP
+    int procs = omp_get_num_procs();
+#else
+    int procs = 1;
+#endif
+    // the loading and the saving of the images being mostly single threaded, a few images processed at the same time
+    // keep the cores busy
+    return rtengine::LIM(procs/4, 1, 4);
+}
+
+// Gives the first entry not being processed to the worker, if the memory its processing needs is available or if force
+// is true. entryRW and workerMutex have to be locked.
+bool BatchQueue::takeNextEntry (BatchQueueWorker* worker, bool force) {
+
+    BatchQueueEntry* next = NULL;
+    for (size_t i=0; i<fd.size() && !next; i++)
+        if (!fd[i]->processing)
+            next = static_cast<BatchQueueEntry*>(fd[i]);
+    if (!next)
+        return false;
 
-    if (!processing) {
+    int w = 0, h = 0;
+    if (next->thumbnail)
+        next->thumbnail->getFinalSize (next->params, w, h);
+    if (w <= 0 || h <= 0) {
+        // size unknown, assume a 24 Mpixels image
+        w = 6000;
+        h = 4000;
+    }
+    size_t memory = rtengine::estimateProcessingMemory (w, h, next->thumbnail && next->thumbnail->getType() == FT_Raw, next->params);
+    if (!force && memoryInUse + memory > rtengine::tileMemoryBudget ())
+        return false;
+
+    // tag it as processing and set sequence
+    next->processing = true;
+    next->sequence = ++sequence;
+    // remove from selection
+    if (next->selected) {
+        std::vector<ThumbBrowserEntryBase*>::iterator pos = std::find (selected.begin(), selected.end(), next);
+        if (pos!=selected.end())
+            selected.erase (pos);
+        next->selected = false;
+    }
+
+    worker->entry = next;
+    worker->memory = memory;
+    memoryInUse += memory;
+    return true;
+}
+
+// Shares the threads and the memory budget of the tiled stages between the running workers: each one gets the same
+// number of threads, and a part of the budget proportional to the memory its entry needs. The running jobs take their
+// new share between their processing steps. workerMutex has to be locked.
+void BatchQueue::shareResources () {
+
+    if (workers.empty())
+        return;
+
+#ifdef _OPENMP
+    int procs = omp_get_num_procs();
+#else
+    int procs = 1;
+#endif
+    const int n = workers.size();
+    const size_t budget = rtengine::tileMemoryBudget ();
+
+    for (int i=0; i<n; i++) {
+        workers[i]->threads = std::max(procs / n + (i < procs % n ? 1 : 0), 1);
+        if (n == 1 || memoryInUse == 0)
+            workers[i]->memoryBudget = budget / n;
+        else
+            workers[i]->memoryBudget = (size_t)((double)budget * workers[i]->memory / memoryInUse);
+    }
+}
+
+// Removes a worker whose thread ends and gives its threads and memory to the other ones. workerMutex has to be locked.
+void BatchQueue::workerEnded (BatchQueueWorker* worker) {
+
+    std::vector<BatchQueueWorker*>::iterator pos = std::find (workers.begin(), workers.end(), worker);
+    if (pos != workers.end())
+        workers.erase (pos);
+    shareResources ();
+}
+
+void BatchQueue::getResources (BatchQueueWorker* worker, int& numThreads, size_t& memoryBudget) {
+
+    MyMutex::MyLock lock(workerMutex);
+    numThreads = worker->threads;
+    memoryBudget = worker->memoryBudget;
+}
+
+// Starts workers on the next entries, as long as the number of jobs and the memory allow it. The threads and the
+// memory are then shared again between all the running workers.
+void BatchQueue::startWorkers (bool fromWorker) {
+
+    std::vector<BatchQueueWorker*> started;
+    {
         // TODO: Check for Linux
         #if PROTECT_VECTORS
         MYWRITERLOCK(l, entryRW);
         #endif
-
-        if (!fd.empty()) {
-            BatchQueueEntry* next;
-
-            next = static_cast<BatchQueueEntry*>(fd[0]);
-            // tag it as processing and set sequence
-            next->processing = true;
-            next->sequence = sequence = 1;
-            processing = next;
-            // remove from selection
-            if (processing->selected) {
-                std::vector<ThumbBrowserEntryBase*>::iterator pos = std::find (selected.begin(), selected.end(), processing);
-                if (pos!=selected.end())
-                    selected.erase (pos);
-                processing->selected = false;
+        MyMutex::MyLock lock(workerMutex);
+
+        if (workers.empty())
+            sequence = 0;
+
+        const int jobs = maxJobs ();
+        while ((int)workers.size() < jobs) {
+            BatchQueueWorker* worker = new BatchQueueWorker (this);
+            // one image is always processed, even if it seems too large for the memory
+            if (!takeNextEntry (worker, workers.empty())) {
+                delete worker;
+                break;
             }
+            workers.push_back (worker);
+            started.push_back (worker);
+        }
 
-            #if PROTECT_VECTORS
-            MYWRITERLOCK_RELEASE(l);
-            #endif
+        if (!started.empty())
+            shareResources ();
+    }
 
-            // remove button set
-            next->removeButtonSet ();
+    for (size_t i=0; i<started.size(); i++) {
+        // remove button set
+        if (fromWorker) {
+            // ButtonSet have Cairo::Surface which might be rendered while we're trying to delete them
+            GThreadLock lock;
+            started[i]->entry->removeButtonSet ();
+        }
+        else
+            started[i]->entry->removeButtonSet ();
+
+        // start batch processing
+        rtengine::startBatchProcessing (started[i]->entry->job, started[i], options.tunnelMetaData, started[i]->threads);
+    }
 
-            // start batch processing
-            rtengine::startBatchProcessing (next->job, this, options.tunnelMetaData);
+    if (!started.empty()) {
+        if (fromWorker)
+            redraw ();
+        else
             queue_draw ();
-        }
     }
 }
 
-rtengine::ProcessingJob* BatchQueue::imageReady (rtengine::IImage16* img) {
+void BatchQueue::startProcessing () {
+
+    startWorkers (false);
+}
+
+rtengine::ProcessingJob* BatchQueue::imageReady (BatchQueueWorker* worker, rtengine::IImage16* img) {
+
+    BatchQueueEntry* processing = worker->entry;
 
     // save image img
     Glib::ustring fname;
@@ -643,6 +858,12 @@ rtengine::ProcessingJob* BatchQueue::imageReady (rtengine::IImage16* img) {
             err = img->saveAsJPEG (fname, saveFormat.jpegQuality, saveFormat.jpegSubSamp);
         img->free ();
 
+        {
+            // the file is written, the other workers see it now
+            MyMutex::MyLock lock(workerMutex);
+            outputNames.erase (fname);
+        }
+
 		if (err)
 			throw Glib::FileError(Glib::FileError::FAILED, M("MAIN_MSG_CANNOTSAVE")+"\n"+fname);
 
@@ -658,6 +879,10 @@ rtengine::ProcessingJob* BatchQueue::imageReady (rtengine::IImage16* img) {
             processing->thumbnail->imageRemovedFromQueue ();
         }
     }
+    else if (fname!="") {
+        MyMutex::MyLock lock(workerMutex);
+        outputNames.erase (fname);
+    }
     // save temporary params file name: delete as last thing
     Glib::ustring processedParams = processing->savedParamsFile;
     
@@ -670,41 +895,46 @@ rtengine::ProcessingJob* BatchQueue::imageReady (rtengine::IImage16* img) {
         #if PROTECT_VECTORS
         MYWRITERLOCK(l, entryRW);
         #endif
-        
+
+        std::vector<ThumbBrowserEntryBase*>::iterator pos = std::find (fd.begin(), fd.end(), processing);
+        if (pos!=fd.end())
+            fd.erase (pos);
         delete processing;
-        processing = NULL;
 
-        fd.erase (fd.begin());
+        MyMutex::MyLock lock(workerMutex);
+        memoryInUse -= worker->memory;
+        worker->entry = NULL;
+        worker->memory = 0;
 
-        // return next job
+        // return next job, the worker going on with its threads as long as the memory allows it
         if (fd.empty()) {
             queueEmptied=true;
         }
-        else if (listener && listener->canStartNext ()) {
-            BatchQueueEntry* next = static_cast<BatchQueueEntry*>(fd[0]);
-            // tag it as selected and set sequence
-            next->processing = true;
-            next->sequence = ++sequence;
-            processing = next;
-            // remove from selection
-            if (processing->selected) {
-                std::vector<ThumbBrowserEntryBase*>::iterator pos = std::find (selected.begin(), selected.end(), processing);
-                if (pos!=selected.end())
-                    selected.erase (pos);
-                processing->selected = false;
-            }
+        else if (listener && listener->canStartNext () && takeNextEntry (worker, workers.size() == 1)) {
             // remove button set
             remove_button_set = true;
         }
+
+        if (!worker->entry) {
+            // the thread of the worker ends
+            workerEnded (worker);
+        }
+        else {
+            // the new entry needs another amount of memory
+            shareResources ();
+        }
     }
 	if (remove_button_set) {
 		// ButtonSet have Cairo::Surface which might be rendered while we're trying to delete them
         GThreadLock lock;
-        processing->removeButtonSet ();
+        worker->entry->removeButtonSet ();
 	}
-    if (saveBatchQueue( )) {
-        safe_g_remove( processedParams );
+
+    // the entry is skipped when loading the saved queue once its parameters are removed, the file doesn't need to be rewritten
+    safe_g_remove( processedParams );
+    if (queueEmptied) {
         // Delete all files in directory \batch when finished, just to be sure to remove zombies
+        MyMutex::MyLock fileLock(queueFileMutex);
 
         // Not sure that locking is necessary, but it should be safer
         // TODO: Check for Linux
@@ -721,13 +951,21 @@ rtengine::ProcessingJob* BatchQueue::imageReady (rtengine::IImage16* img) {
             safe_build_file_list (dir, names, batchdir);
             for(std::vector<Glib::ustring>::iterator iter=names.begin(); iter != names.end();iter++ )
                 safe_g_remove( *iter );
+            staleLines = 0;
         }
     }
+    else {
+        entriesLeftQueue (1);
+
+        // the memory freed may let other entries start
+        if (listener && listener->canStartNext ())
+            startWorkers (true);
+    }
 
     redraw ();
     notifyListener (queueEmptied);
 
-    return processing ? processing->job : NULL;
+    return worker->entry ? worker->entry->job : NULL;
 }
 
 // Calculates automatic filename of processed batch entry, but just the base name
@@ -850,15 +1088,19 @@ Glib::ustring BatchQueue::autoCompleteFileName (const Glib::ustring& fileName, c
 	// if that's not possible (e.g. locked by viewer, R/O), we revert to the standard naming scheme
 	bool inOverwriteMode=options.overwriteOutputFile;
 
+	// the name is reserved until the image is written, so that the other workers don't choose it too
+	MyMutex::MyLock lock(workerMutex);
+
     for (int tries=0; tries<100; tries++) {
         if (tries==0)
             fname = Glib::ustring::compose ("%1.%2", Glib::build_filename (dstdir,  dstfname), format);
         else
             fname = Glib::ustring::compose ("%1-%2.%3", Glib::build_filename (dstdir,  dstfname), tries, format);
 
-		int fileExists=safe_file_test (fname, Glib::FILE_TEST_EXISTS); 
+		bool reserved = outputNames.count (fname);
+		int fileExists = reserved || safe_file_test (fname, Glib::FILE_TEST_EXISTS);
         
-		if (inOverwriteMode && fileExists) {
+		if (inOverwriteMode && fileExists && !reserved) {
 			if (safe_g_remove(fname) == -1)
 				inOverwriteMode = false;  // failed to delete- revert to old naming scheme
 			else
@@ -866,6 +1108,7 @@ Glib::ustring BatchQueue::autoCompleteFileName (const Glib::ustring& fileName, c
 		}
 		
 		if (!fileExists) {
+            outputNames.insert (fname);
             return fname;
         }
     }
@@ -877,10 +1120,10 @@ int setProgressUI (void* p) {
     return 0;
 }
 
-void BatchQueue::setProgress (double p) {
+void BatchQueue::setProgress (BatchQueueWorker* worker, double p) {
 
-    if (processing)
-        processing->progress = p;
+    if (worker->entry)
+        worker->entry->progress = p;
 
     // No need to acquire the GUI, setProgressUI will do it
     g_idle_add (setProgressUI, this);
@@ -938,8 +1181,9 @@ void BatchQueue::redrawNeeded (LWButton* button) {
     queue_draw ();
 }
 
-void BatchQueue::error (Glib::ustring msg) {
+void BatchQueue::error (BatchQueueWorker* worker, Glib::ustring msg) {
 
+    BatchQueueEntry* processing = worker->entry;
     if (processing && processing->processing) {
         // restore failed thumb
         BatchQueueButtonSet* bqbs = new BatchQueueButtonSet (processing);
@@ -947,9 +1191,16 @@ void BatchQueue::error (Glib::ustring msg) {
         processing->addButtonSet (bqbs);
         processing->processing = false;
         processing->job = rtengine::ProcessingJob::create(processing->filename, processing->thumbnail->getType() == FT_Raw, processing->params);
-        processing = NULL;
         redraw ();
     }
+    {
+        // the thread of the worker ends
+        MyMutex::MyLock lock(workerMutex);
+        memoryInUse -= worker->memory;
+        worker->entry = NULL;
+        worker->memory = 0;
+        workerEnded (worker);
+    }
     if (listener) {
         NLParams* params = new NLParams;
         params->listener = listener;
@@ -19,6 +19,7 @@
 #define _BATCHQUEUE_
 
 #include <gtkmm.h>
+#include <set>
 #include "threadutils.h"
 #include "batchqueueentry.h"
 #include "../rtengine/rtengine.h"
@@ -34,9 +35,31 @@ class BatchQueueListener {
         virtual bool canStartNext         () =0;
 };
 
+class BatchQueue;
+
+/** @brief One of the threads processing the batch queue
+  *
+  * Each batch processing thread of the engine has its own listener, which forwards the calls to the queue along with
+  * the entry being processed. The worker deletes itself when its thread ends. */
+class BatchQueueWorker : public rtengine::BatchProcessingListener {
+
+  public:
+    BatchQueue* queue;
+    BatchQueueEntry* entry;  // entry being processed
+    size_t memory;           // estimated memory needed by the processing of the entry, in bytes
+    int threads;             // number of threads of the processing
+    size_t memoryBudget;     // share of the memory budget given to the tiled stages of the processing, in bytes
+
+    explicit BatchQueueWorker (BatchQueue* q) : queue(q), entry(NULL), memory(0), threads(1), memoryBudget(0) {}
+
+    rtengine::ProcessingJob* imageReady (rtengine::IImage16* img);
+    void error (Glib::ustring msg);
+    void setProgress (double p);
+    void getResources (int& numThreads, size_t& memoryBudget);
+};
+
 class FileCatalog;
 class BatchQueue  : public ThumbBrowserBase, 
-                    public rtengine::BatchProcessingListener, 
                     public LWButtonListener {  
 
   protected:
@@ -44,10 +67,20 @@ class BatchQueue  : public ThumbBrowserBase,
     void saveThumbnailHeight (int height);
     int  getThumbnailHeight ();
 
-    BatchQueueEntry* processing;  // holds the currently processed image
     FileCatalog* fileCatalog;
     int sequence; // holds the current sequence index
 
+    // the entries are processed by several workers at the same time, as long as the threads and the memory allow it
+    MyMutex workerMutex;
+    std::vector<BatchQueueWorker*> workers;  // running workers
+    size_t memoryInUse;     // estimated memory used by the running workers, in bytes
+    std::set<Glib::ustring> outputNames;  // output files being written by the workers
+
+    // the saved queue is only appended to, the processed and cancelled entries being skipped when it is loaded; it is
+    // rewritten when the entries are reordered, or when there are more such entries in it than entries left
+    MyMutex queueFileMutex;
+    int staleLines;         // lines of the saved queue whose entry has left the queue
+
     Glib::ustring nameTemplate;
     
     Gtk::ImageMenuItem* cancel;
@@ -64,8 +97,16 @@ class BatchQueue  : public ThumbBrowserBase,
     Glib::ustring autoCompleteFileName (const Glib::ustring& fileName, const Glib::ustring& format);
     Glib::ustring getTempFilenameForParams( const Glib::ustring filename );
     bool saveBatchQueue( );
+    bool appendToBatchQueue (const std::vector<BatchQueueEntry*> &entries);
+    void entriesLeftQueue (int count);
     void notifyListener (bool queueEmptied);
 
+    int  maxJobs ();
+    bool takeNextEntry (BatchQueueWorker* worker, bool force);
+    void startWorkers (bool fromWorker);
+    void shareResources ();
+    void workerEnded (BatchQueueWorker* worker);
+
   public:
     BatchQueue (FileCatalog* aFileCatalog);
     ~BatchQueue ();
@@ -89,9 +130,10 @@ class BatchQueue  : public ThumbBrowserBase,
         return (!fd.empty());
     }
 
-    rtengine::ProcessingJob* imageReady (rtengine::IImage16* img);
-    void error (Glib::ustring msg);
-    void setProgress (double p);
+    rtengine::ProcessingJob* imageReady (BatchQueueWorker* worker, rtengine::IImage16* img);
+    void error (BatchQueueWorker* worker, Glib::ustring msg);
+    void setProgress (BatchQueueWorker* worker, double p);
+    void getResources (BatchQueueWorker* worker, int& numThreads, size_t& memoryBudget);
     void rightClicked (ThumbBrowserEntryBase* entry);
     void doubleClicked (ThumbBrowserEntryBase* entry);
     bool keyPressed (GdkEventKey* event);
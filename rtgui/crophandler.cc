@@ -24,6 +24,7 @@
 #include "cropwindow.h"
 #include "../rtengine/dcrop.h"
 #include "../rtengine/refreshmap.h"
+#include "../rtengine/taskscheduler.h"
 
 using namespace rtengine;
 
@@ -32,6 +33,9 @@ CropHandler::CropHandler ()
     cropX(0), cropY(0), cropW(0), cropH(0), enabled(false),
     cropimg(NULL), cropimgtrue(NULL), ipc(NULL), crop(NULL), listener(NULL), isLowUpdatePriority(false) {
 
+    // one update of crop at a time: tryUpdate merges the requests coming meanwhile
+    updateTasks = new rtengine::TaskGroup (rtengine::TASK_INTERACTIVE, 1);
+
     chi = new CropHandlerIdleHelper;
     chi->destroyed = false;
     chi->pending = 0;
@@ -44,6 +48,10 @@ CropHandler::~CropHandler () {
         ipc->delSizeListener (this);
 
     setEnabled (false);
+    // the queued updates would run on a deleted crop
+    updateTasks->cancel ();
+    updateTasks->wait ();
+    delete updateTasks;
     if (crop) {
         //crop->destroy ();
         delete crop; // will do the same than destroy, plus delete the object
@@ -61,6 +69,15 @@ void CropHandler::setEditSubscriber (EditSubscriber* newSubscriber) {
     (static_cast<rtengine::Crop *>(crop))->setEditSubscriber(newSubscriber);
 }
 
+void CropHandler::setLowUpdatePriority (bool low) {
+
+    if (low == isLowUpdatePriority)
+        return;
+    isLowUpdatePriority = low;
+    // the update already queued, if any, follows the new priority
+    updateTasks->setPriority (low ? rtengine::TASK_NORMAL : rtengine::TASK_INTERACTIVE);
+}
+
 void CropHandler::newImage (StagedImageProcessor* ipc_, bool isDetailWindow) {
 
     ipc = ipc_;
@@ -315,10 +332,7 @@ void CropHandler::update () {
 
 		// To save threads, try to mark "needUpdate" without a thread first
 		if (crop->tryUpdate()) {
-			if (isLowUpdatePriority)
-                Glib::Thread::create(sigc::mem_fun(*crop, &DetailedCrop::fullUpdate), 0, false, true, Glib::THREAD_PRIORITY_LOW);
-			else
-				Glib::Thread::create(sigc::mem_fun(*crop, &DetailedCrop::fullUpdate), false );
+			updateTasks->run (sigc::mem_fun(*crop, &DetailedCrop::fullUpdate));
 		}
     }
 }
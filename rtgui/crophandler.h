@@ -24,6 +24,10 @@
 #include "edit.h"
 #include <gtkmm.h>
 
+namespace rtengine {
+    class TaskGroup;
+}
+
 class CropHandlerListener {
 
     public:
@@ -58,6 +62,7 @@ class CropHandler : public rtengine::DetailedCropListener, public rtengine::Size
 
         rtengine::StagedImageProcessor* ipc;
         rtengine::DetailedCrop* crop;
+        rtengine::TaskGroup* updateTasks;   // the fullUpdate calls of crop queued on the task scheduler
 
         CropHandlerListener* listener;
         CropHandlerIdleHelper* chi;
@@ -81,6 +86,7 @@ class CropHandler : public rtengine::DetailedCropListener, public rtengine::Size
 
         void    setCropHandlerListener (CropHandlerListener* l) { listener = l; }
         void    setEditSubscriber      (EditSubscriber* newSubscriber);
+        void    setLowUpdatePriority   (bool low);
 
         void    newImage    (rtengine::StagedImageProcessor* ipc_, bool isDetailWindow);
         void    setZoom     (int z, int centerx=-1, int centery=-1);
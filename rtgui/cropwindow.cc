@@ -105,6 +105,7 @@ CropWindow::CropWindow (ImageArea* parent, rtengine::StagedImageProcessor* ipc_,
     minWidth = bsw + iw + 2*sideBorderWidth;
 
     cropHandler.setCropHandlerListener (this);
+    cropHandler.setLowUpdatePriority (isLowUpdatePriority);
     cropHandler.newImage (ipc_, isDetailWindow);
 
     state = SNormal;
@@ -1607,6 +1607,36 @@ void FileBrowser::selectImage (Glib::ustring fname) {
     }
 }
 
+std::vector<Thumbnail*> FileBrowser::getNeighbours (const Glib::ustring& fname, int distance) {
+
+    #if PROTECT_VECTORS
+    MYREADERLOCK(l, entryRW);
+    #endif
+
+    std::vector<Thumbnail*> next, prev, neighbours;
+
+    for (size_t i=0; i<fd.size(); i++) {
+        if (fd[i]->filename == fname) {
+            for (size_t k=i+1; k<fd.size() && (int)next.size()<distance; k++)
+                if (!fd[k]->filtered)
+                    next.push_back ((static_cast<FileBrowserEntry*>(fd[k]))->thumbnail);
+            for (ssize_t k=(ssize_t)i-1; k>=0 && (int)prev.size()<distance; k--)
+                if (!fd[k]->filtered)
+                    prev.push_back ((static_cast<FileBrowserEntry*>(fd[k]))->thumbnail);
+            break;
+        }
+    }
+
+    // the next image is the most likely to be opened
+    for (size_t i=0; i<next.size() || i<prev.size(); i++) {
+        if (i<next.size())
+            neighbours.push_back (next[i]);
+        if (i<prev.size())
+            neighbours.push_back (prev[i]);
+    }
+    return neighbours;
+}
+
 void FileBrowser::openNextPreviousEditorImage (Glib::ustring fname, eRTNav nextPrevious) {
 
     // let FileBrowser acquire Editor's perspective
@@ -171,6 +171,8 @@ class FileBrowser  : public ThumbBrowserBase,
 
     void openNextImage ();
     void openPrevImage ();
+    // thumbnails of the images not filtered out around fname, up to distance on each side, the closest ones first
+    std::vector<Thumbnail*> getNeighbours (const Glib::ustring& fname, int distance);
     void copyProfile ();
     void pasteProfile ();
     void partPasteProfile ();
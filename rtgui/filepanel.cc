@@ -21,6 +21,7 @@
 #include "rtwindow.h"
 #include "../rtengine/safegtk.h"
 #include "inspector.h"
+#include "imageprefetcher.h"
 
 int FilePanelInitUI (void* data) {
     (static_cast<FilePanel*>(data))->init ();
@@ -215,7 +216,7 @@ bool FilePanel::fileSelected (Thumbnail* thm) {
     pendingLoadMutex.unlock();
 
     ProgressConnector<rtengine::InitialImage*> *ld = new ProgressConnector<rtengine::InitialImage*>();
-    ld->startFunc (sigc::bind(sigc::ptr_fun(&rtengine::InitialImage::load), thm->getFileName (), thm->getType()==FT_Raw, &error, parent->getProgressListener()),
+    ld->startFunc (sigc::bind(sigc::ptr_fun(&ImagePrefetcher::load), thm->getFileName (), thm->getType()==FT_Raw, &error, parent->getProgressListener()),
                    sigc::bind(sigc::mem_fun(*this,&FilePanel::imageLoaded), thm, ld) );
     return true;
 }
@@ -270,6 +271,12 @@ bool FilePanel::imageLoaded( Thumbnail* thm, ProgressConnector<rtengine::Initial
     }
     pendingLoadMutex.unlock();
 
+    // prepare the images the user is likely to open next
+    {
+    GThreadLock lock;
+    imagePrefetcher.prefetch (fileCatalog->fileBrowser->getNeighbours (thm->getFileName(), options.editorPrefetch));
+    }
+
     thm->imageLoad( false );
 
     return false; // MUST return false from idle function
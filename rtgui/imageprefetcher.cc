@@ -0,0 +1,208 @@
+/*
+ *  This file is part of RawTherapee.
+ *
+ *  RawTherapee is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  RawTherapee is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with RawTherapee.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "imageprefetcher.h"
+#include "options.h"
+#include "../rtengine/tileplan.h"
+#include <algorithm>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+ImagePrefetcher imagePrefetcher;
+
+ImagePrefetcher::ImagePrefetcher ()
+    : cancelCurrent(false), stopped(true) {
+}
+
+void ImagePrefetcher::prefetch (const std::vector<Thumbnail*>& thumbnails) {
+
+    mutex.lock ();
+
+    std::list<Item> wanted;
+    for (size_t i=0; i<thumbnails.size() && (int)i<2*options.editorPrefetch; i++) {
+        Glib::ustring fname = thumbnails[i]->getFileName ();
+
+        std::list<Item>::iterator it;
+        for (it=items.begin(); it!=items.end(); it++)
+            if (it->fname == fname)
+                break;
+        if (it != items.end()) {
+            wanted.splice (wanted.end(), items, it);
+            continue;
+        }
+
+        Item item;
+        item.fname = fname;
+        item.isRaw = thumbnails[i]->getType() == FT_Raw;
+        item.params = thumbnails[i]->getProcParams ();
+        item.image = NULL;
+        item.done = false;
+        int w = 0, h = 0;
+        thumbnails[i]->getFinalSize (item.params, w, h);
+        if (w <= 0 || h <= 0) {
+            // size unknown, assume a 24 Mpixels image
+            w = 6000;
+            h = 4000;
+        }
+        // raw data, preprocessed data and demosaiced planes in float for the raw files, the decoded image otherwise
+        item.memory = (size_t)w * h * (item.isRaw ? 20 : 12);
+        wanted.push_back (item);
+    }
+
+    // the images not wanted anymore
+    for (std::list<Item>::iterator it=items.begin(); it!=items.end(); it++)
+        if (it->image)
+            it->image->decreaseRef ();
+    items.swap (wanted);
+
+    if (!current.empty()) {
+        bool listed = false;
+        for (std::list<Item>::iterator it=items.begin(); it!=items.end() && !listed; it++)
+            listed = it->fname == current;
+        if (!listed)
+            cancelCurrent = true;
+    }
+
+    if (stopped && !items.empty())
+        startThread ();
+
+    mutex.unlock ();
+}
+
+void ImagePrefetcher::startThread () {
+
+    stopped = false;
+
+#if __GNUC__ == 4 && __GNUC_MINOR__ == 8 && defined( WIN32 ) && defined(__x86_64__)
+    #undef THREAD_PRIORITY_NORMAL
+    // See Issue 2384 comment #3
+    Glib::Thread::create(sigc::mem_fun(*this, &ImagePrefetcher::processThread), (unsigned long int)0, false, true, Glib::THREAD_PRIORITY_NORMAL);
+#else
+    #undef THREAD_PRIORITY_LOW
+    Glib::Thread::create(sigc::mem_fun(*this, &ImagePrefetcher::processThread), (unsigned long int)0, false, true, Glib::THREAD_PRIORITY_LOW);
+#endif
+}
+
+void ImagePrefetcher::processThread () {
+
+#ifdef _OPENMP
+    // the other half of the cores stays available to the editor
+    omp_set_num_threads (std::max(omp_get_num_procs() / 2, 1));
+#endif
+    // the prepared images share the memory with the processing of the edited one
+    const size_t budget = rtengine::tileMemoryBudget () / 2;
+
+    mutex.lock ();
+
+    while (true) {
+        // the first image to prepare, if it fits in the memory left
+        size_t memoryInUse = 0;
+        std::list<Item>::iterator next = items.end();
+        for (std::list<Item>::iterator it=items.begin(); it!=items.end(); it++) {
+            if (it->image)
+                memoryInUse += it->memory;
+            else if (!it->done && next == items.end())
+                next = it;
+        }
+        if (next == items.end() || memoryInUse + next->memory > budget)
+            break;
+
+        const Glib::ustring fname = next->fname;
+        const bool isRaw = next->isRaw;
+        const rtengine::procparams::ProcParams params = next->params;
+        current = fname;
+        cancelCurrent = false;
+        mutex.unlock ();
+
+        int error = 0;
+        rtengine::InitialImage* image = rtengine::InitialImage::prefetch (fname, isRaw, params, &error, &cancelCurrent);
+
+        mutex.lock ();
+        current = "";
+        // the item may have been removed, or removed and added again, in the meantime
+        std::list<Item>::iterator it;
+        for (it=items.begin(); it!=items.end(); it++)
+            if (it->fname == fname && !it->done)
+                break;
+        if (it != items.end() && !cancelCurrent) {
+            it->image = image;
+            it->done = true;
+        }
+        else if (image)
+            image->decreaseRef ();
+        prepared.broadcast ();
+    }
+
+    stopped = true;
+    mutex.unlock ();
+}
+
+rtengine::InitialImage* ImagePrefetcher::take (const Glib::ustring& fname) {
+
+    mutex.lock ();
+
+    // wait for the end of its preparation
+    while (current == fname)
+        prepared.wait (mutex);
+
+    for (std::list<Item>::iterator it=items.begin(); it!=items.end(); it++)
+        if (it->fname == fname && it->done) {
+            rtengine::InitialImage* image = it->image;
+            items.erase (it);
+            mutex.unlock ();
+            return image;
+        }
+
+    // the user jumped elsewhere, the loading of the image needs the cores until the next call of prefetch
+    if (!current.empty())
+        cancelCurrent = true;
+    for (std::list<Item>::iterator it=items.begin(); it!=items.end();)
+        if (!it->done)
+            it = items.erase (it);
+        else
+            it++;
+
+    mutex.unlock ();
+    return NULL;
+}
+
+void ImagePrefetcher::clear () {
+
+    mutex.lock ();
+
+    for (std::list<Item>::iterator it=items.begin(); it!=items.end(); it++)
+        if (it->image)
+            it->image->decreaseRef ();
+    items.clear ();
+
+    // wait for the end of the preparation running
+    cancelCurrent = true;
+    while (!current.empty())
+        prepared.wait (mutex);
+
+    mutex.unlock ();
+}
+
+rtengine::InitialImage* ImagePrefetcher::load (const Glib::ustring& fname, bool isRaw, int* errorCode, rtengine::ProgressListener* pl) {
+
+    rtengine::InitialImage* image = imagePrefetcher.take (fname);
+    if (image) {
+        *errorCode = 0;
+        return image;
+    }
+    return rtengine::InitialImage::load (fname, isRaw, errorCode, pl);
+}
@@ -0,0 +1,80 @@
+/*
+ *  This file is part of RawTherapee.
+ *
+ *  RawTherapee is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  RawTherapee is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with RawTherapee.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef _IMAGEPREFETCHER_
+#define _IMAGEPREFETCHER_
+
+#include <glibmm.h>
+#include <list>
+#include <vector>
+#include "../rtengine/rtengine.h"
+#include "thumbnail.h"
+
+/** @brief Loads, preprocesses and demosaics in the background the images the editor is likely to open next
+  *
+  * While an image is edited, its neighbours in the file browser are prepared one after the other by a low priority
+  * thread using half of the cores, as long as they fit in half of the tile memory budget. Opening one of them then
+  * only costs the processing of the preview. */
+class ImagePrefetcher {
+
+    struct Item {
+        Glib::ustring fname;
+        bool isRaw;
+        rtengine::procparams::ProcParams params;
+        rtengine::InitialImage* image;  // NULL until prepared
+        bool done;                      // true when prepared, or when the preparation failed
+        size_t memory;                  // estimated memory of the prepared image
+    };
+
+  protected:
+    std::list<Item> items;          // images wanted, in the order of their preparation
+    Glib::ustring current;          // image being prepared, empty if none
+    volatile bool cancelCurrent;
+    bool stopped;
+#ifdef WIN32
+    Glib::Mutex mutex;              // protects the members above
+    Glib::Cond  prepared;           // signalled at the end of each preparation
+#else
+    Glib::Threads::Mutex mutex;     // protects the members above
+    Glib::Threads::Cond  prepared;  // signalled at the end of each preparation
+#endif
+
+    void startThread ();
+
+  public:
+    ImagePrefetcher ();
+
+    /** @brief Replaces the images to prepare
+      * @param thumbnails thumbnails of the images, the most likely to be opened first; the prepared images not listed
+      *        are freed, and the one being prepared is cancelled if not listed */
+    void prefetch (const std::vector<Thumbnail*>& thumbnails);
+
+    /** @brief Hands over the image of fname if it has been prepared, waiting for the end of its preparation if needed
+      * @return the image, or NULL if it hasn't been prefetched; in the latter case the preparation running, if any, is cancelled */
+    rtengine::InitialImage* take (const Glib::ustring& fname);
+
+    /** @brief Frees the prepared images and cancels the preparation running */
+    void clear ();
+
+    void processThread ();
+
+    /** @brief Same as rtengine::InitialImage::load, the prefetched image being returned if any */
+    static rtengine::InitialImage* load (const Glib::ustring& fname, bool isRaw, int* errorCode, rtengine::ProgressListener* pl);
+};
+
+extern ImagePrefetcher imagePrefetcher;
+
+#endif
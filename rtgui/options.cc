@@ -371,6 +371,9 @@ void Options::setDefaults () {
 #endif
     filledProfile = false;
     maxInspectorBuffers = 2; //  a rather conservative value for low specced systems...
+    previewCacheSize = 4;
+    batchQueueJobs = 0;
+    editorPrefetch = 1;
 
     showProfileSelector = true;
     FileBrowserToolbarSingleRow = false;
@@ -558,6 +561,12 @@ void Options::setDefaults () {
 	rtSettings.leveldnaut=0;
 	rtSettings.leveldnliss=0;
 	rtSettings.leveldnautsimpl=0;
+	rtSettings.tileMemoryBudget=0;
+	rtSettings.curveCacheSize=32;
+	rtSettings.reuseCAFit=false;
+	rtSettings.hugePages=false;
+	rtSettings.rawAnalysisSubsampling=4;
+	rtSettings.schedulerThreads=0;
 
     rtSettings.monitorProfile = "";
     rtSettings.autoMonitorProfile = false;
@@ -773,8 +782,17 @@ if (keyFile.has_group ("Performance")) {
     if (keyFile.has_key ("Performance", "LevNRAUT"))              rtSettings.leveldnaut      = keyFile.get_integer ("Performance", "LevNRAUT");
     if (keyFile.has_key ("Performance", "LevNRLISS"))             rtSettings.leveldnliss     = keyFile.get_integer ("Performance", "LevNRLISS");
     if (keyFile.has_key ("Performance", "SIMPLNRAUT"))            rtSettings.leveldnautsimpl = keyFile.get_integer ("Performance", "SIMPLNRAUT");
+    if (keyFile.has_key ("Performance", "TileMemoryBudget"))      rtSettings.tileMemoryBudget = keyFile.get_integer ("Performance", "TileMemoryBudget");
+    if (keyFile.has_key ("Performance", "CurveCacheSize"))        rtSettings.curveCacheSize  = keyFile.get_integer ("Performance", "CurveCacheSize");
+    if (keyFile.has_key ("Performance", "ReuseCAFit"))            rtSettings.reuseCAFit      = keyFile.get_boolean ("Performance", "ReuseCAFit");
+    if (keyFile.has_key ("Performance", "HugePages"))             rtSettings.hugePages       = keyFile.get_boolean ("Performance", "HugePages");
+    if (keyFile.has_key ("Performance", "RawAnalysisSubsampling")) rtSettings.rawAnalysisSubsampling = keyFile.get_integer ("Performance", "RawAnalysisSubsampling");
+    if (keyFile.has_key ("Performance", "SchedulerThreads"))      rtSettings.schedulerThreads = keyFile.get_integer ("Performance", "SchedulerThreads");
     if (keyFile.has_key ("Performance", "ClutCacheSize"))         clutCacheSize              = keyFile.get_integer ("Performance", "ClutCacheSize");
     if (keyFile.has_key ("Performance", "MaxInspectorBuffers"))   maxInspectorBuffers        = keyFile.get_integer ("Performance", "MaxInspectorBuffers");
+    if (keyFile.has_key ("Performance", "PreviewCacheSize"))      previewCacheSize           = keyFile.get_integer ("Performance", "PreviewCacheSize");
+    if (keyFile.has_key ("Performance", "BatchQueueJobs"))        batchQueueJobs             = keyFile.get_integer ("Performance", "BatchQueueJobs");
+    if (keyFile.has_key ("Performance", "EditorPrefetch"))        editorPrefetch             = keyFile.get_integer ("Performance", "EditorPrefetch");
     if (keyFile.has_key ("Performance", "PreviewDemosaicFromSidecar"))  prevdemo             = (prevdemo_t)keyFile.get_integer ("Performance", "PreviewDemosaicFromSidecar");
     if (keyFile.has_key ("Performance", "Daubechies"))            rtSettings.daubech         = keyFile.get_boolean ("Performance", "Daubechies");
 }
@@ -1060,8 +1078,17 @@ int Options::saveToFile (Glib::ustring fname) {
     keyFile.set_integer ("Performance", "LevNRAUT", rtSettings.leveldnaut);
     keyFile.set_integer ("Performance", "LevNRLISS", rtSettings.leveldnliss);
     keyFile.set_integer ("Performance", "SIMPLNRAUT", rtSettings.leveldnautsimpl);
+    keyFile.set_integer ("Performance", "TileMemoryBudget", rtSettings.tileMemoryBudget);
+    keyFile.set_integer ("Performance", "CurveCacheSize", rtSettings.curveCacheSize);
+    keyFile.set_boolean ("Performance", "ReuseCAFit", rtSettings.reuseCAFit);
+    keyFile.set_boolean ("Performance", "HugePages", rtSettings.hugePages);
+    keyFile.set_integer ("Performance", "RawAnalysisSubsampling", rtSettings.rawAnalysisSubsampling);
+    keyFile.set_integer ("Performance", "SchedulerThreads", rtSettings.schedulerThreads);
     keyFile.set_integer ("Performance", "ClutCacheSize", clutCacheSize);
     keyFile.set_integer ("Performance", "MaxInspectorBuffers", maxInspectorBuffers);
+    keyFile.set_integer ("Performance", "PreviewCacheSize", previewCacheSize);
+    keyFile.set_integer ("Performance", "BatchQueueJobs", batchQueueJobs);
+    keyFile.set_integer ("Performance", "EditorPrefetch", editorPrefetch);
     keyFile.set_integer ("Performance", "PreviewDemosaicFromSidecar", prevdemo);
     keyFile.set_boolean ("Performance", "Daubechies", rtSettings.daubech);
 
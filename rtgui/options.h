@@ -222,6 +222,9 @@ class Options {
     int rgbDenoiseThreadLimit; // maximum number of threads for the denoising tool ; 0 = use the maximum available
     int maxInspectorBuffers;   // maximum number of buffers (i.e. images) for the Inspector feature
     int clutCacheSize;
+    int previewCacheSize;      // number of intermediate results kept per stage of the preview pipeline
+    int batchQueueJobs;        // maximum number of images processed at the same time by the batch queue ; 0 = automatic
+    int editorPrefetch;        // number of images prepared in advance on each side of the edited one ; 0 = disabled
     bool filledProfile;  // Used as reminder for the ProfilePanel "mode"
     prevdemo_t prevdemo; // Demosaicing method used for the <100% preview
 
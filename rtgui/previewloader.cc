@@ -22,6 +22,7 @@
 #include "guiutils.h"
 #include "threadutils.h"
 #include "../rtengine/safegtk.h"
+#include "../rtengine/taskscheduler.h"
 
 #ifdef _OPENMP
 #include <omp.h>
@@ -80,10 +81,11 @@ public:
 		threadCount=omp_get_num_procs();
 		#endif 
 		
-		threadPool_=new Glib::ThreadPool(threadCount,0);
+		// ahead of the thumbnail updates, the file browser needs the entries to show anything
+		tasks_=new rtengine::TaskGroup(rtengine::TASK_NORMAL,threadCount);
 	}
 
-	Glib::ThreadPool* threadPool_;
+	rtengine::TaskGroup* tasks_;
 	MyMutex mutex_;
 	JobSet jobs_;
 	gint nConcurrentThreads;
@@ -197,7 +199,7 @@ void PreviewLoader::add(int dir_id, const Glib::ustring& dir_entry, PreviewLoade
 
 		// queue a run request
 		DEBUG("adding run request %s",dir_entry.c_str());
-		impl_->threadPool_->push(sigc::mem_fun(*impl_, &PreviewLoader::Impl::processNextJob));
+		impl_->tasks_->run(sigc::mem_fun(*impl_, &PreviewLoader::Impl::processNextJob));
 	}
 }
 
@@ -23,6 +23,7 @@
 #include "cursormanager.h"
 #include "rtimage.h"
 #include "whitebalance.h"
+#include "imageprefetcher.h"
 
 #if defined(__APPLE__)
 static gboolean
@@ -614,6 +615,7 @@ bool RTWindow::on_delete_event(GdkEventAny* event) {
     	}
     }
 
+    imagePrefetcher.clear ();
     cacheMgr->closeCache ();  // also makes cleanup if too large
     WhiteBalance::cleanup();
     ProfilePanel::cleanup();
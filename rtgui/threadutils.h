@@ -178,6 +178,39 @@ private:
 };
 
 
+/**
+ * @brief Condition to wait for along with a MyMutex
+ *
+ * The conditions of Glib need a non recursive mutex, so the waiting threads sleep on an inner one. wait releases the
+ * MyMutex once the inner mutex is locked, and broadcast locks the inner mutex too, so that no wakeup is lost in between.
+ */
+class MyCond {
+#ifdef WIN32
+	Glib::Mutex inner;
+	Glib::Cond  cond;
+#else
+	Glib::Threads::Mutex inner;
+	Glib::Threads::Cond  cond;
+#endif
+
+public:
+	// The MyMutex of lock has to be locked once by the calling thread, it is locked again when wait returns
+	void wait(MyMutex::MyLock& lock) {
+		inner.lock();
+		lock.release();
+		cond.wait(inner);
+		inner.unlock();
+		lock.acquire();
+	}
+
+	void broadcast() {
+		inner.lock();
+		cond.broadcast();
+		inner.unlock();
+	}
+};
+
+
 /**
  * @brief Custom RWLock with debugging feature, to replace the buggy Glib::RWLock (can have negative reader_count value!)
  *
@@ -22,6 +22,7 @@
 #include <gtkmm.h>
 #include "guiutils.h"
 #include "threadutils.h"
+#include "../rtengine/taskscheduler.h"
 
 #ifdef _OPENMP
 #include <omp.h>
@@ -76,10 +77,10 @@ public:
 		#endif
 #endif
 		
-		threadPool_=new Glib::ThreadPool(threadCount,0);
+		tasks_=new rtengine::TaskGroup(rtengine::TASK_BACKGROUND,threadCount);
 	}
 
-	Glib::ThreadPool* threadPool_;
+	rtengine::TaskGroup* tasks_;
 
 	// Need to be a Glib::Threads::Mutex because used in a Glib::Threads::Cond object...
 	// This is the only exceptions in RT so far, MyMutex is used everywhere else
@@ -257,7 +258,7 @@ ThumbImageUpdater::add(ThumbBrowserEntryBase* tbe, bool* priority, bool upgrade,
 	impl_->jobs_.push_back(Impl::Job(tbe,priority,upgrade,l));
 
 	DEBUG("adding run request %s",tbe->shortname.c_str());
-	impl_->threadPool_->push(sigc::mem_fun(*impl_, &ThumbImageUpdater::Impl::processNextJob));
+	impl_->tasks_->run(sigc::mem_fun(*impl_, &ThumbImageUpdater::Impl::processNextJob));
 }
 
 